@@ -15,9 +15,20 @@
 #include <string.h>
 #include <fcntl.h>
 #include <signal.h>
+#include <errno.h>
+#include <dirent.h>
+#include <poll.h>
+#include <time.h>
 #include <sys/ioctl.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <sys/signalfd.h>
+
+#include "Daemon.h"
+#include "handoff.h"
+#include "event.h"
 
 //-#include <linux/autoconf.h>
 //-#include "ralink_gpio.h"
@@ -25,10 +36,34 @@
 //-下面定义了一个设备节点,在使用之前需要创建这样一个节点使用"mknod /dev/gpio c 252 0"的语句
 #define GPIO_DEV	"/dev/gpio"
 
-#define MAXFILE 65535
+#define DAEMON_PIDFILE		"/var/run/dreamflower_app.pid"
+#define DAEMON_READY_TMO	30000	//-父进程最多等子进程这么久(ms),超时返回失败,子进程继续运行
+#define DAEMON_LOCK_TMO		3000	//-热重启时等老进程放开pidfile锁(ms)
+#define DAEMON_CONF		"/etc/dreamflower_app.conf"
+#define DAEMON_DRAIN_TMO	2000	//-SIGTERM以后最多用这么久把已经收到的数据处理完(ms)
+
+#if !defined(SYS_close_range) && defined(__NR_close_range)
+#define SYS_close_range __NR_close_range
+#endif
+
 void sigterm_handler(int arg);
 volatile sig_atomic_t _running = 1;
 
+int daemon_notify_fd = -1;		//--N 准备好以后往这个fd写"READY=1\n"
+const char *daemon_pidfile = NULL;	//--p pidfile路径,守护进程默认DAEMON_PIDFILE
+int daemon_pidfile_late = 0;		//-热重启(-H):老进程还拿着锁,交接完以后再调daemon_lock_pidfile
+const char *daemon_conf = DAEMON_CONF;	//--c SIGHUP重新读的配置文件
+int daemon_drain_ms = DAEMON_DRAIN_TMO;
+
+static long long daemon_start_ns;
+static int daemon_ready_fd = -1;	//-和父进程之间的管道,写一个字节父进程就退出
+static int daemon_pid_fd = -1;
+static int daemon_is_ready = 0;
+static long long daemon_stop_ns;	//-开始退出的时间,drain的期限从这里算
+
+static int daemon_sig_fd = -1;
+static struct ev_io daemon_sig_io;
+static daemon_sig_fn daemon_sig_hooks[32];
 
 
 
@@ -37,6 +72,290 @@ void sigterm_handler(int arg)		//-kill发出的signal信号处理，达到进程
 		_running = 0;
 }
 
+static long long daemon_now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+//-main一开始调用,启动时间和第一帧的时间都从这里算
+void daemon_mark_start(void)
+{
+	daemon_start_ns = daemon_now_ns();
+}
+
+double daemon_since_start_ms(void)
+{
+	return (daemon_now_ns() - daemon_start_ns) / 1e6;
+}
+
+/*
+信号不再用处理函数:在创建任何线程之前把它们屏蔽掉(线程会继承),用signalfd变成事件循环里的一个fd,
+回调在主线程里执行,可以随便写日志,加锁,不用只设置一个标志.
+SIGTERM/SIGINT	停止主循环,把已经收到的数据在daemon_drain_ms之内处理完再退出
+SIGHUP		重新读配置文件
+SIGUSR1/SIGUSR2	交给daemon_on_signal登记的函数(统计/时间线)
+*/
+static void daemon_sigset(sigset_t *set)
+{
+	sigemptyset(set);
+	sigaddset(set, SIGTERM);
+	sigaddset(set, SIGINT);
+	sigaddset(set, SIGHUP);
+	sigaddset(set, SIGUSR1);
+	sigaddset(set, SIGUSR2);
+}
+
+//-fork之后,创建线程之前调用
+void daemon_signals(void)
+{
+	struct sigaction sa;
+	sigset_t set;
+
+	daemon_sigset(&set);
+	if (sigprocmask(SIG_BLOCK, &set, NULL) == 0) {
+		daemon_sig_fd = signalfd(-1, &set, SFD_NONBLOCK | SFD_CLOEXEC);
+		if (daemon_sig_fd >= 0)
+			return;
+		sigprocmask(SIG_UNBLOCK, &set, NULL);
+	}
+	//-没有signalfd:和以前一样只处理SIGTERM.不加SA_RESTART,epoll_wait会被打断返回,主循环马上能看到_running
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = sigterm_handler;
+	sigemptyset(&sa.sa_mask);
+	sigaction(SIGTERM, &sa, NULL);
+}
+
+void daemon_on_signal(int sig, daemon_sig_fn fn)
+{
+	if (sig > 0 && sig < (int)(sizeof(daemon_sig_hooks) / sizeof(daemon_sig_hooks[0])))
+		daemon_sig_hooks[sig] = fn;
+}
+
+//-开始退出:记下时间;万一哪一步卡住了,过了期限再多给2秒就由SIGALRM直接结束进程
+void daemon_drain_begin(void)
+{
+	if (daemon_stop_ns)
+		return;
+	daemon_stop_ns = daemon_now_ns();
+	alarm((daemon_drain_ms + 999) / 1000 + 2);
+}
+
+//-离drain期限还有多少ms,没有开始退出时从现在开始算
+int daemon_drain_left(void)
+{
+	long long left;
+
+	daemon_drain_begin();
+	left = daemon_drain_ms - (daemon_now_ns() - daemon_stop_ns) / 1000000;
+	return left > 0 ? (int)left : 0;
+}
+
+/*
+配置文件,每行一项"名字 值"或者"名字=值",#开始的是注释.不认识的名字记一条警告.
+log_level	同-v
+log_mask	同-m
+drain_ms	SIGTERM以后处理剩余数据的期限
+*/
+int daemon_reload(void)
+{
+	char line[256], key[64], *k, *v, *e;
+	FILE *fp;
+	int n = 0;
+
+	fp = fopen(daemon_conf, "r");
+	if (fp == NULL) {
+		LOG(LOGM_MAIN, LOG_WARN, "reload %s: %s", daemon_conf, strerror(errno));
+		return -1;
+	}
+	while (fgets(line, sizeof(line), fp)) {
+		if ((v = strchr(line, '#')) != NULL)
+			*v = 0;
+		k = line + strspn(line, " \t");
+		v = k + strcspn(k, " \t=\n");
+		if (v == k)
+			continue;
+		snprintf(key, sizeof(key), "%.*s", (int)(v - k), k);
+		v += strspn(v, " \t=");
+		if (*v == 0 || *v == '\n')
+			continue;
+		if (strcmp(key, "log_level") == 0)
+			log_level = strtol(v, &e, 0);
+		else if (strcmp(key, "log_mask") == 0)
+			log_mask = strtoul(v, &e, 0);
+		else if (strcmp(key, "drain_ms") == 0)
+			daemon_drain_ms = strtol(v, &e, 0);
+		else {
+			LOG(LOGM_MAIN, LOG_WARN, "%s: unknown key %s", daemon_conf, key);
+			continue;
+		}
+		n++;
+	}
+	fclose(fp);
+	LOG(LOGM_MAIN, LOG_INFO, "reloaded %s: %d settings, log_level %d log_mask 0x%x drain_ms %d",
+	    daemon_conf, n, log_level, log_mask, daemon_drain_ms);
+	return 0;
+}
+
+static void daemon_sig_cb(struct ev_io *io, unsigned int revents)
+{
+	struct signalfd_siginfo si;
+	int sig;
+
+	while (read(io->fd, &si, sizeof(si)) == sizeof(si)) {
+		sig = si.ssi_signo;
+		LOG(LOGM_MAIN, LOG_INFO, "signal %d from pid %u", sig, si.ssi_pid);
+		switch (sig) {
+		case SIGTERM:
+		case SIGINT:
+			_running = 0;
+			daemon_drain_begin();
+			break;
+		case SIGHUP:
+			daemon_reload();
+			break;
+		}
+		if (sig < (int)(sizeof(daemon_sig_hooks) / sizeof(daemon_sig_hooks[0])) && daemon_sig_hooks[sig])
+			daemon_sig_hooks[sig](sig);
+	}
+}
+
+//-ev_init之后调用,信号从这里进入事件循环
+int daemon_signal_watch(void)
+{
+	if (daemon_sig_fd < 0)
+		return -1;
+	ev_io_init(&daemon_sig_io, daemon_sig_fd, EV_READ, daemon_sig_cb, NULL);
+	return ev_add(&daemon_sig_io);
+}
+
+static int cmp_int(const void *a, const void *b)
+{
+	return *(const int *)a - *(const int *)b;
+}
+
+/*
+关掉3以上除了keep之外的所有文件描述符.
+以前是close(0)到close(65534),每次启动六万多次系统调用.
+先用close_range(内核5.9以上)按区间关;不支持就读/proc/self/fd只关打开着的;
+/proc也没有挂载时才按RLIMIT_NOFILE逐个关.
+*/
+static void daemon_close_fds(int *keep, int nkeep)
+{
+	struct rlimit rl;
+	struct dirent *de;
+	DIR *dir;
+	int *fds = NULL, nfds = 0, cap = 0, i, j, fd, lo;
+	long max;
+
+	qsort(keep, nkeep, sizeof(int), cmp_int);
+#if defined(SYS_close_range)
+	lo = 3;
+	for (i = 0; i <= nkeep; i++) {
+		unsigned int hi = i < nkeep ? (unsigned int)keep[i] - 1 : ~0U;
+
+		if (i < nkeep && keep[i] < lo)
+			continue;
+		if (hi >= (unsigned int)lo && syscall(SYS_close_range, lo, hi, 0) != 0)
+			break;		//-ENOSYS:老内核
+		if (i < nkeep)
+			lo = keep[i] + 1;
+	}
+	if (i > nkeep)
+		return;
+#endif
+	dir = opendir("/proc/self/fd");
+	if (dir != NULL) {
+		//-先记下来再关,边读目录边关会把目录自己的fd也关掉
+		while ((de = readdir(dir)) != NULL) {
+			fd = atoi(de->d_name);
+			if (fd < 3 || fd == dirfd(dir))
+				continue;
+			if (nfds == cap) {
+				cap = cap ? cap * 2 : 64;
+				fds = realloc(fds, cap * sizeof(int));
+				if (fds == NULL)
+					break;
+			}
+			fds[nfds++] = fd;
+		}
+		closedir(dir);
+	}
+	if (dir == NULL || fds == NULL) {
+		max = getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur != RLIM_INFINITY ? (long)rl.rlim_cur : 1024;
+		for (fd = 3; fd < max; fd++) {
+			for (j = 0; j < nkeep && keep[j] != fd; j++)
+				;
+			if (j == nkeep)
+				close(fd);
+		}
+		return;
+	}
+	for (i = 0; i < nfds; i++) {
+		for (j = 0; j < nkeep && keep[j] != fds[i]; j++)
+			;
+		if (j == nkeep)
+			close(fds[i]);
+	}
+	free(fds);
+}
+
+//-父进程:等子进程准备好再退出,退出码告诉启动脚本是否成功
+static void daemon_wait_child(int fd, pid_t child)
+{
+	struct pollfd pfd = { fd, POLLIN, 0 };
+	char c = 0;
+	int ret;
+
+	do {
+		ret = poll(&pfd, 1, DAEMON_READY_TMO);
+	} while (ret < 0 && errno == EINTR);
+	if (ret > 0 && read(fd, &c, 1) == 1 && c == 'R') {
+		fprintf(stderr, "dreamflower_app: pid %d ready in %.1f ms\n", (int)child, daemon_since_start_ms());
+		exit(0);
+	}
+	if (ret == 0)
+		fprintf(stderr, "dreamflower_app: pid %d not ready after %d ms\n", (int)child, DAEMON_READY_TMO);
+	else
+		fprintf(stderr, "dreamflower_app: pid %d exited during startup\n", (int)child);
+	exit(1);
+}
+
+//-pidfile加写锁,已经有一个在运行就失败;锁跟着进程,异常退出后下次还能启动
+//-wait_ms:锁被占着时最多等多久,热重启时等老进程退出
+static int daemon_write_pidfile(const char *path, int wait_ms)
+{
+	struct flock fl;
+	char buf[16];
+	int fd, len;
+
+	fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+	if (fd < 0) {
+		LOG(LOGM_MAIN, LOG_ERR, "pidfile %s: %s", path, strerror(errno));
+		return -1;
+	}
+	memset(&fl, 0, sizeof(fl));
+	fl.l_type = F_WRLCK;
+	fl.l_whence = SEEK_SET;
+	while (fcntl(fd, F_SETLK, &fl) != 0) {
+		if (wait_ms <= 0 || (errno != EAGAIN && errno != EACCES)) {
+			LOG(LOGM_MAIN, LOG_ERR, "pidfile %s is locked, already running?", path);
+			close(fd);
+			return -1;
+		}
+		usleep(10000);
+		wait_ms -= 10;
+	}
+	len = snprintf(buf, sizeof(buf), "%d\n", (int)getpid());
+	if (ftruncate(fd, 0) != 0 || write(fd, buf, len) != len) {
+		close(fd);
+		return -1;
+	}
+	daemon_pid_fd = fd;
+	return 0;
+}
 
 /*
 现在需要实现运行灯的闪耀,就不用负责的方法了,就是定时改变电平,以最简单的方法来实现功能就行.
@@ -48,8 +367,11 @@ void sigterm_handler(int arg)		//-kill发出的signal信号处理，达到进程
 int daemon_init(void)	//?参数如何传递过来的,在终端输入命令的时候就带入了参数
 {
 	pid_t pc,pid;
-	int i;
+	int fds[2], keep[2], nkeep = 0, nullfd;
 		
+	//-子进程准备好以后通过这个管道告诉父进程
+	if (pipe(fds) != 0)
+		fds[0] = fds[1] = -1;
 		
 	//-开始实现守护进程
 	pc = fork(); //第一步
@@ -58,21 +380,99 @@ int daemon_init(void)	//?参数如何传递过来的,在终端输入命令的时
 	exit(1);
 	}
 	else if(pc>0)
-		exit(0);	//-这里父进程的退出,就是实现首护进程的第一步
+	{
+		if (fds[0] < 0)
+			exit(0);	//-没有管道就和以前一样直接退出
+		close(fds[1]);
+		daemon_wait_child(fds[0], pc);	//-这里父进程的退出,就是实现首护进程的第一步
+	}
+	if (fds[0] >= 0)
+		close(fds[0]);
+	daemon_ready_fd = fds[1];
 		
 	pid = setsid(); //第二步,,setsid函数用于创建一个新的会话，并担任该会话组的组长。其实就是使进程完全独立出来，从而摆脱其他进程的控制。
 	if (pid < 0)
 		perror("setsid error");	
 		
-	chdir("/"); //第三步,,改变当前目录为根目录
+	if (chdir("/") != 0) //第三步,,改变当前目录为根目录
+		perror("chdir");
 	
 	umask(0); //第四步,,重设文件权限掩码
 	
-	for(i=0;i<MAXFILE;i++) //第五步,,关闭文件描述符
-		close(i);	
-		
-	signal(SIGTERM, sigterm_handler);		//-守护进程退出处理,建立一个信号量,kill时可以对应处理
+	//第五步,,关闭文件描述符.0/1/2指向/dev/null,不然后面打开的串口会变成标准输出,printf就写到串口上了
+	if (daemon_ready_fd >= 0)
+		keep[nkeep++] = daemon_ready_fd;
+	if (daemon_notify_fd >= 0)
+		keep[nkeep++] = daemon_notify_fd;
+	daemon_close_fds(keep, nkeep);
+	nullfd = open("/dev/null", O_RDWR);
+	if (nullfd >= 0) {
+		dup2(nullfd, 0);
+		dup2(nullfd, 1);
+		dup2(nullfd, 2);
+		if (nullfd > 2)
+			close(nullfd);
+	}
 		
+	daemon_signals();		//-守护进程退出处理,建立一个信号量,kill时可以对应处理
+	if (daemon_pidfile == NULL)
+		daemon_pidfile = DAEMON_PIDFILE;
+	if (!daemon_pidfile_late && daemon_write_pidfile(daemon_pidfile, 0) != 0)
+		exit(1);	//-父进程读到EOF,启动失败
 	
 	return 0;
-}
\ No newline at end of file
+}
+
+//-调试模式(-D)不fork,只设置信号,有-p时写pidfile
+int daemon_foreground(void)
+{
+	daemon_signals();
+	if (daemon_pidfile && !daemon_pidfile_late && daemon_write_pidfile(daemon_pidfile, 0) != 0)
+		return -1;
+	return 0;
+}
+
+//-热重启:状态交接完以后老进程才退出并放开锁
+int daemon_lock_pidfile(void)
+{
+	if (!daemon_pidfile || daemon_pid_fd >= 0)
+		return 0;
+	return daemon_write_pidfile(daemon_pidfile, DAEMON_LOCK_TMO);
+}
+
+/*
+主循环开始之前调用:串口已经打开并加入事件循环,可以收帧了.
+通知等待的父进程和-N指定的fd(s6/procd那种notification-fd),记录启动用了多久.
+*/
+void daemon_ready(void)
+{
+	static const char msg[] = "READY=1\n";
+
+	if (daemon_is_ready)
+		return;
+	daemon_is_ready = 1;
+	if (daemon_notify_fd >= 0) {
+		if (write(daemon_notify_fd, msg, sizeof(msg) - 1) < 0)
+			LOG(LOGM_MAIN, LOG_WARN, "notify fd %d: %s", daemon_notify_fd, strerror(errno));
+		close(daemon_notify_fd);
+		daemon_notify_fd = -1;
+	}
+	if (daemon_ready_fd >= 0) {
+		if (write(daemon_ready_fd, "R", 1) < 0)
+			LOG(LOGM_MAIN, LOG_WARN, "ready pipe: %s", strerror(errno));
+		close(daemon_ready_fd);
+		daemon_ready_fd = -1;
+	}
+	LOG(LOGM_MAIN, LOG_INFO, "ready, startup took %.3f ms", daemon_since_start_ms());
+}
+
+//-正常退出时调用,删除pidfile;热重启交接出去的不删,新进程已经写了自己的pid
+void daemon_exit(void)
+{
+	if (daemon_pid_fd >= 0) {
+		if (!handoff_done)
+			unlink(daemon_pidfile);
+		close(daemon_pid_fd);
+		daemon_pid_fd = -1;
+	}
+}
@@ -3,6 +3,26 @@
 #ifndef DAEMON_H
 #define DAEMON_H
 
+extern int daemon_notify_fd;
+extern const char *daemon_pidfile;
+extern int daemon_pidfile_late;
+extern const char *daemon_conf;
+extern int daemon_drain_ms;
+
+typedef void (*daemon_sig_fn)(int sig);
+
 int daemon_init(void);
+int daemon_foreground(void);
+int daemon_lock_pidfile(void);
+void daemon_mark_start(void);
+double daemon_since_start_ms(void);
+void daemon_signals(void);
+int  daemon_signal_watch(void);
+void daemon_on_signal(int sig, daemon_sig_fn fn);
+int  daemon_reload(void);
+void daemon_drain_begin(void);
+int  daemon_drain_left(void);
+void daemon_ready(void);
+void daemon_exit(void);
 
 #endif /* DAEMON_H */
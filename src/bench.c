@@ -0,0 +1,168 @@
+/*
+此文件是微基准测试的框架,从calendar_sub的计时例程发展来的.
+原来用clock/time/gettimeofday/times量一次空循环,只有一个数而且会被系统调度干扰.
+现在每个测试:
+1.先自动选每轮的次数,让一轮至少跑BENCH_TARGET_NS,计时本身的开销可以忽略
+2.预热几轮不计时(cache,分支预测,缺页)
+3.重复跑runs轮,每轮算出单次操作的时间,报告最小值/中位数/p99
+计时用CLOCK_MONOTONIC_RAW(不受NTP调整影响),x86上编译时加-DBENCH_USE_TSC可以用TSC.
+*/
+
+#include "debugfl.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "bench.h"
+
+#define BENCH_MAX		32
+#define BENCH_TARGET_NS		5000000LL	//-一轮至少5ms
+#define BENCH_WARMUP		3
+#define BENCH_MAX_RUNS		1000
+
+#if !defined(CLOCK_MONOTONIC_RAW)
+#define CLOCK_MONOTONIC_RAW CLOCK_MONOTONIC
+#endif
+
+struct bench_entry {
+	const char *name;
+	bench_fn_t fn;
+	void *arg;
+};
+
+static struct bench_entry bench_tab[BENCH_MAX];
+static int bench_cnt = 0;
+
+#if defined(BENCH_USE_TSC) && (defined(__x86_64__) || defined(__i386__))
+static double ns_per_tick = 0;
+
+static inline unsigned long long bench_ticks(void)
+{
+	unsigned int lo, hi;
+
+	//-lfence:前面的指令执行完才读TSC
+	__asm__ __volatile__("lfence; rdtsc" : "=a"(lo), "=d"(hi) : : "memory");
+	return ((unsigned long long)hi << 32) | lo;
+}
+
+static long long mono_raw_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+	return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+//-用CLOCK_MONOTONIC_RAW标定TSC的频率
+static void bench_calibrate(void)
+{
+	struct timespec req = { 0, 50000000 };
+	unsigned long long t0, t1;
+	long long n0, n1;
+
+	n0 = mono_raw_ns();
+	t0 = bench_ticks();
+	nanosleep(&req, NULL);
+	n1 = mono_raw_ns();
+	t1 = bench_ticks();
+	ns_per_tick = (double)(n1 - n0) / (double)(t1 - t0);
+	printf("bench: TSC %.1f MHz\n", 1000.0 / ns_per_tick);
+}
+
+static inline long long bench_ns(unsigned long long ticks)
+{
+	return (long long)(ticks * ns_per_tick);
+}
+#else
+static inline unsigned long long bench_ticks(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+	return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void bench_calibrate(void)
+{
+}
+
+static inline long long bench_ns(unsigned long long ticks)
+{
+	return (long long)ticks;
+}
+#endif
+
+int bench_add(const char *name, bench_fn_t fn, void *arg)
+{
+	if (bench_cnt >= BENCH_MAX)
+		return -1;
+	bench_tab[bench_cnt].name = name;
+	bench_tab[bench_cnt].fn = fn;
+	bench_tab[bench_cnt].arg = arg;
+	bench_cnt++;
+	return 0;
+}
+
+static long long bench_once(struct bench_entry *b, long iters)
+{
+	unsigned long long t0, t1;
+
+	t0 = bench_ticks();
+	b->fn(iters, b->arg);
+	t1 = bench_ticks();
+	return bench_ns(t1 - t0);
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+	double x = *(const double *)a, y = *(const double *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static void bench_one(struct bench_entry *b, long iters, int runs)
+{
+	double *ns;
+	int i, p99;
+
+	if (iters <= 0) {	//-每轮次数翻倍直到一轮够长
+		for (iters = 1; iters < (1L << 30); iters *= 2) {
+			if (bench_once(b, iters) >= BENCH_TARGET_NS)
+				break;
+		}
+	}
+	for (i = 0; i < BENCH_WARMUP; i++)
+		bench_once(b, iters);
+
+	ns = malloc(runs * sizeof(double));
+	if (ns == NULL)
+		return;
+	for (i = 0; i < runs; i++)
+		ns[i] = (double)bench_once(b, iters) / iters;
+	qsort(ns, runs, sizeof(double), cmp_double);
+	p99 = (runs * 99 + 99) / 100 - 1;	//-最近秩法:第ceil(0.99n)个
+	printf("%-20s %10ld %12.2f %12.2f %12.2f\n", b->name, iters, ns[0], ns[runs / 2], ns[p99]);
+	free(ns);
+}
+
+int bench_run_all(const char *filter, long iters, int runs)
+{
+	int i, n = 0;
+
+	if (runs <= 0)
+		runs = 1;
+	if (runs > BENCH_MAX_RUNS)
+		runs = BENCH_MAX_RUNS;
+	bench_calibrate();
+	printf("%-20s %10s %12s %12s %12s   (ns/op, %d runs)\n", "benchmark", "iters/run", "min", "median", "p99", runs);
+	for (i = 0; i < bench_cnt; i++) {
+		if (filter && strstr(bench_tab[i].name, filter) == NULL)
+			continue;
+		fflush(stdout);
+		bench_one(&bench_tab[i], iters, runs);
+		n++;
+	}
+	return n;
+}
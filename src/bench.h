@@ -0,0 +1,17 @@
+//-为了方便调试定义了系列变量以便调试输出
+
+#ifndef BENCH_H
+#define BENCH_H
+
+//-被测函数:执行iters次被测操作
+typedef void (*bench_fn_t)(long iters, void *arg);
+
+int  bench_add(const char *name, bench_fn_t fn, void *arg);
+//-filter为NULL跑全部,否则只跑名字里含有filter的;iters<=0自动选择每轮次数
+int  bench_run_all(const char *filter, long iters, int runs);
+
+//-防止编译器把被测代码优化掉:bench_keep让x的值"被用到",bench_clobber让内存"被改过"
+#define bench_keep(x)	__asm__ __volatile__("" : : "g"(x) : "memory")
+#define bench_clobber()	__asm__ __volatile__("" : : : "memory")
+
+#endif /* BENCH_H */
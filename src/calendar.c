@@ -30,70 +30,89 @@ timeval 相当于更精确的time_t，格式为秒数.微秒数。
 #include <unistd.h>
 #include <fcntl.h>
 
-int calendar_sub(int argc,char* argv[])
-{
-  long    i = 1000000000L;
-  clock_t start_c, finish_c;
-  time_t start_t,finish_t;
-  struct timeval start_stv,finish_stv; //对time_t类型的封装
-  struct tms start_stms,finish_stms;//对clock_t类型的封装
-  struct tm *start_stm,*finish_stm; //对time_t进行变体，类型为int
-  double  duration;
-  long luration;
-  
-   /* 测量一个事件持续的时间*/
-  printf( "Time to do %ld empty loops is \n", i );
-
-  start_c = times(&start_stms); //从后面可以看出times和clock取得的clock_t的数量级不一样，一个为毫秒＊10，一个为微妙
-  start_c = clock();//进程时间测量，进程开始时调用时返回为0
-
-  start_t = time(NULL); //只能精确到秒,,timer = time(NULL);//这一句也可以改成time(&timer);
-  gettimeofday(&start_stv,NULL);	//-它获得的时间精确到微秒（1e-6 s)量级。在一段代码前后分别使用gettimeofday可以计算代码执行时间
+#include "bench.h"
+#include "uart1.h"
+#include "tcpdump.h"
+#include "gpio.h"
+#include "modbus.h"
+#include "capseg.h"
+#include "neigh.h"
+#include "dns.h"
 
+/*
+2026/10/18
+原来在这里用4种方法量10亿次空循环,现在计时交给bench.c的框架:
+空循环也作为一个基准测试(每次循环用bench_keep挡住,不会被编译器整个删掉),
+再加上各模块注册的热点路径(帧拼接,命令分发,报文十六进制格式化).
+输入运行命令:dreamflower_app -D -T [-t 名字过滤] [-n 每轮次数]
+*/
+#define CALENDAR_BENCH_RUNS	31
 
-  start_stm = localtime(&start_t); //时钟向日历时间的转换，mktime为其逆向过程函数，日历的函数有很多，我一般用这个记那么多格式也累，用的时候再man
-
-  //也可以通过ctime直接打印出时间来。
-  printf("====\nstart time:%04d-%02d-%02d %02d:%02d:%02d\n",
-         start_stm->tm_year+1900,
-         start_stm->tm_mon+1,
-         start_stm->tm_mday,
-         start_stm->tm_hour,
-         start_stm->tm_min,
-         start_stm->tm_sec);
-  printf("start time:%s",ctime(&start_t));
-    
-  while( i-- )      ;
-
-  finish_c = times(&finish_stms);
-  finish_c = clock();
+extern const char *bench_filter;
+extern long bench_iters;
 
-  finish_t = time(NULL);
-  gettimeofday(&finish_stv,NULL);
-  
+static void bench_empty_loop(long iters, void *arg)
+{
+  long i;
 
-  duration = (double)(finish_c - start_c)/CLOCKS_PER_SEC; //-这个是获得程序的实际运行时间（秒)
-  printf( "1. [clock_t] get  %f secondes,start = %u,finish =%u\n",duration,start_c,finish_c );
+  for (i = 0; i < iters; i++)
+    bench_keep(i);
+}
 
-  luration = (finish_t - start_t);
-  printf("2. [time_t] get %u seconds,start = %u, finish = %u\n",luration,start_t,finish_t);
+static void print_clock(const char *name, clockid_t id)
+{
+  struct timespec res;
 
-  luration = (finish_stv.tv_sec - start_stv.tv_sec)*1000 + ( finish_stv.tv_usec - start_stv.tv_usec)/1000;
-  printf("3. [struct timeval] get %u ms,start=%u,finish=%u\n",luration,start_stv.tv_sec,finish_stv.tv_sec);
+  if (clock_getres(id, &res) == 0)
+    printf("  %-24s resolution %ld ns\n", name, res.tv_sec * 1000000000L + res.tv_nsec);
+  else
+    printf("  %-24s not available\n", name);
+}
 
+int calendar_sub(int argc,char* argv[])
+{
+  time_t start_t;
+  struct tm start_stm;	//-对time_t进行变体，类型为int
+  struct tms start_stms,finish_stms;//对clock_t类型的封装
   long clktck=sysconf(_SC_CLK_TCK);	//-该函数是获取一些系统的参数,,这里获得The  number  of  clock  ticks  per  second
-  
-  printf("================_SC_CLK_TCK=%d,CLOCKS_PER_SEC=%d\n",clktck,CLOCKS_PER_SEC);
 
-  
-  printf("4. [struct tms] get user= %7.2f,sys=%7.2f,child_user=%7.2f,child_sys=%7.2f\n",
+  start_t = time(NULL);
+  localtime_r(&start_t, &start_stm); //时钟向日历时间的转换，mktime为其逆向过程函数
+  printf("====\nstart time:%04d-%02d-%02d %02d:%02d:%02d\n",
+         start_stm.tm_year+1900,
+         start_stm.tm_mon+1,
+         start_stm.tm_mday,
+         start_stm.tm_hour,
+         start_stm.tm_min,
+         start_stm.tm_sec);
+
+  printf("clocks:\n");
+  print_clock("CLOCK_REALTIME", CLOCK_REALTIME);
+  print_clock("CLOCK_MONOTONIC", CLOCK_MONOTONIC);
+#if defined(CLOCK_MONOTONIC_RAW)
+  print_clock("CLOCK_MONOTONIC_RAW", CLOCK_MONOTONIC_RAW);
+#endif
+  print_clock("CLOCK_PROCESS_CPUTIME_ID", CLOCK_PROCESS_CPUTIME_ID);
+  printf("_SC_CLK_TCK=%ld, CLOCKS_PER_SEC=%ld\n", clktck, (long)CLOCKS_PER_SEC);
+
+  bench_add("empty_loop", bench_empty_loop, NULL);
+  uart_1_Bench();
+  sniffer_Bench();
+  log_Bench();
+  gpio_Bench();
+  modbus_Bench();
+  capseg_Bench();
+  neigh_Bench();
+  dns_Bench();
+
+  times(&start_stms);
+  bench_run_all(bench_filter, bench_iters, CALENDAR_BENCH_RUNS);
+  times(&finish_stms);
+
+  printf("[struct tms] user=%7.2fs sys=%7.2fs\n",
          (finish_stms.tms_utime - start_stms.tms_utime)/(double)clktck,
-         (finish_stms.tms_stime - start_stms.tms_stime)/(double)clktck,
-         (finish_stms.tms_cutime - start_stms.tms_cutime)/(double)clktck,
-         (finish_stms.tms_cstime - start_stms.tms_cstime)/(double)clktck ); 
-
-  //-exit(0);
-
+         (finish_stms.tms_stime - start_stms.tms_stime)/(double)clktck);
+  return 0;
 }
 
 
@@ -0,0 +1,284 @@
+/*
+dfcap:把dreamflower_app -W写的压缩抓包段转成pcap写到标准输出,
+tcpdump -r -,wireshark这些读pcap文件的程序直接用:
+	dfcap 段...			全部报文
+	dfcap -f 起 -t 止 段...		只要这段时间的(unix时间,秒,可以带小数),按块索引只解压有关的块
+	dfcap -F tcp:10.0.0.1:80-10.0.0.2:5000 段...	只要这条流的(两个方向),可以和-f -t一起用
+	dfcap -l 段...			不输出报文,列出每一块的位置,时间,报文数,压缩前后的大小
+	dfcap /data/cap.*.dfc | tcpdump -nr -
+段没有写索引(进程被杀,断电)时顺着块头往下找,最后不完整的一块丢掉.
+-F先看段的流过滤器,没有这条流的段只读了结尾几K就跳过;再看每块的过滤器,只解压可能有的块,
+解压出来的报文再逐个比五元组(过滤器会误判).没有过滤器的段(旧格式,没有索引)只能每块都看.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/stat.h>
+
+#include "lz.h"
+#include "capseg.h"
+#include "pktparse.h"
+
+//-pcap文件头,和libpcap的pcap_file_header一样
+struct capdump_pcap_hdr {
+	uint32_t magic;
+	uint16_t major, minor;
+	int32_t thiszone;
+	uint32_t sigfigs;
+	uint32_t snaplen;
+	uint32_t linktype;
+};
+
+static uint64_t t_from = 0, t_to = UINT64_MAX;
+static int list_only;
+static int pcap_linktype = -1;
+static struct pkt_flow q_flow;		//--F,pkt_flow_canon过的
+static uint64_t q_hash;
+static int q_on;
+
+//-读结尾的索引和流过滤器;没有(或者不对)返回-1.
+//-查流的时候整段都没有这条流返回0,每块的过滤器放到*pbloom
+static int capdump_index(int fd, off_t size, int v2, struct capseg_idx **pidx, uint8_t **pbloom)
+{
+	static uint8_t seg[CAPSEG_SEG_BLOOM];
+	struct capseg_trailer t;
+	struct capseg_idx *idx;
+	uint64_t bloom_off, extra;
+	uint8_t *bloom;
+
+	if (size < (off_t)(sizeof(struct capseg_hdr) + sizeof(t))
+	    || pread(fd, &t, sizeof(t), size - sizeof(t)) != sizeof(t) || t.magic != CAPSEG_IDX_MAGIC)
+		return -1;
+	bloom_off = t.idx_off + (uint64_t)t.nblocks * sizeof(*idx);
+	extra = v2 ? (uint64_t)t.nblocks * CAPSEG_BLK_BLOOM + CAPSEG_SEG_BLOOM : 0;
+	if (bloom_off + extra + sizeof(t) != (uint64_t)size)
+		return -1;
+	if (v2 && q_on) {
+		if (pread(fd, seg, sizeof(seg), bloom_off + (uint64_t)t.nblocks * CAPSEG_BLK_BLOOM) != sizeof(seg))
+			return -1;
+		if (!capseg_bloom_test(seg, CAPSEG_SEG_BLOOM * 8, q_hash))
+			return 0;
+		bloom = malloc(t.nblocks * CAPSEG_BLK_BLOOM + 1);
+		if (bloom == NULL || pread(fd, bloom, t.nblocks * CAPSEG_BLK_BLOOM, bloom_off) != (ssize_t)(t.nblocks * CAPSEG_BLK_BLOOM)) {
+			free(bloom);
+			return -1;
+		}
+		*pbloom = bloom;
+	}
+	idx = malloc(t.nblocks * sizeof(*idx) + 1);
+	if (idx == NULL || pread(fd, idx, t.nblocks * sizeof(*idx), t.idx_off) != (ssize_t)(t.nblocks * sizeof(*idx))) {
+		free(idx);
+		free(*pbloom);
+		*pbloom = NULL;
+		return -1;
+	}
+	*pidx = idx;
+	return t.nblocks;
+}
+
+//-顺着块头建索引;块长度不对的(坏了或者截断了)就停在这里
+static int capdump_scan(int fd, off_t size, uint32_t block, struct capseg_idx **pidx)
+{
+	struct capseg_idx *idx = NULL, *ni;
+	struct capseg_blk b;
+	uint64_t off = sizeof(struct capseg_hdr);
+	int n = 0, a = 0;
+
+	while (off + sizeof(b) <= (uint64_t)size && pread(fd, &b, sizeof(b), off) == sizeof(b)) {
+		if (b.magic != CAPSEG_BLK_MAGIC || b.comp_len > LZ_BOUND(block) || off + sizeof(b) + b.comp_len > (uint64_t)size)
+			break;
+		if (n == a) {
+			ni = realloc(idx, (a ? a * 2 : 64) * sizeof(*ni));
+			if (ni == NULL)
+				break;
+			idx = ni;
+			a = a ? a * 2 : 64;
+		}
+		idx[n].off = off;
+		idx[n].t_first = b.t_first;
+		idx[n].t_last = b.t_last;
+		idx[n].npkts = b.npkts;
+		idx[n].comp_len = b.comp_len;
+		n++;
+		off += sizeof(b) + b.comp_len;
+	}
+	*pidx = idx;
+	return n;
+}
+
+static void capdump_time(char *buf, int size, uint64_t us)
+{
+	time_t s = us / 1000000;
+	struct tm tm;
+
+	localtime_r(&s, &tm);
+	snprintf(buf, size, "%04d-%02d-%02d %02d:%02d:%02d.%06u", tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday,
+		 tm.tm_hour, tm.tm_min, tm.tm_sec, (unsigned int)(us % 1000000));
+}
+
+//-过滤器会误判,解压出来的报文逐个比五元组
+static int capdump_match(const unsigned char *p, uint32_t caplen, int linktype)
+{
+	struct pkt_flow f;
+
+	if (!q_on)
+		return 1;
+	if (pkt_flow(linktype, p, caplen, &f) < 0)
+		return 0;
+	pkt_flow_canon(&f);
+	return memcmp(&f, &q_flow, sizeof(f)) == 0;
+}
+
+//-一块里时间范围内的报文写出去,返回写了几个
+static int capdump_records(const unsigned char *p, uint32_t len, int linktype)
+{
+	struct capseg_rec r;
+	uint64_t t;
+	uint32_t off = 0;
+	int n = 0;
+
+	while (off + sizeof(r) <= len) {
+		memcpy(&r, p + off, sizeof(r));
+		if (r.caplen > len - off - sizeof(r))
+			break;
+		t = (uint64_t)r.ts_sec * 1000000 + r.ts_usec;
+		if (t >= t_from && t <= t_to && capdump_match(p + off + sizeof(r), r.caplen, linktype)) {
+			fwrite(p + off, sizeof(r) + r.caplen, 1, stdout);
+			n++;
+		}
+		off += sizeof(r) + r.caplen;
+	}
+	return n;
+}
+
+static int capdump_file(const char *path)
+{
+	static unsigned char *cbuf, *rbuf;
+	struct capdump_pcap_hdr ph = { 0xa1b2c3d4, 2, 4, 0, 0, 0, 0 };
+	struct capseg_idx *idx = NULL;
+	uint8_t *bloom = NULL;
+	struct capseg_hdr h;
+	struct capseg_blk b;
+	struct stat st;
+	char t0[64], t1[64];
+	uint64_t raw = 0, comp = 0;
+	int fd, n, i, len, pkts = 0, indexed = 1, nread = 0;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0 || fstat(fd, &st) != 0) {
+		perror(path);
+		return -1;
+	}
+	if (pread(fd, &h, sizeof(h), 0) != sizeof(h) || (h.magic != CAPSEG_MAGIC && h.magic != CAPSEG_MAGIC_V1) || h.block > 16 << 20) {
+		fprintf(stderr, "%s: not a capture segment\n", path);
+		close(fd);
+		return -1;
+	}
+	if (cbuf == NULL) {
+		cbuf = malloc(LZ_BOUND(16 << 20));
+		rbuf = malloc(16 << 20);
+		if (cbuf == NULL || rbuf == NULL) {
+			perror("malloc");
+			exit(1);
+		}
+	}
+	if (!list_only) {
+		if (pcap_linktype < 0) {
+			ph.snaplen = h.snaplen;
+			ph.linktype = pcap_linktype = h.linktype;
+			fwrite(&ph, sizeof(ph), 1, stdout);
+		} else if ((int)h.linktype != pcap_linktype) {
+			fprintf(stderr, "%s: link type %u, not %d like the first segment, skipped\n", path, h.linktype, pcap_linktype);
+			close(fd);
+			return -1;
+		}
+	}
+	if ((n = capdump_index(fd, st.st_size, h.magic == CAPSEG_MAGIC, &idx, &bloom)) < 0) {
+		indexed = 0;
+		n = capdump_scan(fd, st.st_size, h.block, &idx);
+	}
+	for (i = 0; i < n; i++) {
+		if (idx[i].t_last < t_from || idx[i].t_first > t_to)
+			continue;	//-这一块整个在范围外,不读不解压
+		if (bloom && !capseg_bloom_test(bloom + i * CAPSEG_BLK_BLOOM, CAPSEG_BLK_BLOOM * 8, q_hash))
+			continue;	//-这一块肯定没有要的流
+		if (pread(fd, &b, sizeof(b), idx[i].off) != sizeof(b) || b.magic != CAPSEG_BLK_MAGIC
+		    || b.comp_len != idx[i].comp_len || b.raw_len > h.block || b.comp_len > LZ_BOUND(h.block)
+		    || pread(fd, cbuf, b.comp_len, idx[i].off + sizeof(b)) != (ssize_t)b.comp_len) {
+			fprintf(stderr, "%s: bad block at %llu\n", path, (unsigned long long)idx[i].off);
+			continue;
+		}
+		raw += b.raw_len;
+		comp += sizeof(b) + b.comp_len;
+		pkts += b.npkts;
+		nread++;
+		if (list_only) {
+			capdump_time(t0, sizeof(t0), b.t_first);
+			capdump_time(t1, sizeof(t1), b.t_last);
+			printf("%10llu  %s - %s  %6u pkts  %6u -> %6u\n", (unsigned long long)idx[i].off, t0, t1, b.npkts, b.raw_len, b.comp_len);
+			continue;
+		}
+		if (b.comp_len == b.raw_len)
+			memcpy(rbuf, cbuf, b.raw_len);
+		else if ((len = lz_decompress(cbuf, b.comp_len, rbuf, b.raw_len)) != (int)b.raw_len) {
+			fprintf(stderr, "%s: corrupt block at %llu\n", path, (unsigned long long)idx[i].off);
+			continue;
+		}
+		capdump_records(rbuf, b.raw_len, h.linktype);
+	}
+	if (list_only)
+		printf("%s: %d blocks%s, %d selected, %d packets, %llu -> %llu bytes (%.1f%%)\n", path, n, indexed ? "" : " (no index)", nread, pkts,
+		       (unsigned long long)raw, (unsigned long long)comp, raw ? comp * 100.0 / raw : 0.0);
+	free(idx);
+	free(bloom);
+	close(fd);
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	int c, i, err = 0;
+
+	while ((c = getopt(argc, argv, "f:t:F:l")) != -1) {
+		switch (c) {
+		case 'f':
+			t_from = strtod(optarg, NULL) * 1e6;
+			break;
+		case 't':
+			t_to = strtod(optarg, NULL) * 1e6;
+			break;
+		case 'F':
+			if (pkt_flow_parse(optarg, &q_flow) != 0) {
+				fprintf(stderr, "%s: bad flow \"%s\", proto:addr:port-addr:port, IPv6 addresses in []\n", argv[0], optarg);
+				return 2;
+			}
+			pkt_flow_canon(&q_flow);
+			q_hash = pkt_flow_hash(&q_flow);
+			q_on = 1;
+			break;
+		case 'l':
+			list_only = 1;
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-l] [-f from] [-t to] [-F flow] segment...  (times in unix seconds)\n", argv[0]);
+			return 2;
+		}
+	}
+	if (optind >= argc) {
+		fprintf(stderr, "usage: %s [-l] [-f from] [-t to] [-F flow] segment...\n", argv[0]);
+		return 2;
+	}
+	if (!list_only && isatty(STDOUT_FILENO)) {
+		fprintf(stderr, "%s: pcap goes to stdout, redirect it or pipe it to tcpdump -r -\n", argv[0]);
+		return 2;
+	}
+	for (i = optind; i < argc; i++)
+		if (capdump_file(argv[i]) != 0)
+			err = 1;
+	return err;
+}
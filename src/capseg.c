@@ -0,0 +1,604 @@
+/*
+此文件是压缩的抓包段,格式见capseg.h.
+以前每个报文在线程池里格式化成十六进制写日志,一个60字节的报文在日志里要好几百字节,
+小flash几个小时就满了.现在只留报文头,64K一块压缩,段的个数和大小固定,旧的删掉.
+*/
+
+#include "debugfl.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <time.h>
+#include <fcntl.h>
+#include <glob.h>
+#include <pthread.h>
+#include <sys/uio.h>
+#include <pcap.h>
+
+#include "bench.h"
+#include "trace.h"
+#include "metrics.h"
+#include "lz.h"
+#include "pktparse.h"
+#include "capseg.h"
+
+#define CAPSEG_BUFS		8		//-块缓冲个数,写线程最多落后这么多块
+#define CAPSEG_FLUSH_US		10000000ULL	//-块开始填超过10s就不等满了,由写线程交出去
+
+struct capseg_buf {
+	struct capseg_blk b;
+	struct capseg_buf *next;
+	uint64_t born_us;		//-开始填的时候(CLOCK_MONOTONIC),不写到文件里
+	unsigned char data[CAPSEG_BLOCK];
+};
+
+int capseg_snap = 0;
+static char cs_prefix[200];
+static long cs_seg_bytes;
+static int cs_keep;
+static int cs_linktype;
+
+static pthread_mutex_t cs_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t cs_cond = PTHREAD_COND_INITIALIZER;
+static struct capseg_buf *cs_bufs, *cs_free, *cs_full, **cs_full_tail = &cs_full;
+/*
+抓包线程正在填的块.抓包线程每个报文先把它换成NULL(拿走),填完再放回;
+写线程看到它太老了,用比较交换拿走交出去(抓包线程正拿着时拿不到,过一会再试).
+链路上没有报文时半块也不会一直留在内存里.
+*/
+static struct capseg_buf *cs_cur;
+static int cs_nfree;
+static int cs_stop, cs_started;
+static pthread_t cs_tid;
+
+//-下面只有写线程用
+static int cs_fd = -1;
+static unsigned int cs_seq;
+static uint64_t cs_off;
+static struct capseg_idx *cs_idx;
+static uint8_t *cs_bloom;		//-每块CAPSEG_BLK_BLOOM字节,和cs_idx一一对应
+static uint8_t cs_seg_bloom[CAPSEG_SEG_BLOOM];
+static int cs_nidx, cs_aidx;
+static int cs_werr;
+static unsigned char cs_out[LZ_BOUND(CAPSEG_BLOCK)];
+
+static struct metric *m_pkts = &metric_sink;
+static struct metric *m_drop = &metric_sink;
+static struct metric *m_raw = &metric_sink;
+static struct metric *m_written = &metric_sink;
+static struct metric *m_segments = &metric_sink;
+
+int capseg_parse(const char *spec)
+{
+	char buf[sizeof(cs_prefix)], *f[4], *p = buf;
+	int n, kb;
+
+	snprintf(buf, sizeof(buf), "%s", spec);
+	for (n = 0; n < 4 && p; n++) {
+		f[n] = p;
+		if ((p = strchr(p, ':')) != NULL)
+			*p++ = 0;
+	}
+	snprintf(cs_prefix, sizeof(cs_prefix), "%s", f[0]);
+	capseg_snap = n > 1 && *f[1] ? atoi(f[1]) : CAPSEG_SNAP_DEF;	//-空的用默认值
+	kb = n > 2 && *f[2] ? atoi(f[2]) : CAPSEG_SEG_KB_DEF;
+	cs_keep = n > 3 && *f[3] ? atoi(f[3]) : CAPSEG_KEEP_DEF;
+	if (cs_prefix[0] == 0 || capseg_snap < 16 || capseg_snap > CAPSEG_BLOCK - (int)sizeof(struct capseg_rec) || kb < 64 || cs_keep < 1) {
+		fprintf(stderr, "capseg: bad spec \"%s\", prefix[:snaplen[:segment KB[:segments]]]\n", spec);
+		capseg_snap = 0;
+		return -1;
+	}
+	cs_seg_bytes = kb * 1024L;
+	return 0;
+}
+
+//-------------------------------- 段文件(写线程) --------------------------------
+static glob_t *capseg_glob(glob_t *g)
+{
+	char pat[sizeof(cs_prefix) + 16];
+
+	snprintf(pat, sizeof(pat), "%s.*.dfc", cs_prefix);
+	if (glob(pat, 0, NULL, g) != 0) {
+		g->gl_pathc = 0;
+		return NULL;
+	}
+	return g;
+}
+
+//-名字是前缀.序号.dfc,序号补0到8位,按名字排序就是按时间
+static void capseg_prune(void)
+{
+	glob_t g;
+	size_t i;
+
+	if (capseg_glob(&g) == NULL)
+		return;
+	for (i = 0; i + cs_keep < g.gl_pathc; i++)
+		unlink(g.gl_pathv[i]);
+	globfree(&g);
+}
+
+static int capseg_seg_open(void)
+{
+	struct capseg_hdr h = { CAPSEG_MAGIC, cs_linktype, capseg_snap, CAPSEG_BLOCK };
+	char name[sizeof(cs_prefix) + 16];
+
+	snprintf(name, sizeof(name), "%s.%08u.dfc", cs_prefix, ++cs_seq);
+	cs_fd = open(name, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (cs_fd < 0)
+		return -1;
+	if (write(cs_fd, &h, sizeof(h)) != sizeof(h)) {
+		close(cs_fd);
+		cs_fd = -1;
+		return -1;
+	}
+	cs_off = sizeof(h);
+	cs_nidx = 0;
+	memset(cs_seg_bloom, 0, sizeof(cs_seg_bloom));
+	metric_inc(m_segments);
+	return 0;
+}
+
+//-写上索引关掉,删掉多出来的旧段
+static void capseg_seg_close(void)
+{
+	struct capseg_trailer t = { cs_off, cs_nidx, CAPSEG_IDX_MAGIC };
+	struct iovec iov[4] = {
+		{ cs_idx, cs_nidx * sizeof(*cs_idx) }, { cs_bloom, cs_nidx * CAPSEG_BLK_BLOOM },
+		{ cs_seg_bloom, sizeof(cs_seg_bloom) }, { &t, sizeof(t) },
+	};
+
+	if (writev(cs_fd, iov, 4) != (ssize_t)(iov[0].iov_len + iov[1].iov_len + iov[2].iov_len + iov[3].iov_len))
+		LOG(LOGM_PCAP, LOG_WARN, "capseg %s.%08u.dfc: index: %s", cs_prefix, cs_seq, strerror(errno));
+	close(cs_fd);
+	cs_fd = -1;
+	capseg_prune();
+}
+
+//-块里每个报文的流放进这一块和整段的过滤器;连着同一条流的只放一次
+static void capseg_bloom(struct capseg_buf *b, uint8_t *blk)
+{
+	struct capseg_rec r;
+	struct pkt_flow f;
+	uint64_t h, last = 0;
+	uint32_t off = 0;
+
+	memset(blk, 0, CAPSEG_BLK_BLOOM);
+	while (off + sizeof(r) <= b->b.raw_len) {
+		memcpy(&r, b->data + off, sizeof(r));
+		off += sizeof(r);
+		if (pkt_flow(cs_linktype, b->data + off, r.caplen, &f) >= 0) {
+			pkt_flow_canon(&f);
+			h = pkt_flow_hash(&f);
+			if (h != last) {
+				capseg_bloom_add(blk, CAPSEG_BLK_BLOOM * 8, h);
+				capseg_bloom_add(cs_seg_bloom, CAPSEG_SEG_BLOOM * 8, h);
+				last = h;
+			}
+		}
+		off += r.caplen;
+	}
+}
+
+static void capseg_write(struct capseg_buf *b)
+{
+	struct capseg_idx *ni;
+	uint8_t *nb;
+	struct iovec iov[2];
+	void *payload = b->data;
+	int comp;
+
+	if (cs_nidx == cs_aidx) {
+		ni = realloc(cs_idx, (cs_aidx ? cs_aidx * 2 : 64) * sizeof(*ni));
+		if (ni == NULL)
+			goto drop;
+		cs_idx = ni;
+		nb = realloc(cs_bloom, (cs_aidx ? cs_aidx * 2 : 64) * CAPSEG_BLK_BLOOM);
+		if (nb == NULL)
+			goto drop;
+		cs_bloom = nb;
+		cs_aidx = cs_aidx ? cs_aidx * 2 : 64;
+	}
+	if (cs_fd < 0 && capseg_seg_open() != 0)
+		goto fail;
+	//-过滤器在压缩前填(段打开以后,打开会清整段的):报文刚被复制进来还在cache里,压缩接着读.
+	//-写失败时这一块的流已经进了整段的过滤器,只是多一次误判
+	capseg_bloom(b, cs_bloom + cs_nidx * CAPSEG_BLK_BLOOM);
+	comp = lz_compress(b->data, b->b.raw_len, cs_out, sizeof(cs_out));
+	if (comp > 0 && comp < (int)b->b.raw_len)
+		payload = cs_out;
+	else
+		comp = b->b.raw_len;	//-压不下去的存原样
+	b->b.magic = CAPSEG_BLK_MAGIC;
+	b->b.comp_len = comp;
+	iov[0].iov_base = &b->b;
+	iov[0].iov_len = sizeof(b->b);
+	iov[1].iov_base = payload;
+	iov[1].iov_len = comp;
+	if (writev(cs_fd, iov, 2) != (ssize_t)(sizeof(b->b) + comp)) {
+		//-写了一半的块截掉(索引要接在最后一个完整的块后面),这一段到此为止
+		if (ftruncate(cs_fd, cs_off) == 0)
+			lseek(cs_fd, cs_off, SEEK_SET);
+		capseg_seg_close();
+		goto fail;
+	}
+	cs_idx[cs_nidx].off = cs_off;
+	cs_idx[cs_nidx].t_first = b->b.t_first;
+	cs_idx[cs_nidx].t_last = b->b.t_last;
+	cs_idx[cs_nidx].npkts = b->b.npkts;
+	cs_idx[cs_nidx].comp_len = comp;
+	cs_nidx++;
+	cs_off += sizeof(b->b) + comp;
+	cs_werr = 0;
+	metric_add(m_raw, b->b.raw_len);
+	metric_add(m_written, sizeof(b->b) + comp);
+	if (cs_off >= (uint64_t)cs_seg_bytes)
+		capseg_seg_close();
+	return;
+fail:
+	if (!cs_werr++)
+		LOG(LOGM_PCAP, LOG_WARN, "capseg %s: %s, dropping blocks", cs_prefix, strerror(errno));
+drop:
+	metric_add(m_drop, b->b.npkts);
+}
+
+static uint64_t capseg_now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void capseg_queue(struct capseg_buf *b)
+{
+	b->next = NULL;
+	*cs_full_tail = b;
+	cs_full_tail = &b->next;
+}
+
+//-拿着cs_lock调用:正在填的块太老了就拿过来排上,返回1;否则返回还要等多少us
+static int capseg_flush_old(uint64_t *wait)
+{
+	struct capseg_buf *b = __atomic_load_n(&cs_cur, __ATOMIC_ACQUIRE);
+	uint64_t now = capseg_now_us();
+
+	*wait = CAPSEG_FLUSH_US;
+	if (b == NULL)
+		return 0;
+	if (now - b->born_us < CAPSEG_FLUSH_US) {
+		*wait = b->born_us + CAPSEG_FLUSH_US - now;
+		return 0;
+	}
+	if (!__atomic_compare_exchange_n(&cs_cur, &b, NULL, 0, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+		*wait = 1000;		//-抓包线程正在往里放
+		return 0;
+	}
+	capseg_queue(b);
+	return 1;
+}
+
+static void *capseg_thread(void *arg)
+{
+	struct capseg_buf *b;
+	struct timespec ts;
+	uint64_t wait;
+
+	trace_thread_name("capseg");
+	pthread_mutex_lock(&cs_lock);
+	for (;;) {
+		while (cs_full == NULL && !cs_stop) {
+			if (capseg_flush_old(&wait))
+				break;
+			clock_gettime(CLOCK_REALTIME, &ts);
+			ts.tv_sec += wait / 1000000;
+			ts.tv_nsec += wait % 1000000 * 1000;
+			if (ts.tv_nsec >= 1000000000L) {
+				ts.tv_sec++;
+				ts.tv_nsec -= 1000000000L;
+			}
+			pthread_cond_timedwait(&cs_cond, &cs_lock, &ts);
+		}
+		if ((b = cs_full) == NULL)
+			break;		//-停了,而且都写完了
+		if ((cs_full = b->next) == NULL)
+			cs_full_tail = &cs_full;
+		pthread_mutex_unlock(&cs_lock);
+		TRACE_BEGIN("capseg_block");
+		capseg_write(b);
+		TRACE_END("capseg_block");
+		pthread_mutex_lock(&cs_lock);
+		b->next = cs_free;
+		cs_free = b;
+		__atomic_add_fetch(&cs_nfree, 1, __ATOMIC_RELAXED);
+	}
+	pthread_mutex_unlock(&cs_lock);
+	if (cs_fd >= 0)
+		capseg_seg_close();
+	return NULL;
+}
+
+//-------------------------------- 抓包线程 --------------------------------
+static void capseg_push(struct capseg_buf *b)
+{
+	pthread_mutex_lock(&cs_lock);
+	capseg_queue(b);
+	pthread_cond_signal(&cs_cond);
+	pthread_mutex_unlock(&cs_lock);
+}
+
+//-只在换块的时候拿一次锁
+void capseg_add(const struct pcap_pkthdr *h, const unsigned char *data)
+{
+	struct capseg_buf *b = __atomic_exchange_n(&cs_cur, NULL, __ATOMIC_ACQUIRE);	//-写线程可能已经拿走了
+	struct capseg_rec r;
+	uint64_t t = (uint64_t)h->ts.tv_sec * 1000000 + h->ts.tv_usec;
+	uint32_t cap = h->caplen < (uint32_t)capseg_snap ? h->caplen : (uint32_t)capseg_snap;
+
+	metric_inc(m_pkts);
+	if (b && b->b.raw_len + sizeof(r) + cap > CAPSEG_BLOCK) {
+		capseg_push(b);
+		b = NULL;
+	}
+	if (b == NULL) {
+		pthread_mutex_lock(&cs_lock);
+		if ((b = cs_free) != NULL) {
+			cs_free = b->next;
+			__atomic_sub_fetch(&cs_nfree, 1, __ATOMIC_RELAXED);
+		}
+		pthread_mutex_unlock(&cs_lock);
+		if (b == NULL) {
+			metric_inc(m_drop);	//-写线程跟不上,丢这个报文,不等
+			return;
+		}
+		b->b.raw_len = 0;
+		b->b.npkts = 0;
+		b->b.t_first = t;
+		b->born_us = capseg_now_us();
+	}
+	r.ts_sec = h->ts.tv_sec;
+	r.ts_usec = h->ts.tv_usec;
+	r.caplen = cap;
+	r.len = h->len;
+	memcpy(b->data + b->b.raw_len, &r, sizeof(r));
+	memcpy(b->data + b->b.raw_len + sizeof(r), data, cap);
+	b->b.raw_len += sizeof(r) + cap;
+	b->b.npkts++;
+	b->b.t_last = t;
+	__atomic_store_n(&cs_cur, b, __ATOMIC_RELEASE);
+}
+
+//-------------------------------- 打开和关闭 --------------------------------
+int capseg_open(int linktype)
+{
+	unsigned int seq;
+	glob_t g;
+	size_t i;
+	char *p;
+	int k;
+
+	if (capseg_snap == 0 || cs_started)
+		return 0;
+	cs_bufs = calloc(CAPSEG_BUFS, sizeof(*cs_bufs));
+	if (cs_bufs == NULL)
+		return -1;
+	cs_free = NULL;
+	for (k = 0; k < CAPSEG_BUFS; k++) {
+		cs_bufs[k].next = cs_free;
+		cs_free = &cs_bufs[k];
+	}
+	cs_nfree = CAPSEG_BUFS;
+	cs_full = NULL;
+	cs_full_tail = &cs_full;
+	cs_linktype = linktype;
+	//-重启以后接着已有的段往后编号,不覆盖
+	cs_seq = 0;
+	if (capseg_glob(&g)) {
+		for (i = 0; i < g.gl_pathc; i++) {
+			p = g.gl_pathv[i] + strlen(cs_prefix) + 1;
+			if (sscanf(p, "%u", &seq) == 1 && seq > cs_seq)
+				cs_seq = seq;
+		}
+		globfree(&g);
+	}
+	if (m_pkts == &metric_sink) {
+		m_pkts = metric_counter("capseg_packets_total", "packets handed to capture segments");
+		m_drop = metric_counter("capseg_dropped_total", "packets dropped because the segment writer fell behind or failed");
+		m_raw = metric_counter("capseg_raw_bytes_total", "packet records before compression");
+		m_written = metric_counter("capseg_written_bytes_total", "compressed block bytes written");
+		m_segments = metric_counter("capseg_segments_total", "segment files started");
+	}
+	cs_stop = 0;
+	if ((k = pthread_create(&cs_tid, NULL, capseg_thread, NULL)) != 0) {
+		LOG(LOGM_PCAP, LOG_WARN, "capseg: pthread_create: %s", strerror(k));
+		free(cs_bufs);
+		cs_bufs = NULL;
+		return -1;
+	}
+	cs_started = 1;
+	LOG(LOGM_PCAP, LOG_INFO, "capseg %s: snaplen %d, %ld KB x %d segments", cs_prefix, capseg_snap, cs_seg_bytes / 1024, cs_keep);
+	return 0;
+}
+
+void capseg_close(void)
+{
+	if (!cs_started)
+		return;
+	if (cs_cur && cs_cur->b.npkts)
+		capseg_push(cs_cur);
+	cs_cur = NULL;
+	pthread_mutex_lock(&cs_lock);
+	cs_stop = 1;
+	pthread_cond_signal(&cs_cond);
+	pthread_mutex_unlock(&cs_lock);
+	pthread_join(cs_tid, NULL);
+	free(cs_bufs);
+	cs_bufs = cs_free = NULL;
+	free(cs_idx);
+	cs_idx = NULL;
+	free(cs_bloom);
+	cs_bloom = NULL;
+	cs_nidx = cs_aidx = 0;
+	cs_started = 0;
+}
+
+//-等着写的块占了百分之几(正在填的不算),抓包线程里调用,不拿锁,差一点没关系
+int capseg_fill(void)
+{
+	int used = CAPSEG_BUFS - __atomic_load_n(&cs_nfree, __ATOMIC_RELAXED) - (cs_cur != NULL);
+
+	return cs_started && used > 0 ? used * 100 / CAPSEG_BUFS : 0;
+}
+
+void capseg_stats(void)
+{
+	uint64_t raw = metric_value(m_raw), written = metric_value(m_written);
+
+	if (!cs_started)
+		return;
+	LOG(LOGM_PCAP, LOG_INFO, "capseg %s: %llu packets, %llu dropped, %llu -> %llu bytes (%.1f%%), segment %u",
+	    cs_prefix, (unsigned long long)metric_value(m_pkts), (unsigned long long)metric_value(m_drop),
+	    (unsigned long long)raw, (unsigned long long)written, raw ? written * 100.0 / raw : 0.0, cs_seq);
+}
+
+//-------------------------------- 基准测试 --------------------------------
+/*
+一块报文头:8条TCP连接轮流来包,以太网+IP+TCP(带时间戳选项)66字节,
+序号,IP id,时间戳每个包都变,和真的抓包差不多.
+*/
+static int capseg_bench_block(unsigned char *buf)
+{
+	static const unsigned char tmpl[66] = {
+		0x00, 0x0c, 0x29, 0x3e, 0x5b, 0x01, 0x00, 0x50, 0x56, 0xc0, 0x00, 0x08, 0x08, 0x00,
+		0x45, 0x00, 0x00, 0x34, 0x00, 0x00, 0x40, 0x00, 0x40, 0x06, 0x00, 0x00,
+		0xc0, 0xa8, 0x01, 0x0a, 0xc0, 0xa8, 0x01, 0x01,
+		0x00, 0x00, 0x00, 0x50, 0, 0, 0, 0, 0, 0, 0, 0, 0x80, 0x10, 0x01, 0xf5, 0, 0, 0, 0,
+		0x01, 0x01, 0x08, 0x0a, 0, 0, 0, 0, 0, 0, 0, 0,
+	};
+	struct capseg_rec r;
+	unsigned char *p;
+	uint32_t v;
+	int n = 0, i = 0, flow;
+
+	while (n + (int)(sizeof(r) + sizeof(tmpl)) <= CAPSEG_BLOCK) {
+		flow = i % 8;
+		r.ts_sec = 1700000000 + i / 1000;
+		r.ts_usec = i % 1000 * 997;
+		r.caplen = sizeof(tmpl);
+		r.len = 66 + (i * 37) % 1400;
+		memcpy(buf + n, &r, sizeof(r));
+		p = buf + n + sizeof(r);
+		memcpy(p, tmpl, sizeof(tmpl));
+		p[19] = i;				//-IP id
+		p[18] = i >> 8;
+		p[33] = 10 + flow;			//-目的地址
+		p[34] = 0xc0 + flow;			//-源端口
+		p[35] = 0x10 + flow;
+		v = 1000000 * flow + i * 1448;		//-序号
+		memcpy(p + 38, &v, 4);
+		v = i * 3;				//-TCP时间戳
+		memcpy(p + 58, &v, 4);
+		p[24] = i * 13;				//-校验和
+		p[50] = i * 7;
+		n += sizeof(r) + sizeof(tmpl);
+		i++;
+	}
+	return n;
+}
+
+static unsigned char bench_blk[CAPSEG_BLOCK];
+static unsigned char bench_lz[LZ_BOUND(CAPSEG_BLOCK)];
+static int bench_raw, bench_comp;
+
+static void bench_lz_compress(long iters, void *arg)
+{
+	long i;
+
+	for (i = 0; i < iters; i++) {
+		bench_clobber();
+		bench_comp = lz_compress(bench_blk, bench_raw, bench_lz, sizeof(bench_lz));
+	}
+}
+
+static void bench_lz_decompress(long iters, void *arg)
+{
+	static unsigned char out[CAPSEG_BLOCK];
+	long i;
+
+	for (i = 0; i < iters; i++) {
+		bench_clobber();
+		bench_keep(lz_decompress(bench_lz, bench_comp, out, sizeof(out)));
+	}
+}
+
+//-写线程每块多做的事:逐个解析报文头填流过滤器
+static void bench_bloom(long iters, void *arg)
+{
+	static struct capseg_buf b;
+	static uint8_t bits[CAPSEG_BLK_BLOOM];
+	long i;
+
+	memcpy(b.data, bench_blk, bench_raw);
+	b.b.raw_len = bench_raw;
+	for (i = 0; i < iters; i++) {
+		bench_clobber();
+		capseg_bloom(&b, bits);
+	}
+}
+
+/*
+lz_compress的cap检查,跑基准测试时先做一遍:
+不能压缩的数据压到正好LZ_BOUND(n)-1字节里必须成功;
+文字15字节,匹配19字节(两个长度扩展都要写)的数据,从0到够用的每个cap都试一遍,
+不够时只能返回0,哪个cap都不能写过cap(后面放了哨兵),压出来的要能解回原样.返回错误个数
+*/
+#define LZ_CHECK_N	1024
+#define LZ_CHECK_GUARD	32
+
+static int capseg_lz_check(void)
+{
+	static uint8_t in[LZ_CHECK_N], out[LZ_BOUND(LZ_CHECK_N) + LZ_CHECK_GUARD], back[LZ_CHECK_N];
+	uint32_t x = 2463534242u;
+	int i, k, n, cap, pass, bad = 0;
+
+	for (pass = 0; pass < 2; pass++) {
+		for (i = 0; i < LZ_CHECK_N; i++) {
+			x ^= x << 13;
+			x ^= x >> 17;
+			x ^= x << 5;
+			in[i] = x;
+		}
+		if (pass == 1)	//-开头64字节当字典,后面每段15字节新的,19字节抄字典
+			for (i = 64; i + 34 <= LZ_CHECK_N; i += 34)
+				memcpy(in + i + 15, in + (i % 45), 19);
+		for (cap = pass == 0 ? LZ_BOUND(LZ_CHECK_N) - 1 : 0; cap < LZ_BOUND(LZ_CHECK_N); cap++) {
+			memset(out, 0xa5, sizeof(out));
+			n = lz_compress(in, LZ_CHECK_N, out, cap);
+			for (k = cap; k < cap + LZ_CHECK_GUARD; k++)
+				if (out[k] != 0xa5)
+					break;
+			if (k < cap + LZ_CHECK_GUARD || n > cap || (pass == 0 && n == 0)
+			    || (n > 0 && (lz_decompress(out, n, back, sizeof(back)) != LZ_CHECK_N || memcmp(in, back, LZ_CHECK_N) != 0))) {
+				printf("lz: FAILED, %s input, cap %d returned %d\n", pass ? "literal 15/match 19" : "incompressible", cap, n);
+				bad++;
+			}
+		}
+	}
+	return bad;
+}
+
+void capseg_Bench(void)
+{
+	cs_linktype = PKT_DLT_EN10MB;
+	if (capseg_lz_check() == 0)
+		printf("lz: output never exceeds cap, incompressible input fits LZ_BOUND(n)-1\n");
+	bench_raw = capseg_bench_block(bench_blk);
+	bench_comp = lz_compress(bench_blk, bench_raw, bench_lz, sizeof(bench_lz));
+	printf("capseg: %d byte block of headers -> %d bytes (%.1f%%)\n", bench_raw, bench_comp, bench_comp * 100.0 / bench_raw);
+	bench_add("lz_compress_64k", bench_lz_compress, NULL);
+	bench_add("lz_decompress_64k", bench_lz_decompress, NULL);
+	bench_add("capseg_bloom_64k", bench_bloom, NULL);
+}
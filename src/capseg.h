@@ -0,0 +1,110 @@
+//-为了方便调试定义了系列变量以便调试输出
+
+#ifndef CAPSEG_H
+#define CAPSEG_H
+
+#include <stdint.h>
+
+/*
+压缩的抓包段:-W打开以后抓到的报文不再一个一个写日志,而是攒成块压缩了写到段文件里.
+抓包线程只把报文(截到snaplen)复制到当前块,块满了交给写线程,自己拿一个空块接着抓;
+压缩和写flash都在写线程里,写线程跟不上时空块用完,丢的是报文(计数),抓包线程从不等.
+段文件:
+	capseg_hdr
+	capseg_blk + 块数据(压缩的,comp_len==raw_len时没有压缩)	重复
+	capseg_idx * nblocks						块索引(时间->位置,一块一项)
+	CAPSEG_BLK_BLOOM字节 * nblocks					每块的流过滤器
+	CAPSEG_SEG_BLOOM字节						整段的流过滤器
+	capseg_trailer
+块解压出来就是pcap格式的报文记录(16字节的头加数据),接在pcap文件头后面就是pcap文件.
+读的时候(dfcap)先读结尾的索引,只解压时间范围里的块;没有索引(进程没有正常退出)时顺着块头找.
+流过滤器是布隆过滤器,键是pkt_flow_canon以后的五元组(两个方向一样),写线程压缩前填.
+查一条流时先看整段的,不在就整段跳过;再看每块的,只解压可能有的块,
+所以查的时间跟着结果的多少走,不跟着存了多少走.
+段写到一定大小换下一个,只留最新的几个,总大小是固定的.
+数字都是本机字节序.
+*/
+#define CAPSEG_MAGIC		0x32434644	//-"DFC2",有流过滤器
+#define CAPSEG_MAGIC_V1		0x31434644	//-"DFC1",只有时间索引,dfcap还能读
+#define CAPSEG_BLK_MAGIC	0x42434644	//-"DFCB"
+#define CAPSEG_IDX_MAGIC	0x49434644	//-"DFCI"
+#define CAPSEG_BLOCK		(64 * 1024)	//-一块解压以后最多这么大
+#define CAPSEG_SNAP_DEF		96		//-默认只留报文头:以太网+IP+TCP带选项
+#define CAPSEG_SEG_KB_DEF	1024
+#define CAPSEG_KEEP_DEF		32
+#define CAPSEG_BLK_BLOOM	512		//-一块几百个报文;500条流时误判4%,50条流时百万分之五
+#define CAPSEG_SEG_BLOOM	4096		//-一段几十块,上千条流
+#define CAPSEG_BLOOM_K		4
+
+struct capseg_hdr {
+	uint32_t magic;
+	uint32_t linktype;		//-pcap_datalink
+	uint32_t snaplen;
+	uint32_t block;			//-CAPSEG_BLOCK
+};
+
+struct capseg_blk {
+	uint32_t magic;
+	uint32_t raw_len;
+	uint32_t comp_len;
+	uint32_t npkts;
+	uint64_t t_first;		//-第一个和最后一个报文的时间(us)
+	uint64_t t_last;
+};
+
+struct capseg_idx {
+	uint64_t off;			//-capseg_blk在文件里的位置
+	uint64_t t_first;
+	uint64_t t_last;
+	uint32_t npkts;
+	uint32_t comp_len;
+};
+
+struct capseg_trailer {
+	uint64_t idx_off;
+	uint32_t nblocks;
+	uint32_t magic;			//-CAPSEG_IDX_MAGIC
+};
+
+//-块里的一个报文,和pcap文件里的记录头一样
+struct capseg_rec {
+	uint32_t ts_sec;
+	uint32_t ts_usec;
+	uint32_t caplen;
+	uint32_t len;
+};
+
+//-k个位置由哈希的高低32位组合出来(双重哈希),nbits是2的幂
+static inline void capseg_bloom_add(uint8_t *bits, uint32_t nbits, uint64_t h)
+{
+	uint32_t a = h, b = h >> 32 | 1;
+	int i;
+
+	for (i = 0; i < CAPSEG_BLOOM_K; i++, a += b)
+		bits[(a & (nbits - 1)) >> 3] |= 1 << (a & 7);
+}
+
+static inline int capseg_bloom_test(const uint8_t *bits, uint32_t nbits, uint64_t h)
+{
+	uint32_t a = h, b = h >> 32 | 1;
+	int i;
+
+	for (i = 0; i < CAPSEG_BLOOM_K; i++, a += b)
+		if (!(bits[(a & (nbits - 1)) >> 3] & 1 << (a & 7)))
+			return 0;
+	return 1;
+}
+
+struct pcap_pkthdr;
+
+extern int capseg_snap;			//-0表示没有打开
+
+int  capseg_parse(const char *spec);	//--W 前缀[:snaplen[:段大小KB[:保留几段]]]
+int  capseg_open(int linktype);		//-开始抓之前调用,启动写线程
+void capseg_add(const struct pcap_pkthdr *h, const unsigned char *data);	//-只在抓包线程里调用
+void capseg_close(void);		//-抓包线程已经停了以后调用,剩下的块写完
+int  capseg_fill(void);			//-写线程落后了多少,百分比
+void capseg_stats(void);
+void capseg_Bench(void);
+
+#endif /* CAPSEG_H */
@@ -0,0 +1,280 @@
+/*
+此文件是本地控制socket.
+以前只有串口能发命令,现场调试要接串口线,脚本也没法用.
+现在连到-C的socket就能发和串口一样的命令(见uart_1_app.c的uart_cmd_table):
+  printf '1 $0003#\n2 $00044#\n' | socat - UNIX-CONNECT:/var/run/dreamflower_app.ctl
+命令处理函数不用改:fd传UART_FD_CAPTURE,UART0_Send把回复放到缓冲里,再按行发回去.
+socket文件只有属主能读写,连上来的进程还要和本进程是同一个用户(或者root).
+在主循环里处理,和串口的命令是串行的,不用加锁.
+*/
+
+#define _GNU_SOURCE
+#include "debugfl.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "event.h"
+#include "handoff.h"
+#include "metrics.h"
+#include "uart1.h"
+#include "ctrl.h"
+
+#define CTRL_SOCK	"/var/run/dreamflower_app.ctl"
+#define CTRL_LINE	512		//-一个请求最长
+#define CTRL_REPLY	1024		//-一个命令的回复最长
+#define CTRL_OUT_MAX	(64 * 1024)	//-对方不读,回复积到这么多就先不读新的请求
+#define CTRL_ID		32
+
+struct ctrl_conn {
+	struct ev_io io;
+	char in[CTRL_LINE];
+	int ilen;
+	int skip;			//-太长的一行,丢到换行为止
+	char *out;
+	int olen, off, osize;
+};
+
+const char *ctrl_path = CTRL_SOCK;
+
+static int ctrl_lfd = -1;
+static struct ev_io ctrl_io;
+static struct metric *m_requests = &metric_sink;
+static struct metric *m_errors = &metric_sink;
+
+static void ctrl_conn_close(struct ctrl_conn *c)
+{
+	ev_del(&c->io);
+	close(c->io.fd);
+	free(c->out);
+	free(c);
+}
+
+static int ctrl_out(struct ctrl_conn *c, const char *s, int n)
+{
+	char *np;
+	int size;
+
+	if (c->olen + n > c->osize) {
+		if (c->off > 0) {	//-已经写出去的先挪掉
+			memmove(c->out, c->out + c->off, c->olen - c->off);
+			c->olen -= c->off;
+			c->off = 0;
+		}
+		for (size = c->osize ? c->osize : 1024; size < c->olen + n; size *= 2)
+			;
+		if (size > c->osize) {
+			np = realloc(c->out, size);
+			if (np == NULL)
+				return -1;
+			c->out = np;
+			c->osize = size;
+		}
+	}
+	memcpy(c->out + c->olen, s, n);
+	c->olen += n;
+	return 0;
+}
+
+//-回复里的换行和反斜杠转义,一个回复保持一行
+static void ctrl_reply(struct ctrl_conn *c, const char *id, const char *status, const char *msg, int len)
+{
+	char line[CTRL_ID + 8 + CTRL_REPLY * 2 + 2];
+	int n, i;
+
+	n = snprintf(line, sizeof(line), "%s %s ", id, status);
+	for (i = 0; i < len; i++) {
+		if (msg[i] == '\n' || msg[i] == '\\') {
+			if (msg[i] == '\n' && i == len - 1)
+				break;	//-结尾的换行不要
+			line[n++] = '\\';
+			line[n++] = msg[i] == '\n' ? 'n' : '\\';
+		} else if (msg[i] != '\r')
+			line[n++] = msg[i];
+	}
+	line[n++] = '\n';
+	if (ctrl_out(c, line, n) != 0)
+		LOG(LOGM_MAIN, LOG_WARN, "ctrl fd %d: reply dropped", c->io.fd);
+}
+
+static void ctrl_request(struct ctrl_conn *c, char *line)
+{
+	char reply[CTRL_REPLY];
+	struct uart_capture cap = { reply, sizeof(reply), 0 };
+	char id[CTRL_ID];
+	char *frame;
+	int n;
+
+	n = strcspn(line, " \t");
+	if (n == 0 || n >= CTRL_ID) {
+		ctrl_reply(c, "-", "ERR", "bad id", 6);
+		metric_inc(m_errors);
+		return;
+	}
+	memcpy(id, line, n);
+	id[n] = 0;
+	frame = line + n + strspn(line + n, " \t");
+	n = strlen(frame);
+	while (n > 0 && (frame[n - 1] == ' ' || frame[n - 1] == '\r'))
+		frame[--n] = 0;
+	metric_inc(m_requests);
+	if (n < 6 || frame[0] != '$' || frame[n - 1] != '#') {
+		ctrl_reply(c, id, "ERR", "bad frame", 9);
+		metric_inc(m_errors);
+		return;
+	}
+	uart_capture = &cap;
+	n = uart_dispatch(UART_FD_CAPTURE, frame, n);
+	uart_capture = NULL;
+	if (n != 0) {
+		ctrl_reply(c, id, "ERR", "unknown command", 15);
+		metric_inc(m_errors);
+		return;
+	}
+	LOG(LOGM_MAIN, LOG_DBG, "ctrl fd %d: %s %s", c->io.fd, id, frame);
+	ctrl_reply(c, id, "OK", reply, cap.len);
+}
+
+//-能写多少写多少;还有没写完的就等EV_WRITE,积压太多就先不读
+static int ctrl_flush(struct ctrl_conn *c)
+{
+	int n;
+
+	while (c->off < c->olen) {
+		n = write(c->io.fd, c->out + c->off, c->olen - c->off);
+		if (n < 0 && errno == EAGAIN)
+			break;
+		if (n <= 0)
+			return -1;
+		c->off += n;
+	}
+	if (c->off == c->olen)
+		c->off = c->olen = 0;
+	if (c->olen == 0)
+		return ev_mod(&c->io, EV_READ);
+	return ev_mod(&c->io, c->olen - c->off > CTRL_OUT_MAX ? EV_WRITE : EV_READ | EV_WRITE);
+}
+
+static void ctrl_conn_cb(struct ev_io *io, unsigned int revents)
+{
+	struct ctrl_conn *c = io->arg;
+	char *nl, *p;
+	int n;
+
+	if ((revents & EV_WRITE) && ctrl_flush(c) != 0) {
+		ctrl_conn_close(c);
+		return;
+	}
+	if (!(revents & (EV_READ | EV_ERR)) || c->olen - c->off > CTRL_OUT_MAX)
+		return;
+	n = read(io->fd, c->in + c->ilen, sizeof(c->in) - 1 - c->ilen);
+	if (n < 0 && errno == EAGAIN)
+		return;
+	if (n <= 0) {
+		ctrl_flush(c);	//-对方关了,回复尽量写出去
+		ctrl_conn_close(c);
+		return;
+	}
+	c->ilen += n;
+	c->in[c->ilen] = 0;
+	for (p = c->in; (nl = strchr(p, '\n')) != NULL; p = nl + 1) {
+		*nl = 0;
+		if (c->skip)
+			c->skip = 0;
+		else if (*p)
+			ctrl_request(c, p);
+	}
+	c->ilen -= p - c->in;
+	memmove(c->in, p, c->ilen);
+	if (c->ilen >= (int)sizeof(c->in) - 1) {
+		LOG(LOGM_MAIN, LOG_WARN, "ctrl fd %d: request too long", io->fd);
+		ctrl_reply(c, "-", "ERR", "too long", 8);
+		metric_inc(m_errors);
+		c->ilen = 0;
+		c->skip = 1;
+	}
+	if (ctrl_flush(c) != 0)
+		ctrl_conn_close(c);
+}
+
+static void ctrl_accept_cb(struct ev_io *io, unsigned int revents)
+{
+	struct ctrl_conn *c;
+	struct ucred cred;
+	socklen_t clen = sizeof(cred);
+	int fd;
+
+	while ((fd = accept4(io->fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+		//-socket文件已经是0600,这里再查一次,防止路径所在目录的权限太松
+		if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &clen) != 0
+				|| (cred.uid != getuid() && cred.uid != 0)) {
+			LOG(LOGM_MAIN, LOG_WARN, "ctrl: refused peer uid %d", (int)cred.uid);
+			close(fd);
+			continue;
+		}
+		c = calloc(1, sizeof(*c));
+		if (c == NULL) {
+			close(fd);
+			continue;
+		}
+		ev_io_init(&c->io, fd, EV_READ, ctrl_conn_cb, c);
+		if (ev_add(&c->io) != 0) {
+			close(fd);
+			free(c);
+			continue;
+		}
+		LOG(LOGM_MAIN, LOG_DBG, "ctrl: pid %d connected, fd %d", (int)cred.pid, fd);
+	}
+}
+
+int ctrl_listen(void)
+{
+	struct sockaddr_un sa;
+	mode_t old;
+	int fd, r;
+
+	if (ctrl_path == NULL || ctrl_path[0] == 0)
+		return 0;
+	memset(&sa, 0, sizeof(sa));
+	sa.sun_family = AF_UNIX;
+	snprintf(sa.sun_path, sizeof(sa.sun_path), "%s", ctrl_path);
+	fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (fd < 0)
+		return -1;
+	unlink(ctrl_path);	//-上次没有删掉的,或者热重启时老进程的
+	old = umask(0177);	//-bind创建的文件直接是0600,没有chmod之前的空档
+	r = bind(fd, (struct sockaddr *)&sa, sizeof(sa));
+	umask(old);
+	if (r != 0 || listen(fd, 8) != 0) {
+		LOG(LOGM_MAIN, LOG_WARN, "ctrl %s: %s", ctrl_path, strerror(errno));
+		close(fd);
+		return -1;
+	}
+	if (m_requests == &metric_sink) {
+		m_requests = metric_counter("ctrl_requests_total", "commands received on the control socket");
+		m_errors = metric_counter("ctrl_errors_total", "control socket requests answered with ERR");
+	}
+	ctrl_lfd = fd;
+	ev_io_init(&ctrl_io, fd, EV_READ, ctrl_accept_cb, NULL);
+	return ev_add(&ctrl_io);
+}
+
+//-热重启交接出去以后,路径已经是新进程的了,不要删
+void ctrl_close(void)
+{
+	if (ctrl_lfd < 0)
+		return;
+	ev_del(&ctrl_io);
+	close(ctrl_lfd);
+	ctrl_lfd = -1;
+	if (!handoff_done)
+		unlink(ctrl_path);
+}
@@ -0,0 +1,19 @@
+//-为了方便调试定义了系列变量以便调试输出
+
+#ifndef CTRL_H
+#define CTRL_H
+
+/*
+本地控制socket:不接串口也能发串口命令,和串口走同一个命令表(uart_dispatch).
+一行一个请求,可以连续发不用等回复,回复按请求的顺序,带上请求的编号:
+  请求  <id> $<4位命令码><参数>#
+  回复  <id> OK <命令回复>	回复里的换行写成\n,反斜杠写成\\
+        <id> ERR <原因>
+*/
+
+extern const char *ctrl_path;		//--C Unix socket路径,空串表示不开
+
+int  ctrl_listen(void);
+void ctrl_close(void);
+
+#endif /* CTRL_H */
@@ -4,10 +4,16 @@
 #define DEBUGFL_H
 
 #include <stdio.h>
+#include "log.h"
+
+//-DEBUG()写到日志里,在include之前定义LOG_MODULE可以归到自己的模块
+#if !defined(LOG_MODULE)
+#define LOG_MODULE	LOGM_MAIN
+#endif
 
 #if 1
-#define DEBUG(...) do{ fprintf(stderr, "<debugfl> ");printf(__VA_ARGS__);} while(0)
-#define API() fprintf(stderr, "<debugfl> api: %s.\n", __FUNCTION__)
+#define DEBUG(...) LOG(LOG_MODULE, LOG_DBG, __VA_ARGS__)
+#define API() LOG(LOG_MODULE, LOG_DBG, "api: %s.", __FUNCTION__)
 #else
 #define DEBUG(...)
 #define API()
@@ -0,0 +1,52 @@
+//-为了方便调试定义了系列变量以便调试输出
+
+#ifndef DNS_H
+#define DNS_H
+
+#include <stdint.h>
+
+/*
+DNS解码:抓包线程里直接在报文上解析(UDP 53端口),不复制;名字支持压缩指针,
+指针只能往前指,最多跳DNS_MAX_JUMPS次,坏报文不会死循环也不会读出界.
+查询进一个固定大小的表(DNS_SLOTS槽,开放寻址),按 服务器,客户端地址端口,事务号 找回复,
+名字的哈希也要对上(报文被截短看不到名字时不比),配上了就得到这次解析用了多久和rcode:
+	-v 3打开时每个查询一条调试日志
+	dns_latency_us直方图,各rcode的计数
+	每个服务器DNS_WINDOW秒一个窗口,最近一到两个窗口的p50/p99,控制命令$0010#查
+DNS_TIMEOUT秒没有回复的算丢了.只看UDP,TCP上的DNS(很少)不管.
+-W只留96字节时长名字和回复的内容看不全,事务号和rcode总是有的.
+*/
+#define DNS_PORT		53
+#define DNS_SLOTS		2048		//-必须是2的幂
+#define DNS_MAX			(DNS_SLOTS * 3 / 4)
+#define DNS_TIMEOUT		5
+#define DNS_MAX_JUMPS		16
+#define DNS_SERVERS		16
+#define DNS_WINDOW		60
+#define DNS_BUCKETS		184		//-2^24 us以内,每个2倍分8格,误差6%以内
+
+struct dns_server_stats {
+	uint8_t ip[16];
+	uint8_t ver;
+	uint32_t queries;
+	uint32_t answers;
+	uint32_t nxdomain;
+	uint32_t servfail;		//-SERVFAIL和REFUSED
+	uint32_t timeouts;
+	uint32_t p50_us;		//-最近一到两个窗口,没有回复时是0
+	uint32_t p99_us;
+	uint32_t samples;		//-p50/p99是从多少个回复算的
+};
+
+struct pcap_pkthdr;
+
+int  dns_name(const uint8_t *msg, int len, int off, char *out, int size);	//-返回名字后面的位置,坏名字返回-1;out可以是NULL
+void dns_open(void);
+int  dns_packet(int linktype, const struct pcap_pkthdr *h, const unsigned char *data);	//-是DNS报文返回1
+void dns_tick(uint32_t now);		//-每秒一次:超时,换窗口
+int  dns_servers(struct dns_server_stats *out, int max);	//-返回服务器个数,按查询数从多到少
+int  dns_server_str(const struct dns_server_stats *s, char *buf, int size);
+void dns_stats(void);
+void dns_Bench(void);
+
+#endif /* DNS_H */
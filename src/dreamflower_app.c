@@ -42,6 +42,22 @@ static const char __rcsid[] =
 #include "fdebug.h"
 #include "calendar.h"
 #include "tcpdump.h"
+#include "thread.h"
+#include "event.h"
+#include "timer.h"
+#include "rtsched.h"
+#include "trace.h"
+#include "log.h"
+#include "handoff.h"
+#include "gpio.h"
+#include "led.h"
+#include "metrics.h"
+#include "ctrl.h"
+#include "fbuf.h"
+#include "modbus.h"
+#include "capseg.h"
+#include "sample.h"
+#include "neigh.h"
 
 
 /* functions */
@@ -179,6 +195,14 @@ extern volatile sig_atomic_t _running;
 ///////////////////////////////////////////////////////////////////////////////
 char		run_flag	= 0;	//-0表示正常运行		1表示进入调试模式,在终端的监控下运行
 char		test_branch	= 0;	//-0
+int		pool_workers	= 0;	//-线程池工作线程个数,0表示按CPU个数
+int		bench_threads	= 0;	//--X 测试的最大线程数,0表示按CPU个数
+long		bench_iters	= 0;	//--X 测试每个线程的操作次数,-T 每轮的次数
+const char	*bench_filter	= NULL;	//--T 只跑名字里有这个字符串的测试
+const char	*log_file	= NULL;	//-日志文件,NULL表示调试模式写到标准错误,守护进程写到LOG_DAEMON_FILE
+char		hot_restart	= 0;	//--H 从正在运行的老进程接手串口和状态
+const char	*gpio_args	= NULL;	//--G GPIO测试的参数,见gpio.c的usage()
+int		status_led	= -1;	//--E 运行灯的引脚,-1表示不用
 
 
 
@@ -211,6 +235,30 @@ sighandler(int sig)
 	scrunning = 0;
 }
 
+static void
+trace_sighandler(int sig)
+{
+	trace_request_dump();	//-只设置标志,文件在主循环里写
+}
+
+static long
+log_dropped_metric(void)
+{
+	return log_dropped;
+}
+
+static void
+app_stats(int sig)
+{
+	uart_1_Stats();
+	sniffer_stats();
+	gpio_stats();
+	ev_stats();
+	modbus_stats();
+	LOG(LOGM_MAIN, LOG_INFO, "pool: %d workers, %d pending; log: %lu dropped; up %.0f ms",
+	    tp_workers(), tp_pending(), log_dropped, daemon_since_start_ms());
+}
+
 
 static speed_t
 parsespeed(char *speed)
@@ -575,7 +623,10 @@ int
 main(int argc,char *argv[])
 {
 	int fd_uart1;
+	char uart_state[HANDOFF_DATA];
+	int uart_state_len = -1;
 	
+  daemon_mark_start();	//-启动时间和第一帧的时间从这里开始算
   printf("Hello World!\n");
   
   //-首先对接收到的命令进行解析,然后根据命令进行程序运行.
@@ -597,9 +648,27 @@ main(int argc,char *argv[])
 	{//-下面进入正常模式,就是使用守护进程,脱离终端控制
 		daemon_init();
 	}
+	else if (daemon_foreground() != 0)
+		goto close;
+	//-fork之后才能启动日志的写线程;守护进程已经关掉了标准错误
+	log_open(log_file ? log_file : (run_flag ? NULL : LOG_DAEMON_FILE));
+	log_start();
+	//-守护进程fork之后才能创建线程
+	if (tp_init(pool_workers) != 0)
+		printf("thread pool init failed, running single threaded\n");
+	//-事件循环和定时器:主循环只在这里等待,不在某个read或者sleep上阻塞
+	if (ev_init() != 0 || timer_init() != 0)
+		goto close;
+	daemon_signal_watch();	//-信号也是事件循环里的一个fd
 	
 	//-开始的测试代码可以从这里开始
-  fd_uart1 = uart1_sub(argc-1, &argv[1]);	//-测试串口功能
+  //-getopt会把选项排到前面,串口设备和模式从optind开始,argv[optind-1]当作程序名
+  //-热重启:串口已经由老进程打开设置好了,直接接过来,不再tcflush
+  fd_uart1 = -1;
+  if (hot_restart && handoff_receive() == 0)
+  	uart_state_len = handoff_find("uart1", &fd_uart1, uart_state, sizeof(uart_state));
+  if (fd_uart1 < 0)
+  	fd_uart1 = uart1_sub(argc-optind+1, &argv[optind-1]);	//-测试串口功能
 
   if(test_branch == 2)
 	calendar_sub(argc-1, &argv[1]);	//-临时测试用,实现读取时间/执行时间功能
@@ -607,20 +676,69 @@ main(int argc,char *argv[])
     sniffer_sub(argc-1, &argv[1]);	//-临时测试用,实现网络报文的抓取和过滤
   else if(test_branch == 4)
     thread_sub(argc-1, &argv[1]);	//-临时测试用,实现多线程的功能
+  else if(test_branch == 5)
+    gpio_sub(gpio_args);	//-GPIO读写和输入边沿事件
 
   
   char buf[100] = {'0'}; 
   sprintf(buf, "%d", fd_uart1);
   f_debug(buf);
 
+  if(fd_uart1 >= 0)
+  {
+  	uart_1_Open(fd_uart1);	//-串口收到的帧在事件回调里处理
+  	if (uart_state_len > 0)
+  		uart_1_Restore(uart_state, uart_state_len);	//-接着拼老进程没拼完的帧
+  }
+  if (hot_restart && daemon_lock_pidfile() != 0)
+  	goto close;
+  handoff_listen();	//-以后可以再用-H热重启这个进程
+  metric_func("log_dropped_total", "log records dropped because the queue was full", METRIC_COUNTER, log_dropped_metric);
+  metrics_listen();	//-各模块的计数器从-M的Unix socket读
+  ctrl_listen();	//--C的Unix socket可以发和串口一样的命令
+  if (modbus_start() != 0)	//--Q 每条Modbus总线一个线程轮询
+  	LOG(LOGM_MAIN, LOG_WARN, "modbus: not all buses started");
+
+  rt_apply(RT_SERIAL);	//-其他线程都已经创建,主线程最后设置自己的CPU和优先级
+  trace_thread_name("serial");
+  daemon_on_signal(SIGUSR1, app_stats);	//-kill -USR1 把各模块的计数写到日志
+  if(trace_enabled)
+  	daemon_on_signal(SIGUSR2, trace_sighandler);	//-kill -USR2 随时导出一次时间线
+
+  daemon_ready();	//-通知父进程和-N,记录启动用时
+  if(status_led >= 0 && gpio_open(gpio_spec) == 0)
+  	led_named(status_led, "slow");	//-运行灯慢闪表示在正常运行
+
   //-下面进入程序的主循环部分
   while(_running)	//-程序一但运行起来就有周期执行的地方.
   {
-  	
-  	if(fd_uart1 >= 0)
-  		uart_1_Main(fd_uart1);
-  	
+  	if(ev_run_once(-1) < 0)
+  		break;
+  	trace_poll();
+  }
+  //-SIGTERM以后:串口里已经到了的数据在期限内处理完,交接出去的fd已经不归这个进程了
+  if(!handoff_done)
+  {
+  	while(daemon_drain_left() > 0 && ev_run_once(0) > 0)
+  		;
+  	//-io_uring写的完成不算事件,上面的循环停下时回复可能还排着队或者还没提交
+  	if(ev_flush_tmo(daemon_drain_left()) < 0)
+  		LOG(LOGM_MAIN, LOG_WARN, "drain deadline %d ms passed, serial replies not all written", daemon_drain_ms);
   }
+  sniffer_stop();
+  modbus_stop();
+  if(tp_drain(daemon_drain_left()) > 0)
+  	LOG(LOGM_MAIN, LOG_WARN, "drain deadline %d ms passed, %d tasks left", daemon_drain_ms, tp_pending());
+  tp_shutdown();	//-把已经提交的任务执行完再退出
+  ctrl_close();
+  uart_1_Close();
+  metrics_close();
+  led_close();
+  gpio_close();
+  trace_dump();
+  daemon_exit();
+  ev_close();
+  log_stop();	//-最后把日志队列写完
   
 close:  
   return 0;
@@ -634,7 +752,7 @@ int parse_options(int argc, char *argv[])
 	int c;
 	char *pLen;
 
-	while ((c = getopt(argc, argv, "a:b:DTSX")) != -1) 
+	while ((c = getopt(argc, argv, "a:b:DTSXw:j:n:t:P:LK:l:v:m:Bp:N:Hc:g:G:E:M:C:R:F:UQ:W:s:A:")) != -1) 
 	{
 		switch(c) 
 		{
@@ -659,6 +777,93 @@ int parse_options(int argc, char *argv[])
 			case 'X':
 				test_branch = 4;				
 				break;
+			case 'w':
+				pool_workers = atoi(optarg);
+				break;
+			case 'j':
+				bench_threads = atoi(optarg);
+				break;
+			case 'n':
+				bench_iters = atol(optarg);
+				break;
+			case 't':
+				bench_filter = optarg;
+				break;
+			case 'P':
+				if (rt_parse(optarg) != 0)
+					return 1;
+				break;
+			case 'L':
+				rt_set_mlock(1);
+				break;
+			case 'K':
+				trace_open(optarg);	//-打开时间线跟踪,导出到这个文件
+				break;
+			case 'l':
+				log_file = optarg;
+				break;
+			case 'v':
+				log_level = atoi(optarg);	//-0错误 1警告 2信息 3调试
+				break;
+			case 'm':
+				log_mask = strtoul(optarg, NULL, 0);	//-按位打开模块,见log.h里的LOGM_*
+				break;
+			case 'B':
+				log_binary = 1;	//-日志写二进制,用dflogdump查看
+				break;
+			case 'p':
+				daemon_pidfile = optarg;
+				break;
+			case 'N':
+				daemon_notify_fd = atoi(optarg);	//-准备好以后往这个fd写READY=1
+				break;
+			case 'H':
+				hot_restart = 1;
+				daemon_pidfile_late = 1;	//-pidfile等老进程交接完退出以后再锁
+				break;
+			case 'c':
+				daemon_conf = optarg;	//-SIGHUP时重新读
+				break;
+			case 'g':
+				gpio_spec = optarg;	//-ralink chip[:/dev/gpiochipN] mock
+				break;
+			case 'G':
+				test_branch = 5;
+				gpio_args = optarg;
+				break;
+			case 'E':
+				status_led = atoi(optarg);
+				break;
+			case 'M':
+				metrics_path = optarg;	//-空串不开
+				break;
+			case 'C':
+				ctrl_path = optarg;	//-空串不开
+				break;
+			case 'R':
+				uart_frames_shm = optarg;	//-空串不发布
+				break;
+			case 'F':
+				if (fbuf_parse(optarg) != 0)	//-一帧最长多少字节,FBUF_MIN到FBUF_LIMIT
+					return 1;
+				break;
+			case 'U':
+				ev_uring = 1;	//-内核不支持时ev_init退回epoll
+				break;
+			case 'Q':
+				modbus_conf = optarg;	//-配置文件的格式见modbus.h
+				break;
+			case 'W':
+				if (capseg_parse(optarg) != 0)	//-抓包写压缩段,见capseg.h
+					return 1;
+				break;
+			case 's':
+				if (sample_parse(optarg) != 0)	//-抓包抽样和过载降级,见sample.h
+					return 1;
+				break;
+			case 'A':
+				neigh_age = atoi(optarg);	//-邻居表多少秒没见就删,0不删
+				break;
 				
 			case 'h':
 				usage();
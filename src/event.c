@@ -0,0 +1,897 @@
+/*
+此文件是主循环用的事件循环,所有需要等待的fd(串口,定时器...)都注册到这里,
+主循环只在epoll_wait里睡眠,不再在某一个read或者sleep上阻塞整个程序.
+回调都在主线程里执行,回调里面不能阻塞.
+-U时换成io_uring:一次io_uring_enter提交这一轮所有的poll,读和写,再等下一批完成,
+网关上几个串口一起收发时系统调用的次数是开销的大头.没有直接用liburing,
+设备上的工具链里没有,只用内核头文件和三个系统调用.
+*/
+
+#include "debugfl.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <sys/syscall.h>
+
+#include "event.h"
+
+#if defined(__has_include)
+#if __has_include(<linux/io_uring.h>) && defined(__NR_io_uring_setup)
+#include <linux/io_uring.h>
+#define EV_URING	1
+#endif
+#endif
+
+#define EV_MAX_EVENTS	32
+
+#if defined(EV_URING) && !defined(IORING_FEAT_RW_CUR_POS)
+#define IORING_FEAT_RW_CUR_POS	(1U << 3)
+#endif
+
+int ev_uring = 0;
+
+static int epfd = -1;
+static __thread int ev_owner;		//-只有调用ev_init的线程(主线程)可以用排队的写
+static unsigned long ev_waits, ev_wakeups;
+
+static unsigned int ev_to_epoll(unsigned int events)
+{
+	unsigned int e = 0;
+
+	if (events & EV_READ)
+		e |= EPOLLIN;
+	if (events & EV_WRITE)
+		e |= EPOLLOUT;
+	if (events & EV_PRI)
+		e |= EPOLLPRI;
+	return e;
+}
+
+#ifdef EV_URING
+/*
+io_uring后端.每个注册的ev_io占一个槽,提交的请求的user_data里带着槽号和槽的代数,
+ev_del以后代数加1,之后才到的完成就认不出来了,丢掉,已经释放的ev_io不会被用到.
+槽里还有没完成的请求时不会分给别的ev_io.
+poll都是一次性的,回调完了再挂上,和epoll的水平触发一样:没读完下一轮还会通知.
+ev_io_read的io提交的是poll后面链着一个读,数据直接读到登记过的缓冲里.
+写按fd排队:一个fd同时只有一个写在内核里,后来的写先拼到下一个缓冲里,保证顺序.
+*/
+#define EV_URING_ENTRIES	128
+#define EV_SLOTS		64
+#define EV_BUF_SIZE		4096
+#define EV_RBUFS		4		//-ev_io_read的io最多这么多个
+#define EV_WBUFS		12
+#define EV_WQS			8		//-同时在写的fd最多这么多个
+#define EV_DEFER		(EV_SLOTS * 2 + 8)
+
+enum {
+	EVK_POLL = 1,
+	EVK_RPOLL,		//-读前面的poll
+	EVK_READ,
+	EVK_WRITE,
+	EVK_WPOLL,		//-写满了(EAGAIN),等可写再写
+	EVK_OTHER,		//-超时,取消,不用处理
+};
+#define EV_UD(kind, idx, gen)	((uint64_t)(gen) << 32 | (uint64_t)(idx) << 8 | (kind))
+#define EV_UD_KIND(ud)		((int)((ud) & 0xff))
+#define EV_UD_IDX(ud)		((int)(((ud) >> 8) & 0xffffff))
+#define EV_UD_GEN(ud)		((uint32_t)((ud) >> 32))
+
+struct ev_slot {
+	struct ev_io *io;		//-NULL:没有用(pending也是0时可以分配)
+	uint32_t gen;
+	int pending;			//-还没有完成的poll/读
+	int armed;
+	int rbuf;			//-登记的读缓冲,-1表示不是ev_io_read
+};
+
+struct ev_wq {
+	int fd;				//--1:没有用
+	int buf, off, len;		//-在内核里的写
+	int next, nlen;			//-排着队的
+	uint32_t gen;
+};
+
+static struct {
+	int fd;
+	unsigned int features;
+	unsigned int entries;
+	unsigned int *sq_head, *sq_tail, *sq_mask, *sq_array;
+	unsigned int *cq_head, *cq_tail, *cq_mask;
+	struct io_uring_sqe *sqes;
+	struct io_uring_cqe *cqes;
+	void *sq_ring, *cq_ring;
+	size_t sq_size, cq_size, sqes_size;
+	unsigned int tail;		//-已经填好还没有告诉内核的sqe
+	int fixed;			//-缓冲登记成功了,用READ_FIXED/WRITE_FIXED
+	char *bufs;
+	struct iovec iov[EV_RBUFS + EV_WBUFS];
+	struct iovec wiov[EV_WBUFS];	//-不能用FIXED时WRITEV的参数
+	unsigned int rfree, wfree;	//-空闲缓冲的位图
+	struct ev_slot slot[EV_SLOTS];
+	struct ev_wq wq[EV_WQS];
+	struct io_uring_cqe defer[EV_DEFER];
+	int ndefer;
+	unsigned long sqes_total, writes, write_errs;
+} ur = { .fd = -1 };
+
+static int ur_setup(unsigned int entries, struct io_uring_params *p)
+{
+	return syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int ur_enter(unsigned int submit, unsigned int wait, unsigned int flags, void *arg, size_t argsz)
+{
+	return syscall(__NR_io_uring_enter, ur.fd, submit, wait, flags, arg, argsz);
+}
+
+static void ur_unmap(void)
+{
+	if (ur.sqes != NULL && ur.sqes != MAP_FAILED)
+		munmap(ur.sqes, ur.sqes_size);
+	if (ur.cq_ring != NULL && ur.cq_ring != MAP_FAILED && ur.cq_ring != ur.sq_ring)
+		munmap(ur.cq_ring, ur.cq_size);
+	if (ur.sq_ring != NULL && ur.sq_ring != MAP_FAILED)
+		munmap(ur.sq_ring, ur.sq_size);
+	ur.sqes = NULL;
+	ur.sq_ring = ur.cq_ring = NULL;
+}
+
+static int ur_init(void)
+{
+	struct io_uring_params p;
+	char *sq, *cq;
+	int i;
+
+	static const unsigned int setup_flags[] = {
+#if defined(IORING_SETUP_SINGLE_ISSUER) && defined(IORING_SETUP_DEFER_TASKRUN)
+		IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_DEFER_TASKRUN,	//-6.1:完成只在等待时处理,不打断主线程
+#endif
+#ifdef IORING_SETUP_COOP_TASKRUN
+		IORING_SETUP_COOP_TASKRUN,
+#endif
+		0,
+	};
+	unsigned int f;
+
+	//-新内核上的选项老内核不认识(EINVAL),一个一个退
+	for (f = 0; f < sizeof(setup_flags) / sizeof(setup_flags[0]); f++) {
+		memset(&p, 0, sizeof(p));
+		p.flags = setup_flags[f];
+		ur.fd = ur_setup(EV_URING_ENTRIES, &p);
+		if (ur.fd >= 0 || errno != EINVAL)
+			break;
+	}
+	if (ur.fd < 0)
+		return -1;
+	ur.features = p.features;
+	ur.entries = p.sq_entries;
+	ur.sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned int);
+	ur.cq_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+	if (p.features & IORING_FEAT_SINGLE_MMAP) {
+		if (ur.cq_size > ur.sq_size)
+			ur.sq_size = ur.cq_size;
+		ur.cq_size = ur.sq_size;
+	}
+	ur.sq_ring = mmap(NULL, ur.sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ur.fd, IORING_OFF_SQ_RING);
+	if (ur.sq_ring == MAP_FAILED)
+		goto fail;
+	if (p.features & IORING_FEAT_SINGLE_MMAP)
+		ur.cq_ring = ur.sq_ring;
+	else
+		ur.cq_ring = mmap(NULL, ur.cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ur.fd, IORING_OFF_CQ_RING);
+	ur.sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+	ur.sqes = mmap(NULL, ur.sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ur.fd, IORING_OFF_SQES);
+	if (ur.cq_ring == MAP_FAILED || ur.sqes == MAP_FAILED)
+		goto fail;
+	sq = ur.sq_ring;
+	cq = ur.cq_ring;
+	ur.sq_head = (unsigned int *)(sq + p.sq_off.head);
+	ur.sq_tail = (unsigned int *)(sq + p.sq_off.tail);
+	ur.sq_mask = (unsigned int *)(sq + p.sq_off.ring_mask);
+	ur.sq_array = (unsigned int *)(sq + p.sq_off.array);
+	ur.cq_head = (unsigned int *)(cq + p.cq_off.head);
+	ur.cq_tail = (unsigned int *)(cq + p.cq_off.tail);
+	ur.cq_mask = (unsigned int *)(cq + p.cq_off.ring_mask);
+	ur.cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+	ur.tail = *ur.sq_tail;
+
+	//-读写缓冲登记一次,以后每次读写内核不用再去找用户页;登记不了(内存锁定的限制)就用普通的读写
+	ur.bufs = mmap(NULL, (EV_RBUFS + EV_WBUFS) * EV_BUF_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (ur.bufs == MAP_FAILED)
+		goto fail;
+	for (i = 0; i < EV_RBUFS + EV_WBUFS; i++) {
+		ur.iov[i].iov_base = ur.bufs + i * EV_BUF_SIZE;
+		ur.iov[i].iov_len = EV_BUF_SIZE;
+	}
+	ur.fixed = syscall(__NR_io_uring_register, ur.fd, IORING_REGISTER_BUFFERS, ur.iov, EV_RBUFS + EV_WBUFS) == 0;
+	ur.rfree = (1u << EV_RBUFS) - 1;
+	ur.wfree = (1u << EV_WBUFS) - 1;
+	for (i = 0; i < EV_SLOTS; i++)
+		ur.slot[i].rbuf = -1;
+	for (i = 0; i < EV_WQS; i++) {
+		ur.wq[i].fd = -1;
+		ur.wq[i].buf = ur.wq[i].next = -1;
+	}
+	return 0;
+fail:
+	ur_unmap();
+	if (ur.bufs != NULL && ur.bufs != MAP_FAILED)
+		munmap(ur.bufs, (EV_RBUFS + EV_WBUFS) * EV_BUF_SIZE);
+	ur.bufs = NULL;
+	close(ur.fd);
+	ur.fd = -1;
+	return -1;
+}
+
+static int ur_submit(unsigned int wait, int timeout_ms);
+
+//-拿一个空的sqe,满了先提交
+static struct io_uring_sqe *ur_sqe(void)
+{
+	struct io_uring_sqe *sqe;
+	unsigned int idx;
+
+	if (ur.tail - __atomic_load_n(ur.sq_head, __ATOMIC_ACQUIRE) >= ur.entries)
+		ur_submit(0, 0);
+	idx = ur.tail & *ur.sq_mask;
+	sqe = &ur.sqes[idx];
+	memset(sqe, 0, sizeof(*sqe));
+	ur.sq_array[idx] = idx;
+	ur.tail++;
+	ur.sqes_total++;
+	return sqe;
+}
+
+//-把填好的sqe交给内核,wait>0时顺便等完成;timeout_ms<0一直等
+static int ur_submit(unsigned int wait, int timeout_ms)
+{
+#ifdef IORING_FEAT_EXT_ARG
+	struct io_uring_getevents_arg arg;
+#endif
+	struct __kernel_timespec ts;
+	struct io_uring_sqe *sqe;
+	unsigned int submit, flags = wait ? IORING_ENTER_GETEVENTS : 0;
+	int ret;
+
+	if (wait && timeout_ms >= 0) {
+		ts.tv_sec = timeout_ms / 1000;
+		ts.tv_nsec = (timeout_ms % 1000) * 1000000L;
+#ifdef IORING_FEAT_EXT_ARG
+		if (!(ur.features & IORING_FEAT_EXT_ARG))
+#endif
+		{	//-老内核:超时也是一个请求
+			sqe = ur_sqe();
+			sqe->opcode = IORING_OP_TIMEOUT;
+			sqe->addr = (unsigned long)&ts;
+			sqe->len = 1;
+			sqe->user_data = EV_UD(EVK_OTHER, 0, 0);
+		}
+	}
+	submit = ur.tail - *ur.sq_tail;
+	__atomic_store_n(ur.sq_tail, ur.tail, __ATOMIC_RELEASE);
+	if (submit == 0 && wait == 0)
+		return 0;
+#ifdef IORING_FEAT_EXT_ARG
+	if (wait && timeout_ms >= 0 && (ur.features & IORING_FEAT_EXT_ARG)) {
+		memset(&arg, 0, sizeof(arg));
+		arg.ts = (unsigned long)&ts;
+		ret = ur_enter(submit, wait, flags | IORING_ENTER_EXT_ARG, &arg, sizeof(arg));
+	} else
+#endif
+		ret = ur_enter(submit, wait, flags, NULL, 0);
+	if (wait)
+		ev_waits++;
+	if (ret < 0 && errno != EINTR && errno != ETIME && errno != EBUSY)
+		perror("io_uring_enter");
+	return ret;
+}
+
+static void ur_prep_rw(struct io_uring_sqe *sqe, int write, int fd, int buf, int off, int len)
+{
+	sqe->fd = fd;
+	sqe->off = (ur.features & IORING_FEAT_RW_CUR_POS) ? (uint64_t)-1 : 0;	//-tty,socket没有位置;普通文件接着当前位置
+	if (ur.fixed) {
+		sqe->opcode = write ? IORING_OP_WRITE_FIXED : IORING_OP_READ_FIXED;
+		sqe->addr = (unsigned long)ur.iov[buf].iov_base + off;
+		sqe->len = len;
+		sqe->buf_index = buf;
+	} else {
+		sqe->opcode = write ? IORING_OP_WRITEV : IORING_OP_READV;
+		if (write) {	//-一个写缓冲同时只有一个写在内核里
+			ur.wiov[buf - EV_RBUFS].iov_base = (char *)ur.iov[buf].iov_base + off;
+			ur.wiov[buf - EV_RBUFS].iov_len = len;
+			sqe->addr = (unsigned long)&ur.wiov[buf - EV_RBUFS];
+		} else
+			sqe->addr = (unsigned long)&ur.iov[buf];
+		sqe->len = 1;
+	}
+}
+
+static unsigned short ur_poll_mask(unsigned int events)
+{
+	unsigned short m = 0;
+
+	if (events & EV_READ)
+		m |= POLLIN;
+	if (events & EV_WRITE)
+		m |= POLLOUT;
+	if (events & EV_PRI)
+		m |= POLLPRI;
+	return m;
+}
+
+static void ur_arm(int idx)
+{
+	struct ev_slot *s = &ur.slot[idx];
+	struct ev_io *io = s->io;
+	struct io_uring_sqe *sqe;
+
+	if (io->events == 0)
+		return;
+	sqe = ur_sqe();
+	sqe->opcode = IORING_OP_POLL_ADD;
+	sqe->fd = io->fd;
+	if (s->rbuf >= 0) {
+		sqe->poll_events = POLLIN;
+		sqe->flags = IOSQE_IO_LINK;	//-poll成功了才读,不会读到EAGAIN
+		sqe->user_data = EV_UD(EVK_RPOLL, idx, s->gen);
+		sqe = ur_sqe();
+		ur_prep_rw(sqe, 0, io->fd, s->rbuf, 0, io->rsize < EV_BUF_SIZE ? io->rsize : EV_BUF_SIZE);
+		sqe->user_data = EV_UD(EVK_READ, idx, s->gen);
+		s->pending += 2;
+	} else {
+		sqe->poll_events = ur_poll_mask(io->events);
+		sqe->user_data = EV_UD(EVK_POLL, idx, s->gen);
+		s->pending++;
+	}
+	s->armed = 1;
+}
+
+static void ur_disarm(int idx)
+{
+	struct ev_slot *s = &ur.slot[idx];
+	struct io_uring_sqe *sqe;
+
+	if (!s->armed)
+		return;
+	sqe = ur_sqe();
+	sqe->opcode = IORING_OP_POLL_REMOVE;
+	sqe->addr = EV_UD(s->rbuf >= 0 ? EVK_RPOLL : EVK_POLL, idx, s->gen);
+	sqe->user_data = EV_UD(EVK_OTHER, 0, 0);
+	s->armed = 0;
+	s->gen++;
+}
+
+static void ur_slot_release(struct ev_slot *s)
+{
+	if (s->io != NULL || s->pending > 0 || s->rbuf < 0)
+		return;
+	ur.rfree |= 1u << s->rbuf;
+	s->rbuf = -1;
+}
+
+//-------------------------------- 写 --------------------------------
+static void ur_wq_start(int w)
+{
+	struct ev_wq *q = &ur.wq[w];
+	struct io_uring_sqe *sqe;
+
+	if (q->buf < 0 && q->next >= 0) {
+		q->buf = q->next;
+		q->off = 0;
+		q->len = q->nlen;
+		q->next = -1;
+		q->nlen = 0;
+	}
+	if (q->buf < 0) {
+		q->fd = -1;	//-这个fd都写完了
+		return;
+	}
+	sqe = ur_sqe();
+	ur_prep_rw(sqe, 1, q->fd, q->buf, q->off, q->len - q->off);
+	sqe->user_data = EV_UD(EVK_WRITE, w, q->gen);
+	ur.writes++;
+}
+
+static void ur_write_done(int w, int res, int kind)
+{
+	struct ev_wq *q = &ur.wq[w];
+	struct io_uring_sqe *sqe;
+
+	if (kind == EVK_WPOLL) {	//-可以写了,接着写
+		ur_wq_start(w);
+		return;
+	}
+	if (res == -EAGAIN) {	//-非阻塞的串口,发送缓冲满了:等可写
+		sqe = ur_sqe();
+		sqe->opcode = IORING_OP_POLL_ADD;
+		sqe->fd = q->fd;
+		sqe->poll_events = POLLOUT;
+		sqe->user_data = EV_UD(EVK_WPOLL, w, q->gen);
+		return;
+	}
+	if (res > 0)
+		q->off += res;
+	if (res <= 0) {
+		ur.write_errs++;
+		LOG(LOGM_MAIN, LOG_WARN, "write fd %d: %s, %d bytes dropped", q->fd, strerror(res < 0 ? -res : EIO), q->len - q->off);
+		q->off = q->len;
+	}
+	if (q->off < q->len) {	//-只写了一部分,剩下的接着写
+		ur_wq_start(w);
+		return;
+	}
+	ur.wfree |= 1u << (q->buf - EV_RBUFS);
+	q->buf = -1;
+	ur_wq_start(w);
+}
+
+//-------------------------------- 完成 --------------------------------
+static unsigned int ur_revents(int res)
+{
+	unsigned int r = 0;
+
+	if (res < 0)
+		return EV_ERR;
+	if (res & POLLIN)
+		r |= EV_READ;
+	if (res & POLLOUT)
+		r |= EV_WRITE;
+	if (res & POLLPRI)
+		r |= EV_PRI;
+	if (res & (POLLERR | POLLHUP | POLLNVAL))
+		r |= EV_ERR;
+	return r;
+}
+
+//-处理一个完成,调用了回调返回1
+static int ur_complete(uint64_t ud, int res)
+{
+	int kind = EV_UD_KIND(ud), idx = EV_UD_IDX(ud);
+	struct ev_slot *s;
+	struct ev_io *io;
+	unsigned int revents;
+
+	if (kind == EVK_WRITE || kind == EVK_WPOLL) {
+		if (idx < EV_WQS && ur.wq[idx].fd >= 0 && ur.wq[idx].gen == EV_UD_GEN(ud))
+			ur_write_done(idx, res, kind);
+		return 0;
+	}
+	if (kind != EVK_POLL && kind != EVK_RPOLL && kind != EVK_READ)
+		return 0;
+	s = &ur.slot[idx];
+	s->pending--;
+	if (s->io == NULL || s->gen != EV_UD_GEN(ud)) {	//-已经删掉了
+		ur_slot_release(s);
+		return 0;
+	}
+	io = s->io;
+	if (kind == EVK_RPOLL) {
+		if (res < 0 && res != -ECANCELED)
+			io->rlen = -1;	//-链着的读会被取消,在读的完成里报错
+		return 0;
+	}
+	s->armed = 0;
+	if (kind == EVK_READ) {
+		if (res == -EAGAIN || (res == -ECANCELED && io->rlen >= 0)) {
+			ur_arm(idx);	//-poll以后又没有数据了
+			return 0;
+		}
+		io->rbuf = ur.iov[s->rbuf].iov_base;
+		io->rlen = res >= 0 ? res : -1;
+		revents = res > 0 ? EV_READ : EV_READ | EV_ERR;
+	} else {
+		if (res == -ECANCELED)
+			return 0;
+		revents = ur_revents(res);
+	}
+	io->cb(io, revents);
+	//-回调里可能删掉了或者改了事件;没有删就重新挂上
+	if (s->io == io && s->gen == EV_UD_GEN(ud) && !s->armed) {
+		io->rlen = 0;
+		ur_arm(idx);
+	}
+	return 1;
+}
+
+//-只收完成不调回调(在ev_del,ev_flush里等的时候),写的完成直接处理,别的留到ev_run_once
+static void ur_reap_defer(int slot_idx)
+{
+	struct io_uring_cqe *c;
+	unsigned int head;
+	struct ev_slot *s;
+	struct ev_io *io;
+
+	head = *ur.cq_head;
+	while (head != __atomic_load_n(ur.cq_tail, __ATOMIC_ACQUIRE)) {
+		c = &ur.cqes[head & *ur.cq_mask];
+		head++;
+		__atomic_store_n(ur.cq_head, head, __ATOMIC_RELEASE);
+		if (EV_UD_KIND(c->user_data) == EVK_WRITE || EV_UD_KIND(c->user_data) == EVK_WPOLL) {
+			ur_complete(c->user_data, c->res);
+			continue;
+		}
+		if (slot_idx >= 0 && EV_UD_IDX(c->user_data) == slot_idx && EV_UD_KIND(c->user_data) != EVK_OTHER) {
+			s = &ur.slot[slot_idx];
+			s->pending--;
+			io = s->io;
+			//-正在删的io:取消之前已经读到的数据还是交给它,热重启交接时不丢
+			if (EV_UD_KIND(c->user_data) == EVK_READ && c->res > 0 && io != NULL) {
+				io->rbuf = ur.iov[s->rbuf].iov_base;
+				io->rlen = c->res;
+				io->cb(io, EV_READ);
+			}
+			continue;
+		}
+		if (ur.ndefer < EV_DEFER)
+			ur.defer[ur.ndefer++] = *c;
+		else
+			LOG(LOGM_MAIN, LOG_ERR, "io_uring: completion dropped");
+	}
+}
+
+static void ur_queue_writes(void)
+{
+	int w;
+
+	for (w = 0; w < EV_WQS; w++)
+		if (ur.wq[w].fd >= 0 && ur.wq[w].buf < 0 && ur.wq[w].next >= 0)
+			ur_wq_start(w);
+}
+
+static long long ur_now_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000LL + ts.tv_nsec / 1000000;
+}
+
+//-写完fd(<0是全部)排着的;timeout_ms<0一直等,到时间还没写完返回-1(串口发不出去的时候)
+static int ur_flush_fd(int fd, int timeout_ms)
+{
+	long long end = timeout_ms >= 0 ? ur_now_ms() + timeout_ms : 0;
+	int w, busy, left = -1;
+
+	do {
+		ur_queue_writes();
+		busy = 0;
+		for (w = 0; w < EV_WQS; w++)
+			if (ur.wq[w].fd >= 0 && (fd < 0 || ur.wq[w].fd == fd))
+				busy = 1;
+		if (!busy)
+			break;
+		if (timeout_ms >= 0 && (left = end - ur_now_ms()) < 0)
+			left = 0;
+		if (ur_submit(1, left) < 0 && errno != EINTR && errno != ETIME)
+			return -1;
+		ur_reap_defer(-1);
+	} while (left != 0);
+	return busy ? -1 : 0;
+}
+
+static int ur_write(int fd, const void *buf, int len)
+{
+	struct ev_wq *q = NULL;
+	int w, b;
+
+	if (len > EV_BUF_SIZE) {	//-太大的不排队:先把这个fd排着的写完,保证顺序
+		ur_flush_fd(fd, -1);
+		return write(fd, buf, len);
+	}
+	for (;;) {
+		for (w = 0; w < EV_WQS; w++)
+			if (ur.wq[w].fd == fd)
+				break;
+		if (w == EV_WQS)
+			for (w = 0; w < EV_WQS; w++)
+				if (ur.wq[w].fd < 0)
+					break;
+		if (w == EV_WQS) {
+			ur_flush_fd(-1, -1);
+			continue;
+		}
+		q = &ur.wq[w];
+		if (q->next >= 0 && q->nlen + len <= EV_BUF_SIZE)
+			break;
+		if (q->next < 0 && ur.wfree != 0)
+			break;
+		ur_flush_fd(q->fd >= 0 ? fd : -1, -1);	//-排队的缓冲满了或者没有空的缓冲
+	}
+	if (q->fd < 0) {
+		q->fd = fd;
+		q->gen++;
+	}
+	if (q->next < 0) {
+		b = __builtin_ctz(ur.wfree);
+		ur.wfree &= ~(1u << b);
+		q->next = EV_RBUFS + b;
+		q->nlen = 0;
+	}
+	memcpy((char *)ur.iov[q->next].iov_base + q->nlen, buf, len);
+	q->nlen += len;
+	return len;
+}
+
+static int ur_run_once(int timeout_ms)
+{
+	struct io_uring_cqe c;
+	unsigned int head;
+	int n = 0, i, ret;
+
+	ur_queue_writes();
+	if (ur.ndefer == 0) {
+		ret = ur_submit(1, timeout_ms);
+		if (ret < 0 && errno != EINTR && errno != ETIME && errno != EBUSY)
+			return -1;
+	} else
+		ur_submit(0, 0);
+	for (i = 0; i < ur.ndefer; i++)	//-回调里还可能再往defer里放,按下标走
+		n += ur_complete(ur.defer[i].user_data, ur.defer[i].res);
+	ur.ndefer = 0;
+	head = *ur.cq_head;
+	while (head != __atomic_load_n(ur.cq_tail, __ATOMIC_ACQUIRE)) {
+		c = ur.cqes[head & *ur.cq_mask];
+		head++;
+		__atomic_store_n(ur.cq_head, head, __ATOMIC_RELEASE);
+		n += ur_complete(c.user_data, c.res);
+		head = *ur.cq_head;	//-回调里可能已经收过完成了
+	}
+	return n;
+}
+#endif	/* EV_URING */
+
+int ev_init(void)
+{
+	if (epfd >= 0)
+		return 0;
+	ev_owner = 1;
+#ifdef EV_URING
+	if (ev_uring && ur.fd < 0) {
+		if (ur_init() == 0) {
+			epfd = ur.fd;
+			LOG(LOGM_MAIN, LOG_INFO, "event loop: io_uring, %u entries, %s buffers", ur.entries, ur.fixed ? "registered" : "plain");
+			return 0;
+		}
+		LOG(LOGM_MAIN, LOG_WARN, "io_uring: %s, using epoll", strerror(errno));
+	}
+#else
+	if (ev_uring)
+		LOG(LOGM_MAIN, LOG_WARN, "io_uring not built in, using epoll");
+#endif
+	ev_uring = 0;
+	epfd = epoll_create1(EPOLL_CLOEXEC);
+	if (epfd < 0) {
+		perror("epoll_create1");
+		return -1;
+	}
+	return 0;
+}
+
+void ev_io_init(struct ev_io *io, int fd, unsigned int events, ev_cb_t cb, void *arg)
+{
+	io->fd = fd;
+	io->events = events;
+	io->cb = cb;
+	io->arg = arg;
+	io->rbuf = NULL;
+	io->rsize = 0;
+	io->rlen = 0;
+	io->slot = -1;
+}
+
+//-epoll:读到buf里;io_uring:读到登记的缓冲里,rbuf指向那里
+void ev_io_read(struct ev_io *io, char *buf, int size)
+{
+	io->rbuf = buf;
+	io->rsize = size;
+}
+
+int ev_add(struct ev_io *io)
+{
+	struct epoll_event ee;
+
+#ifdef EV_URING
+	if (ev_uring) {
+		int i;
+
+		for (i = 0; i < EV_SLOTS; i++)
+			if (ur.slot[i].io == NULL && ur.slot[i].pending == 0)
+				break;
+		if (i == EV_SLOTS || (io->rsize > 0 && ur.rfree == 0)) {
+			LOG(LOGM_MAIN, LOG_ERR, "io_uring: no slot for fd %d", io->fd);
+			return -1;
+		}
+		ur_slot_release(&ur.slot[i]);
+		if (io->rsize > 0) {
+			ur.slot[i].rbuf = __builtin_ctz(ur.rfree);
+			ur.rfree &= ~(1u << ur.slot[i].rbuf);
+		}
+		ur.slot[i].io = io;
+		ur.slot[i].gen++;
+		io->slot = i;
+		io->rlen = 0;
+		ur_arm(i);
+		return 0;
+	}
+#endif
+	memset(&ee, 0, sizeof(ee));
+	ee.events = ev_to_epoll(io->events);
+	ee.data.ptr = io;
+	if (epoll_ctl(epfd, EPOLL_CTL_ADD, io->fd, &ee) < 0) {
+		perror("epoll_ctl add");
+		return -1;
+	}
+	return 0;
+}
+
+int ev_mod(struct ev_io *io, unsigned int events)
+{
+	struct epoll_event ee;
+
+	if (io->events == events)
+		return 0;
+#ifdef EV_URING
+	if (ev_uring) {
+		io->events = events;
+		if (io->slot >= 0 && ur.slot[io->slot].io == io && ur.slot[io->slot].armed) {
+			ur_disarm(io->slot);	//-在回调外面改的:取消旧的poll,按新的事件挂
+			ur_arm(io->slot);
+		}
+		return 0;
+	}
+#endif
+	memset(&ee, 0, sizeof(ee));
+	ee.events = ev_to_epoll(events);
+	ee.data.ptr = io;
+	if (epoll_ctl(epfd, EPOLL_CTL_MOD, io->fd, &ee) < 0) {
+		perror("epoll_ctl mod");
+		return -1;
+	}
+	io->events = events;
+	return 0;
+}
+
+int ev_del(struct ev_io *io)
+{
+#ifdef EV_URING
+	if (ev_uring) {
+		struct ev_slot *s;
+
+		if (io->slot < 0 || ur.slot[io->slot].io != io)
+			return 0;
+		s = &ur.slot[io->slot];
+		ur_disarm(io->slot);
+		if (s->rbuf >= 0) {	//-读可能已经在内核里了:等它结束,fd交给别人(热重启)时不会被这里偷读
+			while (s->pending > 0) {
+				if (ur_submit(1, -1) < 0 && errno != EINTR)
+					break;
+				ur_reap_defer(io->slot);
+			}
+		}
+		s->io = NULL;
+		io->slot = -1;
+		ur_slot_release(s);
+		return 0;
+	}
+#endif
+	if (epoll_ctl(epfd, EPOLL_CTL_DEL, io->fd, NULL) < 0 && errno != EBADF) {
+		perror("epoll_ctl del");
+		return -1;
+	}
+	return 0;
+}
+
+int ev_run_once(int timeout_ms)
+{
+	struct epoll_event ee[EV_MAX_EVENTS];
+	struct ev_io *io;
+	unsigned int revents;
+	int i, n;
+
+#ifdef EV_URING
+	if (ev_uring) {
+		n = ur_run_once(timeout_ms);
+		if (n > 0)
+			ev_wakeups++;
+		return n;
+	}
+#endif
+	n = epoll_wait(epfd, ee, EV_MAX_EVENTS, timeout_ms);
+	ev_waits++;
+	if (n < 0) {
+		if (errno == EINTR)	//-信号打断,回到主循环检查_running
+			return 0;
+		perror("epoll_wait");
+		return -1;
+	}
+	if (n > 0)
+		ev_wakeups++;
+	for (i = 0; i < n; i++) {
+		io = ee[i].data.ptr;
+		revents = 0;
+		if (ee[i].events & EPOLLIN)
+			revents |= EV_READ;
+		if (ee[i].events & EPOLLOUT)
+			revents |= EV_WRITE;
+		if (ee[i].events & EPOLLPRI)
+			revents |= EV_PRI;
+		if (ee[i].events & (EPOLLERR | EPOLLHUP))
+			revents |= EV_ERR;
+		if (io->rsize > 0 && (revents & (EV_READ | EV_ERR))) {	//-ev_io_read:替回调读
+			io->rlen = read(io->fd, io->rbuf, io->rsize);
+			if (io->rlen < 0 && errno == EAGAIN)
+				continue;
+			if (io->rlen <= 0)
+				revents |= EV_ERR;
+		}
+		io->cb(io, revents);
+	}
+	return n;
+}
+
+int ev_write(int fd, const void *buf, int len)
+{
+#ifdef EV_URING
+	if (ev_uring && ev_owner)
+		return ur_write(fd, buf, len);
+#endif
+	return write(fd, buf, len);
+}
+
+int ev_flush(void)
+{
+	return ev_flush_tmo(-1);
+}
+
+int ev_flush_tmo(int timeout_ms)
+{
+#ifdef EV_URING
+	if (ev_uring && ev_owner)
+		return ur_flush_fd(-1, timeout_ms);
+#endif
+	return 0;
+}
+
+const char *ev_backend(void)
+{
+	return ev_uring ? "io_uring" : "epoll";
+}
+
+void ev_stats(void)
+{
+#ifdef EV_URING
+	if (ev_uring) {
+		LOG(LOGM_MAIN, LOG_INFO, "event loop io_uring: %lu waits, %lu wakeups, %lu sqes, %lu writes, %lu write errors",
+		    ev_waits, ev_wakeups, ur.sqes_total, ur.writes, ur.write_errs);
+		return;
+	}
+#endif
+	LOG(LOGM_MAIN, LOG_INFO, "event loop epoll: %lu waits, %lu wakeups", ev_waits, ev_wakeups);
+}
+
+void ev_close(void)
+{
+#ifdef EV_URING
+	if (ev_uring && ur.fd >= 0) {
+		ur_flush_fd(-1, 0);	//-排着队的回复交给内核再关;要等的在ev_flush_tmo里已经等过了
+		ur_unmap();
+		munmap(ur.bufs, (EV_RBUFS + EV_WBUFS) * EV_BUF_SIZE);
+		ur.bufs = NULL;
+		ur.fd = -1;
+	}
+#endif
+	if (epfd >= 0)
+		close(epfd);
+	epfd = -1;
+}
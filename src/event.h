@@ -0,0 +1,47 @@
+//-为了方便调试定义了系列变量以便调试输出
+
+#ifndef EVENT_H
+#define EVENT_H
+
+#define EV_READ		0x01
+#define EV_WRITE	0x02
+#define EV_PRI		0x04	//-紧急数据,sysfs的gpio value文件用这个通知
+#define EV_ERR		0x08	//-只出现在revents里,出错或者挂断
+
+struct ev_io;
+typedef void (*ev_cb_t)(struct ev_io *io, unsigned int revents);
+
+//-结构由调用者分配,注册期间不能释放;回调里可以删除并释放自己,不要释放别的ev_io
+struct ev_io {
+	int fd;
+	unsigned int events;
+	ev_cb_t cb;
+	void *arg;
+	char *rbuf;			//-ev_io_read:回调之前事件循环已经读好的数据
+	int rsize;
+	int rlen;			//-读到的字节数,0是对方关了,-1是出错
+	int slot;			//-io_uring后端用
+};
+
+/*
+两个后端:默认epoll;-U用io_uring,内核不支持(老内核,或者被seccomp禁了)时自动退回epoll.
+io_uring后端里,等待,重新挂poll,ev_write排队的写都在一次io_uring_enter里提交,
+ev_io_read的io收到数据时读也是内核做好的(读到登记过的缓冲里),一帧数据不用再调read.
+*/
+extern int ev_uring;			//--U 1:用io_uring
+
+int  ev_init(void);
+void ev_io_init(struct ev_io *io, int fd, unsigned int events, ev_cb_t cb, void *arg);
+void ev_io_read(struct ev_io *io, char *buf, int size);	//-ev_add之前调用,EV_READ时事件循环替回调读,见rbuf
+int  ev_add(struct ev_io *io);
+int  ev_mod(struct ev_io *io, unsigned int events);
+int  ev_del(struct ev_io *io);
+int  ev_run_once(int timeout_ms);	//-等待并处理一批事件,timeout_ms<0一直等
+int  ev_write(int fd, const void *buf, int len);	//-同一个fd按顺序写;io_uring后端排队,下一次等待时一起提交
+int  ev_flush(void);			//-排队的写全部写完再返回
+int  ev_flush_tmo(int timeout_ms);	//-同上,最多等timeout_ms,没写完返回-1
+const char *ev_backend(void);
+void ev_stats(void);
+void ev_close(void);
+
+#endif /* EVENT_H */
@@ -0,0 +1,173 @@
+/*
+此文件是帧缓冲池.
+以前串口帧放在两个256字节的全局数组里:read_data拼帧用strcat,超过256字节就写出界;
+拼好以后memcpy整个256字节到read_report再处理.
+现在每一帧从这里拿一个缓冲,拼好以后直接把这个缓冲交出去,不再复制;
+帧的最大长度可以设置(-F),超过的丢掉并计数,不会写出界.
+*/
+
+#include "debugfl.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "fbuf.h"
+
+#define FBUF_SLAB	16384		//-一次从系统分这么多,切成同一档的缓冲
+
+struct fbuf_class {
+	pthread_mutex_t lock;
+	struct fbuf *free;
+	uint32_t size;
+	unsigned long total;		//-一共切了多少个
+	unsigned long used;
+};
+
+unsigned int fbuf_max = FBUF_MAX_DEF;
+
+static struct fbuf_class fbuf_classes[FBUF_CLASSES] = {
+	{ PTHREAD_MUTEX_INITIALIZER, NULL, FBUF_MIN },
+	{ PTHREAD_MUTEX_INITIALIZER, NULL, FBUF_MIN << 2 },
+	{ PTHREAD_MUTEX_INITIALIZER, NULL, FBUF_MIN << 4 },
+	{ PTHREAD_MUTEX_INITIALIZER, NULL, FBUF_MIN << 6 },
+	{ PTHREAD_MUTEX_INITIALIZER, NULL, FBUF_MIN << 8 },
+	{ PTHREAD_MUTEX_INITIALIZER, NULL, FBUF_MIN << 10 },
+};
+
+//--F:不是数字的报错;太大的没有一档放得下(fbuf_get失败会当成没有内存),太小的连一个命令都放不下,都截到范围里
+int fbuf_parse(const char *spec)
+{
+	char *end;
+	long n = strtol(spec, &end, 0);
+
+	if (end == spec || *end != 0 || n <= 0) {
+		fprintf(stderr, "fbuf: bad frame size \"%s\", %d..%d bytes\n", spec, FBUF_MIN, FBUF_LIMIT);
+		return -1;
+	}
+	if (n < FBUF_MIN || n > FBUF_LIMIT) {
+		fbuf_max = n < FBUF_MIN ? FBUF_MIN : FBUF_LIMIT;
+		fprintf(stderr, "fbuf: frame size %ld out of range, using %u\n", n, fbuf_max);
+		return 0;
+	}
+	fbuf_max = n;
+	return 0;
+}
+
+static int fbuf_class_of(uint32_t size)
+{
+	int c;
+
+	for (c = 0; c < FBUF_CLASSES; c++)
+		if (size <= fbuf_classes[c].size)
+			return c;
+	return -1;
+}
+
+//-空闲链表空了:分一块切开,大的档一块只有一个
+static int fbuf_grow(struct fbuf_class *k, int cls)
+{
+	size_t one = (sizeof(struct fbuf) + k->size + 1 + 7) & ~(size_t)7;
+	size_t n = FBUF_SLAB / one ? FBUF_SLAB / one : 1;
+	char *slab = malloc(n * one);
+	struct fbuf *f;
+	size_t i;
+
+	if (slab == NULL)
+		return -1;
+	for (i = 0; i < n; i++) {
+		f = (struct fbuf *)(slab + i * one);
+		f->cls = cls;
+		f->size = k->size;
+		f->next = k->free;
+		k->free = f;
+	}
+	k->total += n;
+	return 0;
+}
+
+struct fbuf *fbuf_get(uint32_t size)
+{
+	struct fbuf_class *k;
+	struct fbuf *f;
+	int cls;
+
+	if (size > fbuf_max || (cls = fbuf_class_of(size)) < 0)
+		return NULL;
+	k = &fbuf_classes[cls];
+	pthread_mutex_lock(&k->lock);
+	if (k->free == NULL && fbuf_grow(k, cls) != 0) {
+		pthread_mutex_unlock(&k->lock);
+		return NULL;
+	}
+	f = k->free;
+	k->free = f->next;
+	k->used++;
+	pthread_mutex_unlock(&k->lock);
+	f->refs = 1;
+	f->len = 0;
+	f->ts_ns = 0;
+	f->next = NULL;
+	f->data[0] = 0;
+	return f;
+}
+
+void fbuf_put(struct fbuf *f)
+{
+	struct fbuf_class *k;
+
+	if (f == NULL || __atomic_sub_fetch(&f->refs, 1, __ATOMIC_ACQ_REL) != 0)
+		return;
+	k = &fbuf_classes[f->cls];
+	pthread_mutex_lock(&k->lock);
+	f->next = k->free;
+	k->free = f;
+	k->used--;
+	pthread_mutex_unlock(&k->lock);
+}
+
+//-只有拿着唯一引用的人(拼帧的)才能调用
+int fbuf_append(struct fbuf **pf, const void *data, uint32_t n)
+{
+	struct fbuf *f = *pf, *nf;
+
+	if (f->len + n > fbuf_max)
+		return -1;
+	if (f->len + n > f->size) {
+		nf = fbuf_get(f->len + n);
+		if (nf == NULL)
+			return -2;		//-长度没超,是分不到内存
+		memcpy(nf->data, f->data, f->len);
+		nf->len = f->len;
+		nf->ts_ns = f->ts_ns;
+		fbuf_put(f);
+		*pf = f = nf;
+	}
+	memcpy(f->data + f->len, data, n);
+	f->len += n;
+	f->data[f->len] = 0;
+	return 0;
+}
+
+long fbuf_in_use(void)
+{
+	long n = 0;
+	int c;
+
+	for (c = 0; c < FBUF_CLASSES; c++)
+		n += __atomic_load_n(&fbuf_classes[c].used, __ATOMIC_RELAXED);
+	return n;
+}
+
+void fbuf_stats(void)
+{
+	struct fbuf_class *k;
+	int c;
+
+	for (c = 0; c < FBUF_CLASSES; c++) {
+		k = &fbuf_classes[c];
+		if (k->total > 0)
+			LOG(LOGM_MAIN, LOG_INFO, "fbuf %u: %lu in use, %lu allocated", k->size, k->used, k->total);
+	}
+}
@@ -0,0 +1,45 @@
+//-为了方便调试定义了系列变量以便调试输出
+
+#ifndef FBUF_H
+#define FBUF_H
+
+#include <stdint.h>
+
+/*
+帧缓冲池:按大小分几档(64,256,1K,4K,16K,64K),每档一个空闲链表,不够时一次分一块(slab)切开.
+缓冲带引用计数,一帧拼好以后交给命令处理,要留着用的自己fbuf_ref,用完fbuf_put,
+最后一个put的放回空闲链表,中间不复制.现在留着用的是调试日志(LOG_FRAME):
+日志线程写完才放回;共享内存记录(shmring)给别的进程看,只能复制进去.
+fbuf_ref/fbuf_put哪个线程都可以调用.
+*/
+#define FBUF_CLASSES	6
+#define FBUF_MIN	64
+#define FBUF_LIMIT	(FBUF_MIN << 2 * (FBUF_CLASSES - 1))	//-最大一档,64K
+#define FBUF_MAX_DEF	4096
+
+struct fbuf {
+	int refs;
+	int cls;			//-大小档,放回哪个空闲链表
+	uint32_t size;			//-data能放多少字节,末尾还有一个字节放0
+	uint32_t len;
+	uint64_t ts_ns;			//-收到的时间
+	struct fbuf *next;		//-空闲链表
+	char data[];
+};
+
+extern unsigned int fbuf_max;		//--F 一帧最长多少字节,超过的丢掉并计数
+
+int  fbuf_parse(const char *spec);	//--F的参数,截到[FBUF_MIN,FBUF_LIMIT],不是数字返回-1
+struct fbuf *fbuf_get(uint32_t size);	//-至少能放size字节;超过fbuf_max或者没有内存返回NULL
+int  fbuf_append(struct fbuf **pf, const void *data, uint32_t n);	//-不够大换大一档的;超过fbuf_max返回-1,没有内存返回-2,原来的不变
+void fbuf_put(struct fbuf *f);
+long fbuf_in_use(void);
+void fbuf_stats(void);
+
+static inline struct fbuf *fbuf_ref(struct fbuf *f)
+{
+	__atomic_add_fetch(&f->refs, 1, __ATOMIC_RELAXED);
+	return f;
+}
+
+#endif /* FBUF_H */
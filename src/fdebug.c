@@ -1,39 +1,14 @@
 /*
-此文件用于文件的创建和读写,使用这种方法可以进行信息的输出,用于辅助调试
+此文件用于调试信息的输出,使用这种方法可以进行信息的输出,用于辅助调试
+以前每次调用都system("touch")再open一次文件,而且不关闭,固定写100个字节.
+现在直接交给日志,守护进程模式下日志默认还是写到/tmp/out(LOG_DAEMON_FILE).
 */
 
-#include <fcntl.h>
-#include <stdlib.h>
-#include<unistd.h>
-
-
-
-
-//输出目录   
-#define DIR_OUT_FILE "/tmp/out" 
-
-
-
-
-
+#include "log.h"
+#include "fdebug.h"
 
 
 void f_debug(char *data)
 {
-	int fd;
-
-//查看程序是否运行   
-        //新建输出文件   
-        system("touch "DIR_OUT_FILE);
-	//打开输出文件   
-        fd = open(DIR_OUT_FILE,O_CREAT|O_RDWR,0777); 
-	//-char buf[100] = {'1','2',3}; 
-	//-strcpy(buf,argv[2]);
-	//-sprintf(buf, "%d", fd_uart1);
-	//全部   
-        //-write(fd,buf,100);
-		write(fd,data,100);
-
-	//删除输出文件   
-        //-system("rm "DIR_OUT_FILE); 
-}
\ No newline at end of file
+	LOG(LOGM_MAIN, LOG_INFO, "%s", data);
+}
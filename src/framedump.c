@@ -0,0 +1,75 @@
+/*
+dfframes:读dreamflower_app发布到共享内存里的串口帧,一帧一行:
+	序号 时间(CLOCK_MONOTONIC) 长度 帧
+读得太慢被覆盖的帧打印"lost N".只映射只读,不会影响dreamflower_app.
+	dfframes			从现在开始,一直读
+	dfframes -a			先把共享内存里还有的旧帧打出来
+	dfframes -n			读完现有的就退出
+	dfframes -R /name		dreamflower_app用-R改了名字时
+dreamflower_app退出或者重启以后等新的出现,接着读.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "shmring.h"
+
+#define FRAMEDUMP_POLL_US	1000		//-没有新帧时隔这么久再看
+#define FRAMEDUMP_RETRY_US	500000		//-共享内存还没有建时隔这么久再试
+
+int main(int argc, char *argv[])
+{
+	const char *name = "/dreamflower_app.frames";
+	struct shmring r;
+	struct shmring_frame f;
+	int c, oldest = 0, follow = 1, n;
+
+	while ((c = getopt(argc, argv, "anR:")) != -1) {
+		switch (c) {
+		case 'a':
+			oldest = 1;
+			break;
+		case 'n':
+			follow = 0;
+			break;
+		case 'R':
+			name = optarg;
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-a] [-n] [-R shm name]\n", argv[0]);
+			return 2;
+		}
+	}
+	for (;;) {
+		if (shmring_attach(&r, name, oldest) != 0) {
+			if (!follow) {
+				perror(name);
+				return 1;
+			}
+			usleep(FRAMEDUMP_RETRY_US);
+			continue;
+		}
+		while ((n = shmring_read(&r, &f)) >= 0) {
+			if (n == 0) {
+				if (!follow)
+					break;
+				fflush(stdout);
+				usleep(FRAMEDUMP_POLL_US);
+				continue;
+			}
+			if (f.lost)
+				printf("lost %lu\n", f.lost);
+			printf("%llu %llu.%09llu %u %s\n", (unsigned long long)f.seq,
+			       (unsigned long long)(f.ts_ns / 1000000000ULL), (unsigned long long)(f.ts_ns % 1000000000ULL),
+			       f.len, f.data);
+		}
+		shmring_detach(&r);
+		if (!follow)
+			return 0;
+		fflush(stdout);
+		oldest = 1;	//-新的进程接着旧的序号写,也可能已经写了几帧
+		usleep(FRAMEDUMP_RETRY_US);
+	}
+}
@@ -4,6 +4,7 @@
 首先是框架实现
 */
 
+#define _GNU_SOURCE
 #include "debugfl.h"
 
 #include <stdio.h>             
@@ -12,164 +13,770 @@
 #include <string.h>
 #include <fcntl.h>
 #include <signal.h>
+#include <errno.h>
+#include <time.h>
 #include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <linux/gpio.h>
 //-#include <linux/autoconf.h>
 //-#include "ralink_gpio.h"
 
+#include "bench.h"
+#include "gpio.h"
+#include "led.h"
+
 //-下面定义了一个设备节点,在使用之前需要创建这样一个节点使用"mknod /dev/gpio c 252 0"的语句
 #define GPIO_DEV	"/dev/gpio"
+#define GPIO_MAJOR	252
+#define GPIO_SYSFS	"/sys/class/gpio"
+#define GPIO_DEBOUNCE_MS	20	//--G i 默认的去抖时间
 
+//-ralink_gpio.h里的命令,没有这个头文件时用SDK里的值
+#ifndef RALINK_GPIO_SET_DIR_IN
+#define RALINK_GPIO_SET_DIR_IN		0x11
+#define RALINK_GPIO_SET_DIR_OUT		0x12
+#define RALINK_GPIO_READ		0x02
+#define RALINK_GPIO_WRITE		0x03
+#define RALINK_GPIO6332_SET_DIR_IN	0x13
+#define RALINK_GPIO6332_SET_DIR_OUT	0x14
+#define RALINK_GPIO6332_READ		0x52
+#define RALINK_GPIO6332_WRITE		0x53
+#define RALINK_GPIO9564_SET_DIR_IN	0x15
+#define RALINK_GPIO9564_SET_DIR_OUT	0x16
+#define RALINK_GPIO9564_READ		0x62
+#define RALINK_GPIO9564_WRITE		0x63
+#endif
 
-enum {
-	gpio_in,
-	gpio_out,
-};
-enum {
-	gpio3100,			//-0
-	gpio6332,			//-1
-	gpio9564,			//-2
+const char *gpio_spec = NULL;
+
+static struct gpio_dev gpio_d = { NULL, -1 };
+static struct gpio_line *gpio_lines;
+
+//-chip和mock的fd读出来都是gpioevent_data,一次读一个边沿
+static int lineevent_edge(struct gpio_line *l)
+{
+	struct gpioevent_data ev;
+	int n = 0;
+
+	while (read(l->fd, &ev, sizeof(ev)) == sizeof(ev)) {
+		gpio_line_edge(l, ev.id == GPIOEVENT_EVENT_RISING_EDGE, ev.timestamp);
+		n++;
+	}
+	return n;
+}
+
+static void line_close(struct gpio_dev *d, struct gpio_line *l)
+{
+	if (l->fd >= 0)
+		close(l->fd);
+	if (l->aux >= 0)
+		close(l->aux);
+}
+
+/*
+以前每写一次引脚:open /dev/gpio,打不开还要system("mknod ...")(fork一个shell),ioctl,close.
+现在open一次一直用,节点不存在时自己mknod,不再起shell.
+*/
+//-------------------------------- ralink --------------------------------
+static const unsigned long ralink_dir_in[GPIO_BANKS] = { RALINK_GPIO_SET_DIR_IN, RALINK_GPIO6332_SET_DIR_IN, RALINK_GPIO9564_SET_DIR_IN };
+static const unsigned long ralink_dir_out[GPIO_BANKS] = { RALINK_GPIO_SET_DIR_OUT, RALINK_GPIO6332_SET_DIR_OUT, RALINK_GPIO9564_SET_DIR_OUT };
+static const unsigned long ralink_rd[GPIO_BANKS] = { RALINK_GPIO_READ, RALINK_GPIO6332_READ, RALINK_GPIO9564_READ };
+static const unsigned long ralink_wr[GPIO_BANKS] = { RALINK_GPIO_WRITE, RALINK_GPIO6332_WRITE, RALINK_GPIO9564_WRITE };
+
+static int ralink_read(struct gpio_dev *d, int bank, uint32_t *value)
+{
+	int v;
+
+	if (ioctl(d->fd, ralink_rd[bank], &v) < 0)
+		return -1;
+	*value = v;
+	return 0;
+}
+
+static int ralink_open(struct gpio_dev *d, const char *path)
+{
+	int bank;
+
+	d->fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (d->fd < 0 && errno == ENOENT && strcmp(path, GPIO_DEV) == 0
+			&& mknod(path, S_IFCHR | 0600, makedev(GPIO_MAJOR, 0)) == 0)
+		d->fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (d->fd < 0)
+		return -1;
+	//-整组写需要知道其他引脚现在的值
+	for (bank = 0; bank < GPIO_BANKS; bank++)
+		if (ralink_read(d, bank, &d->out[bank]) != 0)
+			d->out[bank] = 0;
+	return 0;
+}
+
+static void ralink_close(struct gpio_dev *d)
+{
+	close(d->fd);
+}
+
+//-驱动的参数就是引脚的掩码,一次可以设置一组里的多个
+static int ralink_set_dir(struct gpio_dev *d, int bank, uint32_t mask, int dir)
+{
+	return ioctl(d->fd, dir == gpio_out ? ralink_dir_out[bank] : ralink_dir_in[bank], mask) < 0 ? -1 : 0;
+}
+
+//-数据寄存器整组写,输入引脚写了不起作用
+static int ralink_write(struct gpio_dev *d, int bank, uint32_t mask, uint32_t value)
+{
+	return ioctl(d->fd, ralink_wr[bank], value) < 0 ? -1 : 0;
+}
+
+/*
+ralink驱动的中断是给登记的进程发信号,和signalfd的用法冲突,输入边沿改用sysfs:
+value文件在边沿时触发POLLPRI,读一次拿到当前电平.没有内核时间戳,两次poll之间很短的脉冲会合成看不到.
+*/
+static int sysfs_put(const char *path, const char *val)
+{
+	int fd, ret;
+
+	fd = open(path, O_WRONLY | O_CLOEXEC);
+	if (fd < 0)
+		return -1;
+	ret = write(fd, val, strlen(val)) < 0 ? -1 : 0;
+	close(fd);
+	return ret;
+}
+
+static int sysfs_value(int fd)
+{
+	char c;
+
+	if (lseek(fd, 0, SEEK_SET) < 0 || read(fd, &c, 1) != 1)
+		return -1;
+	return c == '1';
+}
+
+static int sysfs_watch(struct gpio_dev *d, struct gpio_line *l)
+{
+	char path[64], num[16];
+
+	snprintf(num, sizeof(num), "%d", l->pin);
+	snprintf(path, sizeof(path), GPIO_SYSFS "/gpio%d", l->pin);
+	if (access(path, F_OK) != 0)
+		sysfs_put(GPIO_SYSFS "/export", num);
+	snprintf(path, sizeof(path), GPIO_SYSFS "/gpio%d/direction", l->pin);
+	sysfs_put(path, "in");
+	snprintf(path, sizeof(path), GPIO_SYSFS "/gpio%d/edge", l->pin);
+	if (sysfs_put(path, "both") != 0)
+		return -1;
+	snprintf(path, sizeof(path), GPIO_SYSFS "/gpio%d/value", l->pin);
+	l->fd = open(path, O_RDONLY | O_CLOEXEC | O_NONBLOCK);
+	if (l->fd < 0)
+		return -1;
+	l->raw = sysfs_value(l->fd);	//-读一次,清掉已经有的通知
+	return EV_PRI;
+}
+
+static int sysfs_edge(struct gpio_line *l)
+{
+	struct timespec ts;
+	int v = sysfs_value(l->fd);
+
+	if (v < 0 || v == l->raw)
+		return 0;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	gpio_line_edge(l, v, (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec);
+	return 1;
+}
+
+static const struct gpio_ops gpio_ralink_ops = {
+	"ralink", GPIO_DEV, ralink_open, ralink_close, ralink_set_dir, ralink_write, ralink_read,
+	sysfs_watch, line_close, sysfs_edge
 };
 
+//-------------------------------- chip --------------------------------
 /*
-int gpio_set_dir(int r, int dir)	//-前面一个是引脚号		后面是方向
+内核的GPIO字符设备(v1接口,4.8以后都有).一次请求的一组引脚方向相同,
+所以每组有一个输出句柄和一个输入句柄,方向变了就重新请求;写是整个输出句柄一个ioctl.
+*/
+struct chip_bank {
+	uint32_t used;			//-设置过方向的引脚
+	int out_fd, in_fd;
+};
+
+struct chip_priv {
+	unsigned int lines;
+	struct chip_bank b[GPIO_BANKS];
+};
+
+static int chip_request(struct gpio_dev *d, int bank, uint32_t mask, int out, int *fd)
 {
-	int fd, req;
-	
-	//-增加打印语句方便知道程序进程
-	printf("boot000\n");
-	
-	//-打开设备GPIO
-	fd = open(GPIO_DEV, O_RDONLY);	//-这里打开了一个文件,也许由于IO的简单就是一个空文件而已没有任何描述
-	if(fd < 0)
-	{
-		system("mknod /dev/gpio c 252 0");
-		fd = open(GPIO_DEV, O_RDONLY);
+	struct gpiohandle_request req;
+	int bit;
+
+	if (*fd >= 0)
+		close(*fd);
+	*fd = -1;
+	if (mask == 0)
+		return 0;
+	memset(&req, 0, sizeof(req));
+	for (bit = 0; bit < 32; bit++) {
+		if (!(mask & (1u << bit)))
+			continue;
+		req.default_values[req.lines] = (d->out[bank] >> bit) & 1;
+		req.lineoffsets[req.lines++] = bank * 32 + bit;
 	}
-	
-	if (fd < 0) {
-		//-perror( ) 用来将上一个函数发生错误的原因输出到标准设备(stderr)。参数 s 所指的字符
-		//-串会先打印出,后面再加上错误原因字符串。此错误原因依照全局变量errno 的值来决定要输出的字符串。
-		perror(GPIO_DEV);
+	req.flags = out ? GPIOHANDLE_REQUEST_OUTPUT : GPIOHANDLE_REQUEST_INPUT;
+	snprintf(req.consumer_label, sizeof(req.consumer_label), "dreamflower_app");
+	if (ioctl(d->fd, GPIO_GET_LINEHANDLE_IOCTL, &req) < 0)
+		return -1;
+	*fd = req.fd;
+	return 0;
+}
+
+static int chip_open(struct gpio_dev *d, const char *path)
+{
+	struct gpiochip_info info;
+	struct chip_priv *p;
+	int bank;
+
+	d->fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (d->fd < 0)
+		return -1;
+	p = calloc(1, sizeof(*p));
+	if (p == NULL || ioctl(d->fd, GPIO_GET_CHIPINFO_IOCTL, &info) < 0) {
+		free(p);
+		close(d->fd);
 		return -1;
 	}
-	//-增加打印语句方便知道程序进程
-	printf("boot001\n");
-	
-	if (dir == gpio_in) {
-
-		if (r == gpio9564)
-			req = RALINK_GPIO9564_SET_DIR_IN;
-		else if (r == gpio6332)
-			req = RALINK_GPIO6332_SET_DIR_IN;
-		else
-			req = RALINK_GPIO_SET_DIR_IN;
-	}
-	else {
-		if (r == gpio9564)
-			req = RALINK_GPIO9564_SET_DIR_OUT;		//-这里的取出是为了,模块之间减少耦合性
-		else if (r == gpio6332)
-			req = RALINK_GPIO6332_SET_DIR_OUT;
-		else
-			req = RALINK_GPIO_SET_DIR_OUT;
+	p->lines = info.lines;
+	for (bank = 0; bank < GPIO_BANKS; bank++)
+		p->b[bank].out_fd = p->b[bank].in_fd = -1;
+	d->priv = p;
+	return 0;
+}
+
+static void chip_close(struct gpio_dev *d)
+{
+	struct chip_priv *p = d->priv;
+	int bank;
+
+	for (bank = 0; bank < GPIO_BANKS; bank++) {
+		if (p->b[bank].out_fd >= 0)
+			close(p->b[bank].out_fd);
+		if (p->b[bank].in_fd >= 0)
+			close(p->b[bank].in_fd);
 	}
-	//-增加打印语句方便知道程序进程
-	printf("boot002\n");
-	if (ioctl(fd, req, 0xffffffff) < 0) 	//-这里设置了输入或者输出特定的引脚,具体实现是如何的需要思考
-	{
-		perror("ioctl");
-		close(fd);
+	free(p);
+	d->priv = NULL;
+	close(d->fd);
+}
+
+static int chip_set_dir(struct gpio_dev *d, int bank, uint32_t mask, int dir)
+{
+	struct chip_priv *p = d->priv;
+	struct chip_bank *b = &p->b[bank];
+	uint32_t dirs = dir == gpio_out ? d->dir[bank] | mask : d->dir[bank] & ~mask;
+	uint32_t used = b->used | mask;
+
+	if (bank * 32 + 32 - __builtin_clz(mask | 1) > (int)p->lines) {
+		errno = EINVAL;
 		return -1;
 	}
-	//-增加打印语句方便知道程序进程
-	printf("boot003\n");
-	close(fd);
+	if (chip_request(d, bank, used & dirs, 1, &b->out_fd) != 0
+			|| chip_request(d, bank, used & ~dirs, 0, &b->in_fd) != 0)
+		return -1;
+	b->used = used;
 	return 0;
 }
 
-int gpio_write_int(int r, int value)	//-实现了向IO口输出指定电平
+//-输出句柄里的引脚按从低到高的顺序排
+static int chip_write(struct gpio_dev *d, int bank, uint32_t mask, uint32_t value)
+{
+	struct chip_priv *p = d->priv;
+	struct gpiohandle_data data;
+	uint32_t outs = p->b[bank].used & d->dir[bank];
+	int bit, n = 0;
+
+	if (p->b[bank].out_fd < 0)
+		return -1;
+	memset(&data, 0, sizeof(data));
+	for (bit = 0; bit < 32; bit++)
+		if (outs & (1u << bit))
+			data.values[n++] = (value >> bit) & 1;
+	return ioctl(p->b[bank].out_fd, GPIOHANDLE_SET_LINE_VALUES_IOCTL, &data) < 0 ? -1 : 0;
+}
+
+static int chip_read_fd(int fd, uint32_t lines, uint32_t *value)
 {
-	int fd, req;
+	struct gpiohandle_data data;
+	int bit, n = 0;
 
-	fd = open(GPIO_DEV, O_RDONLY);
-	if (fd < 0) {
-		perror(GPIO_DEV);
+	if (fd < 0)
+		return 0;
+	if (ioctl(fd, GPIOHANDLE_GET_LINE_VALUES_IOCTL, &data) < 0)
 		return -1;
+	for (bit = 0; bit < 32; bit++)
+		if (lines & (1u << bit))
+			*value |= (uint32_t)(data.values[n++] & 1) << bit;
+	return 0;
+}
+
+static int chip_read(struct gpio_dev *d, int bank, uint32_t *value)
+{
+	struct chip_priv *p = d->priv;
+	struct chip_bank *b = &p->b[bank];
+
+	*value = 0;
+	if (chip_read_fd(b->in_fd, b->used & ~d->dir[bank], value) != 0
+			|| chip_read_fd(b->out_fd, b->used & d->dir[bank], value) != 0)
+		return -1;
+	return 0;
+}
+
+//-边沿两个方向都要,去抖要看到电平回去
+static int chip_watch(struct gpio_dev *d, struct gpio_line *l)
+{
+	struct gpioevent_request req;
+	struct gpiohandle_data data;
+
+	memset(&req, 0, sizeof(req));
+	req.lineoffset = l->pin;
+	req.handleflags = GPIOHANDLE_REQUEST_INPUT;
+	req.eventflags = GPIOEVENT_REQUEST_BOTH_EDGES;
+	snprintf(req.consumer_label, sizeof(req.consumer_label), "dreamflower_app");
+	if (ioctl(d->fd, GPIO_GET_LINEEVENT_IOCTL, &req) < 0)
+		return -1;
+	l->fd = req.fd;
+	fcntl(l->fd, F_SETFL, fcntl(l->fd, F_GETFL) | O_NONBLOCK);
+	if (ioctl(l->fd, GPIOHANDLE_GET_LINE_VALUES_IOCTL, &data) == 0)
+		l->raw = data.values[0];
+	return EV_READ;
+}
+
+static const struct gpio_ops gpio_chip_ops = {
+	"chip", "/dev/gpiochip0", chip_open, chip_close, chip_set_dir, chip_write, chip_read,
+	chip_watch, line_close, lineevent_edge
+};
+
+//-------------------------------- mock --------------------------------
+//-没有硬件:输出引脚读回写的值,输入引脚读gpio_mock_in
+static uint32_t gpio_mock_in[GPIO_BANKS];
+
+static int mock_open(struct gpio_dev *d, const char *path)
+{
+	d->fd = -1;
+	return 0;
+}
+
+static void mock_close(struct gpio_dev *d)
+{
+}
+
+static int mock_set_dir(struct gpio_dev *d, int bank, uint32_t mask, int dir)
+{
+	return 0;
+}
+
+static int mock_write(struct gpio_dev *d, int bank, uint32_t mask, uint32_t value)
+{
+	LOG(LOGM_GPIO, LOG_DBG, "mock bank %d mask 0x%08x value 0x%08x", bank, mask, value);
+	return 0;
+}
+
+static int mock_read(struct gpio_dev *d, int bank, uint32_t *value)
+{
+	*value = (d->out[bank] & d->dir[bank]) | (gpio_mock_in[bank] & ~d->dir[bank]);
+	return 0;
+}
+
+//-管道里写和chip一样的gpioevent_data
+static int mock_watch(struct gpio_dev *d, struct gpio_line *l)
+{
+	int p[2];
+
+	if (pipe2(p, O_NONBLOCK | O_CLOEXEC) != 0)
+		return -1;
+	l->fd = p[0];
+	l->aux = p[1];
+	l->raw = (gpio_mock_in[GPIO_BANK(l->pin)] & GPIO_BIT(l->pin)) != 0;
+	return EV_READ;
+}
+
+void gpio_mock_set(int bank, uint32_t value)
+{
+	struct gpioevent_data ev;
+	struct gpio_line *l;
+	struct timespec ts;
+	uint32_t changed;
+
+	if (bank < 0 || bank >= GPIO_BANKS)
+		return;
+	changed = gpio_mock_in[bank] ^ value;
+	gpio_mock_in[bank] = value;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	ev.timestamp = (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+	for (l = gpio_lines; l; l = l->next) {
+		if (l->aux < 0 || GPIO_BANK(l->pin) != bank || !(changed & GPIO_BIT(l->pin)))
+			continue;
+		ev.id = (value & GPIO_BIT(l->pin)) ? GPIOEVENT_EVENT_RISING_EDGE : GPIOEVENT_EVENT_FALLING_EDGE;
+		if (write(l->aux, &ev, sizeof(ev)) != sizeof(ev))
+			LOG(LOGM_GPIO, LOG_WARN, "mock gpio %d: event lost", l->pin);
 	}
+}
+
+static const struct gpio_ops gpio_mock_ops = {
+	"mock", "", mock_open, mock_close, mock_set_dir, mock_write, mock_read,
+	mock_watch, line_close, lineevent_edge
+};
 
+//-------------------------------- 通用 --------------------------------
+static const struct gpio_ops *gpio_backends[] = { &gpio_ralink_ops, &gpio_chip_ops, &gpio_mock_ops, NULL };
 
-	if (r == gpio9564)
-		req = RALINK_GPIO9564_WRITE;
-	else if (r == gpio6332)
-		req = RALINK_GPIO6332_WRITE;
+static int gpio_dev_dir(struct gpio_dev *d, int bank, uint32_t mask, int dir)
+{
+	if (d->ops == NULL || bank < 0 || bank >= GPIO_BANKS)
+		return -1;
+	d->ioctls++;
+	if (d->ops->set_dir(d, bank, mask, dir) != 0) {
+		LOG(LOGM_GPIO, LOG_ERR, "%s: set dir bank %d mask 0x%08x: %s", d->ops->name, bank, mask, strerror(errno));
+		return -1;
+	}
+	if (dir == gpio_out)
+		d->dir[bank] |= mask;
 	else
-		req = RALINK_GPIO_WRITE;
-//-上面根据标志得到了一个变量值		
-	if (ioctl(fd, req, value) < 0) 	//-不同的标志对应不同的数值输出
-	{
-		perror("ioctl");
-		close(fd);
+		d->dir[bank] &= ~mask;
+	return 0;
+}
+
+//-值没有变就不调驱动
+static int gpio_dev_write(struct gpio_dev *d, int bank, uint32_t mask, uint32_t value)
+{
+	uint32_t nv;
+
+	if (d->ops == NULL || bank < 0 || bank >= GPIO_BANKS)
+		return -1;
+	nv = (d->out[bank] & ~mask) | (value & mask);
+	if (nv == d->out[bank])
+		return 0;
+	d->ioctls++;
+	if (d->ops->write(d, bank, mask, nv) != 0)
+		return -1;
+	d->out[bank] = nv;
+	return 0;
+}
+
+int gpio_open(const char *spec)
+{
+	const struct gpio_ops **o;
+	const char *path;
+	size_t n;
+
+	if (gpio_d.ops != NULL)
+		return 0;
+	if (spec == NULL)
+		spec = "ralink";
+	n = strcspn(spec, ":");
+	path = spec[n] == ':' ? spec + n + 1 : NULL;
+	for (o = gpio_backends; *o; o++)
+		if (strlen((*o)->name) == n && strncmp((*o)->name, spec, n) == 0)
+			break;
+	if (*o == NULL) {
+		LOG(LOGM_GPIO, LOG_ERR, "unknown gpio backend %s", spec);
 		return -1;
 	}
-	close(fd);
+	memset(&gpio_d, 0, sizeof(gpio_d));
+	gpio_d.fd = -1;
+	if ((*o)->open(&gpio_d, path ? path : (*o)->path) != 0) {
+		LOG(LOGM_GPIO, LOG_ERR, "%s: open %s: %s", (*o)->name, path ? path : (*o)->path, strerror(errno));
+		return -1;
+	}
+	gpio_d.ops = *o;
+	LOG(LOGM_GPIO, LOG_INFO, "gpio backend %s %s", (*o)->name, path ? path : (*o)->path);
 	return 0;
 }
 
+void gpio_close(void)
+{
+	if (gpio_d.ops == NULL)
+		return;
+	while (gpio_lines)
+		gpio_unwatch(gpio_lines);
+	gpio_d.ops->close(&gpio_d);
+	gpio_d.ops = NULL;
+	gpio_d.fd = -1;
+}
 
-void gpio_test_write(int data)	//-调用的一个子函数,其中一个流程
+struct gpio_dev *gpio_get(void)
 {
-	int i = 0;
+	return gpio_d.ops ? &gpio_d : NULL;
+}
 
-	//set gpio direction to output
-	gpio_set_dir(gpio3100, gpio_out);
+int gpio_dir_mask(int bank, uint32_t mask, int dir)
+{
+	return gpio_dev_dir(&gpio_d, bank, mask, dir);
+}
 
-  if(data != 0)
-  {
-  	printf("turn off SEC LED = 0x%x\n", data);
-		//turn off LEDs
-		gpio_write_int(gpio3100, data);	//-GPIO_0 熄灭使用的值是0x00000800,,输入指令时显示的是十进制数据
-		sleep(3);
-	}
+int gpio_dir(int pin, int dir)
+{
+	return gpio_dev_dir(&gpio_d, GPIO_BANK(pin), GPIO_BIT(pin), dir);
+}
+
+int gpio_write_mask(int bank, uint32_t mask, uint32_t value)
+{
+	return gpio_dev_write(&gpio_d, bank, mask, value);
+}
+
+int gpio_write(int pin, int value)
+{
+	return gpio_dev_write(&gpio_d, GPIO_BANK(pin), GPIO_BIT(pin), value ? GPIO_BIT(pin) : 0);
+}
+
+int gpio_read_bank(int bank, uint32_t *value)
+{
+	if (gpio_d.ops == NULL || bank < 0 || bank >= GPIO_BANKS)
+		return -1;
+	gpio_d.ioctls++;
+	return gpio_d.ops->read(&gpio_d, bank, value);
+}
+
+int gpio_read(int pin)
+{
+	uint32_t v;
+
+	if (gpio_read_bank(GPIO_BANK(pin), &v) != 0)
+		return -1;
+	return (v & GPIO_BIT(pin)) != 0;
+}
+
+//-去抖:电平稳定debounce_ms以后和已经送出的不一样才送出,中间抖动的只计数
+static void gpio_deliver(struct gpio_line *l)
+{
+	struct gpio_event e;
+
+	if (l->raw == l->value)
+		return;
+	l->value = l->raw;
+	if (!(l->edges & (l->value ? GPIO_EDGE_RISING : GPIO_EDGE_FALLING)))
+		return;
+	e.pin = l->pin;
+	e.value = l->value;
+	e.ts_ns = l->ts_ns;
+	e.count = ++l->nevents;
+	e.edges = l->nedges;
+	l->fn(&e, l->arg);
+}
+
+static void gpio_debounce_cb(struct timer *t)
+{
+	gpio_deliver(t->arg);
+}
+
+//-后端读到一个边沿
+void gpio_line_edge(struct gpio_line *l, int value, uint64_t ts_ns)
+{
+	l->nedges++;
+	l->raw = value;
+	l->ts_ns = ts_ns;
+	if (l->debounce_ms > 0)
+		timer_start(&l->debounce, l->debounce_ms, 0);
 	else
-	{
-		printf("turn on SEC LED = 0x%x\n", data);
-		//turn on all LEDs
-		gpio_write_int(gpio3100, 0);
+		gpio_deliver(l);
+}
+
+static void gpio_line_cb(struct ev_io *io, unsigned int revents)
+{
+	struct gpio_line *l = io->arg;
+
+	gpio_d.ops->edge(l);
+}
+
+//-回调在主循环里执行;不要在回调里gpio_unwatch自己
+struct gpio_line *gpio_watch(int pin, int edges, int debounce_ms, gpio_event_fn fn, void *arg)
+{
+	struct gpio_line *l;
+	int events;
+
+	if (gpio_d.ops == NULL || pin < 0 || pin >= GPIO_BANKS * 32)
+		return NULL;
+	l = calloc(1, sizeof(*l));
+	if (l == NULL)
+		return NULL;
+	l->pin = pin;
+	l->fd = l->aux = -1;
+	l->edges = edges;
+	l->debounce_ms = debounce_ms;
+	l->fn = fn;
+	l->arg = arg;
+	events = gpio_d.ops->watch(&gpio_d, l);
+	if (events <= 0) {
+		LOG(LOGM_GPIO, LOG_ERR, "%s: watch gpio %d: %s", gpio_d.ops->name, pin, strerror(errno));
+		gpio_d.ops->unwatch(&gpio_d, l);
+		free(l);
+		return NULL;
 	}
-	
-	//-测试用
-	//-while(1)
-	//-{
-	//-		gpio_write_int(gpio3100, 0x00000800);
-	//-		sleep(1);		//-单位是秒
-	//-		gpio_write_int(gpio3100, 0x00000000);
-	//-		sleep(1);
-	//-}
+	l->value = l->raw;
+	timer_setup(&l->debounce, gpio_debounce_cb, l);
+	ev_io_init(&l->io, l->fd, events, gpio_line_cb, l);
+	if (ev_add(&l->io) != 0) {
+		gpio_d.ops->unwatch(&gpio_d, l);
+		free(l);
+		return NULL;
+	}
+	l->next = gpio_lines;
+	gpio_lines = l;
+	LOG(LOGM_GPIO, LOG_INFO, "watching gpio %d, level %d, debounce %d ms", pin, l->raw, debounce_ms);
+	return l;
+}
+
+void gpio_unwatch(struct gpio_line *l)
+{
+	struct gpio_line **pp;
 
+	for (pp = &gpio_lines; *pp; pp = &(*pp)->next) {
+		if (*pp == l) {
+			*pp = l->next;
+			break;
+		}
+	}
+	ev_del(&l->io);
+	timer_cancel(&l->debounce);
+	gpio_d.ops->unwatch(&gpio_d, l);
+	free(l);
 }
 
-void gpio_led_blink(void)
+//-SIGUSR1统计
+void gpio_stats(void)
 {
-		gpio_write_int(gpio3100, 0x00000800);
-		sleep(1);		//-单位是秒
-		gpio_write_int(gpio3100, 0x00000000);
-		//-usleep(1000*500);
-		sleep(1);
+	struct gpio_line *l;
+
+	if (gpio_d.ops == NULL)
+		return;
+	LOG(LOGM_GPIO, LOG_INFO, "gpio %s: %lu driver calls", gpio_d.ops->name, gpio_d.ioctls);
+	for (l = gpio_lines; l; l = l->next)
+		LOG(LOGM_GPIO, LOG_INFO, "gpio %d: level %d, %lu edges, %lu events", l->pin, l->value, l->nedges, l->nevents);
 }
+
+/*
+基准测试(dreamflower_app -D -T):8个引脚换一次电平.
+驱动用/dev/null代替(ioctl返回错误,但系统调用的开销是一样的).
 */
+#define GPIO_BENCH_DEV	"/dev/null"
+
+static struct gpio_dev gpio_bench_d;
+
+//-以前的写法:每个引脚open+ioctl+close
+static void bench_gpio_reopen(long iters, void *arg)
+{
+	long i;
+	int pin, fd;
+
+	for (i = 0; i < iters; i++) {
+		for (pin = 0; pin < 8; pin++) {
+			fd = open(GPIO_BENCH_DEV, O_RDONLY);
+			bench_keep(ioctl(fd, RALINK_GPIO_WRITE, (i & 1) << pin));
+			close(fd);
+		}
+	}
+}
+
+//-句柄一直打开,每个引脚一个ioctl
+static void bench_gpio_pin(long iters, void *arg)
+{
+	long i;
+	int pin;
+
+	for (i = 0; i < iters; i++)
+		for (pin = 0; pin < 8; pin++)
+			gpio_dev_write(&gpio_bench_d, 0, 1u << pin, (i & 1) ? ~0u : 0);
+}
 
+//-一组里的8个引脚一个ioctl
+static void bench_gpio_mask(long iters, void *arg)
+{
+	long i;
 
+	for (i = 0; i < iters; i++)
+		gpio_dev_write(&gpio_bench_d, 0, 0xff, (i & 1) ? ~0u : 0);
+}
 
+void gpio_Bench(void)
+{
+	if (gpio_bench_d.ops == NULL) {
+		gpio_bench_d.fd = open(GPIO_BENCH_DEV, O_RDONLY | O_CLOEXEC);
+		gpio_bench_d.ops = &gpio_ralink_ops;
+	}
+	bench_add("gpio_reopen_x8", bench_gpio_reopen, NULL);
+	bench_add("gpio_pin_x8", bench_gpio_pin, NULL);
+	bench_add("gpio_mask_x8", bench_gpio_mask, NULL);
+}
 
 void usage(char *cmd)
 {//-作为一个系统中的应用,下面的信息打印就不需要去深究了,知道使用的前提和效果就好
-	printf("Usage: %s w - writing test (output)\n", cmd);
-	printf("       %s r - reading test (input)\n", cmd);
-	printf("       %s i (<gpio>) - interrupt test for gpio number\n", cmd);
-	printf("       %s l <gpio> <on> <off> <blinks> <rests> <times>\n", cmd);
-	printf("            - set led on <gpio>(0~24) on/off interval, no. of blinking/resting cycles, times of blinking\n");
+	printf("Usage: %s w,<gpio>,<0|1> - writing test (output)\n", cmd);
+	printf("       %s r(,<gpio>) - reading test (input)\n", cmd);
+	printf("       %s i(,<gpio>(,<debounce ms>)) - interrupt test for gpio number\n", cmd);
+	printf("       %s l,<gpio>,<on>,<off>,<blinks>,<rests>,<times>\n", cmd);
+	printf("            - set led on <gpio>(0~95) on/off interval (%d ms units), no. of blinking/resting cycles, times of blinking (%d: forever)\n", LED_UNIT_MS, LED_FOREVER);
 	exit(0);
 }
 
+static void gpio_sub_event(struct gpio_event *e, void *arg)
+{
+	LOG(LOGM_GPIO, LOG_INFO, "gpio %d -> %d at %llu.%09llu, event %lu, %lu edges", e->pin, e->value,
+	    (unsigned long long)(e->ts_ns / 1000000000ULL), (unsigned long long)(e->ts_ns % 1000000000ULL), e->count, e->edges);
+}
+
+//-参数用逗号隔开,和usage()里的一样,例如-G i,12,50
+int gpio_sub(const char *args)
+{
+	char buf[64], *argv[8], *p, *sv;
+	int argc = 0, pin, bank;
+	struct led_pattern lp;
+	uint32_t v;
+
+	snprintf(buf, sizeof(buf), "%s", args);
+	argv[argc++] = "-G";
+	for (p = strtok_r(buf, ",", &sv); p && argc < 8; p = strtok_r(NULL, ",", &sv))
+		argv[argc++] = p;
+	if (argc < 2)
+		usage(argv[0]);
+	if (gpio_open(gpio_spec) != 0)
+		return -1;
+	switch (argv[1][0]) {
+	case 'w':
+		if (argc < 4)
+			usage(argv[0]);
+		pin = atoi(argv[2]);
+		if (gpio_dir(pin, gpio_out) != 0 || gpio_write(pin, atoi(argv[3])) != 0)
+			return -1;
+		printf("gpio %d = %d\n", pin, atoi(argv[3]) != 0);
+		return 0;
+	case 'r':
+		if (argc >= 3) {
+			pin = atoi(argv[2]);
+			printf("gpio %d = %d\n", pin, gpio_read(pin));
+			return 0;
+		}
+		for (bank = 0; bank < GPIO_BANKS; bank++)
+			if (gpio_read_bank(bank, &v) == 0)
+				printf("gpio %d-%d = 0x%08x\n", bank * 32 + 31, bank * 32, v);
+		return 0;
+	case 'i':
+		pin = argc >= 3 ? atoi(argv[2]) : 0;
+		return gpio_watch(pin, GPIO_EDGE_BOTH, argc >= 4 ? atoi(argv[3]) : GPIO_DEBOUNCE_MS, gpio_sub_event, NULL) ? 0 : -1;
+	case 'l':
+		if (argc < 8)
+			usage(argv[0]);
+		lp.on = atoi(argv[3]);
+		lp.off = atoi(argv[4]);
+		lp.blinks = atoi(argv[5]);
+		lp.rests = atoi(argv[6]);
+		lp.times = atoi(argv[7]);
+		return led_pattern(atoi(argv[2]), &lp);
+	default:
+		usage(argv[0]);
+	}
+	return -1;
+}
+
 /*
 现在需要实现运行灯的闪耀,就不用负责的方法了,就是定时改变电平,以最简单的方法来实现功能就行.
 
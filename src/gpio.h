@@ -0,0 +1,112 @@
+//-为了方便调试定义了系列变量以便调试输出
+
+#ifndef GPIO_H
+#define GPIO_H
+
+#include <stdint.h>
+
+#include "event.h"
+#include "timer.h"
+
+/*
+GPIO:设备只在gpio_open时打开一次,以后每次读写就是一个ioctl.
+引脚按32个一组(bank),和Ralink的寄存器一致:gpio3100/gpio6332/gpio9564.
+同一组里的多个引脚用gpio_write_mask一次写完,保存了输出的影子值,不用先读.
+后端:
+ralink	/dev/gpio,MT7688 SDK的ralink_gpio驱动
+chip	/dev/gpiochipN,内核的GPIO字符设备
+mock	内存里的寄存器,没有硬件时测试和基准测试用
+输入引脚的边沿用gpio_watch变成事件循环里的事件:chip用内核的line event(带内核时间戳),
+ralink用sysfs的value文件poll(EV_PRI),mock用一个管道,gpio_mock_set产生边沿.
+*/
+#define GPIO_BANKS	3
+#define GPIO_BANK(pin)	((pin) >> 5)
+#define GPIO_BIT(pin)	(1u << ((pin) & 31))
+
+enum {
+	gpio_in,
+	gpio_out,
+};
+enum {
+	gpio3100,			//-0
+	gpio6332,			//-1
+	gpio9564,			//-2
+};
+
+#define GPIO_EDGE_RISING	1
+#define GPIO_EDGE_FALLING	2
+#define GPIO_EDGE_BOTH		3
+
+struct gpio_dev;
+struct gpio_line;
+
+struct gpio_event {
+	int pin;
+	int value;			//-去抖以后的电平
+	uint64_t ts_ns;			//-最后一个边沿的时间,chip是内核时间戳,sysfs是收到的时间
+	unsigned long count;		//-这个引脚送出的第几个事件
+	unsigned long edges;		//-一共看到了多少个原始边沿(包括被去抖滤掉的)
+};
+typedef void (*gpio_event_fn)(struct gpio_event *e, void *arg);
+
+//-一个被监视的输入引脚,gpio_watch分配
+struct gpio_line {
+	int pin;
+	int fd;
+	int aux;			//-后端自己用(mock:管道的写端)
+	int edges;			//-GPIO_EDGE_*,要送出的边沿
+	int debounce_ms;		//-0:每个边沿都送出
+	int raw;			//-最后一个边沿之后的电平
+	int value;			//-已经送出的电平
+	uint64_t ts_ns;
+	unsigned long nedges;
+	unsigned long nevents;
+	struct ev_io io;
+	struct timer debounce;
+	gpio_event_fn fn;
+	void *arg;
+	struct gpio_line *next;
+};
+
+struct gpio_ops {
+	const char *name;
+	const char *path;		//-默认设备
+	int  (*open)(struct gpio_dev *d, const char *path);
+	void (*close)(struct gpio_dev *d);
+	int  (*set_dir)(struct gpio_dev *d, int bank, uint32_t mask, int dir);
+	int  (*write)(struct gpio_dev *d, int bank, uint32_t mask, uint32_t value);	//-value是整组的新值,只改mask里的引脚
+	int  (*read)(struct gpio_dev *d, int bank, uint32_t *value);
+	int  (*watch)(struct gpio_dev *d, struct gpio_line *l);		//-填l->fd,l->io的事件和l->raw
+	void (*unwatch)(struct gpio_dev *d, struct gpio_line *l);
+	int  (*edge)(struct gpio_line *l);				//-fd可读时调用,对每个边沿调gpio_line_edge
+};
+
+struct gpio_dev {
+	const struct gpio_ops *ops;
+	int fd;
+	uint32_t dir[GPIO_BANKS];	//-1表示输出
+	uint32_t out[GPIO_BANKS];	//-输出的影子值
+	unsigned long ioctls;		//-一共调用了多少次驱动,统计用
+	void *priv;
+};
+
+extern const char *gpio_spec;		//--g 后端[:设备],默认ralink
+
+int  gpio_open(const char *spec);	//-"ralink" "chip:/dev/gpiochip0" "mock"
+void gpio_close(void);
+struct gpio_dev *gpio_get(void);	//-没有打开返回NULL
+int  gpio_dir(int pin, int dir);
+int  gpio_dir_mask(int bank, uint32_t mask, int dir);
+int  gpio_write(int pin, int value);
+int  gpio_write_mask(int bank, uint32_t mask, uint32_t value);
+int  gpio_read(int pin);		//-返回0/1,出错返回-1
+int  gpio_read_bank(int bank, uint32_t *value);
+struct gpio_line *gpio_watch(int pin, int edges, int debounce_ms, gpio_event_fn fn, void *arg);
+void gpio_unwatch(struct gpio_line *l);
+void gpio_line_edge(struct gpio_line *l, int value, uint64_t ts_ns);
+void gpio_mock_set(int bank, uint32_t value);	//-mock:改变输入引脚的电平,监视的引脚产生边沿
+void gpio_stats(void);
+int  gpio_sub(const char *args);	//--G 测试:"w,<gpio>,<0|1>" "r[,<gpio>]" "i[,<gpio>[,<debounce ms>]]" "l,<gpio>,<on>,<off>,<blinks>,<rests>,<times>"
+void gpio_Bench(void);
+
+#endif /* GPIO_H */
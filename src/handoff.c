@@ -0,0 +1,285 @@
+/*
+此文件是热重启的状态交接.
+以前升级就是杀掉老进程再启动新的:串口fd关掉重新打开,UART0_Set里tcflush把输入缓冲清掉,
+read_data里拼了一半的帧也丢了,升级的那一刻发过来的命令就没有回复.
+现在新进程加-H启动:
+1.连到老进程的Unix socket(抽象命名空间,不留文件).
+2.老进程让每个登记过的模块停下来(串口从事件循环里拿掉,不再读),把状态和fd一起用一个
+  SOCK_SEQPACKET消息发过来,fd走SCM_RIGHTS.这期间串口收到的数据留在内核缓冲里.
+3.新进程回一个'K'确认,老进程就退出;没有确认(新进程启动失败)老进程恢复原样继续运行.
+4.新进程直接用收到的fd,不再打开和设置串口,接着拼老进程没拼完的帧.
+监听socket也交过来,下一次热重启还用它.pcap句柄没有办法从fd恢复,抓包由新进程重新打开.
+*/
+
+#define _GNU_SOURCE
+#include "debugfl.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/time.h>
+
+#include "event.h"
+#include "handoff.h"
+
+#define HANDOFF_NAME	"dreamflower_app.handoff"	//-抽象socket名字,前面加\0
+#define HANDOFF_MAX	8
+#define HANDOFF_MAGIC	0x44464831	//-"DFH1",结构变了要改
+#define HANDOFF_TMO_MS	3000
+
+struct handoff_item {
+	char name[16];
+	int has_fd;			//-按顺序对应SCM_RIGHTS里的fd
+	int len;
+	unsigned char data[HANDOFF_DATA];
+};
+
+struct handoff_msg {
+	unsigned int magic;
+	int n;
+	struct handoff_item item[HANDOFF_MAX];
+};
+
+struct handoff_mod {
+	char name[16];
+	handoff_save_fn save;
+	handoff_resume_fn resume;
+	void *arg;
+};
+
+extern volatile sig_atomic_t _running;
+
+int handoff_done = 0;
+
+static struct handoff_mod handoff_mods[HANDOFF_MAX];
+static int handoff_nmods = 0;
+
+static struct handoff_msg handoff_in;		//-新进程收到的
+static int handoff_in_fd[HANDOFF_MAX];
+
+static int handoff_lfd = -1;
+static struct ev_io handoff_io;
+
+static socklen_t handoff_addr(struct sockaddr_un *sa)
+{
+	memset(sa, 0, sizeof(*sa));
+	sa->sun_family = AF_UNIX;
+	memcpy(sa->sun_path + 1, HANDOFF_NAME, strlen(HANDOFF_NAME));
+	return offsetof(struct sockaddr_un, sun_path) + 1 + strlen(HANDOFF_NAME);
+}
+
+static void handoff_timeout(int fd)
+{
+	struct timeval tv = { HANDOFF_TMO_MS / 1000, (HANDOFF_TMO_MS % 1000) * 1000 };
+
+	setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+	setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+}
+
+int handoff_register(const char *name, handoff_save_fn save, handoff_resume_fn resume, void *arg)
+{
+	struct handoff_mod *m;
+
+	if (handoff_nmods >= HANDOFF_MAX)
+		return -1;
+	m = &handoff_mods[handoff_nmods++];
+	snprintf(m->name, sizeof(m->name), "%s", name);
+	m->save = save;
+	m->resume = resume;
+	m->arg = arg;
+	return 0;
+}
+
+//-老进程:把所有模块的状态和fd发给新进程,等确认
+static void handoff_send(int cfd)
+{
+	static struct handoff_msg msg;	//-4KB多,不放在栈上
+	union {
+		char buf[CMSG_SPACE(sizeof(int) * HANDOFF_MAX)];
+		struct cmsghdr align;
+	} ctl;
+	struct msghdr mh;
+	struct iovec iov;
+	struct cmsghdr *cm;
+	struct ucred cred;
+	socklen_t clen = sizeof(cred);
+	int fds[HANDOFF_MAX], nfds = 0, i, fd, len;
+	char ack = 0;
+
+	//-只交给同一个用户(或者root)启动的进程
+	if (getsockopt(cfd, SOL_SOCKET, SO_PEERCRED, &cred, &clen) != 0
+			|| (cred.uid != getuid() && cred.uid != 0)) {
+		LOG(LOGM_MAIN, LOG_WARN, "handoff: refused peer uid %d", (int)cred.uid);
+		return;
+	}
+	memset(&msg, 0, sizeof(msg));
+	msg.magic = HANDOFF_MAGIC;
+	for (i = 0; i < handoff_nmods; i++) {
+		struct handoff_item *it = &msg.item[msg.n];
+
+		fd = -1;
+		len = handoff_mods[i].save(handoff_mods[i].arg, &fd, it->data, sizeof(it->data));
+		if (len < 0)
+			continue;
+		memcpy(it->name, handoff_mods[i].name, sizeof(it->name));
+		it->len = len;
+		it->has_fd = fd >= 0;
+		if (fd >= 0)
+			fds[nfds++] = fd;
+		msg.n++;
+	}
+
+	memset(&mh, 0, sizeof(mh));
+	iov.iov_base = &msg;
+	iov.iov_len = offsetof(struct handoff_msg, item) + msg.n * sizeof(msg.item[0]);
+	mh.msg_iov = &iov;
+	mh.msg_iovlen = 1;
+	if (nfds > 0) {
+		mh.msg_control = ctl.buf;
+		mh.msg_controllen = CMSG_SPACE(sizeof(int) * nfds);
+		cm = CMSG_FIRSTHDR(&mh);
+		cm->cmsg_level = SOL_SOCKET;
+		cm->cmsg_type = SCM_RIGHTS;
+		cm->cmsg_len = CMSG_LEN(sizeof(int) * nfds);
+		memcpy(CMSG_DATA(cm), fds, sizeof(int) * nfds);
+	}
+	handoff_timeout(cfd);
+	if (sendmsg(cfd, &mh, MSG_NOSIGNAL) < 0 || recv(cfd, &ack, 1, 0) != 1 || ack != 'K') {
+		LOG(LOGM_MAIN, LOG_WARN, "handoff to pid %d failed, resuming", (int)cred.pid);
+		for (i = 0; i < handoff_nmods; i++)
+			if (handoff_mods[i].resume)
+				handoff_mods[i].resume(handoff_mods[i].arg);
+		return;
+	}
+	LOG(LOGM_MAIN, LOG_INFO, "handed off %d items to pid %d, exiting", msg.n, (int)cred.pid);
+	handoff_done = 1;
+	_running = 0;
+}
+
+static void handoff_accept_cb(struct ev_io *io, unsigned int revents)
+{
+	int cfd = accept4(io->fd, NULL, NULL, SOCK_CLOEXEC);
+
+	if (cfd < 0)
+		return;
+	handoff_send(cfd);
+	close(cfd);
+}
+
+//-监听socket自己也是一项,新进程接着用
+static int handoff_save_listen(void *arg, int *fd, void *buf, int size)
+{
+	*fd = handoff_lfd;
+	return 0;
+}
+
+int handoff_listen(void)
+{
+	struct sockaddr_un sa;
+	socklen_t len = handoff_addr(&sa);
+	int fd;
+
+	if (handoff_find("listen", &fd, NULL, 0) < 0 || fd < 0) {
+		fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+		if (fd < 0)
+			return -1;
+		if (bind(fd, (struct sockaddr *)&sa, len) != 0 || listen(fd, 1) != 0) {
+			//-EADDRINUSE:已经有一个在运行,这个进程不能被热重启,其他照常
+			LOG(LOGM_MAIN, LOG_WARN, "handoff: listen: %s", strerror(errno));
+			close(fd);
+			return -1;
+		}
+	}
+	handoff_lfd = fd;
+	handoff_register("listen", handoff_save_listen, NULL, NULL);
+	ev_io_init(&handoff_io, fd, EV_READ, handoff_accept_cb, NULL);
+	return ev_add(&handoff_io);
+}
+
+//-新进程:连老进程,收状态和fd,确认.返回0表示收到了
+int handoff_receive(void)
+{
+	union {
+		char buf[CMSG_SPACE(sizeof(int) * HANDOFF_MAX)];
+		struct cmsghdr align;
+	} ctl;
+	struct sockaddr_un sa;
+	socklen_t len = handoff_addr(&sa);
+	struct msghdr mh;
+	struct iovec iov;
+	struct cmsghdr *cm;
+	int fd, i, k, nfds = 0, *fds = NULL;
+	ssize_t n;
+
+	for (i = 0; i < HANDOFF_MAX; i++)
+		handoff_in_fd[i] = -1;
+	fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+	if (fd < 0)
+		return -1;
+	if (connect(fd, (struct sockaddr *)&sa, len) != 0) {
+		LOG(LOGM_MAIN, LOG_INFO, "handoff: no running instance (%s), cold start", strerror(errno));
+		close(fd);
+		return -1;
+	}
+	handoff_timeout(fd);
+	memset(&mh, 0, sizeof(mh));
+	iov.iov_base = &handoff_in;
+	iov.iov_len = sizeof(handoff_in);
+	mh.msg_iov = &iov;
+	mh.msg_iovlen = 1;
+	mh.msg_control = ctl.buf;
+	mh.msg_controllen = sizeof(ctl.buf);
+	n = recvmsg(fd, &mh, MSG_CMSG_CLOEXEC);
+	for (cm = CMSG_FIRSTHDR(&mh); n > 0 && cm; cm = CMSG_NXTHDR(&mh, cm)) {
+		if (cm->cmsg_level == SOL_SOCKET && cm->cmsg_type == SCM_RIGHTS) {
+			fds = (int *)CMSG_DATA(cm);
+			nfds = (cm->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+		}
+	}
+	if (n < (ssize_t)offsetof(struct handoff_msg, item) || handoff_in.magic != HANDOFF_MAGIC
+			|| handoff_in.n < 0 || handoff_in.n > HANDOFF_MAX || (mh.msg_flags & (MSG_TRUNC | MSG_CTRUNC))) {
+		LOG(LOGM_MAIN, LOG_ERR, "handoff: bad message (%d bytes)", (int)n);
+		for (i = 0; i < nfds; i++)
+			close(fds[i]);
+		handoff_in.n = 0;
+		close(fd);		//-老进程收不到确认,会自己恢复
+		return -1;
+	}
+	for (i = 0, k = 0; i < handoff_in.n; i++)
+		if (handoff_in.item[i].has_fd && k < nfds)
+			handoff_in_fd[i] = fds[k++];
+	if (send(fd, "K", 1, MSG_NOSIGNAL) != 1) {
+		//-老进程已经不在了,fd都是有效的,照样用
+		LOG(LOGM_MAIN, LOG_WARN, "handoff: ack: %s", strerror(errno));
+	}
+	close(fd);
+	LOG(LOGM_MAIN, LOG_INFO, "handoff: received %d items, %d fds", handoff_in.n, nfds);
+	return 0;
+}
+
+int handoff_find(const char *name, int *fd, void *buf, int size)
+{
+	struct handoff_item *it;
+	int i, len;
+
+	for (i = 0; i < handoff_in.n; i++) {
+		it = &handoff_in.item[i];
+		if (strncmp(it->name, name, sizeof(it->name)) != 0)
+			continue;
+		len = it->len < size ? it->len : size;
+		if (buf && len > 0)
+			memcpy(buf, it->data, len);
+		if (fd)
+			*fd = handoff_in_fd[i];
+		return it->len;
+	}
+	return -1;
+}
@@ -0,0 +1,24 @@
+//-为了方便调试定义了系列变量以便调试输出
+
+#ifndef HANDOFF_H
+#define HANDOFF_H
+
+/*
+热重启:新进程(-H)连到老进程的Unix socket,老进程把打开的fd(SCM_RIGHTS)和各模块的状态交过来.
+模块用handoff_register登记:
+save	交接时调用,停止使用fd,把状态写到buf,返回长度,*fd填要交出去的fd(没有填-1)
+resume	新进程没有确认时调用,老进程恢复原样继续运行
+*/
+#define HANDOFF_DATA	512		//-每个模块状态的最大字节数
+
+typedef int  (*handoff_save_fn)(void *arg, int *fd, void *buf, int size);
+typedef void (*handoff_resume_fn)(void *arg);
+
+extern int handoff_done;		//-老进程:已经交接完,退出时不要删pidfile
+
+int handoff_register(const char *name, handoff_save_fn save, handoff_resume_fn resume, void *arg);
+int handoff_receive(void);		//-新进程:从老进程接收,没有老进程返回-1
+int handoff_find(const char *name, int *fd, void *buf, int size);	//-返回状态长度,没有这一项返回-1
+int handoff_listen(void);		//-开始等下一次热重启,接收到的监听socket直接用
+
+#endif /* HANDOFF_H */
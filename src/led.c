@@ -0,0 +1,159 @@
+/*
+此文件是LED闪烁.以前gpio_led_blink是写一次电平sleep(1)再写一次,调用的地方整个停住,
+现在每个LED一个定时器,几个LED各闪各的,闪法随时可以换(比如用来表示连接状态).
+每次翻转就是一次gpio_write,电平没有变不调驱动.
+*/
+
+#include "debugfl.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "timer.h"
+#include "gpio.h"
+#include "led.h"
+
+enum {
+	LED_IDLE,		//-常亮/常灭/闪完了
+	LED_ON,
+	LED_OFF,
+	LED_REST,
+};
+
+struct led {
+	int pin;
+	int lit;
+	int phase;
+	unsigned int blink;		//-这一轮闪了几次
+	unsigned int rep;		//-已经闪完了几轮
+	struct led_pattern p;
+	struct timer t;
+	struct led *next;
+};
+
+static const struct {
+	const char *name;
+	struct led_pattern p;
+} led_names[] = {
+	{ "off",	{ 0, 0, 0, 0, 0 } },
+	{ "on",		{ 1, 0, 0, 0, 0 } },
+	{ "slow",	{ 10, 10, 1, 0, LED_FOREVER } },
+	{ "fast",	{ 1, 1, 1, 0, LED_FOREVER } },
+	{ "heartbeat",	{ 1, 2, 2, 3, LED_FOREVER } },
+};
+
+int led_active_low = 1;
+
+static struct led *leds;
+
+static void led_apply(struct led *l, int lit)
+{
+	l->lit = lit;
+	gpio_write(l->pin, lit ^ led_active_low);
+}
+
+static void led_start(struct led *l, int phase, unsigned int units)
+{
+	l->phase = phase;
+	timer_start(&l->t, units * LED_UNIT_MS, 0);
+}
+
+static void led_step(struct timer *t)
+{
+	struct led *l = t->arg;
+
+	switch (l->phase) {
+	case LED_ON:
+		led_apply(l, 0);
+		led_start(l, LED_OFF, l->p.off);
+		return;
+	case LED_OFF:
+		if (++l->blink < l->p.blinks) {
+			led_apply(l, 1);
+			led_start(l, LED_ON, l->p.on);
+			return;
+		}
+		if (l->p.rests > 0) {
+			led_start(l, LED_REST, l->p.rests * (l->p.on + l->p.off));
+			return;
+		}
+		/* fall through */
+	case LED_REST:
+		if (l->p.times != LED_FOREVER && ++l->rep >= l->p.times) {
+			l->phase = LED_IDLE;
+			LOG(LOGM_GPIO, LOG_DBG, "led %d: pattern done", l->pin);
+			return;
+		}
+		l->blink = 0;
+		led_apply(l, 1);
+		led_start(l, LED_ON, l->p.on);
+		return;
+	}
+}
+
+static struct led *led_get(int pin)
+{
+	struct led *l;
+
+	for (l = leds; l; l = l->next)
+		if (l->pin == pin)
+			return l;
+	if (gpio_dir(pin, gpio_out) != 0)
+		return NULL;
+	l = calloc(1, sizeof(*l));
+	if (l == NULL)
+		return NULL;
+	l->pin = pin;
+	timer_setup(&l->t, led_step, l);
+	l->next = leds;
+	leds = l;
+	return l;
+}
+
+int led_pattern(int pin, const struct led_pattern *p)
+{
+	struct led *l = led_get(pin);
+
+	if (l == NULL)
+		return -1;
+	timer_cancel(&l->t);
+	l->p = *p;
+	if (l->p.blinks == 0)
+		l->p.blinks = 1;
+	l->blink = 0;
+	l->rep = 0;
+	l->phase = LED_IDLE;
+	LOG(LOGM_GPIO, LOG_INFO, "led %d: on %u off %u blinks %u rests %u times %u",
+	    pin, p->on, p->off, p->blinks, p->rests, p->times);
+	if (p->on == 0 || p->off == 0 || p->times == 0) {
+		led_apply(l, p->on != 0 && p->off == 0);	//-常亮或者常灭
+		return 0;
+	}
+	led_apply(l, 1);
+	led_start(l, LED_ON, l->p.on);
+	return 0;
+}
+
+int led_named(int pin, const char *name)
+{
+	unsigned int i;
+
+	for (i = 0; i < sizeof(led_names) / sizeof(led_names[0]); i++)
+		if (strcmp(led_names[i].name, name) == 0)
+			return led_pattern(pin, &led_names[i].p);
+	LOG(LOGM_GPIO, LOG_WARN, "led %d: unknown pattern %s", pin, name);
+	return -1;
+}
+
+void led_close(void)
+{
+	struct led *l;
+
+	while ((l = leds) != NULL) {
+		leds = l->next;
+		timer_cancel(&l->t);
+		led_apply(l, 0);
+		free(l);
+	}
+}
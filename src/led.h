@@ -0,0 +1,29 @@
+//-为了方便调试定义了系列变量以便调试输出
+
+#ifndef LED_H
+#define LED_H
+
+/*
+LED闪烁:每个LED一个定时器,在主循环里翻转电平,不阻塞串口和抓包.
+参数和ralink驱动的LED一样:亮on个单位,灭off个单位,这样闪blinks次,再灭rests个(on+off)周期,
+整个重复times次(LED_FOREVER一直闪).单位LED_UNIT_MS.
+随时可以用led_pattern换成新的闪法,从头开始.
+*/
+#define LED_UNIT_MS	100
+#define LED_FOREVER	4000		//-和驱动的RALINK_GPIO_LED_INFINITY一样
+
+struct led_pattern {
+	unsigned int on;		//-0:常灭
+	unsigned int off;		//-0:常亮
+	unsigned int blinks;
+	unsigned int rests;
+	unsigned int times;
+};
+
+extern int led_active_low;		//-1:输出0灯亮(开发板上的SEC灯就是这样)
+
+int  led_pattern(int pin, const struct led_pattern *p);
+int  led_named(int pin, const char *name);	//-"off" "on" "slow" "fast" "heartbeat"
+void led_close(void);			//-全部灭掉,退出时调用
+
+#endif /* LED_H */
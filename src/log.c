@@ -0,0 +1,1018 @@
+/*
+此文件是日志输出.
+以前的f_debug每次调用都要system("touch")起一个进程,再open一次文件并且不关闭,固定写100个字节;
+DEBUG()前缀写到stderr内容写到stdout,两边的缓冲不同,输出经常错位.在收帧的路径上调用一次就是几毫秒.
+现在:
+1.调用的线程不格式化,只把调用点(struct log_site)和参数的原始值放进一个固定大小的环形队列
+  (多个线程写,一个线程读,不加锁).每个格子有自己的序号,写的线程用CAS抢位置,写完再发布序号,
+  读的线程看序号就知道这一格好了没有.字符串参数要复制,因为调用返回后指针就可能失效了.
+2.后台线程一次取出最多LOG_BATCH条,格式化以后一次write写到文件.
+3.队列满了就丢掉并计数,不会让串口或者抓包线程等磁盘;写线程下次写的时候报告丢了多少条.
+4.写线程还没启动(daemon_init之前)或者已经停止时,直接同步写.
+5.-B写二进制:调用点编号+时间差+参数,整数用变长编码.每次启动先写一个头,里面是所有调用点的
+  格式串,所以dflogdump不需要和设备上的程序是同一个编译结果,在PC上也能还原.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "log.h"
+#include "fbuf.h"
+#include "bench.h"
+
+#define LOG_CELLS	1024		//-队列长度,必须是2的幂,一共占LOG_CELLS*256字节
+#define LOG_MSG		224		//-一条日志参数的最大字节数,超过的字符串截断
+#define LOG_BATCH	64		//-写线程一次最多写的条数
+#define LOG_LINE	512		//-格式化以后一行的最大长度
+#define LOG_MAGIC	"DFLB"
+#define LOG_VERSION	1
+
+//-二进制文件里每条记录开头的标记
+#define LOG_TAG_HEADER	0
+#define LOG_TAG_SITE	2		//-调用点编号+LOG_TAG_SITE
+
+struct log_cell {
+	unsigned long seq;		//-等于写位置说明空闲,等于写位置+1说明写好了
+	uint64_t ts;			//-CLOCK_REALTIME ns
+	const struct log_site *site;
+	unsigned short len;
+	struct fbuf *fb;		//-LOG_FRAME的帧,写完放回
+	unsigned char arg[LOG_MSG];	//-整数/浮点/指针各8字节,字符串1字节长度+内容
+};
+
+int log_level = LOG_INFO;
+unsigned int log_mask = ~0u;
+unsigned long log_dropped = 0;
+int log_binary = 0;
+
+//-链接器给logfmt段生成的起止地址;dflogdump里没有调用点,所以是weak
+extern struct log_site __start_logfmt[] __attribute__((weak));
+extern struct log_site __stop_logfmt[] __attribute__((weak));
+
+static struct log_cell log_q[LOG_CELLS];
+static unsigned long log_enq;		//-多个线程竞争
+static unsigned long log_deq;		//-只有写线程改,log_queue_fill读
+
+static int log_fd = 2;
+static int log_running = 0;		//-写线程在跑
+static int log_stopping = 0;
+static int log_idle = 0;		//-写线程在等,写进队列后要叫醒它
+static pthread_t log_tid;
+static pthread_mutex_t log_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t log_cond = PTHREAD_COND_INITIALIZER;
+
+//-下面这些只在log_emit里(持有log_emit_lock)用
+static pthread_mutex_t log_emit_lock = PTHREAD_MUTEX_INITIALIZER;
+static char log_out[LOG_BATCH * LOG_LINE];
+static int log_hdr_done = 0;
+static uint64_t log_last_us;
+
+static const char log_lvl_ch[] = "EWID";
+static const char *log_mod_name[LOGM_NR] = { "main", "uart", "pcap", "pool", "ev", "gpio", "modbus" };
+
+static void log_init_cells(void)
+{
+	static int done = 0;
+	unsigned long i;
+
+	if (done)
+		return;
+	for (i = 0; i < LOG_CELLS; i++)
+		log_q[i].seq = i;
+	done = 1;
+}
+
+/*
+格式串解析:每个参数一个字母
+i int  l long  q long long  z size_t  p 指针  d double  D long double  s 字符串  h LOG_HEX的字节
+F LOG_FRAME的帧(调用时不复制,写的时候从缓冲里取)
+T 不支持的格式,调用时已经格式化成了字符串
+*/
+static int log_parse(const char *fmt, int hex, char *types)
+{
+	const char *p = fmt;
+	int n = 0, len;
+	char t;
+
+	while ((p = strchr(p, '%')) != NULL) {
+		p++;
+		if (*p == '%') {
+			p++;
+			continue;
+		}
+		while (*p && strchr("-+ #0'", *p))
+			p++;
+		while (*p >= '0' && *p <= '9')
+			p++;
+		if (*p == '.') {
+			p++;
+			while (*p >= '0' && *p <= '9')
+				p++;
+		}
+		len = 0;
+		if (*p == 'h') {
+			p++;
+			if (*p == 'h')
+				p++;
+		} else if (*p == 'l') {
+			p++;
+			len = 'l';
+			if (*p == 'l') {
+				p++;
+				len = 'q';
+			}
+		} else if (*p == 'q' || *p == 'j' || *p == 'L') {
+			len = *p == 'L' ? 'L' : 'q';
+			p++;
+		} else if (*p == 'z' || *p == 't') {
+			len = 'z';
+			p++;
+		}
+		switch (*p) {
+		case 'd': case 'i': case 'u': case 'o': case 'x': case 'X': case 'c':
+			t = len == 'l' ? 'l' : len == 'q' ? 'q' : len == 'z' ? 'z' : 'i';
+			break;
+		case 'e': case 'E': case 'f': case 'F': case 'g': case 'G': case 'a': case 'A':
+			t = len == 'L' ? 'D' : 'd';
+			break;
+		case 's':
+			if (len)
+				return -1;	//-%ls
+			t = 's';
+			break;
+		case 'p':
+			t = 'p';
+			break;
+		default:
+			return -1;		//-* %n %m 等
+		}
+		if (n >= LOG_MAXARGS)
+			return -1;
+		types[n++] = t;
+		p++;
+	}
+	if (hex)
+		types[n++] = hex == 2 ? 'F' : 'h';
+	types[n] = 0;
+	return n;
+}
+
+//-返回调用点的参数类型,第一次调用时解析;别的线程正在解析时自己解析一份用
+static const char *log_site_types(struct log_site *s, char *local)
+{
+	unsigned char st = __atomic_load_n(&s->state, __ATOMIC_ACQUIRE);
+	unsigned char zero = 0;
+
+	if (st == 2)
+		return s->types;
+	if (log_parse(s->fmt, s->hex, local) < 0) {
+		local[0] = 'T';
+		local[1] = s->hex == 2 ? 'F' : s->hex ? 'h' : 0;
+		local[2] = 0;
+	}
+	if (st == 0 && __atomic_compare_exchange_n(&s->state, &zero, 1, 0,
+			__ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+		memcpy(s->types, local, sizeof(s->types));
+		__atomic_store_n(&s->state, 2, __ATOMIC_RELEASE);
+	}
+	return local;
+}
+
+static void log_put8(unsigned char *p, uint64_t v)
+{
+	memcpy(p, &v, 8);
+}
+
+static uint64_t log_get8(const unsigned char *p)
+{
+	uint64_t v;
+
+	memcpy(&v, p, 8);
+	return v;
+}
+
+//-按types把参数的原始值复制到arg,返回字节数.这是调用线程上唯一的开销
+static int log_capture(unsigned char *arg, const char *types, const void *hex, int hexlen,
+		const char *fmt, va_list ap)
+{
+	int n = 0, room, len;
+	const char *str;
+	const char *t;
+	double d;
+
+	for (t = types; *t; t++) {
+		//-后面每个参数至少留9个字节,字符串截断也不能挤掉后面的参数
+		room = LOG_MSG - n - 1 - 9 * (int)strlen(t + 1);
+		switch (*t) {
+		case 'i':
+			log_put8(arg + n, (int64_t)va_arg(ap, int));
+			n += 8;
+			break;
+		case 'l':
+			log_put8(arg + n, (int64_t)va_arg(ap, long));
+			n += 8;
+			break;
+		case 'q':
+			log_put8(arg + n, (int64_t)va_arg(ap, long long));
+			n += 8;
+			break;
+		case 'z':
+			log_put8(arg + n, (uint64_t)va_arg(ap, size_t));
+			n += 8;
+			break;
+		case 'p':
+			log_put8(arg + n, (uintptr_t)va_arg(ap, void *));
+			n += 8;
+			break;
+		case 'd':
+		case 'D':
+			d = *t == 'd' ? va_arg(ap, double) : (double)va_arg(ap, long double);
+			memcpy(arg + n, &d, 8);
+			n += 8;
+			break;
+		case 's':
+			str = va_arg(ap, const char *);
+			if (str == NULL)
+				str = "(null)";
+			len = strnlen(str, room > 255 ? 255 : room);
+			arg[n++] = len;
+			memcpy(arg + n, str, len);
+			n += len;
+			break;
+		case 'T':
+			if (room > 256)
+				room = 256;
+			len = vsnprintf((char *)arg + n + 1, room, fmt, ap);
+			if (len >= room)
+				len = room - 1;
+			if (len < 0)
+				len = 0;
+			arg[n++] = len;
+			n += len;
+			break;
+		case 'h':
+			len = hexlen < room ? hexlen : room;
+			if (len > LOG_HEX_MAX)
+				len = LOG_HEX_MAX;
+			if (len < 0)
+				len = 0;
+			arg[n++] = len;
+			memcpy(arg + n, hex, len);
+			n += len;
+			break;
+		case 'F':
+			arg[n++] = 0;
+			break;
+		}
+	}
+	return n;
+}
+
+//-按调用点的格式串把arg里的参数格式化到out,返回长度
+static int log_render(const struct log_site *s, const char *types, const unsigned char *arg,
+		const struct fbuf *fb, char *out, int size)
+{
+	const char *p = s->fmt, *q;
+	char spec[32], str[256];
+	int o = 0, k = 0, a = 0, len, speclen;
+	uint64_t v;
+	double d;
+
+	if (types[0] == 'T') {
+		len = arg[a++];
+		if (len > size - 1)
+			len = size - 1;
+		memcpy(out, arg + a, len);
+		o = len;
+		a += arg[a - 1];
+		k++;
+		p = "";
+	}
+	while (*p && o < size - 1) {
+		if (*p != '%' || p[1] == '%') {
+			out[o++] = *p;
+			p += *p == '%' ? 2 : 1;
+			continue;
+		}
+		//-一个转换说明原样交给snprintf
+		q = p + 1;
+		while (*q && !strchr("diouxXceEfFgGaAsp", *q))
+			q++;
+		if (*q == 0 || types[k] == 0 || types[k] == 'h' || types[k] == 'F')
+			break;
+		speclen = q - p + 1;
+		if (speclen >= (int)sizeof(spec))
+			speclen = sizeof(spec) - 1;
+		memcpy(spec, p, speclen);
+		spec[speclen] = 0;
+		p = q + 1;
+		switch (types[k++]) {
+		case 's':
+			len = arg[a++];
+			memcpy(str, arg + a, len);
+			str[len] = 0;
+			a += len;
+			len = snprintf(out + o, size - o, spec, str);
+			break;
+		case 'd':
+			memcpy(&d, arg + a, 8);
+			a += 8;
+			len = snprintf(out + o, size - o, spec, d);
+			break;
+		case 'D':
+			memcpy(&d, arg + a, 8);
+			a += 8;
+			len = snprintf(out + o, size - o, spec, (long double)d);
+			break;
+		case 'l':
+			v = log_get8(arg + a);
+			a += 8;
+			len = snprintf(out + o, size - o, spec, (long)v);
+			break;
+		case 'q':
+			v = log_get8(arg + a);
+			a += 8;
+			len = snprintf(out + o, size - o, spec, (long long)v);
+			break;
+		case 'z':
+			v = log_get8(arg + a);
+			a += 8;
+			len = snprintf(out + o, size - o, spec, (size_t)v);
+			break;
+		case 'p':
+			v = log_get8(arg + a);
+			a += 8;
+			len = snprintf(out + o, size - o, spec, (void *)(uintptr_t)v);
+			break;
+		default:
+			v = log_get8(arg + a);
+			a += 8;
+			len = snprintf(out + o, size - o, spec, (int)v);
+			break;
+		}
+		if (len > 0)
+			o += len;
+		if (o > size - 1)
+			o = size - 1;
+	}
+	//-去掉格式串末尾的换行,统一由调用者加
+	while (o > 0 && out[o - 1] == '\n')
+		o--;
+	//-输出被截断时a不再准确,只有格式串完整走完才接着打十六进制
+	if (s->hex && *p == 0 && types[k] == 'h') {
+		len = arg[a++];
+		for (; len > 0 && o + 4 < size; len--)
+			o += snprintf(out + o, size - o, " %02x", arg[a++]);
+	} else if (*p == 0 && types[k] == 'F') {
+		//-帧的文字:写线程从缓冲里取,dflogdump从记录里取;控制字符换成'.',一条日志只占一行
+		const unsigned char *t = fb ? (const unsigned char *)fb->data : arg + a + 1;
+
+		len = fb ? (int)fb->len : arg[a];
+		if (len > 0 && o < size - 1)
+			out[o++] = ' ';
+		for (; len > 0 && o < size - 1; len--, t++)
+			out[o++] = *t < ' ' || *t == 0x7f ? '.' : *t;
+	}
+	return o;
+}
+
+static int log_prefix(char *buf, int size, uint64_t ts, int lvl, int mod)
+{
+	static time_t last_sec = (time_t)-1;
+	static char last_str[16];
+	time_t sec = ts / 1000000000ULL;
+	struct tm tm;
+
+	if (sec != last_sec) {
+		localtime_r(&sec, &tm);
+		strftime(last_str, sizeof(last_str), "%H:%M:%S", &tm);
+		last_sec = sec;
+	}
+	return snprintf(buf, size, "%s.%03d %c %s: ", last_str,
+			(int)(ts / 1000000ULL % 1000), log_lvl_ch[lvl & 3],
+			mod < LOGM_NR ? log_mod_name[mod] : "?");
+}
+
+//-一条日志格式化成一行文字,带换行
+static int log_format_line(char *out, int size, const struct log_site *s, const char *types,
+		uint64_t ts, const unsigned char *arg, const struct fbuf *fb)
+{
+	int o;
+
+	o = log_prefix(out, size, ts, s->lvl, s->mod);
+	o += log_render(s, types, arg, fb, out + o, size - o - 1);
+	out[o++] = '\n';
+	return o;
+}
+
+//-----------------------------------------------------------------------------
+//-二进制编码
+
+static int log_put_varint(unsigned char *p, uint64_t v)
+{
+	int n = 0;
+
+	while (v >= 0x80) {
+		p[n++] = (v & 0x7f) | 0x80;
+		v >>= 7;
+	}
+	p[n++] = v;
+	return n;
+}
+
+static int log_put_zigzag(unsigned char *p, int64_t v)
+{
+	return log_put_varint(p, ((uint64_t)v << 1) ^ (uint64_t)(v >> 63));
+}
+
+static int log_put_str(unsigned char *p, const char *s)
+{
+	int len = strlen(s);
+	int n = log_put_varint(p, len);
+
+	memcpy(p + n, s, len);
+	return n + len;
+}
+
+static int log_site_count(void)
+{
+	if (__start_logfmt == NULL || __stop_logfmt == NULL)
+		return 0;
+	return __stop_logfmt - __start_logfmt;
+}
+
+//-文件头:标记,魔数,版本,起始时刻,全部调用点.每次启动写一次,追加写的文件里可以有多个
+static int log_write_header(uint64_t ts)
+{
+	int i, nsites = log_site_count(), o = 0, ret;
+	struct log_site *s;
+	unsigned char *buf;
+	char local[LOG_MAXARGS + 4];
+	size_t size = 64;
+
+	for (i = 0; i < nsites; i++)
+		size += 40 + strlen(__start_logfmt[i].file) + strlen(__start_logfmt[i].fmt);
+	buf = malloc(size);
+	if (buf == NULL)
+		return -1;
+	buf[o++] = LOG_TAG_HEADER;
+	memcpy(buf + o, LOG_MAGIC, 4);
+	o += 4;
+	buf[o++] = LOG_VERSION;
+	log_last_us = ts / 1000;
+	o += log_put_varint(buf + o, log_last_us);
+	o += log_put_varint(buf + o, nsites);
+	for (i = 0; i < nsites; i++) {
+		s = &__start_logfmt[i];
+		o += log_put_varint(buf + o, s->line);
+		buf[o++] = s->mod;
+		buf[o++] = s->lvl;
+		o += log_put_str(buf + o, s->file);
+		o += log_put_str(buf + o, s->fmt);
+		o += log_put_str(buf + o, log_site_types(s, local));
+	}
+	ret = write(log_fd, buf, o);
+	free(buf);
+	return ret < 0 ? -1 : 0;
+}
+
+//-一条日志编码成二进制:标记(调用点编号+2),和上一条的时间差(us),参数
+static int log_encode(unsigned char *p, const struct log_cell *c, const char *types)
+{
+	const unsigned char *arg = c->arg;
+	uint64_t us = c->ts / 1000, v;
+	int n = 0, len, i;
+
+	n += log_put_varint(p + n, (c->site - __start_logfmt) + LOG_TAG_SITE);
+	n += log_put_zigzag(p + n, (int64_t)(us - log_last_us));	//-多个线程写的队列,时间可能倒退一点
+	log_last_us = us;
+	for (; *types; types++) {
+		switch (*types) {
+		case 'F':
+			if (c->fb) {
+				len = c->fb->len < LOG_FRAME_MAX ? (int)c->fb->len : LOG_FRAME_MAX;
+				n += log_put_varint(p + n, len);
+				memcpy(p + n, c->fb->data, len);
+				n += len;
+				arg += 1 + *arg;
+				break;
+			}
+			/* fall through */
+		case 's':
+		case 'T':
+		case 'h':
+			len = *arg++;
+			n += log_put_varint(p + n, len);
+			memcpy(p + n, arg, len);
+			n += len;
+			arg += len;
+			break;
+		case 'd':
+		case 'D':
+			v = log_get8(arg);	//-double固定8字节,小端
+			for (i = 0; i < 8; i++)
+				p[n++] = v >> (i * 8);
+			arg += 8;
+			break;
+		default:
+			n += log_put_zigzag(p + n, (int64_t)log_get8(arg));
+			arg += 8;
+			break;
+		}
+	}
+	return n;
+}
+
+//-----------------------------------------------------------------------------
+
+//-写线程和同步写都从这里输出,一次write
+static void log_emit(struct log_cell **cells, int n)
+{
+	char local[LOG_MAXARGS + 4];
+	const char *types;
+	int i, o = 0;
+
+	pthread_mutex_lock(&log_emit_lock);	//-只有同步写的时候才会有竞争
+	if (log_binary && !log_hdr_done && n > 0) {
+		if (log_write_header(cells[0]->ts) == 0)
+			log_hdr_done = 1;
+	}
+	for (i = 0; i < n; i++) {
+		types = log_site_types((struct log_site *)cells[i]->site, local);
+		if (log_binary)
+			o += log_encode((unsigned char *)log_out + o, cells[i], types);
+		else
+			o += log_format_line(log_out + o, LOG_LINE, cells[i]->site, types,
+					cells[i]->ts, cells[i]->arg, cells[i]->fb);
+	}
+	if (o > 0 && write(log_fd, log_out, o) < 0 && errno == EBADF)
+		log_fd = -1;
+	pthread_mutex_unlock(&log_emit_lock);
+}
+
+static void log_fill(struct log_cell *c, struct log_site *s, const void *hex, int hexlen,
+		const char *fmt, va_list ap)
+{
+	char local[LOG_MAXARGS + 4];
+	struct timespec ts;
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+	c->ts = (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+	c->site = s;
+	c->fb = NULL;
+	c->len = log_capture(c->arg, log_site_types(s, local), hex, hexlen, fmt, ap);
+}
+
+//-没有写线程时当场格式化输出
+static void log_emit_now(struct log_site *s, const void *hex, int hexlen, struct fbuf *fb,
+		const char *fmt, va_list ap)
+{
+	struct log_cell tmp, *one = &tmp;
+
+	log_fill(&tmp, s, hex, hexlen, fmt, ap);
+	tmp.fb = fb;
+	log_emit(&one, 1);
+}
+
+static void log_enqueue(struct log_site *s, const void *hex, int hexlen, struct fbuf *fb,
+		const char *fmt, va_list ap)
+{
+	struct log_cell *c;
+	unsigned long pos, seq;
+	long dif;
+
+	if (log_fd < 0)
+		return;
+	if (!__atomic_load_n(&log_running, __ATOMIC_ACQUIRE)) {
+		log_emit_now(s, hex, hexlen, fb, fmt, ap);
+		return;
+	}
+
+	pos = __atomic_load_n(&log_enq, __ATOMIC_RELAXED);
+	for (;;) {
+		c = &log_q[pos & (LOG_CELLS - 1)];
+		seq = __atomic_load_n(&c->seq, __ATOMIC_ACQUIRE);
+		dif = (long)(seq - pos);
+		if (dif == 0) {
+			if (__atomic_compare_exchange_n(&log_enq, &pos, pos + 1, 1,
+					__ATOMIC_RELAXED, __ATOMIC_RELAXED))
+				break;
+		} else if (dif < 0) {
+			__atomic_fetch_add(&log_dropped, 1, __ATOMIC_RELAXED);	//-满了
+			return;
+		} else {
+			pos = __atomic_load_n(&log_enq, __ATOMIC_RELAXED);
+		}
+	}
+	log_fill(c, s, hex, hexlen, fmt, ap);
+	if (fb)
+		c->fb = fbuf_ref(fb);	//-写线程写完在log_release里放回
+	__atomic_store_n(&c->seq, pos + 1, __ATOMIC_SEQ_CST);
+
+	//-写线程在睡才需要进锁;错过了也只是晚一点写,它最多睡LOG_IDLE_MS
+	if (__atomic_load_n(&log_idle, __ATOMIC_SEQ_CST)) {
+		pthread_mutex_lock(&log_lock);
+		pthread_cond_signal(&log_cond);
+		pthread_mutex_unlock(&log_lock);
+	}
+}
+
+void log_site_write(struct log_site *s, const char *fmt, ...)
+{
+	va_list ap;
+
+	va_start(ap, fmt);
+	log_enqueue(s, NULL, 0, NULL, fmt, ap);
+	va_end(ap);
+}
+
+void log_site_hex(struct log_site *s, const void *data, int len, const char *fmt, ...)
+{
+	va_list ap;
+
+	va_start(ap, fmt);
+	log_enqueue(s, data, len, NULL, fmt, ap);
+	va_end(ap);
+}
+
+void log_site_fbuf(struct log_site *s, struct fbuf *f, const char *fmt, ...)
+{
+	va_list ap;
+
+	va_start(ap, fmt);
+	log_enqueue(s, NULL, 0, f, fmt, ap);
+	va_end(ap);
+}
+
+#define LOG_IDLE_MS	200
+
+//-取出已经写好的连续若干格,返回条数
+static int log_take(struct log_cell **cells, int max)
+{
+	unsigned long pos = log_deq;
+	int n = 0;
+
+	while (n < max) {
+		struct log_cell *c = &log_q[pos & (LOG_CELLS - 1)];
+
+		if (__atomic_load_n(&c->seq, __ATOMIC_ACQUIRE) != pos + 1)
+			break;
+		cells[n++] = c;
+		pos++;
+	}
+	return n;
+}
+
+static void log_release(struct log_cell **cells, int n)
+{
+	int i;
+
+	for (i = 0; i < n; i++) {
+		fbuf_put(cells[i]->fb);
+		cells[i]->fb = NULL;
+		__atomic_store_n(&cells[i]->seq, log_deq + LOG_CELLS, __ATOMIC_RELEASE);
+		__atomic_store_n(&log_deq, log_deq + 1, __ATOMIC_RELAXED);
+	}
+}
+
+//-队列满了百分之几,别的线程看个大概(抓包判断过载用)
+int log_queue_fill(void)
+{
+	long n = (long)(__atomic_load_n(&log_enq, __ATOMIC_RELAXED) - __atomic_load_n(&log_deq, __ATOMIC_RELAXED));
+
+	if (!__atomic_load_n(&log_running, __ATOMIC_RELAXED) || n <= 0)
+		return 0;
+	return n >= LOG_CELLS ? 100 : n * 100 / LOG_CELLS;
+}
+
+//-写线程自己报告丢失,不能再进队列
+static void log_emit_drops(const char *fmt, ...)
+{
+	LOG_SITE(LOGM_MAIN, LOG_WARN, 0, "log queue full, %lu messages dropped");
+	va_list ap;
+
+	va_start(ap, fmt);
+	log_emit_now(&_log_site, NULL, 0, NULL, fmt, ap);
+	va_end(ap);
+}
+
+static void log_report_drops(void)
+{
+	static unsigned long reported = 0;
+	unsigned long d = __atomic_load_n(&log_dropped, __ATOMIC_RELAXED);
+
+	if (d == reported)
+		return;
+	log_emit_drops("log queue full, %lu messages dropped", d - reported);
+	reported = d;
+}
+
+static void *log_thread(void *arg)
+{
+	struct log_cell *cells[LOG_BATCH];
+	struct timespec ts;
+	int n;
+
+	for (;;) {
+		n = log_take(cells, LOG_BATCH);
+		if (n > 0) {
+			log_emit(cells, n);
+			log_release(cells, n);
+			log_report_drops();
+			continue;
+		}
+		if (__atomic_load_n(&log_stopping, __ATOMIC_ACQUIRE))
+			break;		//-队列已经空了
+		pthread_mutex_lock(&log_lock);
+		__atomic_store_n(&log_idle, 1, __ATOMIC_SEQ_CST);
+		if (log_take(cells, 1) == 0 && !log_stopping) {
+			clock_gettime(CLOCK_REALTIME, &ts);
+			ts.tv_nsec += LOG_IDLE_MS * 1000000L;
+			if (ts.tv_nsec >= 1000000000L) {
+				ts.tv_sec++;
+				ts.tv_nsec -= 1000000000L;
+			}
+			pthread_cond_timedwait(&log_cond, &log_lock, &ts);
+		}
+		__atomic_store_n(&log_idle, 0, __ATOMIC_RELAXED);
+		pthread_mutex_unlock(&log_lock);
+	}
+	log_report_drops();
+	return NULL;
+}
+
+int log_open(const char *path)
+{
+	int fd;
+
+	if (path == NULL) {
+		log_fd = 2;
+		return 0;
+	}
+	fd = open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+	if (fd < 0) {
+		fprintf(stderr, "log: open %s: %s\n", path, strerror(errno));
+		return -1;
+	}
+	if (log_fd > 2)
+		close(log_fd);
+	log_fd = fd;
+	log_hdr_done = 0;
+	return 0;
+}
+
+int log_start(void)
+{
+	if (log_running)
+		return 0;
+	log_init_cells();
+	log_stopping = 0;
+	if (pthread_create(&log_tid, NULL, log_thread, NULL) != 0)
+		return -1;		//-没有写线程就一直同步写
+	__atomic_store_n(&log_running, 1, __ATOMIC_RELEASE);
+	return 0;
+}
+
+void log_stop(void)
+{
+	struct log_cell *cells[LOG_BATCH];
+	int n;
+
+	if (!log_running)
+		return;
+	__atomic_store_n(&log_running, 0, __ATOMIC_RELEASE);	//-之后的日志同步写
+	pthread_mutex_lock(&log_lock);
+	__atomic_store_n(&log_stopping, 1, __ATOMIC_RELEASE);
+	pthread_cond_signal(&log_cond);
+	pthread_mutex_unlock(&log_lock);
+	pthread_join(log_tid, NULL);
+	//-停之前正在往队列里放的那几条,写线程退出时可能还没发布
+	while ((n = log_take(cells, LOG_BATCH)) > 0) {
+		log_emit(cells, n);
+		log_release(cells, n);
+	}
+}
+
+//-----------------------------------------------------------------------------
+//-解码:dflogdump把-B写的文件还原成和文字模式一样的输出
+
+struct log_reader {
+	FILE *in;
+	int eof;
+};
+
+static int log_get_byte(struct log_reader *r)
+{
+	int c = getc(r->in);
+
+	if (c == EOF)
+		r->eof = 1;
+	return c == EOF ? 0 : c;
+}
+
+static uint64_t log_get_varint(struct log_reader *r)
+{
+	uint64_t v = 0;
+	int shift = 0, c;
+
+	do {
+		c = log_get_byte(r);
+		if (shift < 64)
+			v |= (uint64_t)(c & 0x7f) << shift;
+		shift += 7;
+	} while ((c & 0x80) && !r->eof);
+	return v;
+}
+
+static int64_t log_get_zigzag(struct log_reader *r)
+{
+	uint64_t v = log_get_varint(r);
+
+	return (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+}
+
+static char *log_get_str(struct log_reader *r)
+{
+	uint64_t len = log_get_varint(r);
+	char *s;
+
+	if (r->eof || len > 65536)
+		return NULL;
+	s = malloc(len + 1);
+	if (s == NULL)
+		return NULL;
+	if (fread(s, 1, len, r->in) != len)
+		r->eof = 1;
+	s[len] = 0;
+	return s;
+}
+
+static void log_free_sites(struct log_site *sites, int n)
+{
+	int i;
+
+	for (i = 0; i < n; i++) {
+		free((char *)sites[i].file);
+		free((char *)sites[i].fmt);
+	}
+	free(sites);
+}
+
+//-返回还原的条数,文件损坏时在stderr说明并停在那里
+int log_decode(FILE *in, FILE *out)
+{
+	struct log_reader r = { in, 0 };
+	struct log_site *sites = NULL, *s;
+	unsigned char arg[LOG_MSG + 64], magic[5];
+	char line[LOG_LINE], *types;
+	uint64_t tag, us = 0, v, len;
+	int nsites = 0, i, a, records = 0;
+
+	for (;;) {
+		tag = log_get_varint(&r);
+		if (r.eof)
+			break;
+		if (tag == LOG_TAG_HEADER) {
+			if (fread(magic, 1, 5, in) != 5 || memcmp(magic, LOG_MAGIC, 4) != 0
+					|| magic[4] != LOG_VERSION) {
+				fprintf(stderr, "dflogdump: bad header after %d records\n", records);
+				break;
+			}
+			log_free_sites(sites, nsites);
+			us = log_get_varint(&r);
+			nsites = log_get_varint(&r);
+			sites = calloc(nsites ? nsites : 1, sizeof(*sites));
+			if (sites == NULL)
+				return -1;
+			for (i = 0; i < nsites && !r.eof; i++) {
+				s = &sites[i];
+				s->line = log_get_varint(&r);
+				s->mod = log_get_byte(&r);
+				s->lvl = log_get_byte(&r);
+				s->file = log_get_str(&r);
+				s->fmt = log_get_str(&r);
+				types = log_get_str(&r);
+				if (s->file == NULL || s->fmt == NULL || types == NULL
+						|| strlen(types) >= sizeof(s->types)) {
+					free(types);
+					fprintf(stderr, "dflogdump: truncated header\n");
+					log_free_sites(sites, i + 1);
+					return -1;
+				}
+				strcpy(s->types, types);
+				s->hex = strchr(types, 'F') ? 2 : strchr(types, 'h') != NULL;
+				s->state = 2;
+				free(types);
+			}
+			continue;
+		}
+		if (tag < LOG_TAG_SITE || tag - LOG_TAG_SITE >= (uint64_t)nsites) {
+			fprintf(stderr, "dflogdump: bad record %llu after %d records\n",
+				(unsigned long long)tag, records);
+			break;
+		}
+		s = &sites[tag - LOG_TAG_SITE];
+		us += log_get_zigzag(&r);
+		a = 0;
+		for (types = s->types; *types && !r.eof; types++) {
+			switch (*types) {
+			case 's':
+			case 'T':
+			case 'h':
+			case 'F':
+				len = log_get_varint(&r);
+				if (len > 255 || a + 1 + len > sizeof(arg)) {
+					r.eof = 1;
+					break;
+				}
+				arg[a++] = len;
+				if (fread(arg + a, 1, len, in) != len)
+					r.eof = 1;
+				a += len;
+				break;
+			case 'd':
+			case 'D':
+				if (a + 8 > sizeof(arg)) {	//-坏文件:字符串已经把arg填满了
+					r.eof = 1;
+					break;
+				}
+				v = 0;
+				for (i = 0; i < 8; i++)
+					v |= (uint64_t)log_get_byte(&r) << (i * 8);
+				log_put8(arg + a, v);
+				a += 8;
+				break;
+			default:
+				if (a + 8 > sizeof(arg)) {
+					r.eof = 1;
+					break;
+				}
+				log_put8(arg + a, (uint64_t)log_get_zigzag(&r));
+				a += 8;
+				break;
+			}
+		}
+		if (r.eof) {
+			fprintf(stderr, "dflogdump: truncated record after %d records\n", records);
+			break;
+		}
+		fwrite(line, 1, log_format_line(line, sizeof(line), s, s->types, us * 1000, arg, NULL), out);
+		records++;
+	}
+	log_free_sites(sites, nsites);
+	return records;
+}
+
+//-----------------------------------------------------------------------------
+/*
+基准测试(dreamflower_app -D -T):只测调用线程上的开销,不进队列.
+log_capture是现在LOG()在调用线程上做的事,log_snprintf是以前每条都要做的格式化
+*/
+static int log_bench_capture(struct log_site *s, unsigned char *buf, const char *fmt, ...)
+{
+	char local[LOG_MAXARGS + 4];
+	va_list ap;
+	int n;
+
+	va_start(ap, fmt);
+	n = log_capture(buf, log_site_types(s, local), NULL, 0, fmt, ap);
+	va_end(ap);
+	return n;
+}
+
+static void bench_log_capture(long iters, void *arg)
+{
+	LOG_SITE(LOGM_UART, LOG_DBG, 0, "read_report: %s fd %d");
+	unsigned char buf[LOG_MSG];
+	long i;
+
+	for (i = 0; i < iters; i++) {
+		bench_clobber();
+		bench_keep(log_bench_capture(&_log_site, buf, _log_site.fmt, "$0001#", 5));
+	}
+}
+
+static void bench_log_snprintf(long iters, void *arg)
+{
+	char buf[LOG_LINE];
+	long i;
+
+	for (i = 0; i < iters; i++) {
+		bench_clobber();
+		bench_keep(snprintf(buf, sizeof(buf), "read_report: %s fd %d", "$0001#", 5));
+	}
+}
+
+void log_Bench(void)
+{
+	bench_add("log_capture", bench_log_capture, NULL);
+	bench_add("log_snprintf", bench_log_snprintf, NULL);
+}
@@ -0,0 +1,105 @@
+//-为了方便调试定义了系列变量以便调试输出
+
+#ifndef LOG_H
+#define LOG_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+/*
+日志:调用的地方不格式化,只把格式串的编号和参数的原始值放进无锁队列,
+由后台线程格式化成文字,或者直接写成二进制(-B),再用dflogdump离线还原.
+级别越小越重要;LOG_LEVEL_MAX以上的调用编译时就去掉,log_level以上的运行时跳过.
+*/
+enum {
+	LOG_ERR = 0,
+	LOG_WARN,
+	LOG_INFO,
+	LOG_DBG,
+};
+
+//-模块,每个模块在log_mask里占一位
+enum {
+	LOGM_MAIN = 0,
+	LOGM_UART,
+	LOGM_PCAP,
+	LOGM_POOL,
+	LOGM_EV,
+	LOGM_GPIO,
+	LOGM_MODBUS,
+	LOGM_NR
+};
+
+#define LOG_DAEMON_FILE	"/tmp/out"	//-守护进程没有终端,没有-l时写到这里
+
+#if !defined(LOG_LEVEL_MAX)
+#define LOG_LEVEL_MAX	LOG_DBG
+#endif
+
+#define LOG_MAXARGS	8		//-超过的或者不支持的格式(%n %m *)在调用时直接格式化
+#define LOG_HEX_MAX	128		//-LOG_HEX一条最多带的字节数
+#define LOG_FRAME_MAX	200		//-LOG_FRAME的帧内容最多写多少字节
+
+/*
+每个LOG()调用点一个静态结构,全部放在logfmt段里,编号就是在段里的下标.
+types是第一次调用时从格式串解析出来的参数类型,以后直接用.
+*/
+struct log_site {
+	const char *fmt;
+	const char *file;
+	int line;
+	unsigned char mod;
+	unsigned char lvl;
+	unsigned char hex;		//-1:LOG_HEX,参数后面还有一段原始字节 2:LOG_FRAME,后面是帧的文字
+	unsigned char state;		//-0没解析 1正在解析 2 types可用
+	char types[LOG_MAXARGS + 4];
+} __attribute__((aligned(8)));
+
+extern int log_level;			//-运行时级别,默认LOG_INFO
+extern unsigned int log_mask;		//-打开的模块,默认全部
+extern unsigned long log_dropped;	//-队列满丢掉的条数
+extern int log_binary;			//-1:输出文件写二进制
+
+void log_site_write(struct log_site *s, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+void log_site_hex(struct log_site *s, const void *data, int len, const char *fmt, ...) __attribute__((format(printf, 4, 5)));
+struct fbuf;
+void log_site_fbuf(struct log_site *s, struct fbuf *f, const char *fmt, ...) __attribute__((format(printf, 3, 4)));
+int  log_open(const char *path);	//-输出文件,NULL表示标准错误
+int  log_start(void);			//-守护进程fork之后再启动写线程
+void log_stop(void);			//-把队列里剩下的写完再退出
+int  log_queue_fill(void);			//-队列满了百分之几
+int  log_decode(FILE *in, FILE *out);	//-把-B写的二进制日志还原成文字,dflogdump用
+void log_Bench(void);
+
+#define LOG_FIRST(fmt, ...)	fmt
+#define LOG_SITE(mod, lvl, hex, fmt) \
+	static struct log_site _log_site __attribute__((section("logfmt"), used, aligned(8))) = \
+		{ fmt, __FILE__, __LINE__, mod, lvl, hex, 0, { 0 } }
+
+#define LOG_ON(mod, lvl) \
+	((lvl) <= LOG_LEVEL_MAX && (lvl) <= log_level && (log_mask & (1u << (mod))))
+
+#define LOG(mod, lvl, ...) do { \
+	if (LOG_ON(mod, lvl)) { \
+		LOG_SITE(mod, lvl, 0, LOG_FIRST(__VA_ARGS__, 0)); \
+		log_site_write(&_log_site, __VA_ARGS__); \
+	} \
+} while (0)
+
+//-fmt的内容后面接data的十六进制,len超过LOG_HEX_MAX的截断
+#define LOG_HEX(mod, lvl, data, len, ...) do { \
+	if (LOG_ON(mod, lvl)) { \
+		LOG_SITE(mod, lvl, 1, LOG_FIRST(__VA_ARGS__, 0)); \
+		log_site_hex(&_log_site, data, len, __VA_ARGS__); \
+	} \
+} while (0)
+
+//-fmt的内容后面接一帧的文字:调用线程只给缓冲加一个引用,不复制,写线程写完了再fbuf_put
+#define LOG_FRAME(mod, lvl, f, ...) do { \
+	if (LOG_ON(mod, lvl)) { \
+		LOG_SITE(mod, lvl, 2, LOG_FIRST(__VA_ARGS__, 0)); \
+		log_site_fbuf(&_log_site, f, __VA_ARGS__); \
+	} \
+} while (0)
+
+#endif /* LOG_H */
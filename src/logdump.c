@@ -0,0 +1,36 @@
+/*
+dflogdump:把dreamflower_app -B写的二进制日志还原成文字.
+文件头里带着所有调用点的格式串,所以可以在PC上编译运行,不需要设备上的那个程序:
+	make dflogdump CC=gcc
+	dflogdump /tmp/out > out.txt
+不带参数时从标准输入读.
+*/
+
+#include <stdio.h>
+#include <string.h>
+
+#include "log.h"
+
+int main(int argc, char *argv[])
+{
+	FILE *fp;
+	int i, ret = 0;
+
+	if (argc < 2)
+		return log_decode(stdin, stdout) < 0;
+	for (i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "-") == 0) {
+			ret |= log_decode(stdin, stdout) < 0;
+			continue;
+		}
+		fp = fopen(argv[i], "rb");
+		if (fp == NULL) {
+			perror(argv[i]);
+			ret = 1;
+			continue;
+		}
+		ret |= log_decode(fp, stdout) < 0;
+		fclose(fp);
+	}
+	return ret;
+}
@@ -0,0 +1,158 @@
+/*
+此文件是抓包段用的压缩,说明见lz.h.
+哈希表放在栈上(16K),每次压缩从头开始,块和块之间没有关系,读的时候可以只解压需要的块.
+*/
+
+#include "debugfl.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#include "lz.h"
+
+#define LZ_MINMATCH	4
+#define LZ_HASH_LOG	12
+#define LZ_LASTLITERALS	5	//-最后5个字节一定是文字
+#define LZ_MFLIMIT	12	//-最后一个匹配至少要在结尾前12个字节开始
+#define LZ_MAX_OFFSET	65535
+#define LZ_SKIP_TRIGGER	6	//-连续找不到匹配时步子越走越大,不压缩的数据(加密的载荷)很快跳过去
+
+static inline uint32_t lz_read32(const uint8_t *p)
+{
+	uint32_t v;
+
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+static inline uint32_t lz_hash(uint32_t v)
+{
+	return (v * 2654435761u) >> (32 - LZ_HASH_LOG);
+}
+
+//-长度扩展:15以上的部分每255一个字节
+static uint8_t *lz_put_len(uint8_t *op, int len)
+{
+	for (; len >= 255; len -= 255)
+		*op++ = 255;
+	*op++ = len;
+	return op;
+}
+
+static uint8_t *lz_put_literals(uint8_t *op, const uint8_t *lit, int litlen, int matchlen)
+{
+	uint8_t *token = op++;
+
+	*token = (litlen >= 15 ? 15 : litlen) << 4 | (matchlen >= 15 ? 15 : matchlen);
+	if (litlen >= 15)
+		op = lz_put_len(op, litlen - 15);
+	memcpy(op, lit, litlen);
+	return op + litlen;
+}
+
+int lz_compress(const void *src, int n, void *dst, int cap)
+{
+	const uint8_t *base = src, *ip = base, *anchor = base, *ref;
+	const uint8_t *iend = base + n, *mflimit = iend - LZ_MFLIMIT, *matchlimit = iend - LZ_LASTLITERALS;
+	uint8_t *op = dst, *oend = op + cap;
+	uint32_t tab[1 << LZ_HASH_LOG];
+	int litlen, len, off;
+	uint32_t h;
+
+	if (n > LZ_MFLIMIT) {
+		memset(tab, 0, sizeof(tab));
+		ip++;
+		while (ip < mflimit) {
+			h = lz_hash(lz_read32(ip));
+			ref = base + tab[h];
+			tab[h] = ip - base;
+			if (ip - ref > LZ_MAX_OFFSET || lz_read32(ref) != lz_read32(ip)) {
+				ip += 1 + ((ip - anchor) >> LZ_SKIP_TRIGGER);
+				continue;
+			}
+			while (ip > anchor && ref > base && ip[-1] == ref[-1]) {
+				ip--;
+				ref--;
+			}
+			for (len = LZ_MINMATCH; ip + len < matchlimit && ip[len] == ref[len]; len++)
+				;
+			litlen = ip - anchor;
+			//-令牌,文字长度扩展,文字,偏移,匹配长度扩展;长度>=15时扩展是(长度-15)/255+1字节
+			if (op + 1 + (litlen + 240) / 255 + litlen + 2 + (len - LZ_MINMATCH + 240) / 255 > oend)
+				return 0;
+			op = lz_put_literals(op, anchor, litlen, len - LZ_MINMATCH);
+			off = ip - ref;
+			*op++ = off;
+			*op++ = off >> 8;
+			if (len - LZ_MINMATCH >= 15)
+				op = lz_put_len(op, len - LZ_MINMATCH - 15);
+			ip += len;
+			anchor = ip;
+			if (ip < mflimit)
+				tab[lz_hash(lz_read32(ip - 2))] = ip - 2 - base;
+		}
+	}
+	litlen = iend - anchor;
+	if (op + 1 + (litlen + 240) / 255 + litlen > oend)
+		return 0;
+	op = lz_put_literals(op, anchor, litlen, 0);
+	return op - (uint8_t *)dst;
+}
+
+//-长度扩展,读过了结尾返回-1
+static int lz_get_len(const uint8_t **pp, const uint8_t *iend, int len)
+{
+	const uint8_t *ip = *pp;
+	int b;
+
+	do {
+		if (ip >= iend)
+			return -1;
+		b = *ip++;
+		len += b;
+	} while (b == 255);
+	*pp = ip;
+	return len;
+}
+
+int lz_decompress(const void *src, int n, void *dst, int cap)
+{
+	const uint8_t *ip = src, *iend = ip + n, *match;
+	uint8_t *ostart = dst, *op = ostart, *oend = op + cap;
+	int token, len, off;
+
+	while (ip < iend) {
+		token = *ip++;
+		len = token >> 4;
+		if (len == 15 && (len = lz_get_len(&ip, iend, len)) < 0)
+			return -1;
+		if (len > iend - ip || len > oend - op)
+			return -1;
+		memcpy(op, ip, len);
+		op += len;
+		ip += len;
+		if (ip >= iend)
+			break;		//-最后一个序列只有文字
+		if (iend - ip < 2)
+			return -1;
+		off = ip[0] | ip[1] << 8;
+		ip += 2;
+		if (off == 0 || off > op - ostart)
+			return -1;
+		len = token & 15;
+		if (len == 15 && (len = lz_get_len(&ip, iend, len)) < 0)
+			return -1;
+		len += LZ_MINMATCH;
+		if (len > oend - op)
+			return -1;
+		match = op - off;
+		if (off >= len) {
+			memcpy(op, match, len);
+			op += len;
+		} else {
+			while (len--)	//-重叠的匹配(比如一串相同的字节)只能一个一个复制
+				*op++ = *match++;
+		}
+	}
+	return op - ostart;
+}
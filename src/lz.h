@@ -0,0 +1,18 @@
+//-为了方便调试定义了系列变量以便调试输出
+
+#ifndef LZ_H
+#define LZ_H
+
+/*
+LZ77类的快速压缩,格式和LZ4的块格式(block format)一样:
+一个序列是 令牌(高4位文字长度,低4位匹配长度-4) [长度扩展] 文字 偏移(2字节,小端) [长度扩展].
+压缩只找一个候选(4字节的哈希表),不回头找更长的,压得不如gzip但快得多;
+抓包头重复多(MAC,IP,端口),一块TCP报文头大约压到40%.
+解压检查所有长度和偏移,坏数据只会返回-1,不会写出dst.
+*/
+#define LZ_BOUND(n)	((n) + (n) / 255 + 16)	//-最坏情况下压缩以后的长度
+
+int lz_compress(const void *src, int n, void *dst, int cap);	//-返回压缩以后的长度,cap不够返回0
+int lz_decompress(const void *src, int n, void *dst, int cap);	//-返回解压以后的长度,数据不对返回-1
+
+#endif /* LZ_H */
@@ -0,0 +1,372 @@
+/*
+此文件是计数器登记表和读取它的Unix socket.
+以前只有printf,守护进程的标准输出已经关掉了,现场什么都看不到.
+现在各模块登记自己的计数器,连到-M的socket就能读:
+  socat - UNIX-CONNECT:/var/run/dreamflower_app.metrics		Prometheus文本格式
+  echo json | socat - UNIX-CONNECT:/var/run/dreamflower_app.metrics	JSON
+请求以"GET "开头时加HTTP头,可以直接给Prometheus之类的工具转发.
+在主循环里处理,只是把各分片加起来,不会让别的线程停下来.
+*/
+
+#define _GNU_SOURCE
+#include "debugfl.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/stat.h>
+
+#include "event.h"
+#include "timer.h"
+#include "handoff.h"
+#include "metrics.h"
+
+#define METRICS_SOCK	"/var/run/dreamflower_app.metrics"
+#define METRICS_PREFIX	"dreamflower_"
+#define METRICS_REQ	256		//-请求最多读这么多
+#define METRICS_TMO_MS	1000		//-连上来这么久不发请求就当成空请求回文本格式;回的东西这么久没读完就关掉
+
+struct metrics_conn {
+	struct ev_io io;
+	struct timer tmo;
+	char req[METRICS_REQ];
+	int rlen;
+	char *out;
+	int olen, off;
+};
+
+struct metric_shard metric_shards[METRIC_SHARDS];
+__thread int metric_self;
+
+const char *metrics_path = METRICS_SOCK;
+
+static struct metric *metric_list, **metric_tail = &metric_list;
+struct metric metric_sink = { "sink", "", METRIC_COUNTER, 0 };	//-槽用完以后都加到槽0上
+static int metric_next_slot = 1;
+static int metric_next_shard;
+
+static int metrics_lfd = -1;
+static struct ev_io metrics_io;
+
+int metric_shard_get(void)
+{
+	metric_self = __atomic_fetch_add(&metric_next_shard, 1, __ATOMIC_RELAXED) % METRIC_SHARDS + 1;
+	return metric_self - 1;
+}
+
+static struct metric *metric_new(const char *name, const char *help, int type, int slots, long (*fn)(void))
+{
+	struct metric *m;
+
+	if (metric_next_slot + slots > METRIC_SLOTS || (m = calloc(1, sizeof(*m))) == NULL) {
+		LOG(LOGM_MAIN, LOG_WARN, "metric %s: no room", name);
+		return &metric_sink;
+	}
+	m->name = name;
+	m->help = help;
+	m->type = type;
+	m->fn = fn;
+	m->slot = metric_next_slot;
+	metric_next_slot += slots;
+	*metric_tail = m;
+	metric_tail = &m->next;
+	return m;
+}
+
+struct metric *metric_counter(const char *name, const char *help)
+{
+	return metric_new(name, help, METRIC_COUNTER, 1, NULL);
+}
+
+struct metric *metric_gauge(const char *name, const char *help)
+{
+	return metric_new(name, help, METRIC_GAUGE, 1, NULL);
+}
+
+struct metric *metric_func(const char *name, const char *help, int type, long (*fn)(void))
+{
+	return metric_new(name, help, type, 0, fn);
+}
+
+struct metric *metric_histogram(const char *name, const char *help)
+{
+	return metric_new(name, help, METRIC_HISTOGRAM, METRIC_BUCKETS + 1, NULL);
+}
+
+//-桶i的上限是2^i us
+void metric_observe(struct metric *m, uint64_t us)
+{
+	int b = us <= 1 ? 0 : 64 - __builtin_clzll(us - 1);
+	int s = metric_self ? metric_self - 1 : metric_shard_get();
+
+	if (m == &metric_sink)
+		return;
+	if (b > METRIC_BUCKETS - 1)
+		b = METRIC_BUCKETS - 1;
+	__atomic_fetch_add(&metric_shards[s].v[m->slot + b], 1, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&metric_shards[s].v[m->slot + METRIC_BUCKETS], us, __ATOMIC_RELAXED);
+}
+
+void metric_set(struct metric *m, uint64_t v)
+{
+	__atomic_store_n(&metric_shards[0].v[m->slot], v, __ATOMIC_RELAXED);
+}
+
+static uint64_t metric_sum(int slot)
+{
+	uint64_t v = 0;
+	int s;
+
+	for (s = 0; s < METRIC_SHARDS; s++)
+		v += __atomic_load_n(&metric_shards[s].v[slot], __ATOMIC_RELAXED);
+	return v;
+}
+
+uint64_t metric_value(const struct metric *m)
+{
+	return m->fn ? (uint64_t)m->fn() : metric_sum(m->slot);
+}
+
+//-------------------------------- 输出 --------------------------------
+struct mbuf {
+	char *p;
+	int len, size;
+};
+
+static void mb_printf(struct mbuf *b, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+static void mb_printf(struct mbuf *b, const char *fmt, ...)
+{
+	va_list ap;
+	char *np;
+	int n;
+
+	for (;;) {
+		va_start(ap, fmt);
+		n = vsnprintf(b->p + b->len, b->size - b->len, fmt, ap);
+		va_end(ap);
+		if (n < b->size - b->len) {
+			b->len += n;
+			return;
+		}
+		np = realloc(b->p, b->size * 2 + n);
+		if (np == NULL)
+			return;
+		b->p = np;
+		b->size = b->size * 2 + n;
+	}
+}
+
+static const char *metric_type_name[] = { "counter", "gauge", "histogram" };
+
+static void metrics_prom(struct mbuf *b)
+{
+	struct metric *m;
+	uint64_t c;
+	int i;
+
+	for (m = metric_list; m; m = m->next) {
+		mb_printf(b, "# HELP " METRICS_PREFIX "%s %s\n# TYPE " METRICS_PREFIX "%s %s\n",
+			  m->name, m->help, m->name, metric_type_name[m->type]);
+		if (m->type != METRIC_HISTOGRAM) {
+			mb_printf(b, METRICS_PREFIX "%s %llu\n", m->name, (unsigned long long)metric_value(m));
+			continue;
+		}
+		for (i = 0, c = 0; i < METRIC_BUCKETS; i++) {
+			c += metric_sum(m->slot + i);
+			if (i < METRIC_BUCKETS - 1)
+				mb_printf(b, METRICS_PREFIX "%s_bucket{le=\"%llu\"} %llu\n", m->name, 1ULL << i, (unsigned long long)c);
+			else
+				mb_printf(b, METRICS_PREFIX "%s_bucket{le=\"+Inf\"} %llu\n", m->name, (unsigned long long)c);
+		}
+		mb_printf(b, METRICS_PREFIX "%s_sum %llu\n" METRICS_PREFIX "%s_count %llu\n",
+			  m->name, (unsigned long long)metric_sum(m->slot + METRIC_BUCKETS), m->name, (unsigned long long)c);
+	}
+}
+
+static void metrics_json(struct mbuf *b)
+{
+	struct metric *m;
+	uint64_t c;
+	int i;
+
+	mb_printf(b, "{");
+	for (m = metric_list; m; m = m->next) {
+		mb_printf(b, "%s\n\"%s\":", m == metric_list ? "" : ",", m->name);
+		if (m->type != METRIC_HISTOGRAM) {
+			mb_printf(b, "%llu", (unsigned long long)metric_value(m));
+			continue;
+		}
+		mb_printf(b, "{\"buckets\":[");
+		for (i = 0, c = 0; i < METRIC_BUCKETS; i++) {
+			c += metric_sum(m->slot + i);
+			mb_printf(b, "%s%llu", i ? "," : "", (unsigned long long)c);
+		}
+		mb_printf(b, "],\"sum\":%llu,\"count\":%llu}", (unsigned long long)metric_sum(m->slot + METRIC_BUCKETS), (unsigned long long)c);
+	}
+	mb_printf(b, "\n}\n");
+}
+
+int metrics_format(char **out, int json)
+{
+	struct mbuf b = { malloc(4096), 0, 4096 };
+
+	if (b.p == NULL)
+		return -1;
+	if (json)
+		metrics_json(&b);
+	else
+		metrics_prom(&b);
+	*out = b.p;
+	return b.len;
+}
+
+//-------------------------------- socket --------------------------------
+static void metrics_conn_close(struct metrics_conn *c)
+{
+	ev_del(&c->io);
+	timer_cancel(&c->tmo);
+	close(c->io.fd);
+	free(c->out);
+	free(c);
+}
+
+static void metrics_respond(struct metrics_conn *c);
+
+//-socat - UNIX-CONNECT:连上来什么都不发也不关写端,等到超时也要给它一份
+static void metrics_conn_tmo(struct timer *t)
+{
+	struct metrics_conn *c = t->arg;
+
+	if (c->out) {
+		metrics_conn_close(c);
+		return;
+	}
+	timer_start(&c->tmo, METRICS_TMO_MS, 0);	//-写也给一个超时,对方不读就关掉
+	metrics_respond(c);
+}
+
+//-请求读完了(一行,或者对方关了写端):生成全部输出再慢慢写
+static void metrics_respond(struct metrics_conn *c)
+{
+	struct mbuf b = { malloc(4096), 0, 4096 };
+	int http = strncmp(c->req, "GET ", 4) == 0;
+	int json = strstr(c->req, "json") != NULL;
+	char *body;
+	int n;
+
+	if (b.p == NULL || (n = metrics_format(&body, json)) < 0) {
+		free(b.p);
+		metrics_conn_close(c);
+		return;
+	}
+	if (http)
+		mb_printf(&b, "HTTP/1.0 200 OK\r\nContent-Type: %s\r\nContent-Length: %d\r\n\r\n",
+			  json ? "application/json" : "text/plain; version=0.0.4", n);
+	mb_printf(&b, "%s", body);
+	free(body);
+	c->out = b.p;
+	c->olen = b.len;
+	c->off = 0;
+	ev_mod(&c->io, EV_WRITE);
+}
+
+static void metrics_conn_cb(struct ev_io *io, unsigned int revents)
+{
+	struct metrics_conn *c = io->arg;
+	int n;
+
+	if (c->out) {
+		n = write(io->fd, c->out + c->off, c->olen - c->off);
+		if (n < 0 && errno == EAGAIN)
+			return;
+		if (n <= 0 || (c->off += n) >= c->olen)
+			metrics_conn_close(c);
+		return;
+	}
+	n = read(io->fd, c->req + c->rlen, sizeof(c->req) - 1 - c->rlen);
+	if (n < 0 && errno == EAGAIN)
+		return;
+	if (n > 0)
+		c->rlen += n;
+	c->req[c->rlen] = 0;
+	if (n <= 0 || strchr(c->req, '\n') || c->rlen >= (int)sizeof(c->req) - 1)
+		metrics_respond(c);
+}
+
+static void metrics_accept_cb(struct ev_io *io, unsigned int revents)
+{
+	struct metrics_conn *c;
+	struct ucred cred;
+	socklen_t clen = sizeof(cred);
+	int fd;
+
+	while ((fd = accept4(io->fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+		//-和ctrl.c一样:socket文件是0600,再查一次对方,防止路径所在目录的权限太松
+		if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &clen) != 0
+				|| (cred.uid != getuid() && cred.uid != 0)) {
+			LOG(LOGM_MAIN, LOG_WARN, "metrics: refused peer uid %d", (int)cred.uid);
+			close(fd);
+			continue;
+		}
+		c = calloc(1, sizeof(*c));
+		if (c == NULL) {
+			close(fd);
+			continue;
+		}
+		ev_io_init(&c->io, fd, EV_READ, metrics_conn_cb, c);
+		timer_setup(&c->tmo, metrics_conn_tmo, c);
+		if (ev_add(&c->io) != 0) {
+			close(fd);
+			free(c);
+			continue;
+		}
+		timer_start(&c->tmo, METRICS_TMO_MS, 0);
+	}
+}
+
+int metrics_listen(void)
+{
+	struct sockaddr_un sa;
+	mode_t old;
+	int fd, r;
+
+	if (metrics_path == NULL || metrics_path[0] == 0)
+		return 0;
+	memset(&sa, 0, sizeof(sa));
+	sa.sun_family = AF_UNIX;
+	snprintf(sa.sun_path, sizeof(sa.sun_path), "%s", metrics_path);
+	fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (fd < 0)
+		return -1;
+	unlink(metrics_path);	//-上次没有删掉的,或者热重启时老进程的
+	old = umask(0177);	//-计数器里有现场的信息,和控制socket一样只给本用户
+	r = bind(fd, (struct sockaddr *)&sa, sizeof(sa));
+	umask(old);
+	if (r != 0 || listen(fd, 8) != 0) {
+		LOG(LOGM_MAIN, LOG_WARN, "metrics %s: %s", metrics_path, strerror(errno));
+		close(fd);
+		return -1;
+	}
+	metrics_lfd = fd;
+	ev_io_init(&metrics_io, fd, EV_READ, metrics_accept_cb, NULL);
+	return ev_add(&metrics_io);
+}
+
+//-热重启交接出去以后,路径已经是新进程的了,不要删
+void metrics_close(void)
+{
+	if (metrics_lfd < 0)
+		return;
+	ev_del(&metrics_io);
+	close(metrics_lfd);
+	metrics_lfd = -1;
+	if (!handoff_done)
+		unlink(metrics_path);
+}
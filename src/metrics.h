@@ -0,0 +1,66 @@
+//-为了方便调试定义了系列变量以便调试输出
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdint.h>
+
+/*
+计数器:每个线程加到自己的分片上(没有锁,不和别的线程抢cache行),读的时候把各分片加起来.
+读的人不会让热点路径停下来,看到的值可能差几个,计数器本来就不要求那么准.
+登记(metric_counter等)只在主线程初始化时做,加计数哪个线程都可以.
+*/
+#define METRIC_SHARDS	8
+#define METRIC_SLOTS	128
+#define METRIC_BUCKETS	24		//-直方图:上限1,2,4...2^22 us,最后一个是+Inf
+
+enum {
+	METRIC_COUNTER,
+	METRIC_GAUGE,
+	METRIC_HISTOGRAM,
+};
+
+struct metric {
+	const char *name;
+	const char *help;
+	int type;
+	int slot;			//-在分片里的位置,直方图占METRIC_BUCKETS+1个(最后一个是和)
+	long (*fn)(void);		//-不为NULL时读的时候调用,不用分片
+	struct metric *next;
+};
+
+struct metric_shard {
+	uint64_t v[METRIC_SLOTS];
+} __attribute__((aligned(64)));
+
+extern struct metric_shard metric_shards[METRIC_SHARDS];
+extern __thread int metric_self;	//-分片编号+1,0表示这个线程还没有分
+extern struct metric metric_sink;	//-还没有登记的计数器指向这里,加了也不输出
+
+extern const char *metrics_path;	//--M Unix socket路径,空串表示不开
+
+struct metric *metric_counter(const char *name, const char *help);
+struct metric *metric_gauge(const char *name, const char *help);
+struct metric *metric_func(const char *name, const char *help, int type, long (*fn)(void));
+struct metric *metric_histogram(const char *name, const char *help);
+int  metric_shard_get(void);
+void metric_observe(struct metric *m, uint64_t us);
+void metric_set(struct metric *m, uint64_t v);	//-gauge,只能一个线程写
+uint64_t metric_value(const struct metric *m);
+int  metrics_format(char **out, int json);	//-返回长度,*out由调用者free
+int  metrics_listen(void);
+void metrics_close(void);
+
+static inline void metric_add(struct metric *m, uint64_t n)
+{
+	int s = metric_self ? metric_self - 1 : metric_shard_get();
+
+	__atomic_fetch_add(&metric_shards[s].v[m->slot], n, __ATOMIC_RELAXED);
+}
+
+static inline void metric_inc(struct metric *m)
+{
+	metric_add(m, 1);
+}
+
+#endif /* METRICS_H */
@@ -0,0 +1,732 @@
+/*
+此文件是Modbus RTU主站,说明见modbus.h.
+RTU没有帧头帧尾,帧和帧之间靠至少3.5个字符时间的静默分开,所以:
+发之前等总线静默够t3.5;收的时候按功能码算好回复应该多长,收够就算完,
+收到一半停了超过t3.5(再加上驱动的延迟)也算完,然后靠CRC和长度判断对不对.
+一条总线同时只能有一个请求在路上,要把一轮压短,只能少发几次请求(合并),少等(t3.5算准,坏表少等超时).
+*/
+
+#define _GNU_SOURCE		//-posix_openpt ppoll
+#include "debugfl.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
+#include <pthread.h>
+#include <termios.h>
+#include <sys/ioctl.h>
+#include <linux/serial.h>
+
+#include "uart1.h"
+#include "bench.h"
+#include "trace.h"
+#include "rtsched.h"
+#include "metrics.h"
+#include "modbus.h"
+
+#define MB_LATENCY_NS	10000000ULL	//-收到一半以后等t3.5再加上这么久:USB转串口的驱动一般攒几ms才交上来
+#define MB_SIM_REGS	10000		//-模拟的从站有这么多个寄存器,超出的回异常2
+
+struct mb_point {
+	uint8_t slave, fc;
+	uint16_t addr, count;
+};
+
+//-合并以后的一次请求
+struct mb_txn {
+	uint8_t slave, fc;
+	uint16_t addr, count;
+	uint8_t req[8];			//-请求帧,包括CRC
+	int rlen;			//-正常回复的长度
+	uint16_t *val;			//-count个值,线圈也是一个值一个uint16_t
+	uint64_t ts_ns;			//-最后一次读到的时间,0表示还没有读到过
+};
+
+struct mb_bus {
+	char dev[64];
+	int fd;
+	int simfd;			//-sim:pty的另一头,模拟的从站在这里收发
+	int baud, databits, parity, stopbits;
+	int timeout_ms, gap, period_ms, sim_slaves;
+	uint64_t char_ns, t35_ns;	//-一个字符的时间和3.5个字符的静默
+	uint64_t idle_ns;		//-总线从这个时刻开始静默
+	struct mb_point *pt;
+	int npt, apt;
+	struct mb_txn *txn;
+	int ntxn;
+	uint8_t fails[248];		//-每个从站连续不回的次数
+	uint8_t skip[248];		//-还要跳过几轮
+	pthread_mutex_t lock;		//-保护txn的val和ts_ns
+	pthread_t tid, sim_tid;
+	int started, sim_started;
+	volatile int running;
+	unsigned long cycles;
+	uint64_t cycle_ns;		//-最近一轮用了多久
+	struct mb_bus *next;
+};
+
+enum {
+	MB_OK = 0,
+	MB_TIMEOUT = -1,
+	MB_BAD = -2,			//-CRC,长度,从站号或者功能码不对
+	MB_EXCEPTION = -3,
+};
+
+const char *modbus_conf = NULL;
+
+static struct mb_bus *mb_buses;
+static struct metric *m_requests = &metric_sink;
+static struct metric *m_timeouts = &metric_sink;
+static struct metric *m_bad = &metric_sink;
+static struct metric *m_exceptions = &metric_sink;
+static struct metric *m_cycle = &metric_sink;
+
+//-多项式0xA001(0x8005反过来),初值0xFFFF,一次查表处理一个字节
+static const uint16_t mb_crc_table[256] = {
+	0x0000, 0xc0c1, 0xc181, 0x0140, 0xc301, 0x03c0, 0x0280, 0xc241,
+	0xc601, 0x06c0, 0x0780, 0xc741, 0x0500, 0xc5c1, 0xc481, 0x0440,
+	0xcc01, 0x0cc0, 0x0d80, 0xcd41, 0x0f00, 0xcfc1, 0xce81, 0x0e40,
+	0x0a00, 0xcac1, 0xcb81, 0x0b40, 0xc901, 0x09c0, 0x0880, 0xc841,
+	0xd801, 0x18c0, 0x1980, 0xd941, 0x1b00, 0xdbc1, 0xda81, 0x1a40,
+	0x1e00, 0xdec1, 0xdf81, 0x1f40, 0xdd01, 0x1dc0, 0x1c80, 0xdc41,
+	0x1400, 0xd4c1, 0xd581, 0x1540, 0xd701, 0x17c0, 0x1680, 0xd641,
+	0xd201, 0x12c0, 0x1380, 0xd341, 0x1100, 0xd1c1, 0xd081, 0x1040,
+	0xf001, 0x30c0, 0x3180, 0xf141, 0x3300, 0xf3c1, 0xf281, 0x3240,
+	0x3600, 0xf6c1, 0xf781, 0x3740, 0xf501, 0x35c0, 0x3480, 0xf441,
+	0x3c00, 0xfcc1, 0xfd81, 0x3d40, 0xff01, 0x3fc0, 0x3e80, 0xfe41,
+	0xfa01, 0x3ac0, 0x3b80, 0xfb41, 0x3900, 0xf9c1, 0xf881, 0x3840,
+	0x2800, 0xe8c1, 0xe981, 0x2940, 0xeb01, 0x2bc0, 0x2a80, 0xea41,
+	0xee01, 0x2ec0, 0x2f80, 0xef41, 0x2d00, 0xedc1, 0xec81, 0x2c40,
+	0xe401, 0x24c0, 0x2580, 0xe541, 0x2700, 0xe7c1, 0xe681, 0x2640,
+	0x2200, 0xe2c1, 0xe381, 0x2340, 0xe101, 0x21c0, 0x2080, 0xe041,
+	0xa001, 0x60c0, 0x6180, 0xa141, 0x6300, 0xa3c1, 0xa281, 0x6240,
+	0x6600, 0xa6c1, 0xa781, 0x6740, 0xa501, 0x65c0, 0x6480, 0xa441,
+	0x6c00, 0xacc1, 0xad81, 0x6d40, 0xaf01, 0x6fc0, 0x6e80, 0xae41,
+	0xaa01, 0x6ac0, 0x6b80, 0xab41, 0x6900, 0xa9c1, 0xa881, 0x6840,
+	0x7800, 0xb8c1, 0xb981, 0x7940, 0xbb01, 0x7bc0, 0x7a80, 0xba41,
+	0xbe01, 0x7ec0, 0x7f80, 0xbf41, 0x7d00, 0xbdc1, 0xbc81, 0x7c40,
+	0xb401, 0x74c0, 0x7580, 0xb541, 0x7700, 0xb7c1, 0xb681, 0x7640,
+	0x7200, 0xb2c1, 0xb381, 0x7340, 0xb101, 0x71c0, 0x7080, 0xb041,
+	0x5000, 0x90c1, 0x9181, 0x5140, 0x9301, 0x53c0, 0x5280, 0x9241,
+	0x9601, 0x56c0, 0x5780, 0x9741, 0x5500, 0x95c1, 0x9481, 0x5440,
+	0x9c01, 0x5cc0, 0x5d80, 0x9d41, 0x5f00, 0x9fc1, 0x9e81, 0x5e40,
+	0x5a00, 0x9ac1, 0x9b81, 0x5b40, 0x9901, 0x59c0, 0x5880, 0x9841,
+	0x8801, 0x48c0, 0x4980, 0x8941, 0x4b00, 0x8bc1, 0x8a81, 0x4a40,
+	0x4e00, 0x8ec1, 0x8f81, 0x4f40, 0x8d01, 0x4dc0, 0x4c80, 0x8c41,
+	0x4400, 0x84c1, 0x8581, 0x4540, 0x8701, 0x47c0, 0x4680, 0x8641,
+	0x8201, 0x42c0, 0x4380, 0x8341, 0x4100, 0x81c1, 0x8081, 0x4040,
+};
+
+//-帧后面带着CRC(低字节在前)一起算,结果是0就对
+uint16_t modbus_crc(const uint8_t *p, int n)
+{
+	uint16_t crc = 0xffff;
+
+	while (n-- > 0)
+		crc = (crc >> 8) ^ mb_crc_table[(crc ^ *p++) & 0xff];
+	return crc;
+}
+
+static uint64_t mb_now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+//-一次最多睡100ms,停下来的时候不用等完一个很长的period
+static void mb_sleep_until(struct mb_bus *b, uint64_t ns)
+{
+	struct timespec ts;
+	uint64_t now;
+
+	while (b->running && (now = mb_now_ns()) < ns) {
+		if (ns - now > 100000000ULL)
+			now += 100000000ULL;
+		else
+			now = ns;
+		ts.tv_sec = now / 1000000000ULL;
+		ts.tv_nsec = now % 1000000000ULL;
+		clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+	}
+}
+
+static int mb_wait(int fd, uint64_t ns)
+{
+	struct pollfd pfd = { fd, POLLIN, 0 };
+	struct timespec ts = { ns / 1000000000ULL, ns % 1000000000ULL };
+
+	return ppoll(&pfd, 1, &ts, NULL);
+}
+
+//-------------------------------- 配置 --------------------------------
+static struct mb_bus *mb_bus_new(const char *dev, int baud, const char *parms, int timeout_ms)
+{
+	struct mb_bus *b;
+
+	if (parms == NULL)
+		parms = "8N1";
+	if (strlen(parms) != 3 || parms[0] < '5' || parms[0] > '8' || strchr("NEOnoe", parms[1]) == NULL
+	    || (parms[2] != '1' && parms[2] != '2') || baud <= 0)
+		return NULL;
+	b = calloc(1, sizeof(*b));
+	if (b == NULL)
+		return NULL;
+	snprintf(b->dev, sizeof(b->dev), "%s", dev);
+	b->fd = b->simfd = -1;
+	b->baud = baud;
+	b->databits = parms[0] - '0';
+	b->parity = parms[1];
+	b->stopbits = parms[2] - '0';
+	b->timeout_ms = timeout_ms > 0 ? timeout_ms : MODBUS_TIMEOUT_MS;
+	b->gap = MODBUS_GAP;
+	b->sim_slaves = 247;
+	pthread_mutex_init(&b->lock, NULL);
+	return b;
+}
+
+static int mb_point_add(struct mb_bus *b, int slave, int fc, int addr, int count)
+{
+	struct mb_point *np;
+	int max = fc <= 2 ? MODBUS_MAX_BITS : MODBUS_MAX_REGS;
+
+	if (slave < 1 || slave > 247 || fc < 1 || fc > 4 || addr < 0 || count < 1 || count > max || addr + count > 65536)
+		return -1;
+	if (b->npt == b->apt) {
+		np = realloc(b->pt, (b->apt ? b->apt * 2 : 16) * sizeof(*np));
+		if (np == NULL)
+			return -1;
+		b->pt = np;
+		b->apt = b->apt ? b->apt * 2 : 16;
+	}
+	b->pt[b->npt].slave = slave;
+	b->pt[b->npt].fc = fc;
+	b->pt[b->npt].addr = addr;
+	b->pt[b->npt].count = count;
+	b->npt++;
+	return 0;
+}
+
+static void mb_bus_free(struct mb_bus *b)
+{
+	int i;
+
+	for (i = 0; i < b->ntxn; i++)
+		free(b->txn[i].val);
+	free(b->txn);
+	free(b->pt);
+	pthread_mutex_destroy(&b->lock);
+	free(b);
+}
+
+/*
+配置文件的格式见modbus.h.总线按出现的顺序挂在mb_buses上.
+*/
+static int mb_parse(const char *path)
+{
+	char line[256], dev[64], parms[8];
+	struct mb_bus *b = NULL, **tail = &mb_buses;
+	int n = 0, a[4], k;
+	FILE *fp;
+
+	fp = fopen(path, "r");
+	if (fp == NULL) {
+		LOG(LOGM_MODBUS, LOG_WARN, "modbus %s: %s", path, strerror(errno));
+		return -1;
+	}
+	while (fgets(line, sizeof(line), fp)) {
+		n++;
+		line[strcspn(line, "#\n")] = 0;
+		if (line[strspn(line, " \t")] == 0)
+			continue;
+		if ((k = sscanf(line, " bus %63s %d %7s %d", dev, &a[0], parms, &a[1])) >= 2) {
+			b = mb_bus_new(dev, a[0], k >= 3 ? parms : NULL, k >= 4 ? a[1] : 0);
+			if (b == NULL)
+				goto bad;
+			*tail = b;
+			tail = &b->next;
+		} else if (b && (k = sscanf(line, " read %d %d %d %d", &a[0], &a[1], &a[2], &a[3])) >= 3) {
+			if (mb_point_add(b, a[0], a[1], a[2], k >= 4 ? a[3] : 1) != 0)
+				goto bad;
+		} else if (b && sscanf(line, " gap %d", &a[0]) == 1)
+			b->gap = a[0];
+		else if (b && sscanf(line, " period %d", &a[0]) == 1)
+			b->period_ms = a[0];
+		else if (b && sscanf(line, " sim_slaves %d", &a[0]) == 1)
+			b->sim_slaves = a[0];
+		else
+			goto bad;
+	}
+	fclose(fp);
+	return 0;
+bad:
+	LOG(LOGM_MODBUS, LOG_WARN, "modbus %s:%d: bad line", path, n);
+	fclose(fp);
+	return -1;
+}
+
+static int mb_point_cmp(const void *x, const void *y)
+{
+	const struct mb_point *p = x, *q = y;
+
+	if (p->slave != q->slave)
+		return p->slave - q->slave;
+	if (p->fc != q->fc)
+		return p->fc - q->fc;
+	return p->addr - q->addr;
+}
+
+static int mb_txn_add(struct mb_bus *b, int slave, int fc, int addr, int count)
+{
+	struct mb_txn *t;
+	uint16_t crc;
+
+	t = &b->txn[b->ntxn];
+	t->val = calloc(count, sizeof(uint16_t));
+	if (t->val == NULL)
+		return -1;
+	t->slave = slave;
+	t->fc = fc;
+	t->addr = addr;
+	t->count = count;
+	t->req[0] = slave;
+	t->req[1] = fc;
+	t->req[2] = addr >> 8;
+	t->req[3] = addr;
+	t->req[4] = count >> 8;
+	t->req[5] = count;
+	crc = modbus_crc(t->req, 6);
+	t->req[6] = crc;
+	t->req[7] = crc >> 8;
+	t->rlen = 5 + (fc <= 2 ? (count + 7) / 8 : count * 2);
+	b->ntxn++;
+	return 0;
+}
+
+/*
+把read排好序,同一从站同一功能码的相邻几条合成一次请求:
+下一条离已经合并的范围不超过gap个寄存器,合并以后也不超过一次能读的个数.
+*/
+static int mb_group(struct mb_bus *b)
+{
+	struct mb_point *p, *q;
+	int i, j, lo, hi, max;
+
+	b->txn = calloc(b->npt, sizeof(*b->txn));
+	if (b->txn == NULL)
+		return -1;
+	qsort(b->pt, b->npt, sizeof(*b->pt), mb_point_cmp);
+	for (i = 0; i < b->npt; i = j) {
+		p = &b->pt[i];
+		lo = p->addr;
+		hi = p->addr + p->count;
+		max = p->fc <= 2 ? MODBUS_MAX_BITS : MODBUS_MAX_REGS;
+		for (j = i + 1; j < b->npt; j++) {
+			q = &b->pt[j];
+			if (b->gap < 0 || q->slave != p->slave || q->fc != p->fc || q->addr > hi + b->gap)
+				break;
+			if (q->addr + q->count > hi) {
+				if (q->addr + q->count - lo > max)
+					break;
+				hi = q->addr + q->count;
+			}
+		}
+		if (mb_txn_add(b, p->slave, p->fc, lo, hi - lo) != 0)
+			return -1;
+	}
+	return 0;
+}
+
+//-------------------------------- 总线 --------------------------------
+//-UART0_Set没有关掉输入的转换(ICRNL,IXON会改掉0x0d,0x11这些字节),RTU是二进制的
+static void mb_raw(int fd)
+{
+	struct serial_struct ss;
+	struct termios tio;
+
+	if (tcgetattr(fd, &tio) == 0) {
+		tio.c_iflag &= ~(IGNBRK | BRKINT | PARMRK | ISTRIP | INLCR | IGNCR | ICRNL | IXON | IXOFF | IXANY);
+		tio.c_lflag &= ~IEXTEN;
+		tio.c_cc[VMIN] = 1;
+		tio.c_cc[VTIME] = 0;
+		tcsetattr(fd, TCSANOW, &tio);
+	}
+	//-8250之类的驱动收到就交上来,不攒;pty和USB转串口不支持,不管
+	if (ioctl(fd, TIOCGSERIAL, &ss) == 0) {
+		ss.flags |= ASYNC_LOW_LATENCY;
+		ioctl(fd, TIOCSSERIAL, &ss);
+	}
+}
+
+static int mb_bus_open(struct mb_bus *b)
+{
+	char *path = b->dev;
+	int bits;
+
+	if (strcmp(b->dev, "sim") == 0) {
+		b->simfd = posix_openpt(O_RDWR | O_NOCTTY);
+		if (b->simfd < 0 || grantpt(b->simfd) != 0 || unlockpt(b->simfd) != 0 || (path = ptsname(b->simfd)) == NULL)
+			return -1;
+	}
+	b->fd = UART0_Open(b->fd, path);
+	if (b->fd < 0)
+		return -1;
+	if (UART0_Set(b->fd, b->baud, 0, b->databits, b->stopbits, b->parity) != 0)
+		return -1;
+	mb_raw(b->fd);
+	//-一个字符:起始位,数据位,校验位,停止位;19200以上t3.5固定1750us(标准里这么规定的)
+	bits = 1 + b->databits + (b->parity != 'N' && b->parity != 'n') + b->stopbits;
+	b->char_ns = bits * 1000000000ULL / b->baud;
+	b->t35_ns = b->baud > 19200 ? 1750000ULL : b->char_ns * 35 / 10;
+	b->idle_ns = mb_now_ns();
+	return 0;
+}
+
+//-一次请求和回复
+static int mb_transact(struct mb_bus *b, struct mb_txn *t)
+{
+	uint8_t rx[MODBUS_ADU];
+	uint64_t now, tx_end, deadline, last = 0;
+	int n = 0, r, want = t->rlen, i;
+
+	mb_sleep_until(b, b->idle_ns + b->t35_ns);
+	tcflush(b->fd, TCIFLUSH);	//-上一次超时以后才到的回复不能算到这一次头上
+	now = mb_now_ns();
+	if (write(b->fd, t->req, sizeof(t->req)) != sizeof(t->req))
+		return MB_TIMEOUT;
+	tcdrain(b->fd);
+	metric_inc(m_requests);
+	//-真串口tcdrain返回时已经发完了,pty没有线上的时间,按字符数算
+	tx_end = mb_now_ns();
+	if (tx_end < now + sizeof(t->req) * b->char_ns)
+		tx_end = now + sizeof(t->req) * b->char_ns;
+	deadline = tx_end + b->timeout_ms * 1000000ULL;
+	while (n < want) {
+		now = mb_now_ns();
+		if (n == 0 && now >= deadline)
+			break;
+		if (mb_wait(b->fd, n == 0 ? deadline - now : b->t35_ns + MB_LATENCY_NS) <= 0)
+			break;
+		r = read(b->fd, rx + n, sizeof(rx) - n);
+		if (r <= 0)
+			break;
+		n += r;
+		last = mb_now_ns();
+		if (n >= 2 && (rx[1] & 0x80))
+			want = 5;
+	}
+	b->idle_ns = n ? last : tx_end;
+	if (n == 0) {
+		metric_inc(m_timeouts);
+		return MB_TIMEOUT;
+	}
+	if (n != want || rx[0] != t->slave || modbus_crc(rx, n) != 0) {
+		metric_inc(m_bad);
+		return MB_BAD;
+	}
+	if (rx[1] == (t->fc | 0x80)) {
+		metric_inc(m_exceptions);
+		LOG(LOGM_MODBUS, LOG_DBG, "modbus %s: slave %d fc %d addr %d: exception %d", b->dev, t->slave, t->fc, t->addr, rx[2]);
+		return MB_EXCEPTION;
+	}
+	if (rx[1] != t->fc || rx[2] != want - 5) {
+		metric_inc(m_bad);
+		return MB_BAD;
+	}
+	pthread_mutex_lock(&b->lock);
+	for (i = 0; i < t->count; i++)
+		t->val[i] = t->fc <= 2 ? (rx[3 + i / 8] >> (i % 8)) & 1 : rx[3 + i * 2] << 8 | rx[4 + i * 2];
+	t->ts_ns = last;
+	pthread_mutex_unlock(&b->lock);
+	return MB_OK;
+}
+
+/*
+一轮:每个请求发一次.一个从站不回,这一轮它后面的请求都不发了;
+连续MODBUS_FAIL_MAX次不回的每MODBUS_SKIP_CYCLES轮才试一次.
+*/
+static void mb_cycle(struct mb_bus *b)
+{
+	struct mb_txn *t;
+	uint64_t t0 = mb_now_ns();
+	int i, s, r;
+
+	for (s = 1; s <= 247; s++)
+		if (b->skip[s])
+			b->skip[s]--;
+	TRACE_BEGIN("modbus_cycle");
+	for (i = 0; i < b->ntxn && b->running; i++) {
+		t = &b->txn[i];
+		s = t->slave;
+		if (b->skip[s])
+			continue;
+		r = mb_transact(b, t);
+		if (r != MB_TIMEOUT) {
+			if (b->fails[s] >= MODBUS_FAIL_MAX)
+				LOG(LOGM_MODBUS, LOG_INFO, "modbus %s: slave %d back", b->dev, s);
+			__atomic_store_n(&b->fails[s], 0, __ATOMIC_RELAXED);
+			continue;
+		}
+		if (b->fails[s] < 255)
+			__atomic_store_n(&b->fails[s], b->fails[s] + 1, __ATOMIC_RELAXED);
+		if (b->fails[s] == MODBUS_FAIL_MAX)
+			LOG(LOGM_MODBUS, LOG_WARN, "modbus %s: slave %d not answering, polling every %d cycles", b->dev, s, MODBUS_SKIP_CYCLES);
+		b->skip[s] = b->fails[s] >= MODBUS_FAIL_MAX ? MODBUS_SKIP_CYCLES : 1;
+	}
+	TRACE_END("modbus_cycle");
+	b->cycle_ns = mb_now_ns() - t0;
+	b->cycles++;
+	metric_observe(m_cycle, b->cycle_ns / 1000);
+	if (b->period_ms > 0)
+		mb_sleep_until(b, t0 + b->period_ms * 1000000ULL);
+}
+
+static void *mb_thread(void *arg)
+{
+	struct mb_bus *b = arg;
+
+	rt_apply(RT_MODBUS);
+	trace_thread_name("modbus");
+	while (b->running)
+		mb_cycle(b);
+	return NULL;
+}
+
+//-------------------------------- 模拟的从站 --------------------------------
+//-寄存器的值是从站号*1000+地址,线圈是(从站号+地址)的最低位
+static int mb_sim_reply(struct mb_bus *b, const uint8_t *q, uint8_t *r)
+{
+	int slave = q[0], fc = q[1], addr = q[2] << 8 | q[3], count = q[4] << 8 | q[5];
+	int n, i, v, max = fc <= 2 ? MODBUS_MAX_BITS : MODBUS_MAX_REGS;
+	uint16_t crc;
+
+	if (modbus_crc(q, 8) != 0 || slave < 1 || slave > b->sim_slaves)
+		return 0;	//-真的从站也不回
+	r[0] = slave;
+	if (fc < 1 || fc > 4 || count < 1 || count > max || addr + count > MB_SIM_REGS) {
+		r[1] = fc | 0x80;
+		r[2] = fc < 1 || fc > 4 ? 1 : 2;
+		n = 3;
+	} else if (fc <= 2) {
+		r[1] = fc;
+		r[2] = (count + 7) / 8;
+		memset(r + 3, 0, r[2]);
+		for (i = 0; i < count; i++)
+			r[3 + i / 8] |= ((slave + addr + i) & 1) << (i % 8);
+		n = 3 + r[2];
+	} else {
+		r[1] = fc;
+		r[2] = count * 2;
+		for (i = 0; i < count; i++) {
+			v = slave * 1000 + addr + i;
+			r[3 + i * 2] = v >> 8;
+			r[4 + i * 2] = v;
+		}
+		n = 3 + r[2];
+	}
+	crc = modbus_crc(r, n);
+	r[n++] = crc;
+	r[n++] = crc >> 8;
+	return n;
+}
+
+//-pty上没有波特率,按线上的时间等:收完请求(8个字符),静默t3.5,发回复
+static void *mb_sim_thread(void *arg)
+{
+	struct mb_bus *b = arg;
+	uint8_t q[MODBUS_ADU], r[MODBUS_ADU];
+	uint64_t t;
+	int n = 0, k, len;
+
+	trace_thread_name("modbus_sim");
+	while (b->running) {
+		if (mb_wait(b->simfd, 100000000ULL) <= 0)
+			continue;
+		k = read(b->simfd, q + n, sizeof(q) - n);
+		if (k <= 0)
+			break;
+		t = mb_now_ns();
+		for (n += k; n >= 8; n -= 8) {
+			len = mb_sim_reply(b, q, r);
+			memmove(q, q + 8, n - 8);
+			if (len == 0)
+				continue;
+			mb_sleep_until(b, t + (8 + len) * b->char_ns + b->t35_ns);
+			if (write(b->simfd, r, len) != len)
+				break;
+		}
+	}
+	return NULL;
+}
+
+//-------------------------------- 启动和停止 --------------------------------
+static int mb_bus_start(struct mb_bus *b)
+{
+	if (b->npt == 0 || mb_group(b) != 0 || mb_bus_open(b) != 0)
+		return -1;
+	b->running = 1;
+	if (b->simfd >= 0) {
+		if (pthread_create(&b->sim_tid, NULL, mb_sim_thread, b) != 0)
+			return -1;
+		b->sim_started = 1;
+	}
+	if (pthread_create(&b->tid, NULL, mb_thread, b) != 0)
+		return -1;
+	b->started = 1;
+	LOG(LOGM_MODBUS, LOG_INFO, "modbus %s: %d reads in %d requests, t3.5 %llu us",
+	    b->dev, b->npt, b->ntxn, (unsigned long long)b->t35_ns / 1000);
+	return 0;
+}
+
+static void mb_bus_stop(struct mb_bus *b)
+{
+	b->running = 0;
+	if (b->started)
+		pthread_join(b->tid, NULL);
+	if (b->sim_started)
+		pthread_join(b->sim_tid, NULL);
+	b->started = b->sim_started = 0;
+	if (b->fd >= 0)
+		UART0_Close(b->fd);
+	if (b->simfd >= 0)
+		close(b->simfd);
+	b->fd = b->simfd = -1;
+}
+
+int modbus_start(void)
+{
+	struct mb_bus *b;
+	int err = 0;
+
+	if (modbus_conf == NULL)
+		return 0;
+	if (mb_parse(modbus_conf) != 0)
+		return -1;
+	m_requests = metric_counter("modbus_requests_total", "Modbus requests sent");
+	m_timeouts = metric_counter("modbus_timeouts_total", "Modbus requests without a reply");
+	m_bad = metric_counter("modbus_bad_replies_total", "Modbus replies with a bad CRC, length, slave or function");
+	m_exceptions = metric_counter("modbus_exceptions_total", "Modbus exception replies");
+	m_cycle = metric_histogram("modbus_cycle_us", "time to poll every request on a bus once");
+	for (b = mb_buses; b; b = b->next) {
+		if (mb_bus_start(b) != 0) {
+			LOG(LOGM_MODBUS, LOG_WARN, "modbus %s: can't start", b->dev);
+			mb_bus_stop(b);
+			err = -1;
+		}
+	}
+	return err;
+}
+
+void modbus_stop(void)
+{
+	struct mb_bus *b;
+
+	while ((b = mb_buses) != NULL) {
+		mb_buses = b->next;
+		mb_bus_stop(b);
+		mb_bus_free(b);
+	}
+}
+
+int modbus_get(int slave, int fc, int addr, uint16_t *v, uint64_t *age_ms)
+{
+	struct mb_bus *b;
+	struct mb_txn *t;
+	uint64_t ts;
+	int i;
+
+	for (b = mb_buses; b; b = b->next) {
+		for (i = 0; i < b->ntxn; i++) {
+			t = &b->txn[i];
+			if (t->slave != slave || t->fc != fc || addr < t->addr || addr >= t->addr + t->count)
+				continue;
+			pthread_mutex_lock(&b->lock);
+			ts = t->ts_ns;
+			*v = t->val[addr - t->addr];
+			pthread_mutex_unlock(&b->lock);
+			if (ts == 0 || __atomic_load_n(&b->fails[slave], __ATOMIC_RELAXED) >= MODBUS_FAIL_MAX)
+				return -2;
+			if (age_ms)
+				*age_ms = (mb_now_ns() - ts) / 1000000;
+			return 0;
+		}
+	}
+	return -1;
+}
+
+void modbus_stats(void)
+{
+	struct mb_bus *b;
+	int s, off;
+
+	for (b = mb_buses; b; b = b->next) {
+		for (s = 1, off = 0; s <= 247; s++)
+			off += __atomic_load_n(&b->fails[s], __ATOMIC_RELAXED) >= MODBUS_FAIL_MAX;
+		LOG(LOGM_MODBUS, LOG_INFO, "modbus %s: %d requests per cycle, %lu cycles, last %.1f ms, %d slaves not answering",
+		    b->dev, b->ntxn, b->cycles, b->cycle_ns / 1e6, off);
+	}
+}
+
+//-------------------------------- 基准测试 --------------------------------
+static void bench_modbus_crc(long iters, void *arg)
+{
+	static uint8_t frame[MODBUS_ADU];
+	long i;
+
+	for (i = 0; i < iters; i++) {
+		bench_clobber();
+		bench_keep(modbus_crc(frame, sizeof(frame)));
+	}
+}
+
+/*
+一轮的时间,sim总线115200:8个表,每个表4组寄存器(电压,电流,功率,电能),地址隔得不远.
+合并以后一个表一次请求,-1不合并时一个表4次,差的就是每次请求的t3.5和请求帧本身.
+*/
+#define BENCH_MB_METERS	8
+
+static void bench_modbus_cycle(long iters, void *arg)
+{
+	static struct mb_bus *bus[2];
+	static const int regs[][2] = { { 0, 2 }, { 6, 2 }, { 12, 4 }, { 20, 2 } };
+	int gap = *(int *)arg, s, k;
+	struct mb_bus *b = bus[gap >= 0];
+	long i;
+
+	if (b == NULL) {
+		b = mb_bus_new("sim", 115200, "8N1", 0);
+		if (b == NULL)
+			return;
+		b->gap = gap;
+		for (s = 1; s <= BENCH_MB_METERS; s++)
+			for (k = 0; k < 4; k++)
+				mb_point_add(b, s, 3, regs[k][0], regs[k][1]);
+		if (mb_group(b) != 0 || mb_bus_open(b) != 0) {
+			mb_bus_stop(b);
+			mb_bus_free(b);
+			return;
+		}
+		b->running = 1;
+		if (pthread_create(&b->sim_tid, NULL, mb_sim_thread, b) != 0)
+			return;
+		b->sim_started = 1;
+		bus[gap >= 0] = b;	//-一直留着,下一轮接着用
+	}
+	for (i = 0; i < iters; i++)
+		mb_cycle(b);
+}
+
+void modbus_Bench(void)
+{
+	static int gap = MODBUS_GAP, nogap = -1;
+
+	bench_add("modbus_crc256", bench_modbus_crc, NULL);
+	bench_add("modbus_cycle", bench_modbus_cycle, &gap);
+	bench_add("modbus_cycle_nogroup", bench_modbus_cycle, &nogap);
+}
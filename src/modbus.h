@@ -0,0 +1,39 @@
+//-为了方便调试定义了系列变量以便调试输出
+
+#ifndef MODBUS_H
+#define MODBUS_H
+
+#include <stdint.h>
+
+/*
+Modbus RTU主站:每条总线一个线程,按配置文件(-Q)一轮一轮地读各个表的寄存器.
+同一个从站,同一个功能码,地址挨得近的几条read在启动时合并成一次请求(中间空着的寄存器也一起读),
+请求帧连CRC在启动时就算好,一轮里只剩下:等够3.5个字符的静默,写,等回复,校验,存值.
+连续几次不回的从站先跳过几轮再试,一个坏表不会把整轮拖成好几个超时.
+读到的值放在总线自己的缓存里,modbus_get哪个线程都可以读.
+
+配置文件,每行一项,#开始的是注释:
+bus <设备> <波特率> [8N1] [超时ms]	开始一条总线;设备写sim时开一个pty,另一头是模拟的从站
+read <从站> <功能码1-4> <地址> [个数]	要读的寄存器(功能码1/2是线圈/离散输入,一个值是0/1)
+gap <n>				合并时最多跨过几个不要的寄存器,默认MODBUS_GAP,-1不合并
+period <ms>			一轮最短多长,0表示一轮完了马上开始下一轮
+sim_slaves <n>			sim总线上只有1..n号从站回答
+*/
+#define MODBUS_GAP		8
+#define MODBUS_MAX_REGS		125	//-功能码3/4一次最多读这么多个寄存器
+#define MODBUS_MAX_BITS		2000	//-功能码1/2一次最多读这么多位
+#define MODBUS_ADU		256	//-RTU帧最长256字节
+#define MODBUS_TIMEOUT_MS	200	//-默认的回复超时
+#define MODBUS_FAIL_MAX		3	//-连续这么多次不回就算掉线
+#define MODBUS_SKIP_CYCLES	10	//-掉线的从站每这么多轮试一次
+
+extern const char *modbus_conf;		//--Q 配置文件,NULL表示不开Modbus
+
+uint16_t modbus_crc(const uint8_t *p, int n);
+int  modbus_start(void);		//-读配置,打开总线,启动线程;没有配置返回0
+void modbus_stop(void);
+int  modbus_get(int slave, int fc, int addr, uint16_t *v, uint64_t *age_ms);	//-0:有值 -1:没有配置 -2:还没有读到或者已经掉线
+void modbus_stats(void);
+void modbus_Bench(void);
+
+#endif /* MODBUS_H */
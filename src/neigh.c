@@ -0,0 +1,325 @@
+/*
+此文件是从抓包学的邻居表,说明见neigh.h.
+抓包线程改,主线程(控制命令)查,一把锁;只有ARP和邻居发现报文进锁,一般每秒没几个.
+表的查找和删除在ohash.h.
+*/
+
+#include "debugfl.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <arpa/inet.h>
+#include <pcap.h>
+
+#include "bench.h"
+#include "log.h"
+#include "metrics.h"
+#include "pktparse.h"
+#include "ohash.h"
+#include "neigh.h"
+
+int neigh_age = NEIGH_AGE_DEF;
+
+static struct neigh_entry nt[NEIGH_SLOTS];
+static int nt_count;
+static pthread_mutex_t nt_lock = PTHREAD_MUTEX_INITIALIZER;
+static char nt_ifs[NEIGH_IFS][16];
+static int nt_nifs;
+
+static struct metric *m_new = &metric_sink;
+static struct metric *m_changed = &metric_sink;
+static struct metric *m_dup = &metric_sink;
+static struct metric *m_aged = &metric_sink;
+static struct metric *m_full = &metric_sink;
+
+static long neigh_count_metric(void)
+{
+	return __atomic_load_n(&nt_count, __ATOMIC_RELAXED);
+}
+
+int neigh_open(const char *ifname)
+{
+	int i;
+
+	if (m_new == &metric_sink) {
+		m_new = metric_counter("neigh_new_total", "addresses seen for the first time");
+		m_changed = metric_counter("neigh_changed_total", "addresses that moved to another MAC");
+		m_dup = metric_counter("neigh_duplicate_total", "addresses claimed by two MACs in turn");
+		m_aged = metric_counter("neigh_aged_total", "entries removed after neigh_age seconds unseen");
+		m_full = metric_counter("neigh_table_full_total", "new addresses not stored because the table was full");
+		metric_func("neigh_entries", "entries in the neighbor table", METRIC_GAUGE, neigh_count_metric);
+	}
+	for (i = 0; i < nt_nifs; i++)
+		if (strcmp(nt_ifs[i], ifname) == 0)
+			return i;
+	if (nt_nifs == NEIGH_IFS)
+		return NEIGH_IFS - 1;	//-不会有这么多网口,真有了后面的算一个
+	snprintf(nt_ifs[nt_nifs], sizeof(nt_ifs[0]), "%s", ifname);
+	return nt_nifs++;
+}
+
+const char *neigh_ifname(int ifidx)
+{
+	return ifidx < nt_nifs ? nt_ifs[ifidx] : "?";
+}
+
+//-地址加网口
+static uint32_t neigh_hash(const void *p)
+{
+	const struct neigh_entry *e = p;
+
+	return ohash_fnv(ohash_fnv(OHASH_FNV_INIT, e->ip, 16), &e->ifidx, 1);
+}
+
+static int neigh_eq(const void *p, const void *key)
+{
+	const struct neigh_entry *e = p, *k = key;
+
+	return e->ver == k->ver && e->ifidx == k->ifidx && memcmp(e->ip, k->ip, 16) == 0;
+}
+
+static int neigh_used(const void *p)
+{
+	return ((const struct neigh_entry *)p)->ver != 0;
+}
+
+static const struct ohash nt_tab = { nt, sizeof(nt[0]), NEIGH_SLOTS, neigh_hash, neigh_eq, neigh_used };
+
+//-查找用的键:只填地址,版本,网口.在拿锁之前填好
+static void neigh_key(struct neigh_entry *k, const uint8_t *ip, int ver, int ifidx)
+{
+	memset(k->ip, 0, 16);
+	memcpy(k->ip, ip, ver == 6 ? 16 : 4);
+	k->ver = ver;
+	k->ifidx = ifidx;
+}
+
+static void neigh_mac_str(const uint8_t *m, char *buf)
+{
+	sprintf(buf, "%02x:%02x:%02x:%02x:%02x:%02x", m[0], m[1], m[2], m[3], m[4], m[5]);
+}
+
+static void neigh_ip_str(const uint8_t *ip, int ver, char *buf, int size)
+{
+	inet_ntop(ver == 6 ? AF_INET6 : AF_INET, ip, buf, size);
+}
+
+static void neigh_learn(int ifidx, int ver, const uint8_t *ip, const uint8_t *mac, uint32_t now)
+{
+	char a[INET6_ADDRSTRLEN], m0[18], m1[18];
+	struct neigh_entry *e, k;
+
+	neigh_key(&k, ip, ver, ifidx);
+	pthread_mutex_lock(&nt_lock);
+	e = &nt[ohash_slot(&nt_tab, &k)];	//-表不会满(NEIGH_MAX),一定有空槽
+	if (e->ver == 0) {
+		if (nt_count >= NEIGH_MAX) {
+			pthread_mutex_unlock(&nt_lock);
+			metric_inc(m_full);
+			return;
+		}
+		memcpy(e->ip, k.ip, 16);
+		e->ver = ver;
+		e->ifidx = ifidx;
+		memcpy(e->mac, mac, 6);
+		e->first_seen = now;
+		__atomic_store_n(&nt_count, nt_count + 1, __ATOMIC_RELAXED);
+		metric_inc(m_new);
+		neigh_ip_str(k.ip, ver, a, sizeof(a));
+		neigh_mac_str(mac, m0);
+		LOG(LOGM_PCAP, LOG_INFO, "neigh: new %s %s on %s", a, m0, neigh_ifname(ifidx));
+	} else if (memcmp(e->mac, mac, 6) != 0) {
+		neigh_ip_str(k.ip, ver, a, sizeof(a));
+		neigh_mac_str(e->mac, m0);
+		neigh_mac_str(mac, m1);
+		if (e->changed && now - e->changed < NEIGH_DUP_SEC && memcmp(e->prev_mac, mac, 6) == 0) {
+			metric_inc(m_dup);
+			if (!(e->flags & NEIGH_F_DUP))
+				LOG(LOGM_PCAP, LOG_WARN, "neigh: duplicate %s: %s and %s on %s", a, m0, m1, neigh_ifname(ifidx));
+			e->flags |= NEIGH_F_DUP;
+		} else {
+			metric_inc(m_changed);
+			LOG(LOGM_PCAP, LOG_WARN, "neigh: %s changed %s -> %s on %s", a, m0, m1, neigh_ifname(ifidx));
+		}
+		memcpy(e->prev_mac, e->mac, 6);
+		memcpy(e->mac, mac, 6);
+		e->changed = now;
+		e->changes++;
+	}
+	e->last_seen = now;
+	pthread_mutex_unlock(&nt_lock);
+}
+
+//-邻居发现的选项里找链路层地址(1:源 2:目标)
+static const uint8_t *neigh_nd_lla(const unsigned char *p, int len, int type)
+{
+	int off = 0, olen;
+
+	while (off + 8 <= len) {
+		olen = p[off + 1] * 8;
+		if (olen == 0 || off + olen > len)
+			break;
+		if (p[off] == type)
+			return p + off + 2;
+		off += olen;
+	}
+	return NULL;
+}
+
+int neigh_packet(int ifidx, int linktype, const struct pcap_pkthdr *h, const unsigned char *data)
+{
+	static const uint8_t zero[16];
+	const unsigned char *p;
+	const uint8_t *lla;
+	int off, type, len, caplen = h->caplen;
+
+	if ((off = pkt_l3(linktype, data, caplen, &type)) < 0)
+		return 0;
+	p = data + off;
+	len = caplen - off;
+	if (type == PKT_ETH_ARP) {
+		//-以太网/IPv4:硬件类型1,协议0x0800,长度6和4;发送方地址是0.0.0.0的是探测,不学
+		if (len >= 28 && p[0] == 0 && p[1] == 1 && p[2] == 8 && p[3] == 0 && p[4] == 6 && p[5] == 4
+		    && memcmp(p + 14, zero, 4) != 0)
+			neigh_learn(ifidx, 4, p + 14, p + 8, h->ts.tv_sec);
+		return 1;
+	}
+	//-IPv6直接跟ICMPv6(邻居发现的跳数限制是255,不会带扩展头),类型135请求,136通告
+	if (type != PKT_ETH_IPV6 || len < 40 + 24 || p[6] != 58 || p[7] != 255 || (p[40] != 135 && p[40] != 136))
+		return 0;
+	if (p[40] == 135) {
+		if (memcmp(p + 8, zero, 16) != 0 && (lla = neigh_nd_lla(p + 64, len - 64, 1)) != NULL)
+			neigh_learn(ifidx, 6, p + 8, lla, h->ts.tv_sec);	//-源地址是::的是重复地址检测
+	} else if ((lla = neigh_nd_lla(p + 64, len - 64, 2)) != NULL) {
+		neigh_learn(ifidx, 6, p + 48, lla, h->ts.tv_sec);
+	}
+	return 1;
+}
+
+static void neigh_delete(uint32_t i)
+{
+	ohash_delete(&nt_tab, i);
+	__atomic_store_n(&nt_count, nt_count - 1, __ATOMIC_RELAXED);
+}
+
+void neigh_tick(uint32_t now)
+{
+	uint32_t i = 0;
+
+	pthread_mutex_lock(&nt_lock);
+	while (i < NEIGH_SLOTS) {
+		struct neigh_entry *e = &nt[i];
+
+		if (e->ver && neigh_age > 0 && now - e->last_seen >= (uint32_t)neigh_age) {
+			neigh_delete(i);
+			metric_inc(m_aged);
+			continue;	//-挪过来的这一项还要看
+		}
+		if ((e->flags & NEIGH_F_DUP) && now - e->changed >= NEIGH_DUP_SEC)
+			e->flags &= ~NEIGH_F_DUP;	//-不抢了,下次再抢再报
+		i++;
+	}
+	pthread_mutex_unlock(&nt_lock);
+}
+
+int neigh_find(const uint8_t *ip, int ver, struct neigh_entry *e)
+{
+	struct neigh_entry k;
+	int i, j, ret = -1;
+
+	pthread_mutex_lock(&nt_lock);
+	for (i = 0; i < (nt_nifs ? nt_nifs : 1) && ret; i++) {
+		neigh_key(&k, ip, ver, i);
+		j = ohash_slot(&nt_tab, &k);
+		if (nt[j].ver) {
+			*e = nt[j];
+			ret = 0;
+		}
+	}
+	pthread_mutex_unlock(&nt_lock);
+	return ret;
+}
+
+int neigh_list(struct neigh_entry *out, int max)
+{
+	int i, n = 0, total;
+
+	pthread_mutex_lock(&nt_lock);
+	for (i = 0; i < NEIGH_SLOTS && n < max; i++)
+		if (nt[i].ver)
+			out[n++] = nt[i];
+	total = nt_count;
+	pthread_mutex_unlock(&nt_lock);
+	return total;
+}
+
+int neigh_str(const struct neigh_entry *e, char *buf, int size)
+{
+	char a[INET6_ADDRSTRLEN], m[18], pm[18];
+
+	neigh_ip_str(e->ip, e->ver, a, sizeof(a));
+	neigh_mac_str(e->mac, m);
+	if (e->changes == 0)
+		return snprintf(buf, size, "%s %s %s seen %u-%u", a, m, neigh_ifname(e->ifidx), e->first_seen, e->last_seen);
+	neigh_mac_str(e->prev_mac, pm);
+	return snprintf(buf, size, "%s %s %s seen %u-%u changes %u was %s at %u%s", a, m, neigh_ifname(e->ifidx),
+			e->first_seen, e->last_seen, e->changes, pm, e->changed, e->flags & NEIGH_F_DUP ? " duplicate" : "");
+}
+
+void neigh_stats(void)
+{
+	if (m_new == &metric_sink)
+		return;
+	LOG(LOGM_PCAP, LOG_INFO, "neigh: %d entries, %llu new, %llu changed, %llu duplicate, %llu aged, %llu not stored",
+	    (int)neigh_count_metric(), (unsigned long long)metric_value(m_new), (unsigned long long)metric_value(m_changed),
+	    (unsigned long long)metric_value(m_dup), (unsigned long long)metric_value(m_aged),
+	    (unsigned long long)metric_value(m_full));
+}
+
+//-------------------------------- 基准测试 --------------------------------
+#define BENCH_HOSTS	256
+
+static unsigned char bench_arp[BENCH_HOSTS][42];
+
+//-已经在表里的主机的ARP应答:解析,查表,更新last_seen,是绝大多数ARP报文的情况
+static void bench_neigh_arp(long iters, void *arg)
+{
+	struct pcap_pkthdr h;
+	long i;
+
+	memset(&h, 0, sizeof(h));
+	h.caplen = h.len = 42;
+	h.ts.tv_sec = 1700000000;
+	for (i = 0; i < iters; i++) {
+		bench_clobber();
+		bench_keep(neigh_packet(0, PKT_DLT_EN10MB, &h, bench_arp[i % BENCH_HOSTS]));
+	}
+}
+
+void neigh_Bench(void)
+{
+	static const unsigned char tmpl[42] = {
+		0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x00, 0x50, 0x56, 0xc0, 0x00, 0x00, 0x08, 0x06,
+		0x00, 0x01, 0x08, 0x00, 0x06, 0x04, 0x00, 0x02,
+		0x00, 0x50, 0x56, 0xc0, 0x00, 0x00, 0xc0, 0xa8, 0x00, 0x00,
+		0x00, 0x0c, 0x29, 0x3e, 0x5b, 0x01, 0xc0, 0xa8, 0x01, 0x01,
+	};
+	struct pcap_pkthdr h;
+	int i, level = log_level;
+
+	neigh_open("bench");
+	memset(&h, 0, sizeof(h));
+	h.caplen = h.len = 42;
+	h.ts.tv_sec = 1700000000;
+	log_level = LOG_ERR;	//-先把主机都学进去,new不要打出来
+	for (i = 0; i < BENCH_HOSTS; i++) {
+		memcpy(bench_arp[i], tmpl, sizeof(tmpl));
+		bench_arp[i][11] = bench_arp[i][27] = i;	//-MAC和IP的最后一个字节
+		bench_arp[i][31] = i;
+		neigh_packet(0, PKT_DLT_EN10MB, &h, bench_arp[i]);
+	}
+	log_level = level;
+	bench_add("neigh_arp", bench_neigh_arp, NULL);
+}
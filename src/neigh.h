@@ -0,0 +1,54 @@
+//-为了方便调试定义了系列变量以便调试输出
+
+#ifndef NEIGH_H
+#define NEIGH_H
+
+#include <stdint.h>
+
+/*
+邻居表:从抓到的ARP(IPv4)和邻居请求/通告(IPv6)里学IP->MAC->网口,代替另外跑的arpwatch
+(它要把同样的流量再抓一遍).每个ARP报文在抓包线程里查一次表,改一项.
+表是开放寻址的哈希表,槽数固定(NEIGH_SLOTS),一项48字节;
+NEIGH_AGE秒(-A,0表示不老化)没有再出现的每秒清掉,表满了新的不进,记数.
+变化写日志并记数:
+	new		没见过的IP
+	changed		IP换了MAC(换网卡,换设备)
+	duplicate	换回了NEIGH_DUP_SEC秒内刚换掉的MAC:两台机器在抢一个IP,同一项NEIGH_DUP_SEC秒里只报一次
+查询走控制命令$0009#(见uart_1_app.c).时间都是报文时间戳的秒.
+*/
+#define NEIGH_SLOTS		1024	//-必须是2的幂
+#define NEIGH_MAX		(NEIGH_SLOTS * 3 / 4)	//-再多探测链太长
+#define NEIGH_AGE_DEF		3600
+#define NEIGH_DUP_SEC		60
+#define NEIGH_IFS		4	//-最多记几个网口的名字
+
+#define NEIGH_F_DUP		1	//-最近报过duplicate
+
+struct neigh_entry {
+	uint8_t ip[16];			//-IPv4只用前4个字节
+	uint8_t ver;			//-4或6,0表示空槽
+	uint8_t ifidx;			//-neigh_ifname的下标
+	uint8_t mac[6];
+	uint8_t prev_mac[6];		//-上一次换掉的MAC
+	uint16_t flags;
+	uint32_t first_seen;
+	uint32_t last_seen;
+	uint32_t changed;		//-最后一次换MAC的时间,0表示没换过
+	uint32_t changes;
+};
+
+struct pcap_pkthdr;
+
+extern int neigh_age;			//-秒
+
+int  neigh_open(const char *ifname);	//-开始抓包时调用,返回网口的下标
+int  neigh_packet(int ifidx, int linktype, const struct pcap_pkthdr *h, const unsigned char *data);	//-ARP/邻居发现报文返回1
+void neigh_tick(uint32_t now);		//-每秒一次,老化
+int  neigh_find(const uint8_t *ip, int ver, struct neigh_entry *e);	//-找到返回0,复制一份
+int  neigh_list(struct neigh_entry *out, int max);	//-复制最多max项,返回表里一共几项
+const char *neigh_ifname(int ifidx);
+int  neigh_str(const struct neigh_entry *e, char *buf, int size);
+void neigh_stats(void);
+void neigh_Bench(void);
+
+#endif /* NEIGH_H */
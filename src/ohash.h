@@ -0,0 +1,72 @@
+//-为了方便调试定义了系列变量以便调试输出
+
+#ifndef OHASH_H
+#define OHASH_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+/*
+固定槽数的开放寻址哈希表(线性探测),邻居表和DNS查询表共用.
+表项和槽数组由调用者自己定义,这里只管找槽和删除:
+删除用后移(backward shift),不留墓碑,表一直不会越用越慢.
+调用者要保证表不会满(留1/4空槽),查找一定能停在空槽上;加锁也是调用者的事.
+都是inline:表定义成static const,编译器能把回调展开,和各自手写的一样快.
+*/
+struct ohash {
+	void *slot;				//-槽数组
+	size_t size;				//-一项多大
+	uint32_t nslots;			//-必须是2的幂
+	uint32_t (*hash)(const void *e);	//-表项(或者同样格式的键)的哈希,不用取模
+	int (*eq)(const void *e, const void *key);
+	int (*used)(const void *e);		//-空槽返回0
+};
+
+#define OHASH_FNV_INIT	2166136261u
+
+static inline uint32_t ohash_fnv(uint32_t h, const void *p, int n)	//-FNV-1a,可以接着上一段算
+{
+	const uint8_t *b = p;
+
+	while (n-- > 0)
+		h = (h ^ *b++) * 16777619u;
+	return h;
+}
+
+static inline void *ohash_at(const struct ohash *t, uint32_t i)
+{
+	return (char *)t->slot + i * t->size;
+}
+
+//-key的槽,没有就是探测链上第一个空槽
+static inline uint32_t ohash_slot(const struct ohash *t, const void *key)
+{
+	uint32_t mask = t->nslots - 1, i = t->hash(key) & mask;
+
+	while (t->used(ohash_at(t, i)) && !t->eq(ohash_at(t, i), key))
+		i = (i + 1) & mask;
+	return i;
+}
+
+//-清掉第i项,后面探测链上的往前挪,保证查找不会在空槽提前停下.
+//-挪过来的那一项在i,遍历时i要再看一次
+static inline void ohash_delete(const struct ohash *t, uint32_t i)
+{
+	uint32_t mask = t->nslots - 1, j = i, k;
+
+	for (;;) {
+		j = (j + 1) & mask;
+		if (!t->used(ohash_at(t, j)))
+			break;
+		k = t->hash(ohash_at(t, j)) & mask;
+		//-k(本来该在的位置)在(i,j]之间(循环意义上)的不能挪
+		if (i <= j ? (i < k && k <= j) : (i < k || k <= j))
+			continue;
+		memcpy(ohash_at(t, i), ohash_at(t, j), t->size);
+		i = j;
+	}
+	memset(ohash_at(t, i), 0, t->size);
+}
+
+#endif /* OHASH_H */
@@ -0,0 +1,227 @@
+/*
+此文件是报文头解析,说明见pktparse.h.
+报文里的数都是网络字节序,一个字节一个字节拼,不用对齐也不管本机字节序.
+*/
+
+#include "debugfl.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <arpa/inet.h>
+
+#include "pktparse.h"
+
+#define PKT_GET16(p)	((uint16_t)((p)[0] << 8 | (p)[1]))
+
+int pkt_l3(int linktype, const unsigned char *p, int caplen, int *ethertype)
+{
+	int off, type;
+
+	switch (linktype) {
+	case PKT_DLT_EN10MB:
+		if (caplen < 14)
+			return -1;
+		type = PKT_GET16(p + 12);
+		off = 14;
+		while ((type == 0x8100 || type == 0x88a8) && off + 4 <= caplen) {	//-VLAN,QinQ
+			type = PKT_GET16(p + off + 2);
+			off += 4;
+		}
+		break;
+	case PKT_DLT_LINUX_SLL:
+		if (caplen < 16)
+			return -1;
+		type = PKT_GET16(p + 14);
+		off = 16;
+		break;
+	case PKT_DLT_NULL:
+		if (caplen < 5)
+			return -1;
+		type = p[4] >> 4 == 6 ? PKT_ETH_IPV6 : PKT_ETH_IP;	//-地址族是发送方的字节序,直接看IP版本
+		off = 4;
+		break;
+	case PKT_DLT_RAW:
+	case PKT_DLT_RAW_BSD:
+	case PKT_DLT_RAW_FILE:
+		if (caplen < 1)
+			return -1;
+		type = p[0] >> 4 == 6 ? PKT_ETH_IPV6 : PKT_ETH_IP;
+		off = 0;
+		break;
+	default:
+		return -1;
+	}
+	*ethertype = type;
+	return off;
+}
+
+int pkt_flow(int linktype, const unsigned char *p, int caplen, struct pkt_flow *f)
+{
+	int off, type, hl, nh, first = 1, n;
+
+	memset(f, 0, sizeof(*f));
+	if ((off = pkt_l3(linktype, p, caplen, &type)) < 0)
+		return -1;
+	if (type == PKT_ETH_IP) {
+		if (off + 20 > caplen || p[off] >> 4 != 4 || (hl = (p[off] & 15) * 4) < 20)
+			return -1;
+		f->ver = 4;
+		f->proto = p[off + 9];
+		memcpy(f->addr[0], p + off + 12, 4);
+		memcpy(f->addr[1], p + off + 16, 4);
+		first = (PKT_GET16(p + off + 6) & 0x1fff) == 0;	//-不是第一个分片没有端口
+		off += hl;
+	} else if (type == PKT_ETH_IPV6) {
+		if (off + 40 > caplen || p[off] >> 4 != 6)
+			return -1;
+		f->ver = 6;
+		nh = p[off + 6];
+		memcpy(f->addr[0], p + off + 8, 16);
+		memcpy(f->addr[1], p + off + 24, 16);
+		off += 40;
+		//-扩展头:逐跳,路由,目的选项,分片;最多看4个
+		for (n = 0; n < 4 && (nh == 0 || nh == 43 || nh == 60 || nh == 44) && off + 8 <= caplen; n++) {
+			if (nh == 44) {
+				first = (PKT_GET16(p + off + 2) & 0xfff8) == 0;
+				nh = p[off];
+				off += 8;
+			} else {
+				nh = p[off];
+				off += (p[off + 1] + 1) * 8;
+			}
+		}
+		f->proto = nh;
+	} else {
+		return -1;
+	}
+	if (off > caplen)
+		off = caplen;
+	if (!first)
+		return off;
+	if (f->proto == 6 || f->proto == 17) {
+		if (off + 4 <= caplen) {
+			f->port[0] = PKT_GET16(p + off);
+			f->port[1] = PKT_GET16(p + off + 2);
+		}
+		if (f->proto == 17)
+			off += 8;
+		else if (off + 13 <= caplen)
+			off += (p[off + 12] >> 4) * 4;
+		else
+			off = caplen;
+		if (off > caplen)
+			off = caplen;
+	}
+	return off;
+}
+
+void pkt_flow_canon(struct pkt_flow *f)
+{
+	uint8_t a[16];
+	uint16_t t;
+	int c;
+
+	c = memcmp(f->addr[0], f->addr[1], 16);
+	if (c > 0 || (c == 0 && f->port[0] > f->port[1])) {
+		memcpy(a, f->addr[0], 16);
+		memcpy(f->addr[0], f->addr[1], 16);
+		memcpy(f->addr[1], a, 16);
+		t = f->port[0];
+		f->port[0] = f->port[1];
+		f->port[1] = t;
+	}
+}
+
+//-FNV-1a,64位
+uint64_t pkt_flow_hash(const struct pkt_flow *f)
+{
+	const unsigned char *p = (const unsigned char *)f;
+	uint64_t h = 0xcbf29ce484222325ULL;
+	size_t i;
+
+	for (i = 0; i < sizeof(*f); i++) {
+		h ^= p[i];
+		h *= 0x100000001b3ULL;
+	}
+	return h;
+}
+
+//-"地址:端口"或者"[IPv6地址]:端口",端口可以没有
+static int pkt_endpoint(char *s, struct pkt_flow *f, int i)
+{
+	char *port = NULL, *e;
+	long v;
+
+	if (*s == '[') {
+		if ((e = strchr(++s, ']')) == NULL)
+			return -1;
+		*e++ = 0;
+		if (*e == ':')
+			port = e + 1;
+		else if (*e)
+			return -1;
+	} else if ((e = strrchr(s, ':')) != NULL) {
+		*e = 0;
+		port = e + 1;
+	}
+	if (inet_pton(AF_INET, s, f->addr[i]) == 1) {
+		if (f->ver == 6)
+			return -1;
+		f->ver = 4;
+	} else if (inet_pton(AF_INET6, s, f->addr[i]) == 1) {
+		if (f->ver == 4)
+			return -1;
+		f->ver = 6;
+	} else {
+		return -1;
+	}
+	if (port) {
+		v = strtol(port, &e, 10);
+		if (*port == 0 || *e || v < 0 || v > 65535)
+			return -1;
+		f->port[i] = v;
+	}
+	return 0;
+}
+
+int pkt_flow_parse(const char *s, struct pkt_flow *f)
+{
+	char buf[128], *p, *q, *e;
+	long v;
+
+	memset(f, 0, sizeof(*f));
+	snprintf(buf, sizeof(buf), "%s", s);
+	if ((p = strchr(buf, ':')) == NULL || (q = strchr(p + 1, '-')) == NULL)
+		return -1;
+	*p++ = 0;
+	*q++ = 0;
+	if (strcmp(buf, "tcp") == 0)
+		f->proto = 6;
+	else if (strcmp(buf, "udp") == 0)
+		f->proto = 17;
+	else if ((v = strtol(buf, &e, 10)) > 0 && v < 256 && *e == 0)
+		f->proto = v;
+	else
+		return -1;
+	if (pkt_endpoint(p, f, 0) != 0 || pkt_endpoint(q, f, 1) != 0)
+		return -1;
+	return 0;
+}
+
+int pkt_flow_str(const struct pkt_flow *f, char *buf, int size)
+{
+	char a[2][INET6_ADDRSTRLEN], proto[8];
+	int af = f->ver == 6 ? AF_INET6 : AF_INET;
+
+	inet_ntop(af, f->addr[0], a[0], sizeof(a[0]));
+	inet_ntop(af, f->addr[1], a[1], sizeof(a[1]));
+	if (f->proto == 6 || f->proto == 17)
+		snprintf(proto, sizeof(proto), "%s", f->proto == 6 ? "tcp" : "udp");
+	else
+		snprintf(proto, sizeof(proto), "%u", f->proto);
+	if (f->ver == 6)
+		return snprintf(buf, size, "%s:[%s]:%u-[%s]:%u", proto, a[0], f->port[0], a[1], f->port[1]);
+	return snprintf(buf, size, "%s:%s:%u-%s:%u", proto, a[0], f->port[0], a[1], f->port[1]);
+}
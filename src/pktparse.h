@@ -0,0 +1,39 @@
+//-为了方便调试定义了系列变量以便调试输出
+
+#ifndef PKTPARSE_H
+#define PKTPARSE_H
+
+#include <stdint.h>
+
+/*
+报文头解析:链路层(以太网带VLAN,Linux cooked,裸IP)到IPv4/IPv6再到TCP/UDP的端口.
+只看头,不复制,不分配;caplen不够(snaplen截掉了)时能解析多少算多少.
+抓包段的布隆过滤器(写的时候)和dfcap -F(查的时候)用同一个流的定义,两边必须一致.
+*/
+#define PKT_DLT_NULL	0
+#define PKT_DLT_EN10MB	1
+#define PKT_DLT_RAW	12
+#define PKT_DLT_RAW_BSD	14
+#define PKT_DLT_RAW_FILE	101	//-pcap文件里的LINKTYPE_RAW
+#define PKT_DLT_LINUX_SLL	113
+
+#define PKT_ETH_IP	0x0800
+#define PKT_ETH_ARP	0x0806
+#define PKT_ETH_IPV6	0x86dd
+
+//-一条流.结构整个参加哈希,填之前要清0
+struct pkt_flow {
+	uint8_t ver;			//-4或6
+	uint8_t proto;			//-IP协议号
+	uint16_t port[2];		//-主机字节序;不是TCP/UDP或者不是第一个分片时是0
+	uint8_t addr[2][16];		//-IPv4只用前4个字节
+};
+
+int pkt_l3(int linktype, const unsigned char *p, int caplen, int *ethertype);	//-返回网络层的偏移,不认识的链路层返回-1
+int pkt_flow(int linktype, const unsigned char *p, int caplen, struct pkt_flow *f);	//-返回TCP/UDP载荷的偏移,不是IP返回-1
+void pkt_flow_canon(struct pkt_flow *f);		//-两个方向变成同一个:小的一端放前面
+uint64_t pkt_flow_hash(const struct pkt_flow *f);
+int pkt_flow_parse(const char *s, struct pkt_flow *f);	//-"tcp:10.0.0.1:80-10.0.0.2:5000",IPv6地址放[]里
+int pkt_flow_str(const struct pkt_flow *f, char *buf, int size);
+
+#endif /* PKTPARSE_H */
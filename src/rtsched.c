@@ -0,0 +1,173 @@
+/*
+此文件负责线程的CPU绑定和实时调度.
+网关忙着转发的时候,串口主循环和抓包线程和其他进程一起抢CPU,串口回复的延迟没有上限.
+现在可以给每类线程指定CPU,SCHED_FIFO/SCHED_RR优先级,以及mlockall锁定内存.
+普通用户运行没有权限(EPERM)时打印一次警告,按原来的普通调度继续运行,不影响功能.
+
+用法: -P serial:0:fifo:50 -P pcap:1:rr:40 -P worker:2-3 -L
+*/
+
+#define _GNU_SOURCE
+#include "debugfl.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+
+#include "rtsched.h"
+
+struct rt_conf {
+	int set;		//-命令行里配置过
+	int has_cpus;
+	cpu_set_t cpus;
+	int policy;
+	int prio;
+	int warned;		//-同一类线程的权限警告只打一次
+};
+
+static struct rt_conf rt_conf[RT_ROLE_MAX];
+static int rt_mlock = 0;
+static int rt_locked = 0;
+
+static const char *rt_role_name[RT_ROLE_MAX] = { "serial", "pcap", "worker", "modbus" };
+
+//-解析 "0,2-3" 这样的CPU列表
+static int parse_cpus(const char *s, cpu_set_t *set)
+{
+	char *ep;
+	long a, b;
+
+	CPU_ZERO(set);
+	while (*s) {
+		a = strtol(s, &ep, 10);
+		if (ep == s || a < 0 || a >= CPU_SETSIZE)
+			return -1;
+		b = a;
+		s = ep;
+		if (*s == '-') {
+			b = strtol(s + 1, &ep, 10);
+			if (ep == s + 1 || b < a || b >= CPU_SETSIZE)
+				return -1;
+			s = ep;
+		}
+		for (; a <= b; a++)
+			CPU_SET(a, set);
+		if (*s == ',')
+			s++;
+		else if (*s)
+			return -1;
+	}
+	return 0;
+}
+
+int rt_parse(const char *spec)
+{
+	char buf[128], *field[4], *p;
+	struct rt_conf c;
+	int i, n = 0, role = -1;
+
+	if (strlen(spec) >= sizeof(buf))
+		return -1;
+	strcpy(buf, spec);
+	//-strtok会把空字段吞掉,"pcap::fifo:40"这样不指定CPU的写法要自己切
+	p = buf;
+	while (n < 4) {
+		field[n++] = p;
+		p = strchr(p, ':');
+		if (p == NULL)
+			break;
+		*p++ = '\0';
+	}
+
+	for (i = 0; i < RT_ROLE_MAX; i++) {
+		if (strcmp(field[0], rt_role_name[i]) == 0)
+			role = i;
+	}
+	if (role < 0) {
+		fprintf(stderr, "rtsched: unknown thread role \"%s\"\n", field[0]);
+		return -1;
+	}
+
+	memset(&c, 0, sizeof(c));
+	c.set = 1;
+	c.policy = SCHED_OTHER;
+	if (n > 1 && field[1][0] != '\0') {
+		if (parse_cpus(field[1], &c.cpus) != 0) {
+			fprintf(stderr, "rtsched: bad cpu list \"%s\"\n", field[1]);
+			return -1;
+		}
+		c.has_cpus = 1;
+	}
+	if (n > 2 && field[2][0] != '\0') {
+		if (strcmp(field[2], "fifo") == 0)
+			c.policy = SCHED_FIFO;
+		else if (strcmp(field[2], "rr") == 0)
+			c.policy = SCHED_RR;
+		else if (strcmp(field[2], "other") == 0)
+			c.policy = SCHED_OTHER;
+		else {
+			fprintf(stderr, "rtsched: bad policy \"%s\"\n", field[2]);
+			return -1;
+		}
+	}
+	if (c.policy != SCHED_OTHER) {
+		c.prio = n > 3 ? atoi(field[3]) : 1;
+		if (c.prio < sched_get_priority_min(c.policy))
+			c.prio = sched_get_priority_min(c.policy);
+		if (c.prio > sched_get_priority_max(c.policy))
+			c.prio = sched_get_priority_max(c.policy);
+	}
+	rt_conf[role] = c;
+	return 0;
+}
+
+void rt_set_mlock(int on)
+{
+	rt_mlock = on;
+}
+
+int rt_apply(enum rt_role role)
+{
+	struct rt_conf *c;
+	struct sched_param sp;
+	int err, ret = 0;
+
+	if (rt_mlock && !rt_locked) {
+		//-第一次调用的时候锁,MCL_FUTURE让后面创建的线程栈和分配的内存也常驻
+		if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0)
+			LOG(LOGM_MAIN, LOG_WARN, "rtsched: mlockall: %s, continuing unlocked\n", strerror(errno));
+		rt_locked = 1;
+	}
+
+	if (role < 0 || role >= RT_ROLE_MAX || !rt_conf[role].set)
+		return 0;
+	c = &rt_conf[role];
+
+	if (c->has_cpus) {
+		err = pthread_setaffinity_np(pthread_self(), sizeof(c->cpus), &c->cpus);
+		if (err != 0) {
+			LOG(LOGM_MAIN, LOG_WARN, "rtsched: %s affinity: %s\n", rt_role_name[role], strerror(err));
+			ret = -1;
+		}
+	}
+	if (c->policy != SCHED_OTHER) {
+		memset(&sp, 0, sizeof(sp));
+		sp.sched_priority = c->prio;
+		err = pthread_setschedparam(pthread_self(), c->policy, &sp);
+		if (err == EPERM) {
+			//-没有CAP_SYS_NICE或者RLIMIT_RTPRIO是0,保持普通调度
+			if (!c->warned++)
+				LOG(LOGM_MAIN, LOG_WARN, "rtsched: %s: no permission for %s, staying SCHED_OTHER\n",
+					rt_role_name[role], c->policy == SCHED_FIFO ? "SCHED_FIFO" : "SCHED_RR");
+			ret = -1;
+		} else if (err != 0) {
+			LOG(LOGM_MAIN, LOG_WARN, "rtsched: %s sched: %s\n", rt_role_name[role], strerror(err));
+			ret = -1;
+		}
+	}
+	return ret;
+}
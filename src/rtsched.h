@@ -0,0 +1,19 @@
+//-为了方便调试定义了系列变量以便调试输出
+
+#ifndef RTSCHED_H
+#define RTSCHED_H
+
+//-需要单独设置CPU和调度策略的几类线程
+enum rt_role {
+	RT_SERIAL,	//-主线程,串口和事件循环
+	RT_PCAP,	//-抓包线程(pcap_loop)
+	RT_WORKER,	//-线程池的工作线程
+	RT_MODBUS,	//-Modbus总线的轮询线程
+	RT_ROLE_MAX
+};
+
+int  rt_parse(const char *spec);	//--P role:cpus[:policy[:prio]],例如 serial:0:fifo:50
+void rt_set_mlock(int on);		//--L 锁定内存,避免缺页带来的延迟
+int  rt_apply(enum rt_role role);	//-设置调用这个函数的线程,没有权限时只打印警告继续运行
+
+#endif /* RTSCHED_H */
@@ -0,0 +1,146 @@
+/*
+此文件是抓包的抽样和过载降级,说明见sample.h.
+以前流量一大,解码队列满了就在抓包线程里就地解码,抓包线程慢下来,内核缓冲满了乱丢,
+丢哪些包,丢多少都说不准.现在先按配置少留一些(截短,抽样),丢多少有数,日志里看得到.
+*/
+
+#include "debugfl.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pcap.h>
+
+#include "log.h"
+#include "metrics.h"
+#include "sample.h"
+
+int sample_on = 0;
+static unsigned int sp_n = 1;			//-配置的1/N
+static unsigned int sp_on_ms, sp_period_ms;	//-周期是0表示不按时间
+static unsigned int sp_fill;			//-0表示不自适应
+static unsigned int sp_drops = SAMPLE_DROPS_DEF;
+
+//-当前状态,只有抓包线程用
+static int sp_level, sp_calm;
+static int sp_hold = SAMPLE_CALM;		//-回升前要连续平稳几秒
+static unsigned long sp_ticks, sp_recover_at;	//-秒数,上次回升的时候
+static unsigned int sp_cur_n = 1, sp_count;
+static unsigned int sp_snap;			//-0表示不截
+static unsigned int sp_kdrop;
+static int sp_have_kdrop;
+
+static struct metric *m_out = &metric_sink;
+static struct metric *m_events = &metric_sink;
+static struct metric *m_level = &metric_sink;
+
+int sample_parse(const char *spec)
+{
+	char buf[64], *f[4], *p = buf;
+	int n, bad = 0;
+
+	snprintf(buf, sizeof(buf), "%s", spec);
+	for (n = 0; n < 4 && p; n++) {
+		f[n] = p;
+		if ((p = strchr(p, ':')) != NULL)
+			*p++ = 0;
+	}
+	sp_n = *f[0] ? atoi(f[0]) : 1;
+	if (n > 1 && *f[1])
+		bad |= sscanf(f[1], "%u/%u", &sp_on_ms, &sp_period_ms) != 2 || sp_on_ms == 0 || sp_on_ms >= sp_period_ms;
+	sp_fill = n > 2 && *f[2] ? atoi(f[2]) : 0;
+	sp_drops = n > 3 && *f[3] ? atoi(f[3]) : SAMPLE_DROPS_DEF;
+	if (bad || (int)sp_n < 1 || sp_fill > 100 || (int)sp_drops < 1) {
+		fprintf(stderr, "sample: bad spec \"%s\", N[:on ms/period ms[:queue %%[:kernel drops/s]]]\n", spec);
+		sp_period_ms = 0;
+		return -1;
+	}
+	sp_cur_n = sp_n;
+	sample_on = sp_n > 1 || sp_period_ms || sp_fill;
+	return 0;
+}
+
+static void sample_level(int level)
+{
+	sp_level = level;
+	sp_snap = level >= 1 ? SAMPLE_HDR_SNAP : 0;
+	sp_cur_n = level >= 2 ? sp_n << 2 * (level - 1) : sp_n;
+	sp_count = 0;
+	metric_set(m_level, level);
+}
+
+void sample_open(void)
+{
+	if (!sample_on)
+		return;
+	if (m_out == &metric_sink) {
+		m_out = metric_counter("pcap_sampled_out_total", "packets skipped by sampling");
+		m_events = metric_counter("pcap_degrade_events_total", "times overload raised the sampling level");
+		m_level = metric_gauge("pcap_sample_level", "0 normal, 1 headers only, 2.. sparser sampling");
+	}
+	sp_have_kdrop = 0;
+	sp_calm = 0;
+	sp_hold = SAMPLE_CALM;
+	sp_recover_at = 0;
+	sample_level(0);
+	LOG(LOGM_PCAP, LOG_INFO, "sample: 1 in %u, %u/%u ms, adaptive at queue %u%% or %u drops/s",
+	    sp_n, sp_on_ms, sp_period_ms, sp_fill, sp_drops);
+}
+
+int sample_take(struct pcap_pkthdr *h)
+{
+	if (sp_period_ms && ((uint64_t)h->ts.tv_sec * 1000 + h->ts.tv_usec / 1000) % sp_period_ms >= sp_on_ms)
+		goto out;
+	if (sp_cur_n > 1 && ++sp_count < sp_cur_n)
+		goto out;
+	sp_count = 0;
+	if (sp_snap && h->caplen > sp_snap)
+		h->caplen = sp_snap;
+	return 1;
+out:
+	metric_inc(m_out);
+	return 0;
+}
+
+void sample_tick(unsigned int kdrop, int fill, unsigned int ms)
+{
+	unsigned int d = sp_have_kdrop && ms ? (unsigned long long)(kdrop - sp_kdrop) * 1000 / ms : 0;	//-每秒丢多少
+
+	sp_kdrop = kdrop;
+	sp_have_kdrop = 1;
+	if (!sp_fill)
+		return;
+	sp_ticks++;
+	if ((unsigned int)fill >= sp_fill || d >= sp_drops) {
+		sp_calm = 0;
+		if (sp_level >= SAMPLE_LEVELS)
+			return;
+		if (sp_recover_at && sp_ticks - sp_recover_at <= (unsigned long)sp_hold && sp_hold < SAMPLE_HOLD_MAX)
+			sp_hold = sp_hold * 2 < SAMPLE_HOLD_MAX ? sp_hold * 2 : SAMPLE_HOLD_MAX;
+		sample_level(sp_level + 1);
+		metric_inc(m_events);
+		LOG(LOGM_PCAP, LOG_WARN, "sample: overload (queue %d%%, kernel dropped %u/s), level %d: snaplen %u, 1 in %u, hold %d s",
+		    fill, d, sp_level, sp_snap, sp_cur_n, sp_hold);
+	} else if (sp_level > 0 && (unsigned int)fill < sp_fill / 2 && d == 0) {
+		if (++sp_calm < sp_hold)
+			return;
+		sp_calm = 0;
+		sp_recover_at = sp_ticks;
+		sample_level(sp_level - 1);
+		LOG(LOGM_PCAP, LOG_INFO, "sample: load down (queue %d%%), level %d: snaplen %u, 1 in %u",
+		    fill, sp_level, sp_snap, sp_cur_n);
+	} else if (sp_level == 0 && ++sp_calm >= SAMPLE_HOLD_MAX) {
+		sp_hold = SAMPLE_CALM;		//-好久没有过载了
+		sp_calm = 0;
+	} else if (sp_level > 0) {
+		sp_calm = 0;
+	}
+}
+
+void sample_stats(void)
+{
+	if (!sample_on)
+		return;
+	LOG(LOGM_PCAP, LOG_INFO, "sample: level %d, %llu skipped, %llu overload events", sp_level,
+	    (unsigned long long)metric_value(m_out), (unsigned long long)metric_value(m_events));
+}
@@ -0,0 +1,36 @@
+//-为了方便调试定义了系列变量以便调试输出
+
+#ifndef SAMPLE_H
+#define SAMPLE_H
+
+#include <stdint.h>
+
+/*
+抓包抽样和过载降级,-s N[:开ms/周期ms[:队列%[:丢包/s]]]:
+	N		每N个报文留1个(按个数,确定的,不随机)
+	开/周期		按时间:每个周期只留开头这么多毫秒的报文,比如100/1000
+	队列%		打开自适应:解码队列(线程池和日志,-W时是段的块缓冲)超过这么满就降一级
+	丢包/s		内核每秒丢包超过这么多也降一级,默认100
+降级:第1级只留报文头(SAMPLE_HDR_SNAP),再往上每级抽样再稀4倍,最多SAMPLE_LEVELS级;
+每秒最多降一级,连续SAMPLE_CALM秒队列不到一半,内核不丢包才回升一级;
+回升以后这么短时间里又过载,说明负载就在边上,要等的时间加倍(最多SAMPLE_HOLD_MAX秒),免得来回跳.
+每次升降写一条日志,pcap_sample_level是当前级别.
+都在抓包线程里,不加锁.
+*/
+#define SAMPLE_HDR_SNAP		96
+#define SAMPLE_LEVELS		4
+#define SAMPLE_CALM		5
+#define SAMPLE_HOLD_MAX		60
+#define SAMPLE_DROPS_DEF	100
+
+struct pcap_pkthdr;
+
+extern int sample_on;
+
+int  sample_parse(const char *spec);
+void sample_open(void);
+int  sample_take(struct pcap_pkthdr *h);	//-留下返回1,caplen可能被截短;丢掉返回0
+void sample_tick(unsigned int kdrop, int fill, unsigned int ms);	//-约每秒一次(定时):内核累计丢包数,队列满了百分之几,距上次过了多少毫秒
+void sample_stats(void);
+
+#endif /* SAMPLE_H */
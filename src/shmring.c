@@ -0,0 +1,201 @@
+/*
+此文件是串口帧的共享内存发布.
+别的进程要看串口上的帧,以前只能和本进程抢着读tty,或者从日志里找.
+现在get_complete_frame拼好的每一帧都写到共享内存的环形队列里(/dev/shm下,-R改名字),
+读的进程mmap只读映射,自己按序号往后读,不和串口路径抢锁,也不经过socket再复制一次.
+读的太慢只会丢它自己的帧,写的人不知道也不等.
+热重启时新进程接着用同一块共享内存和同一个序号,读的进程感觉不到.
+*/
+
+#include "debugfl.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include "shmring.h"
+
+static size_t shmring_size(unsigned int nslots)
+{
+	return sizeof(struct shmring_hdr) + (size_t)nslots * sizeof(struct shmring_slot);
+}
+
+static int shmring_map(struct shmring *r, const char *name, int writable)
+{
+	struct stat st;
+	int fd;
+
+	fd = shm_open(name, writable ? O_RDWR | O_CREAT : O_RDONLY, 0644);
+	if (fd < 0)
+		return -1;
+	if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(struct shmring_hdr)) {
+		if (!writable) {
+			close(fd);
+			errno = EINVAL;
+			return -1;
+		}
+		st.st_size = 0;
+	}
+	r->size = st.st_size;
+	r->h = NULL;
+	if (r->size > 0) {
+		r->h = mmap(NULL, r->size, writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+		if (r->h == MAP_FAILED)
+			r->h = NULL;
+	}
+	return fd;
+}
+
+static int shmring_valid(const struct shmring *r)
+{
+	const struct shmring_hdr *h = r->h;
+
+	return h != NULL && h->magic == SHMRING_MAGIC && h->slot_size == sizeof(struct shmring_slot)
+		&& h->nslots > 0 && (h->nslots & (h->nslots - 1)) == 0 && r->size >= shmring_size(h->nslots);
+}
+
+//-已经有一样大小的(热重启或者上次没删),接着它的序号写;否则重新建
+int shmring_create(struct shmring *r, const char *name, unsigned int nslots)
+{
+	int fd;
+
+	memset(r, 0, sizeof(*r));
+	if (nslots == 0 || (nslots & (nslots - 1)) != 0)
+		nslots = SHMRING_SLOTS;
+	fd = shmring_map(r, name, 1);
+	if (fd < 0) {
+		LOG(LOGM_UART, LOG_WARN, "shmring %s: %s", name, strerror(errno));
+		return -1;
+	}
+	if (!shmring_valid(r) || r->h->nslots != nslots) {
+		if (r->h != NULL)
+			munmap(r->h, r->size);
+		r->size = shmring_size(nslots);
+		r->h = NULL;
+		if (ftruncate(fd, 0) == 0 && ftruncate(fd, r->size) == 0)	//-先截成0,旧内容全部清掉
+			r->h = mmap(NULL, r->size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		if (r->h == NULL || r->h == MAP_FAILED) {
+			LOG(LOGM_UART, LOG_WARN, "shmring %s: %s", name, strerror(errno));
+			r->h = NULL;
+			close(fd);
+			shm_unlink(name);
+			return -1;
+		}
+		r->h->nslots = nslots;
+		r->h->slot_size = sizeof(struct shmring_slot);
+		__atomic_store_n(&r->h->magic, SHMRING_MAGIC, __ATOMIC_RELEASE);
+	}
+	close(fd);
+	r->mask = r->h->nslots - 1;
+	r->next = __atomic_load_n(&r->h->head, __ATOMIC_RELAXED) + 1;
+	__atomic_store_n(&r->h->writer, (uint32_t)getpid(), __ATOMIC_RELEASE);
+	LOG(LOGM_UART, LOG_INFO, "shmring %s: %u slots, next seq %llu", name, r->h->nslots, (unsigned long long)r->next);
+	return 0;
+}
+
+//-串口路径上每帧调用一次,只有内存写,没有系统调用
+void shmring_publish(struct shmring *r, uint64_t ts_ns, const void *data, uint32_t len)
+{
+	struct shmring_slot *s;
+
+	if (r->h == NULL)
+		return;
+	s = &r->h->slot[r->next & r->mask];
+	__atomic_store_n(&s->seq, 0, __ATOMIC_RELAXED);	//-读的人看到0或者序号变了就知道复制的东西不可信
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	s->ts_ns = ts_ns;
+	s->len = len;
+	memcpy(s->data, data, len < SHMRING_DATA ? len : SHMRING_DATA);
+	__atomic_store_n(&s->seq, r->next, __ATOMIC_RELEASE);
+	__atomic_store_n(&r->h->head, r->next, __ATOMIC_RELEASE);
+	r->next++;
+}
+
+void shmring_close(struct shmring *r, const char *name, int keep)
+{
+	if (r->h == NULL)
+		return;
+	if (!keep) {
+		__atomic_store_n(&r->h->writer, 0, __ATOMIC_RELEASE);	//-已经映射了的读者看到这个就知道没有新的帧了
+		shm_unlink(name);
+	}
+	munmap(r->h, r->size);
+	r->h = NULL;
+}
+
+//-------------------------------- 读 --------------------------------
+int shmring_attach(struct shmring *r, const char *name, int from_oldest)
+{
+	uint64_t head;
+	int fd;
+
+	memset(r, 0, sizeof(*r));
+	fd = shmring_map(r, name, 0);
+	if (fd < 0)
+		return -1;
+	close(fd);
+	if (!shmring_valid(r)) {
+		if (r->h != NULL)
+			munmap(r->h, r->size);
+		r->h = NULL;
+		errno = EINVAL;
+		return -1;
+	}
+	r->mask = r->h->nslots - 1;
+	head = __atomic_load_n(&r->h->head, __ATOMIC_ACQUIRE);
+	if (!from_oldest)
+		r->next = head + 1;
+	else
+		r->next = head >= r->h->nslots ? head - r->h->nslots + 1 : 1;
+	return 0;
+}
+
+int shmring_read(struct shmring *r, struct shmring_frame *f)
+{
+	const struct shmring_slot *s;
+	uint64_t head, seq;
+	unsigned long lost = 0;
+	uint32_t n;
+
+	for (;;) {
+		head = __atomic_load_n(&r->h->head, __ATOMIC_ACQUIRE);
+		if (r->next > head)
+			return __atomic_load_n(&r->h->writer, __ATOMIC_RELAXED) != 0 ? 0 : -1;
+		if (head - r->next >= r->h->nslots) {	//-落后超过一圈,跳到还在的最老的一帧
+			lost += head - r->h->nslots + 1 - r->next;
+			r->lost += head - r->h->nslots + 1 - r->next;
+			r->next = head - r->h->nslots + 1;
+		}
+		s = &r->h->slot[r->next & r->mask];
+		seq = __atomic_load_n(&s->seq, __ATOMIC_ACQUIRE);
+		if (seq == r->next) {
+			f->ts_ns = s->ts_ns;
+			f->len = s->len;
+			n = f->len < SHMRING_DATA ? f->len : SHMRING_DATA;
+			memcpy(f->data, s->data, n);
+			__atomic_thread_fence(__ATOMIC_ACQUIRE);
+			if (__atomic_load_n(&s->seq, __ATOMIC_RELAXED) == r->next) {
+				f->data[n] = 0;
+				f->seq = r->next++;
+				f->lost = lost;
+				return 1;
+			}
+		}
+		lost++;		//-复制的时候被新的一帧覆盖了
+		r->lost++;
+		r->next++;
+	}
+}
+
+void shmring_detach(struct shmring *r)
+{
+	if (r->h != NULL)
+		munmap(r->h, r->size);
+	r->h = NULL;
+}
@@ -0,0 +1,61 @@
+//-为了方便调试定义了系列变量以便调试输出
+
+#ifndef SHMRING_H
+#define SHMRING_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+POSIX共享内存里的环形队列,一个写的(dreamflower_app),任意多个读的(别的进程).
+写的人不加锁也不等读的人:每个槽有自己的序号,写之前清0,写完再填上;
+读的人复制完再看一次序号,变了说明复制的时候被覆盖了(读得太慢),算丢了.
+读的人落后超过一圈时跳到最老的还在的一帧,丢了多少记在lost里.
+没有通知机制,读的人自己轮询head,写的人一次publish只是几次内存写.
+*/
+#define SHMRING_MAGIC	0x44465231	//-"DFR1",结构变了要改
+#define SHMRING_SLOTS	1024		//-必须是2的幂
+#define SHMRING_DATA	256		//-一帧最多存这么多,更长的帧只存前面,len是实际长度
+
+struct shmring_slot {
+	uint64_t seq;			//-0:正在写;否则是这个槽里那一帧的序号
+	uint64_t ts_ns;			//-CLOCK_MONOTONIC,串口read返回的时间
+	uint32_t len;			//-帧的实际长度,超过SHMRING_DATA的只存了前面
+	uint32_t pad;
+	char data[SHMRING_DATA];
+} __attribute__((aligned(64)));
+
+struct shmring_hdr {
+	uint32_t magic;
+	uint32_t nslots;
+	uint32_t slot_size;		//-sizeof(struct shmring_slot),读的人用来检查版本
+	uint32_t writer;		//-写的进程的pid,0表示已经退出
+	uint64_t head __attribute__((aligned(64)));	//-最后写完的一帧的序号,从1开始
+	struct shmring_slot slot[];
+};
+
+struct shmring {
+	struct shmring_hdr *h;
+	size_t size;
+	uint64_t mask;
+	uint64_t next;			//-写:下一帧的序号;读:下一个要读的序号
+	unsigned long lost;		//-读:一共丢了多少帧
+};
+
+struct shmring_frame {
+	uint64_t seq;
+	uint64_t ts_ns;
+	uint32_t len;
+	unsigned long lost;		//-这一帧之前丢了多少帧
+	char data[SHMRING_DATA + 1];	//-后面补了0
+};
+
+int  shmring_create(struct shmring *r, const char *name, unsigned int nslots);
+void shmring_publish(struct shmring *r, uint64_t ts_ns, const void *data, uint32_t len);
+void shmring_close(struct shmring *r, const char *name, int keep);	//-keep:热重启交接出去了,不删也不标记退出
+
+int  shmring_attach(struct shmring *r, const char *name, int from_oldest);
+int  shmring_read(struct shmring *r, struct shmring_frame *f);	//-1:读到一帧;0:没有新的;-1:写的进程已经退出
+void shmring_detach(struct shmring *r);
+
+#endif /* SHMRING_H */
@@ -8,38 +8,220 @@ libpcap
 #include <time.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <signal.h>
 
+#include <pthread.h>
 
+#include "thread.h"
+#include "rtsched.h"
+#include "bench.h"
+#include "tcpdump.h"
+#include "trace.h"
+#include "log.h"
+#include "metrics.h"
+#include "capseg.h"
+#include "sample.h"
+#include "neigh.h"
+#include "dns.h"
 
 
-//-һpcap_loopһյ㹻İpcap_loopcallbackصͬʱpcap_loop()userݸ
-//-ڶյݰpcap_pkthdr͵ָ
-//-յݰ
-void getPacket(u_char * arg, const struct pcap_pkthdr * pkthdr, const u_char * packet)
+
+extern volatile sig_atomic_t _running;
+
+static struct metric * m_pcap_rx = &metric_sink;
+static struct metric * m_pcap_done = &metric_sink;
+static struct metric * m_pcap_nomem = &metric_sink;
+static struct metric * m_pcap_kdrop = &metric_sink;
+static struct metric * m_pcap_ifdrop = &metric_sink;
+
+#define SNIFFER_READ_MS 200	//-pcapʱ:·ʱҲҪʱÿ
+
+struct sniffer_ctx {
+  pcap_t * device;
+  int id;
+  long pkt_sec;		//-ϴϻھӱ,DNSʱ(ʱ)
+  uint64_t tick_ms;	//-ϴȡںͳƵʱ(CLOCK_MONOTONIC)
+  unsigned int kdrop;	//-ϴȡںۼƶ
+  int linktype;
+  int ifidx;		//-ھӱ
+};
+
+//-̳߳ؽһ,ݽڽṹ.pcapصغpacketʧЧ,븴
+struct pkt_job {
+  int id;
+  struct pcap_pkthdr hdr;
+  u_char data[0];
+};
+
+//-һİԭĸʽ(ͷϢ+ÿ16ֽڵʮ)дout,س.
+//-outҪSNIFFER_FMT_SIZE(caplen)ֽ
+int sniffer_format(char * out, int id, const struct pcap_pkthdr * hdr, const u_char * data)
 {
-  int * id = (int *)arg;
-  
-  printf("id: %d\n", ++(*id));
-  printf("Packet length: %d\n", pkthdr->len);
-  printf("Number of bytes: %d\n", pkthdr->caplen);
-  printf("Recieved time: %s", ctime((const time_t *)&pkthdr->ts.tv_sec)); 
-  
+  char * p = out;
+  char tbuf[32];
   int i;
-  for(i=0; i<pkthdr->len; ++i)
+
+  p += sprintf(p, "id: %d\n", id);
+  p += sprintf(p, "Packet length: %d\n", hdr->len);
+  p += sprintf(p, "Number of bytes: %d\n", hdr->caplen);
+  p += sprintf(p, "Recieved time: %s", ctime_r((const time_t *)&hdr->ts.tv_sec, tbuf));	//-ctime
+  for(i=0; i<hdr->caplen; ++i)	//-ֻcaplenֽץ,len·ϵĳ
   {
-    printf(" %02x", packet[i]);
+    p += sprintf(p, " %02x", data[i]);
     if( (i + 1) % 16 == 0 )
     {
-      printf("\n");
+      *p++ = '\n';
     }
   }
-  
-  printf("\n\n");
+  *p++ = '\n';
+  *p++ = '\n';
+  return p - out;
+}
+
+//-ͷһ־,ݰLOG_HEX_MAXֳɼʮ;ʽ־̻߳
+static void decodePacket(void * arg)
+{
+  struct pkt_job * job = (struct pkt_job *)arg;
+  int off, n;
+
+  TRACE_BEGIN("decode");
+  LOG(LOGM_PCAP, LOG_INFO, "id: %d len: %u caplen: %u time: %ld.%06ld",
+      job->id, job->hdr.len, job->hdr.caplen, (long)job->hdr.ts.tv_sec, (long)job->hdr.ts.tv_usec);
+  for(off=0; off<job->hdr.caplen; off+=n)	//-ֻcaplenֽץ,len·ϵĳ
+  {
+    n = job->hdr.caplen - off;
+    if(n > LOG_HEX_MAX)
+      n = LOG_HEX_MAX;
+    LOG_HEX(LOGM_PCAP, LOG_INFO, job->data + off, n, "id: %d +%04x:", job->id, off);
+  }
+  free(job);
+  metric_inc(m_pcap_done);
+  TRACE_END("decode");
 }
 
+//-ϵĳ̶(ٷֱ):-WʱεĿ黺,̳߳غ־Ǹ
+static int sniffer_fill(void)
+{
+  int pool, log;
+
+  if(capseg_snap)
+    return capseg_fill();
+  pool = tp_capacity() > 0 ? tp_pending() * 100 / tp_capacity() : 0;
+  log = log_queue_fill();
+  return pool > log ? pool : log;
+}
+
+//-һpcap_loopһյ㹻İpcap_loopcallbackصͬʱpcap_loop()userݸ
+//-ڶյݰpcap_pkthdr͵ָ
+//-յݰ
+void getPacket(u_char * arg, const struct pcap_pkthdr * pkthdr, const u_char * packet)
+{
+  struct sniffer_ctx * ctx = (struct sniffer_ctx *)arg;
+  struct pcap_pkthdr hdr = *pkthdr;	//-ʱcaplenĶ
+  struct pkt_job * job;
+
+  if(!_running)
+  {
+    pcap_breakloop(ctx->device);
+    return;
+  }
+
+  TRACE_BEGIN("pcap_cb");
+  metric_inc(m_pcap_rx);
+  if(pkthdr->ts.tv_sec != ctx->pkt_sec)
+  {//-ھӱDNSʱ䶼Ǳʱ
+    ctx->pkt_sec = pkthdr->ts.tv_sec;
+    neigh_tick(pkthdr->ts.tv_sec);
+    dns_tick(pkthdr->ts.tv_sec);
+  }
+  //-ARPھӷȽھӱ,ڳǰ,һҲ©;ֻǶ࿴һ,
+  //-ıͱһ߳,дļ,dfcap -FҲõ
+  neigh_packet(ctx->ifidx, ctx->linktype, pkthdr, packet);
+  //-DNSѯͻظʱ,Ҳڳǰ,һ䲻;
+  //-ı,ĺͲQUERYDNSҲڶļ
+  dns_packet(ctx->linktype, pkthdr, packet);
+  if(sample_on && !sample_take(&hdr))
+  {
+    TRACE_END("pcap_cb");
+    return;
+  }
+  if(capseg_snap)
+  {//--W:ͷܳɿѹдļ,һһд־
+    capseg_add(&hdr, packet);
+    metric_inc(m_pcap_done);
+    TRACE_END("pcap_cb");
+    return;
+  }
+  job = malloc(sizeof(*job) + hdr.caplen);
+  if(job == NULL)
+  {
+    metric_inc(m_pcap_nomem);
+    TRACE_END("pcap_cb");
+    return;
+  }
+  job->id = ++ctx->id;
+  job->hdr = hdr;
+  memcpy(job->data, packet, hdr.caplen);
+
+  //-ץֻ߳,ŵ̳߳;̳߳زʱ͵ؽ
+  if(tp_submit(decodePacket, job) != 0)
+    decodePacket(job);
+  TRACE_END("pcap_cb");
+}
+
+static struct sniffer_ctx sniffer;
+static pthread_t sniffer_tid;
+
+static uint64_t sniffer_now_ms(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+//-ÿһ,ʱ,·ûбҲ(pcap_dispatchʱ᷵):ȡںͳ,ؽ.
+//-ں˶ֻץ߳ȡ(pcap_statsץܲ)
+static void sniffer_tick(struct sniffer_ctx * ctx)
+{
+  struct pcap_stat ps;
+  uint64_t now = sniffer_now_ms();
+  unsigned int ms = now - ctx->tick_ms;
+
+  if(ms < 1000)
+    return;
+  ctx->tick_ms = now;
+  if(pcap_stats(ctx->device, &ps) == 0)
+  {
+    metric_set(m_pcap_kdrop, ps.ps_drop);
+    metric_set(m_pcap_ifdrop, ps.ps_ifdrop);
+    ctx->kdrop = ps.ps_drop;
+  }
+  if(sample_on)
+    sample_tick(ctx->kdrop, sniffer_fill(), ms);	//-ؾͽ,ٻָ
+}
+
+static void * sniffer_thread(void * arg)
+{
+  struct sniffer_ctx * ctx = (struct sniffer_ctx *)arg;
+
+  rt_apply(RT_PCAP);
+  trace_thread_name("pcap");
+  ctx->tick_ms = sniffer_now_ms();
+  //-pcap_loop:ÿһ(߶ʱ)һ,ðʱÿ
+  while(_running && pcap_dispatch(ctx->device, -1, getPacket, (u_char*)ctx) >= 0)
+    sniffer_tick(ctx);
+  return NULL;
+}
+
+//-Դӿٴε,Ѿץʲô;ʧܷ-1,˳
 int sniffer_sub(int argc,char* argv[])
 {
   char errBuf[PCAP_ERRBUF_SIZE], * devStr;
+
+  if(sniffer.device != NULL)
+    return 0;
   
   /* get a device */
   devStr = pcap_lookupdev(errBuf);	//-صһʵӿڵַָ
@@ -51,11 +233,11 @@ int sniffer_sub(int argc,char* argv[])
   else
   {
     printf("error: %s\n", errBuf);
-    exit(1);
+    return -1;
   }
   
   /* open a device, wait until a packet arrives */
-  pcap_t * device = pcap_open_live(devStr, 65535, 1, 0, errBuf);	//-ָӿڵpcap_tָ룬вҪʹָ
+  pcap_t * device = pcap_open_live(devStr, capseg_snap ? capseg_snap : 65535, 1, SNIFFER_READ_MS, errBuf);	//-ʱ0,ûаʱpcap_dispatchҪÿ,˳ʱҲҪص	//-ָӿڵpcap_tָ룬вҪʹָ
   //-һǵһȡӿֱַʹӲ롣
   //-ڶǶÿݰӿͷҪץٸֽڣǿֵֻץÿݰͷľݡ͵̫֡1518ֽڣĳЩЭݰһ㣬κһЭһݰȶȻС65535ֽڡ
   //-ָǷ򿪻ģʽ(Promiscuous Mode)0ʾǻģʽκֵʾģʽҪ򿪻ģʽôҲҪ򿪻ģʽʹµeth0ģʽ
@@ -66,24 +248,102 @@ int sniffer_sub(int argc,char* argv[])
   if(!device)
   {
     printf("error: pcap_open_live(): %s\n", errBuf);
-    exit(1);
+    return -1;
   }
   
   /* construct a filter */
   struct bpf_program filter;	//-һ˱ʽ
-  pcap_compile(device, &filter, "dst port 80", 1, 0);	//-ʽ
+  pcap_compile(device, &filter, "dst port 80 or arp or (icmp6 and (ip6[40] == 135 or ip6[40] == 136)) or udp port 53", 1, 0);	//-ʽ;ARPھ/ͨھӱ(ICMPv6Ҫ),UDP 53DNS
   pcap_setfilter(device, &filter);	//-Ӧ
   
   //-Ӧ˱ʽ֮Ǳʹpcap_loop()pcap_next()ץץˡ
-  /* wait loop forever */
-  int id = 0;
-  pcap_loop(device, -1, getPacket, (u_char*)&id);
-  
-  pcap_close(device);	//-رpcap_open_live()ȡpcap_tӿڶͷԴ
+  //-pcap_loopŵץ߳,̻߳ȥܴڵ¼ѭ
+  if(capseg_open(pcap_datalink(device)) != 0)
+  {
+    printf("error: capture segments\n");
+    pcap_close(device);
+    return -1;
+  }
+  sniffer.device = device;
+  sniffer.id = 0;
+  sniffer.kdrop = 0;
+  sniffer.linktype = pcap_datalink(device);
+  sniffer.ifidx = neigh_open(devStr);
+  dns_open();
+  if(m_pcap_rx == &metric_sink)	//-ͣٿҪظǼ
+  {
+    m_pcap_rx = metric_counter("pcap_received_total", "packets delivered by libpcap");
+    m_pcap_done = metric_counter("pcap_processed_total", "packets decoded");
+    m_pcap_nomem = metric_counter("pcap_dropped_nomem_total", "packets dropped because no memory for a copy");
+    m_pcap_kdrop = metric_gauge("pcap_kernel_dropped", "ps_drop from pcap_stats, updated at most once a second");
+    m_pcap_ifdrop = metric_gauge("pcap_if_dropped", "ps_ifdrop from pcap_stats");
+  }
+  sample_open();
+  int err = pthread_create(&sniffer_tid, NULL, sniffer_thread, &sniffer);
+  if(err != 0)
+  {
+    printf("pthread_create error:%s\n", strerror(err));
+    capseg_close();
+    pcap_close(device);
+    sniffer.device = NULL;
+    return -1;
+  }
 
   return 0;
 }
 
+//-˳ʱ:pcap_dispatch,ץ߳̽
+void sniffer_stop(void)
+{
+  if(sniffer.device == NULL)
+    return;
+  pcap_breakloop(sniffer.device);
+  pthread_join(sniffer_tid, NULL);
+  capseg_close();	//-ץ߳ͣ,ʣµĿд
+  pcap_close(sniffer.device);	//-رpcap_open_live()ȡpcap_tӿڶͷԴ
+  sniffer.device = NULL;
+}
+
+//-SIGUSR1ͳ:ںյ/ĺѾ.
+//-߳,ץ̻߳,ٵpcap_stats(ں˵ļ),ץ߳ÿȡֵ
+void sniffer_stats(void)
+{
+  if(sniffer.device == NULL)
+    return;
+  LOG(LOGM_PCAP, LOG_INFO, "pcap: %d captured, recv %llu drop %llu ifdrop %llu",
+      sniffer.id, (unsigned long long)metric_value(m_pcap_rx),
+      (unsigned long long)metric_value(m_pcap_kdrop), (unsigned long long)metric_value(m_pcap_ifdrop));
+  capseg_stats();
+  sample_stats();
+  neigh_stats();
+  dns_stats();
+}
+
+
+//-׼(dreamflower_app -D -T):һ̫֡ǰָʽĿ,log_captureԱ
+static void bench_hexdump(long iters, void * arg)
+{
+  static u_char pkt[1514];
+  static char out[SNIFFER_FMT_SIZE(1514)];
+  struct pcap_pkthdr hdr;
+  long i;
+
+  memset(&hdr, 0, sizeof(hdr));
+  hdr.caplen = hdr.len = sizeof(pkt);
+  for(i=0; i<sizeof(pkt); i++)
+    pkt[i] = i * 7;
+  for(i=0; i<iters; i++)
+  {
+    sniffer_format(out, i, &hdr, pkt);
+    bench_keep(out[0]);
+  }
+}
+
+void sniffer_Bench(void)
+{
+  bench_add("hexdump_1514", bench_hexdump, NULL);
+}
+
 
 //-
 /*
@@ -4,5 +4,13 @@
 #define TCPDUMP_H
 
 int sniffer_sub(int argc,char* argv[]);
+void sniffer_stop(void);
+void sniffer_stats(void);
+
+//-sniffer_format输出需要的缓冲区大小
+#define SNIFFER_FMT_SIZE(caplen)	(160 + (caplen) * 3 + (caplen) / 16 + 4)
+struct pcap_pkthdr;
+int  sniffer_format(char * out, int id, const struct pcap_pkthdr * hdr, const unsigned char * data);
+void sniffer_Bench(void);
 
 #endif /* TCPDUMP_H */
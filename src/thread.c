@@ -22,75 +22,481 @@ pthread库不是linux默认的库，所以在编译时候需要指明libpthread.
 #include <pthread.h>
 #include <unistd.h>
 #include <string.h>
+#include <signal.h>
+#include <sched.h>
+#include <time.h>
+#include <stdatomic.h>
+
+#include "thread.h"
+#include "rtsched.h"
+#include "trace.h"
+#include "metrics.h"
  
 
 
-static int num=0;	//-前面的static表示仅仅这个文件中使用这个变量
-pthread_mutex_t mylock=PTHREAD_MUTEX_INITIALIZER;
+/*
+-X 锁竞争测试:原来两个线程在mylock里面加减并且每次都printf,测到的其实是printf的速度.
+现在多个线程各自对计数器做iters次加1,比较四种做法:
+mutex   pthread互斥锁
+spin    pthread自旋锁
+atomic  C11 atomic_fetch_add
+shard   每个线程一个独占cache line的计数器,读的时候再求和
+线程数从1开始翻倍直到-j指定的个数,打印每次操作的时间和相对单线程的吞吐倍数,
+串口和抓包的统计计数器用哪种做法就按这个结果来选.
+输入运行命令:dreamflower_app -D -X [-j 线程数] [-n 每线程次数]
+*/
+#define BENCH_MAX_THREADS	64
+#define CACHE_LINE		64
+
+extern int bench_threads;
+extern long bench_iters;
+
+struct padded_counter {
+	long v;
+	char pad[CACHE_LINE - sizeof(long)];
+} __attribute__((aligned(CACHE_LINE)));
+
+static struct {
+	pthread_mutex_t mutex;
+	pthread_spinlock_t spin;
+	long locked __attribute__((aligned(CACHE_LINE)));	//-mutex/spin保护的计数器
+	atomic_long atomic __attribute__((aligned(CACHE_LINE)));
+	struct padded_counter shard[BENCH_MAX_THREADS];
+	pthread_barrier_t start;
+	long iters;
+} bench;
+
+struct bench_arg {
+	int idx;		//-shard方式用来选自己的计数器
+	void (*loop)(struct bench_arg *);
+	struct timespec t0, t1;
+};
+
+static void bench_mutex(struct bench_arg *ba)
+{
+	long i, n = bench.iters;
+
+	for (i = 0; i < n; i++) {
+		pthread_mutex_lock(&bench.mutex);
+		bench.locked++;
+		pthread_mutex_unlock(&bench.mutex);
+	}
+}
+
+static void bench_spin(struct bench_arg *ba)
+{
+	long i, n = bench.iters;
+
+	for (i = 0; i < n; i++) {
+		pthread_spin_lock(&bench.spin);
+		bench.locked++;
+		pthread_spin_unlock(&bench.spin);
+	}
+}
+
+static void bench_atomic(struct bench_arg *ba)
+{
+	long i, n = bench.iters;
+
+	for (i = 0; i < n; i++)
+		atomic_fetch_add_explicit(&bench.atomic, 1, memory_order_relaxed);
+}
+
+static void bench_shard(struct bench_arg *ba)
+{
+	volatile long *c = &bench.shard[ba->idx].v;	//-volatile:每次都真正写内存,和其他做法公平比较
+	long i, n = bench.iters;
+
+	for (i = 0; i < n; i++)
+		*c = *c + 1;
+}
+
+//-每个线程自己记开始和结束时间,单核上主线程被放行时别的线程可能早就跑完了
+static void *bench_thread(void *arg)
+{
+	struct bench_arg *ba = arg;
+
+	pthread_barrier_wait(&bench.start);
+	clock_gettime(CLOCK_MONOTONIC, &ba->t0);
+	ba->loop(ba);
+	clock_gettime(CLOCK_MONOTONIC, &ba->t1);
+	return NULL;
+}
+
+static const struct {
+	const char *name;
+	void (*loop)(struct bench_arg *);
+} bench_methods[] = {
+	{ "mutex",  bench_mutex },
+	{ "spin",   bench_spin },
+	{ "atomic", bench_atomic },
+	{ "shard",  bench_shard },
+};
+#define BENCH_NMETHODS	(sizeof(bench_methods) / sizeof(bench_methods[0]))
 
+static long bench_total(void)
+{
+	long sum;
+	int i;
 
-void *add(void *arg) 
-{//线程执行函数，执行500次加法
-  int i = 0,tmp;
-  for (; i <500; i++)
-  {
-	  pthread_mutex_lock(&mylock);
-    tmp=num+1;
-    num=tmp;
-    printf("add+1,result is:%d\n",num);
-	pthread_mutex_unlock(&mylock);
-  }
-  return ((void *)0);
+	sum = bench.locked + atomic_load(&bench.atomic);
+	for (i = 0; i < BENCH_MAX_THREADS; i++)
+		sum += bench.shard[i].v;
+	return sum;
 }
 
-void *sub(void *arg)//线程执行函数，执行500次减法
+static long long ts_ns(const struct timespec *ts)
+{
+	return (long long)ts->tv_sec * 1000000000LL + ts->tv_nsec;
+}
+
+//-返回从第一个线程开始到最后一个线程结束的纳秒数,失败返回-1
+static long long bench_run(void (*loop)(struct bench_arg *), int nthreads)
+{
+	pthread_t tid[BENCH_MAX_THREADS];
+	struct bench_arg ba[BENCH_MAX_THREADS];
+	long long first = 0, last = 0;
+	int i, err;
+
+	bench.locked = 0;
+	atomic_store(&bench.atomic, 0);
+	memset(bench.shard, 0, sizeof(bench.shard));
+	pthread_barrier_init(&bench.start, NULL, nthreads);
+
+	for (i = 0; i < nthreads; i++) {
+		ba[i].idx = i;
+		ba[i].loop = loop;
+		err = pthread_create(&tid[i], NULL, bench_thread, &ba[i]);
+		if (err != 0) {
+			printf("pthread_create error:%s\n", strerror(err));
+			exit(-1);	//-已经有线程在等barrier,没法正常回收
+		}
+	}
+	for (i = 0; i < nthreads; i++) {
+		pthread_join(tid[i], NULL);
+		if (i == 0 || ts_ns(&ba[i].t0) < first)
+			first = ts_ns(&ba[i].t0);
+		if (i == 0 || ts_ns(&ba[i].t1) > last)
+			last = ts_ns(&ba[i].t1);
+	}
+	pthread_barrier_destroy(&bench.start);
+
+	if (bench_total() != (long)nthreads * bench.iters) {
+		printf("counter mismatch: %ld != %ld\n", bench_total(), (long)nthreads * bench.iters);
+		return -1;
+	}
+	return last - first;
+}
+
+int thread_sub(int argc, char** argv) //-这个是主线程,再开的就是子线程
 {
-  int i=0,tmp;
-  for(;i<500;i++)
-  {
-	  pthread_mutex_lock(&mylock);	//-线程调用该函数让互斥锁上锁，如果该互斥锁已被另一个线程锁定和拥有，则调用该线程将阻塞，直到该互斥锁变为可用为止。
-    tmp=num-1;
-    num=tmp;
-    printf("sub-1,result is:%d\n",num);
-	pthread_mutex_unlock(&mylock);
-  }
-  return ((void *)0);
+	double base[BENCH_NMETHODS];
+	long long ns;
+	int maxthreads, t, m;
+	double total_ops, mops;
+
+	maxthreads = bench_threads > 0 ? bench_threads : sysconf(_SC_NPROCESSORS_ONLN);
+	if (maxthreads <= 0)
+		maxthreads = 1;
+	if (maxthreads > BENCH_MAX_THREADS)
+		maxthreads = BENCH_MAX_THREADS;
+	bench.iters = bench_iters > 0 ? bench_iters : 1000000L;
+
+	pthread_mutex_init(&bench.mutex, NULL);
+	pthread_spin_init(&bench.spin, PTHREAD_PROCESS_PRIVATE);
+
+	printf("lock contention: %d threads max, %ld increments per thread\n", maxthreads, bench.iters);
+	printf("%7s %-7s %12s %14s %10s %8s\n", "threads", "method", "ns/op", "ns/op/thread", "Mops/s", "scaling");
+
+	for (t = 1; t <= maxthreads; t = (t * 2 > maxthreads && t != maxthreads) ? maxthreads : t * 2) {
+		for (m = 0; m < BENCH_NMETHODS; m++) {
+			ns = bench_run(bench_methods[m].loop, t);
+			if (ns <= 0)
+				return -1;
+			total_ops = (double)t * bench.iters;
+			mops = total_ops * 1000.0 / ns;
+			if (t == 1)
+				base[m] = mops;
+			//-ns/op:墙上时间除以总操作数(吞吐的倒数);ns/op/thread:每个线程看到的单次延迟
+			printf("%7d %-7s %12.2f %14.2f %10.2f %7.2fx\n", t, bench_methods[m].name,
+				ns / total_ops, (double)ns / bench.iters, mops, mops / base[m]);
+		}
+	}
+
+	pthread_spin_destroy(&bench.spin);
+	pthread_mutex_destroy(&bench.mutex);
+	return 0;
 }
 
 /*
-输入运行命令:dreamflower_app -D -X
+2026/10/18
+线程池:固定个数的工作线程,每个线程有一个自己的双端队列.
+本线程从队尾取(后进先出,刚提交的数据还在cache里),空闲的线程从别人的队头偷(先进先出),
+这样忙的线程不会一直堆积任务.其他线程(主循环/抓包回调)提交的任务轮流放到各个队列.
+以后有并发需要的功能都往这里提交任务,不要再各自创建线程.
 */
-int thread_sub(int argc, char** argv) //-这个是主线程,再开的就是子线程
+#define TP_MAX_WORKERS	16
+#define TP_DEQUE_SIZE	256		//-必须是2的幂
+
+extern volatile sig_atomic_t _running;
+
+static struct metric *m_tasks = &metric_sink;
+
+struct tp_task {
+	tp_func_t fn;
+	void *arg;
+};
+
+struct tp_deque {
+	pthread_mutex_t lock;
+	unsigned int head;		//-偷取端
+	unsigned int tail;		//-本线程端
+	struct tp_task task[TP_DEQUE_SIZE];
+};
+
+struct tp_worker {
+	pthread_t tid;
+	int id;
+	struct tp_deque dq;
+};
+
+static struct {
+	struct tp_worker *w;
+	int nworkers;
+	pthread_mutex_t lock;		//-只保护工作线程的睡眠/唤醒,提交任务不拿
+	pthread_cond_t cond;
+	int idle;			//-在睡或者准备睡的工作线程(原子读写,改的时候拿着锁)
+	int pending;			//-已经入队还没有被取走的任务
+	int stop;			//-不再接受提交(原子读写)
+	int submitters;			//-正在tp_submit里的线程,tp_shutdown等它们出来
+	int quit;			//-提交都结束了,工作线程做完剩下的就退出
+	unsigned int rr;		//-外部提交时轮流选择队列
+} pool = { NULL, 0, PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, 0, 0, 0, 0, 0, 0 };
+
+static __thread int tp_self = -1;	//-工作线程自己的编号,其他线程为-1
+
+static int tp_push(struct tp_deque *dq, tp_func_t fn, void *arg)
+{
+	int ret = -1;
+
+	pthread_mutex_lock(&dq->lock);
+	if (dq->tail - dq->head < TP_DEQUE_SIZE) {
+		dq->task[dq->tail & (TP_DEQUE_SIZE - 1)].fn = fn;
+		dq->task[dq->tail & (TP_DEQUE_SIZE - 1)].arg = arg;
+		dq->tail++;
+		ret = 0;
+	}
+	pthread_mutex_unlock(&dq->lock);
+	return ret;
+}
+
+static int tp_pop(struct tp_deque *dq, struct tp_task *t)	//-本线程从队尾取
+{
+	int ret = -1;
+
+	pthread_mutex_lock(&dq->lock);
+	if (dq->tail != dq->head) {
+		dq->tail--;
+		*t = dq->task[dq->tail & (TP_DEQUE_SIZE - 1)];
+		ret = 0;
+	}
+	pthread_mutex_unlock(&dq->lock);
+	return ret;
+}
+
+static int tp_steal(struct tp_deque *dq, struct tp_task *t)	//-别的线程从队头偷
+{
+	int ret = -1;
+
+	if (pthread_mutex_trylock(&dq->lock) != 0)	//-正在被操作就换下一个,不在这里排队
+		return -1;
+	if (dq->tail != dq->head) {
+		*t = dq->task[dq->head & (TP_DEQUE_SIZE - 1)];
+		dq->head++;
+		ret = 0;
+	}
+	pthread_mutex_unlock(&dq->lock);
+	return ret;
+}
+
+static int tp_get(struct tp_worker *self, struct tp_task *t)
+{
+	int i, n = pool.nworkers;
+
+	if (tp_pop(&self->dq, t) == 0)
+		return 0;
+	for (i = 1; i < n; i++) {
+		if (tp_steal(&pool.w[(self->id + i) % n].dq, t) == 0)
+			return 0;
+	}
+	return -1;
+}
+
+static void *tp_worker_main(void *arg)
+{
+	struct tp_worker *self = arg;
+	struct tp_task t;
+
+	tp_self = self->id;
+	rt_apply(RT_WORKER);
+	trace_thread_name("worker");
+	for (;;) {
+		if (tp_get(self, &t) == 0) {
+			__atomic_sub_fetch(&pool.pending, 1, __ATOMIC_RELEASE);
+			t.fn(t.arg);
+			metric_inc(m_tasks);
+			continue;
+		}
+		pthread_mutex_lock(&pool.lock);
+		//-先登记空闲再看pending,和tp_submit先加pending再看idle配对:两边至少有一边看得到另一边
+		__atomic_add_fetch(&pool.idle, 1, __ATOMIC_SEQ_CST);
+		while (__atomic_load_n(&pool.pending, __ATOMIC_SEQ_CST) == 0 && !pool.quit)
+			pthread_cond_wait(&pool.cond, &pool.lock);
+		__atomic_sub_fetch(&pool.idle, 1, __ATOMIC_RELAXED);
+		if (pool.quit && __atomic_load_n(&pool.pending, __ATOMIC_ACQUIRE) == 0) {
+			pthread_mutex_unlock(&pool.lock);
+			break;
+		}
+		pthread_mutex_unlock(&pool.lock);
+		//-pending不为0但是一时偷不到:任务正在入队的路上,让一下CPU再找
+		sched_yield();
+	}
+	return NULL;
+}
+
+static long tp_pending_metric(void)
+{
+	return tp_pending();
+}
+
+static long tp_workers_metric(void)
+{
+	return tp_workers();
+}
+
+int tp_init(int nworkers)
+{
+	int i, err;
+
+	if (pool.w != NULL)
+		return 0;
+	if (nworkers <= 0)
+		nworkers = sysconf(_SC_NPROCESSORS_ONLN);
+	if (nworkers <= 0)
+		nworkers = 1;
+	if (nworkers > TP_MAX_WORKERS)
+		nworkers = TP_MAX_WORKERS;
+
+	pool.w = calloc(nworkers, sizeof(struct tp_worker));
+	if (pool.w == NULL)
+		return -1;
+	m_tasks = metric_counter("pool_tasks_total", "tasks run by the thread pool");
+	metric_func("pool_queue_depth", "tasks queued and not yet started", METRIC_GAUGE, tp_pending_metric);
+	metric_func("pool_workers", "worker threads", METRIC_GAUGE, tp_workers_metric);
+	pool.stop = 0;
+	pool.quit = 0;
+	pool.pending = 0;
+	for (i = 0; i < nworkers; i++) {
+		pool.w[i].id = i;
+		pthread_mutex_init(&pool.w[i].dq.lock, NULL);
+	}
+	for (i = 0; i < nworkers; i++) {
+		err = pthread_create(&pool.w[i].tid, NULL, tp_worker_main, &pool.w[i]);
+		if (err != 0) {
+			printf("pthread_create error:%s\n", strerror(err));
+			break;
+		}
+		pool.nworkers++;	//-工作线程只看已经创建好的那部分
+	}
+	if (pool.nworkers == 0) {
+		free(pool.w);
+		pool.w = NULL;
+		return -1;
+	}
+	return 0;
+}
+
+int tp_submit(tp_func_t fn, void *arg)
+{
+	int i, n, ret = -1;
+	unsigned int start;
+
+	//-先登记再看stop:tp_shutdown置了stop以后等登记的都出去才放工作线程走,才free(pool.w),
+	//-所以看到stop为0的提交者入队时工作线程一定还在.不拿pool.lock,本线程的队列只有自己的锁
+	__atomic_add_fetch(&pool.submitters, 1, __ATOMIC_SEQ_CST);
+	if (__atomic_load_n(&pool.stop, __ATOMIC_SEQ_CST) || pool.w == NULL || !_running)
+		goto out;
+	n = pool.nworkers;
+	//-先计数再入队,工作线程看到pending不为0就不会去睡
+	__atomic_add_fetch(&pool.pending, 1, __ATOMIC_SEQ_CST);
+	if (tp_self >= 0 && tp_push(&pool.w[tp_self].dq, fn, arg) == 0)
+		goto queued;
+	start = __atomic_fetch_add(&pool.rr, 1, __ATOMIC_RELAXED);
+	for (i = 0; i < n; i++) {
+		if (tp_push(&pool.w[(start + i) % n].dq, fn, arg) == 0)
+			goto queued;
+	}
+	__atomic_sub_fetch(&pool.pending, 1, __ATOMIC_RELEASE);
+	goto out;	//-全部队列都满了,由调用者决定丢弃还是自己执行
+
+queued:
+	if (__atomic_load_n(&pool.idle, __ATOMIC_SEQ_CST) > 0) {	//-都在忙就不用碰pool.lock
+		pthread_mutex_lock(&pool.lock);
+		pthread_cond_signal(&pool.cond);
+		pthread_mutex_unlock(&pool.lock);
+	}
+	ret = 0;
+out:
+	__atomic_sub_fetch(&pool.submitters, 1, __ATOMIC_RELEASE);
+	return ret;
+}
+
+void tp_shutdown(void)
+{
+	int i;
+
+	if (pool.w == NULL)
+		return;
+	__atomic_store_n(&pool.stop, 1, __ATOMIC_SEQ_CST);
+	while (__atomic_load_n(&pool.submitters, __ATOMIC_ACQUIRE) > 0)
+		sched_yield();	//-只等已经在入队的,很快
+	pthread_mutex_lock(&pool.lock);
+	pool.quit = 1;
+	pthread_cond_broadcast(&pool.cond);
+	pthread_mutex_unlock(&pool.lock);
+
+	for (i = 0; i < pool.nworkers; i++) {
+		pthread_join(pool.w[i].tid, NULL);
+		pthread_mutex_destroy(&pool.w[i].dq.lock);
+	}
+	free(pool.w);
+	pool.w = NULL;
+	pool.nworkers = 0;
+}
+
+//-退出前等队列里的任务都被取走,最多等timeout_ms,返回还剩多少个没有开始
+int tp_drain(int timeout_ms)
+{
+	struct timespec ts = { 0, 1000000 };
+	int left;
+
+	while ((left = tp_pending()) > 0 && timeout_ms-- > 0)
+		nanosleep(&ts, NULL);
+	return left;
+}
+
+int tp_workers(void)
+{
+	return pool.nworkers;
+}
+
+//-队列一共能放多少个任务
+int tp_capacity(void)
+{
+	return pool.nworkers * TP_DEQUE_SIZE;
+}
+
+int tp_pending(void)
 {
-   
-  pthread_t tid1,tid2;
-  int err;
-  void *tret;
-  err=pthread_create(&tid1,NULL,add,NULL);//创建线程
-  if(err!=0)
-  {
-    printf("pthread_create error:%s\n",strerror(err));
-    exit(-1);
-  }
-  err=pthread_create(&tid2,NULL,sub,NULL);
-  if(err!=0)
-  {
-    printf("pthread_create error:%s\n",strerror(err));
-     exit(-1);
-  }
-  err=pthread_join(tid1,&tret);//阻塞等待线程id为tid1的线程，直到该线程退出
-  if(err!=0)
-  {
-    printf("can not join with thread1:%s\n",strerror(err));
-    exit(-1);
-  }
-  printf("thread 1 exit code %d\n",(int)tret);
-  err=pthread_join(tid2,&tret);
-  if(err!=0)
-  {
-    printf("can not join with thread1:%s\n",strerror(err));
-    exit(-1);
-  }
-  printf("thread 2 exit code %d\n",(int)tret);
-  return 0;
+	return __atomic_load_n(&pool.pending, __ATOMIC_RELAXED);
 }
@@ -0,0 +1,19 @@
+//-为了方便调试定义了系列变量以便调试输出
+
+#ifndef THREAD_H
+#define THREAD_H
+
+//-线程池执行的任务函数,arg由提交者负责分配和释放
+typedef void (*tp_func_t)(void *arg);
+
+int  tp_init(int nworkers);			//-启动固定数量的工作线程,nworkers<=0时按CPU个数
+int  tp_submit(tp_func_t fn, void *arg);	//-任何线程都可以提交,队列满或已关闭返回-1
+void tp_shutdown(void);				//-执行完剩余任务后回收所有工作线程
+int  tp_drain(int timeout_ms);			//-等队列排空,返回剩下的任务数
+int  tp_workers(void);
+int  tp_pending(void);				//-已提交还没有开始执行的任务数(队列深度)
+int  tp_capacity(void);
+
+int thread_sub(int argc, char** argv);
+
+#endif /* THREAD_H */
@@ -0,0 +1,300 @@
+/*
+此文件是分层时间轮定时器.以前的定时动作都是在代码里直接sleep/usleep,
+一睡整个程序都停了.现在所有定时动作(帧超时,LED闪烁,周期统计...)都挂到这里,
+由一个timerfd驱动,和串口一起在事件循环里等待.
+
+时间轮:精度1ms,5层每层64格,第0层一格1ms,第1层一格64ms...最远可以放2^30ms(12天多).
+插入/取消都是链表操作O(1).第0层转满一圈时把上一层当前格里的定时器重新分配到下层.
+每层用一个64位的位图记录哪些格不空,这样可以直接算出下一次需要醒来的时刻,
+timerfd只在需要的时候响,没有定时器时完全不响.
+*/
+
+#include "debugfl.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/timerfd.h>
+
+#include "event.h"
+#include "timer.h"
+
+#define WHEEL_BITS	6
+#define WHEEL_SIZE	(1 << WHEEL_BITS)
+#define WHEEL_MASK	(WHEEL_SIZE - 1)
+#define WHEEL_LEVELS	5
+#define WHEEL_MAX	((1UL << (WHEEL_BITS * WHEEL_LEVELS)) - 1)
+
+struct timer_slot {
+	struct timer *next, *prev;	//-和struct timer开头一样,当作链表头
+};
+
+static struct {
+	struct timer_slot slot[WHEEL_LEVELS][WHEEL_SIZE];
+	uint64_t bitmap[WHEEL_LEVELS];
+	unsigned long clk;		//-下一个要处理的tick
+	unsigned long armed;		//-timerfd当前设置的到期tick
+	int armed_on;			//-timerfd是否设置了
+	struct timespec base;		//-tick 0对应的CLOCK_MONOTONIC时刻
+	int fd;
+	struct ev_io io;
+	int count;
+	int in_run;			//-正在执行到期回调
+} wheel;
+
+static unsigned long mono_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (ts.tv_sec - wheel.base.tv_sec) * 1000UL + (ts.tv_nsec - wheel.base.tv_nsec) / 1000000L;
+}
+
+unsigned long timer_now(void)
+{
+	return mono_ms();
+}
+
+static void slot_link(int level, int idx, struct timer *t)
+{
+	struct timer_slot *s = &wheel.slot[level][idx];
+
+	t->next = (struct timer *)s;
+	t->prev = s->prev;
+	s->prev->next = t;
+	s->prev = t;
+	wheel.bitmap[level] |= 1ULL << idx;
+}
+
+static void timer_unlink(struct timer *t)
+{
+	t->prev->next = t->next;
+	t->next->prev = t->prev;
+	t->next = t->prev = NULL;
+}
+
+//-按离现在还有多远放到合适的层
+static void wheel_insert(struct timer *t)
+{
+	unsigned long delta;
+	int level;
+
+	if ((long)(t->expires - wheel.clk) < 0)		//-已经过期的放到马上要处理的格
+		t->expires = wheel.clk;
+	delta = t->expires - wheel.clk;
+	if (delta > WHEEL_MAX) {
+		delta = WHEEL_MAX;
+		t->expires = wheel.clk + delta;
+	}
+	for (level = 0; level < WHEEL_LEVELS - 1; level++) {
+		if (delta < (1UL << (WHEEL_BITS * (level + 1))))
+			break;
+	}
+	slot_link(level, (t->expires >> (WHEEL_BITS * level)) & WHEEL_MASK, t);
+}
+
+//-把第level层当前格里的定时器重新分配到下面的层
+static void wheel_cascade(int level)
+{
+	int idx = (wheel.clk >> (WHEEL_BITS * level)) & WHEEL_MASK;
+	struct timer_slot *s = &wheel.slot[level][idx];
+	struct timer *t;
+
+	wheel.bitmap[level] &= ~(1ULL << idx);
+	while (s->next != (struct timer *)s) {
+		t = s->next;
+		timer_unlink(t);
+		wheel_insert(t);
+	}
+}
+
+//-把64位的位图转到从第start格开始,最低的置位离start最近
+static uint64_t bitmap_rot(uint64_t map, int start)
+{
+	start &= WHEEL_MASK;
+	return start ? (map >> start) | (map << (WHEEL_SIZE - start)) : map;
+}
+
+//-算出下一个有事情做的tick(第0层有定时器到期,或者上层有不空的格要往下分),没有定时器返回0
+static int wheel_next(unsigned long *next)
+{
+	unsigned long best = 0, t, low;
+	int level, shift, pos, found = 0;
+
+	if (wheel.count == 0)
+		return 0;
+	if (wheel.bitmap[0]) {
+		best = wheel.clk + __builtin_ctzll(bitmap_rot(wheel.bitmap[0], wheel.clk));
+		found = 1;
+	}
+	for (level = 1; level < WHEEL_LEVELS; level++) {
+		if (wheel.bitmap[level] == 0)
+			continue;
+		shift = WHEEL_BITS * level;
+		pos = (wheel.clk >> shift) & WHEEL_MASK;
+		low = wheel.clk & ((1UL << shift) - 1);
+		if (low == 0 && (wheel.bitmap[level] & (1ULL << pos)))
+			t = wheel.clk;		//-这一格正好在clk这一刻往下分
+		else
+			t = ((wheel.clk >> shift) + 1 + __builtin_ctzll(bitmap_rot(wheel.bitmap[level], pos + 1))) << shift;
+		if (!found || (long)(t - best) < 0)
+			best = t;
+		found = 1;
+	}
+	*next = best;
+	return found;
+}
+
+static void wheel_arm(void)
+{
+	struct itimerspec its;
+	unsigned long next = 0;
+	unsigned long long ns;
+	int on = wheel_next(&next);
+
+	if (on == wheel.armed_on && (!on || next == wheel.armed))
+		return;
+	memset(&its, 0, sizeof(its));
+	if (on) {
+		ns = (unsigned long long)wheel.base.tv_nsec + (unsigned long long)next * 1000000ULL;
+		its.it_value.tv_sec = wheel.base.tv_sec + ns / 1000000000ULL;
+		its.it_value.tv_nsec = ns % 1000000000ULL;
+	}
+	if (timerfd_settime(wheel.fd, TFD_TIMER_ABSTIME, &its, NULL) < 0)
+		perror("timerfd_settime");
+	wheel.armed = next;
+	wheel.armed_on = on;
+}
+
+static void wheel_run(unsigned long now)
+{
+	struct timer_slot *s;
+	struct timer *t;
+	unsigned long next;
+	int idx, level;
+
+	while ((long)(now - wheel.clk) >= 0) {
+		idx = wheel.clk & WHEEL_MASK;
+		if (idx == 0) {
+			for (level = 1; level < WHEEL_LEVELS; level++) {
+				wheel_cascade(level);
+				if (((wheel.clk >> (WHEEL_BITS * level)) & WHEEL_MASK) != 0)
+					break;
+			}
+		}
+		if (!(wheel.bitmap[0] & (1ULL << idx))) {
+			//-到下一个有事情做的tick之间都是空转,直接跳过去
+			if (!wheel_next(&next) || (long)(next - now) > 0) {
+				wheel.clk = now + 1;
+				break;
+			}
+			wheel.clk = (long)(next - wheel.clk) > 0 ? next : wheel.clk + 1;
+			continue;
+		}
+		s = &wheel.slot[0][idx];
+		wheel.bitmap[0] &= ~(1ULL << idx);
+		while (s->next != (struct timer *)s) {
+			t = s->next;
+			timer_unlink(t);
+			wheel.count--;
+			if (t->period) {	//-周期定时器先放回去,回调里可以取消或者改周期
+				t->expires += t->period;
+				if ((long)(t->expires - now) <= 0)	//-耽误了好几个周期就不补了
+					t->expires = now + t->period;
+				wheel_insert(t);
+				wheel.count++;
+			}
+			t->cb(t);
+		}
+		wheel.clk++;
+	}
+}
+
+static void timer_io_cb(struct ev_io *io, unsigned int revents)
+{
+	uint64_t exp;
+
+	if (read(wheel.fd, &exp, sizeof(exp)) < 0) {
+		;	//-EAGAIN:已经被重新设置过了,照样按当前时间处理
+	}
+	wheel.armed_on = 0;
+	wheel.in_run = 1;
+	wheel_run(mono_ms());
+	wheel.in_run = 0;
+	wheel_arm();
+}
+
+int timer_init(void)
+{
+	int l, i;
+
+	clock_gettime(CLOCK_MONOTONIC, &wheel.base);
+	for (l = 0; l < WHEEL_LEVELS; l++) {
+		for (i = 0; i < WHEEL_SIZE; i++) {
+			wheel.slot[l][i].next = (struct timer *)&wheel.slot[l][i];
+			wheel.slot[l][i].prev = (struct timer *)&wheel.slot[l][i];
+		}
+		wheel.bitmap[l] = 0;
+	}
+	wheel.clk = 0;
+	wheel.armed_on = 0;
+	wheel.count = 0;
+	wheel.fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	if (wheel.fd < 0) {
+		perror("timerfd_create");
+		return -1;
+	}
+	ev_io_init(&wheel.io, wheel.fd, EV_READ, timer_io_cb, NULL);
+	return ev_add(&wheel.io);
+}
+
+void timer_setup(struct timer *t, timer_cb_t cb, void *arg)
+{
+	memset(t, 0, sizeof(*t));
+	t->cb = cb;
+	t->arg = arg;
+}
+
+void timer_start(struct timer *t, unsigned int ms, unsigned int period_ms)
+{
+	unsigned long now = mono_ms();
+
+	if (t->next)
+		timer_cancel(t);
+	if (wheel.count == 0 && !wheel.in_run)	//-空的时间轮直接拨到现在,不用从很久以前一格一格追
+		wheel.clk = now;
+	//-时间轮可能已经处理到现在之后(回调里再启动的情况),按时间轮的时刻算到期
+	if ((long)(now - wheel.clk) < 0)
+		now = wheel.clk;
+	t->expires = now + ms;
+	t->period = period_ms;
+	wheel_insert(t);
+	wheel.count++;
+	if (!wheel.in_run && (!wheel.armed_on || (long)(t->expires - wheel.armed) < 0))
+		wheel_arm();
+}
+
+void timer_cancel(struct timer *t)
+{
+	int l, i;
+
+	if (t->next == NULL)
+		return;
+	timer_unlink(t);
+	wheel.count--;
+	//-格子空了把位图清掉,不然wheel_next会算出一个没用的唤醒
+	for (l = 0; l < WHEEL_LEVELS; l++) {
+		i = (t->expires >> (WHEEL_BITS * l)) & WHEEL_MASK;
+		if ((wheel.bitmap[l] & (1ULL << i)) &&
+		    wheel.slot[l][i].next == (struct timer *)&wheel.slot[l][i])
+			wheel.bitmap[l] &= ~(1ULL << i);
+	}
+	t->period = 0;
+}
+
+int timer_pending(const struct timer *t)
+{
+	return t->next != NULL;
+}
@@ -0,0 +1,25 @@
+//-为了方便调试定义了系列变量以便调试输出
+
+#ifndef TIMER_H
+#define TIMER_H
+
+struct timer;
+typedef void (*timer_cb_t)(struct timer *t);
+
+//-结构由调用者分配(一般嵌在自己的结构里),回调在主循环里执行,不能阻塞
+struct timer {
+	struct timer *next, *prev;
+	unsigned long expires;		//-到期的时刻(ms)
+	unsigned int period;		//-周期(ms),0表示只执行一次
+	timer_cb_t cb;
+	void *arg;
+};
+
+int  timer_init(void);			//-创建timerfd并注册到事件循环,要在ev_init之后
+void timer_setup(struct timer *t, timer_cb_t cb, void *arg);
+void timer_start(struct timer *t, unsigned int ms, unsigned int period_ms);	//-已经在跑的会先取消
+void timer_cancel(struct timer *t);
+int  timer_pending(const struct timer *t);
+unsigned long timer_now(void);		//-时间轮的当前时刻(ms)
+
+#endif /* TIMER_H */
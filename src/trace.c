@@ -0,0 +1,163 @@
+/*
+此文件是热点路径的时间线跟踪.
+DEBUG()打印只能看到一堆没有顺序的文字,回复延迟突然变大的时候看不出时间花在哪里.
+现在每个线程有自己的环形缓冲区,只记录(时刻,名字,开始/结束),写的时候不加锁:
+每个缓冲区只有它自己的线程写,写完一条再更新head.满了就覆盖最老的.
+收到SIGUSR2或者程序退出时把所有线程的记录写成Chrome trace-event格式的JSON,
+用chrome://tracing或者ui.perfetto.dev打开就是按线程排列的时间线.
+*/
+
+#include "debugfl.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/syscall.h>
+
+#include "trace.h"
+
+#define TRACE_RING	8192		//-每个线程保留最近的这么多条,必须是2的幂
+
+struct trace_ev {
+	uint64_t ts;			//-CLOCK_MONOTONIC ns
+	const char *name;
+	char ph;			//-B开始 E结束 i瞬时
+};
+
+struct trace_buf {
+	struct trace_buf *next;
+	int tid;
+	char name[16];
+	uint64_t head;			//-已经写了多少条,只有本线程写
+	struct trace_ev ev[TRACE_RING];
+};
+
+volatile int trace_enabled = 0;
+
+static struct trace_buf *trace_list = NULL;	//-所有线程的缓冲区,只增加不删除
+static pthread_mutex_t trace_lock = PTHREAD_MUTEX_INITIALIZER;
+static __thread struct trace_buf *trace_self = NULL;
+static const char *trace_path = NULL;
+static volatile int trace_dump_req = 0;
+
+static struct trace_buf *trace_buf_get(void)
+{
+	struct trace_buf *b;
+
+	if (trace_self)
+		return trace_self;
+	b = calloc(1, sizeof(*b));
+	if (b == NULL)
+		return NULL;
+	b->tid = syscall(SYS_gettid);
+	snprintf(b->name, sizeof(b->name), "tid-%d", b->tid);
+	pthread_mutex_lock(&trace_lock);	//-每个线程只在第一次打点时进来一次
+	b->next = trace_list;
+	__atomic_store_n(&trace_list, b, __ATOMIC_RELEASE);
+	pthread_mutex_unlock(&trace_lock);
+	trace_self = b;
+	return b;
+}
+
+void trace_event(const char *name, char ph)
+{
+	struct trace_buf *b = trace_buf_get();
+	struct trace_ev *e;
+	struct timespec ts;
+
+	if (b == NULL)
+		return;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	e = &b->ev[b->head & (TRACE_RING - 1)];
+	e->ts = (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+	e->name = name;
+	e->ph = ph;
+	__atomic_store_n(&b->head, b->head + 1, __ATOMIC_RELEASE);	//-内容写完再发布
+}
+
+void trace_thread_name(const char *name)
+{
+	struct trace_buf *b;
+
+	if (!trace_enabled)
+		return;
+	b = trace_buf_get();
+	if (b)
+		snprintf(b->name, sizeof(b->name), "%s", name);
+}
+
+int trace_open(const char *path)
+{
+	trace_path = path;
+	trace_enabled = 1;
+	return 0;
+}
+
+void trace_request_dump(void)
+{
+	trace_dump_req = 1;
+}
+
+void trace_poll(void)
+{
+	if (trace_dump_req) {
+		trace_dump_req = 0;
+		trace_dump();
+	}
+}
+
+static void trace_dump_buf(FILE *fp, struct trace_buf *b, int pid, int *first)
+{
+	struct trace_ev *copy, *e;
+	uint64_t head, head2, start, first_idx, i;
+	int n = 0;
+
+	copy = malloc(sizeof(b->ev));
+	if (copy == NULL)
+		return;
+	head = __atomic_load_n(&b->head, __ATOMIC_ACQUIRE);
+	start = first_idx = head > TRACE_RING ? head - TRACE_RING : 0;
+	for (i = start; i < head; i++)
+		copy[n++] = b->ev[i & (TRACE_RING - 1)];
+	//-复制的时候线程还在写,被覆盖掉的最老的几条不要
+	head2 = __atomic_load_n(&b->head, __ATOMIC_ACQUIRE);
+	if (head2 > TRACE_RING && head2 - TRACE_RING > start)
+		start = head2 - TRACE_RING;
+
+	fprintf(fp, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+		*first ? "" : ",\n", pid, b->tid, b->name);
+	*first = 0;
+	for (i = start; i < head; i++) {
+		e = &copy[i - first_idx];
+		fprintf(fp, ",\n{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%llu.%03u,\"pid\":%d,\"tid\":%d%s}",
+			e->name, e->ph, (unsigned long long)(e->ts / 1000), (unsigned int)(e->ts % 1000),
+			pid, b->tid, e->ph == 'i' ? ",\"s\":\"t\"" : "");
+	}
+	free(copy);
+}
+
+//-写Chrome trace-event JSON,ts的单位是微秒
+int trace_dump(void)
+{
+	struct trace_buf *b;
+	FILE *fp;
+	int first = 1, pid = getpid();
+
+	if (!trace_enabled || trace_path == NULL)
+		return -1;
+	fp = fopen(trace_path, "w");
+	if (fp == NULL) {
+		perror(trace_path);
+		return -1;
+	}
+	fprintf(fp, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+	for (b = __atomic_load_n(&trace_list, __ATOMIC_ACQUIRE); b; b = b->next)
+		trace_dump_buf(fp, b, pid, &first);
+	fprintf(fp, "\n]}\n");
+	fclose(fp);
+	return 0;
+}
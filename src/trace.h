@@ -0,0 +1,29 @@
+//-为了方便调试定义了系列变量以便调试输出
+
+#ifndef TRACE_H
+#define TRACE_H
+
+/*
+热点路径打点:TRACE_BEGIN/TRACE_END成对使用,name必须是字符串常量(只保存指针).
+没有用-K打开时只多一次判断;编译时加-DNO_TRACE整个去掉.
+*/
+extern volatile int trace_enabled;
+
+void trace_event(const char *name, char ph);
+void trace_thread_name(const char *name);	//-在trace里显示的线程名,每个线程开始时调用
+int  trace_open(const char *path);		//-打开跟踪,dump时写到path
+void trace_request_dump(void);			//-信号处理函数里调用,只设置标志
+void trace_poll(void);				//-主循环里调用,有dump请求就写文件
+int  trace_dump(void);
+
+#if defined(NO_TRACE)
+#define TRACE_BEGIN(name)	do { } while (0)
+#define TRACE_END(name)		do { } while (0)
+#define TRACE_INSTANT(name)	do { } while (0)
+#else
+#define TRACE_BEGIN(name)	do { if (trace_enabled) trace_event(name, 'B'); } while (0)
+#define TRACE_END(name)		do { if (trace_enabled) trace_event(name, 'E'); } while (0)
+#define TRACE_INSTANT(name)	do { if (trace_enabled) trace_event(name, 'i'); } while (0)
+#endif
+
+#endif /* TRACE_H */
@@ -16,6 +16,11 @@
 #include<termios.h>    /*PPSIX 终端控制定义*/  
 #include<errno.h>      /*错误号定义*/  
 #include<string.h>  
+
+#include "trace.h"
+#include "metrics.h"
+#include "uart1.h"
+#include "event.h"
    
    
 //宏定义  
@@ -50,7 +55,7 @@ int UART0_Open(int fd,char* port)  //-目前程序如果成功的话就是阻塞
                   printf("fcntl=%d\n",fcntl(fd, F_SETFL,0));  
      }  
       //测试是否为终端设备      
-     if(0 == isatty(STDIN_FILENO))  
+     if(0 == isatty(fd))	//-以前测的是STDIN_FILENO,守护进程的标准输入是/dev/null  
      {  
                        printf("standard input is not a terminal device\n");  
                   return(FALSE);  
@@ -285,11 +290,27 @@ int UART0_Recv(int fd, char *rcv_buf,int data_len)
 *                              data_len    :一帧数据的个数 
 * 出口参数：        正确返回为1，错误返回为0 
 *******************************************************************/  
+struct metric *uart_tx_bytes = &metric_sink;	//-uart_1_Open里登记
+struct uart_capture *uart_capture = NULL;
+
 int UART0_Send(int fd, char *send_buf,int data_len)  
 {  
     int len = 0;  
      
-    len = write(fd,send_buf,data_len);  
+    if (fd == UART_FD_CAPTURE)
+    {//-不是真的串口,回复留给控制socket
+       if (uart_capture == NULL)
+          return FALSE;
+       len = data_len < uart_capture->size - uart_capture->len ? data_len : uart_capture->size - uart_capture->len;
+       memcpy(uart_capture->buf + uart_capture->len, send_buf, len);
+       uart_capture->len += len;
+       return data_len;
+    }
+    TRACE_BEGIN("reply_write");
+    len = ev_write(fd,send_buf,data_len);	//-io_uring后端:排队,下一次等待时一起提交
+    TRACE_END("reply_write");
+    if (len > 0)
+       metric_add(uart_tx_bytes, len);
     if (len == data_len )  
     {  
        return len;  
@@ -323,6 +344,8 @@ int uart1_sub(int argc, char *argv[])	//?参数如何传递过来的,在终端
     }  
        
     fd = UART0_Open(fd,argv[1]); //打开串口，返回文件描述符  
+    if(FALSE == fd)
+      return FALSE;	//-打不开就不要在下面一直重试,启动会卡住
     do{  
                   err = UART0_Init(fd,57600,0,8,1,'N');  
                   printf("Set Port Exactly!\n");  
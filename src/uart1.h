@@ -3,7 +3,32 @@
 #ifndef UART_1_APP_H
 #define UART_1_APP_H
 
-void uart_1_Main(int fd);
+struct fbuf;
+
+extern const char *uart_frames_shm;	//--R 发布串口帧的共享内存名字,空串表示不发布
+
+int  uart_1_Open(int fd);
+void uart_1_Restore(const void *buf, int len);
+void uart_1_Close(void);
+void uart_1_Stats(void);
+void uart_1_Main(int fd, struct fbuf *f);
+int  uart_dispatch(int fd, const char *frame, int len);
+void uart_1_Bench(void);
+int UART0_Open(int fd,char* port);
+int UART0_Set(int fd,int speed,int flow_ctrl,int databits,int stopbits,int parity);
+void UART0_Close(int fd);
 int UART0_Send(int fd, char *send_buf,int data_len);
 
+struct metric;
+extern struct metric *uart_tx_bytes;
+
+//-控制socket借用串口的命令处理:fd是UART_FD_CAPTURE时UART0_Send把回复放到uart_capture里
+#define UART_FD_CAPTURE	(-2)
+struct uart_capture {
+	char *buf;
+	int size;
+	int len;
+};
+extern struct uart_capture *uart_capture;
+
 #endif /* UART_1_APP_H */
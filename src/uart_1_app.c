@@ -13,6 +13,8 @@ Linux串口操作中，特别以非阻塞的方式读取和发送数据，做好
 1.下面的程序有一个问题:当同时接收到两个命令的时候就会丢失其中一个,这个后续需要处理
 */
 
+#define _GNU_SOURCE		//-posix_openpt
+#define LOG_MODULE	LOGM_UART
 #include "debugfl.h"
 
 //串口相关的头文件  
@@ -21,80 +23,208 @@ Linux串口操作中，特别以非阻塞的方式读取和发送数据，做好
 #include<unistd.h>     /*Unix 标准函数定义*/  
 #include<sys/types.h>   
 #include<sys/stat.h>     
+#include<sys/mman.h>
 #include<fcntl.h>      /*文件控制定义*/  
 #include<termios.h>    /*PPSIX 终端控制定义*/  
 #include<errno.h>      /*错误号定义*/  
 #include<string.h>  
+#include<time.h>
+#include<stdarg.h>
+#include<arpa/inet.h>
    
 #include "uart1.h"
+#include "event.h"
+#include "timer.h"
+#include "bench.h"
+#include "trace.h"
+#include "Daemon.h"
+#include "handoff.h"
+#include "metrics.h"
+#include "gpio.h"
+#include "led.h"
+#include "tcpdump.h"
+#include "shmring.h"
+#include "fbuf.h"
+#include "modbus.h"
+#include "neigh.h"
+#include "dns.h"
 
 
-//首先定义了两个字符数组：
-//-一个缓冲数组，用来存放每一次读到的数据
-char read_data[256]={0};
-//-int read_pt=0;	//-指向待处理位置的
-//-存放一个完整的数据帧，以便处理
-char read_report[256]={0};
+//-'$'之后这么久还没有等到'#'就把半帧丢掉,以前是在读的循环里usleep等
+#define FRAME_TIMEOUT_MS	500
+#define UART_STATE_DATA		256	//-热重启交接的半帧最长多少,整个状态要放得进HANDOFF_DATA
 
+//-一个串口在事件循环里的状态
+struct uart_port {
+	int fd;
+	struct ev_io io;
+	struct timer frame_tmo;		//-帧超时
+	struct fbuf *cur;		//-正在拼的帧,NULL表示在等'$'
+	void (*on_frame)(struct uart_port *port, struct fbuf *f);	//-拼好一帧后调用,要留着f就fbuf_ref
+	unsigned long frames;
+	unsigned long timeouts;
+	uint64_t rx_ns;			//-最近一次read返回的时间,回复延迟从这里算
+	struct shmring *ring;		//-拼好的帧发布到这里,NULL不发布
+	char rx[256];			//-epoll后端读到这里;io_uring后端直接读到登记的缓冲里
+};
 
+static void frame_ready(struct uart_port *port, struct fbuf *f);
+static void uart_1_io_cb(struct ev_io *io, unsigned int revents);
 
-//得到了一个完整的数据帧
-void get_complete_frame(int fd)
+static struct uart_port port1 = { -1 };
+static struct shmring frame_ring;
+
+const char *uart_frames_shm = "/dreamflower_app.frames";
+
+static struct metric *m_rx_bytes = &metric_sink;
+static struct metric *m_frames = &metric_sink;
+static struct metric *m_bad = &metric_sink;
+static struct metric *m_oversize = &metric_sink;
+static struct metric *m_nobuf = &metric_sink;
+static struct metric *m_timeouts = &metric_sink;
+static struct metric *m_latency = &metric_sink;
+
+static uint64_t uart_now_ns(void)
 {
-    char read_tmp[256]={0};
-    int return_flag=0;
-    int i;
-    //存放读取到的字节数
-    while(1)
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void frame_timeout(struct timer *t)
+{
+	struct uart_port *port = t->arg;
+
+	port->timeouts++;
+	metric_inc(m_timeouts);
+	DEBUG("frame timeout, drop: %s\n", port->cur ? port->cur->data : "");
+	fbuf_put(port->cur);
+	port->cur = NULL;
+}
+
+//-一帧超过fbuf_max:丢掉,后面的字节也丢掉直到下一个'$'
+static void frame_oversize(struct uart_port *port)
+{
+	metric_inc(m_oversize);
+	LOG(LOGM_UART, LOG_WARN, "frame longer than %u bytes, dropped", fbuf_max);
+	timer_cancel(&port->frame_tmo);
+	fbuf_put(port->cur);
+	port->cur = NULL;
+}
+
+//-缓冲池分不到内存:这一帧丢掉,和太长的分开计数
+static void frame_nobuf(struct uart_port *port)
+{
+	metric_inc(m_nobuf);
+	LOG(LOGM_UART, LOG_WARN, "no frame buffer, frame dropped");
+	timer_cancel(&port->frame_tmo);
+	fbuf_put(port->cur);
+	port->cur = NULL;
+}
+
+//-帧的拼接:'$'开始一帧,'#'结束,帧外面的字节丢掉.
+//-两个标志之间的字节一次加到缓冲里;每拼好一帧调用一次on_frame,返回拼好的帧数
+static int frame_feed(struct uart_port *port, const char *read_tmp, int len)
+{
+    struct fbuf *f;
+    const char *p;
+    int n = 0, i = 0, j, r;
+
+    while(i < len)
     {
-      memset(read_tmp,0,sizeof(read_tmp));
-      if(read(fd, read_tmp, sizeof(read_tmp))>0)
-      {
-        //数据帧的拼接
-        printf("read_tmp: %s\n",read_tmp);
-        for( i=0;i<strlen(read_tmp);i++)
+        if(port->cur == NULL)
+        {//-等帧头
+            p = memchr(read_tmp + i, '$', len - i);
+            if(p == NULL)
+                break;
+            i = p - read_tmp;
+            port->cur = fbuf_get(0);	//-先拿最小的一档,不够再换大的
+            if(port->cur == NULL)
+            {
+                frame_nobuf(port);
+                i++;
+                continue;
+            }
+        }
+        if(read_tmp[i] == '$')
+        {//-新的一帧,没拼完的半帧丢掉
+            port->cur->len = 0;
+            timer_start(&port->frame_tmo, FRAME_TIMEOUT_MS, 0);
+            j = i + 1;
+        }
+        else
+            j = i;
+        while(j < len && read_tmp[j] != '$' && read_tmp[j] != '#')
+            j++;
+        if(j < len && read_tmp[j] == '#')
+            j++;
+        if((r = fbuf_append(&port->cur, read_tmp + i, j - i)) != 0)
         {
-              if(read_tmp[i]=='$')
-              {
-                memset(read_data,0,sizeof(read_data));
-                char tmp[5]={0};
-                tmp[0]=read_tmp[i];
-                strcat(read_data,tmp);
-              }
-              else if(read_tmp[i]=='#')
-              {
-                char tmp[5]={0};
-                tmp[0]=read_tmp[i];
-                strcat(read_data,tmp);
-                return_flag=1;
-                memset(read_report,0,sizeof(read_report));
-                //遇到帧尾，将read_data帧拷贝到read_buf中，以便处理
-                memcpy(read_report,read_data,sizeof(read_data));
-                printf("read_report: %s\n",read_report);	//-把准备处理的报文打印出来
-              }
-              else
-              {
-                  char tmp[5]={0};
-                tmp[0]=read_tmp[i];
-                strcat(read_data,tmp);
-              }
+            if(r == -2)
+                frame_nobuf(port);
+            else
+                frame_oversize(port);
+            i = j;
+            continue;
         }
-        //有了一个完整的数据帧就返回处理
-        if(return_flag==1)
-            return;
-      }
-      else//读不到数据就返回，以便检查对方是否断线
-        return;
-    	usleep(100000);
+        i = j;
+        if(port->cur->data[port->cur->len - 1] != '#')
+            continue;
+        //-拼好一帧:缓冲直接交出去,马上处理,同一次读到的下一帧用另一个缓冲
+        timer_cancel(&port->frame_tmo);
+        f = port->cur;
+        port->cur = NULL;
+        f->ts_ns = port->rx_ns;
+        port->frames++;
+        metric_inc(m_frames);
+        if(port->ring)	//-共享内存给别的进程看,只能复制进去
+            shmring_publish(port->ring, f->ts_ns, f->data, f->len);
+        port->on_frame(port, f);	//-要留着帧的(调试日志)自己加引用
+        fbuf_put(f);
+        n++;
+    }
+    return n;
+}
+
+//得到了一个完整的数据帧
+//-串口可读的时候调用一次,只读一次不等待;一次读到几帧就处理几帧,返回处理的帧数,读失败返回-1
+//-数据已经由事件循环读好了(ev_io_read),在port->io.rbuf里
+int get_complete_frame(struct uart_port *port)
+{
+    const char *read_tmp = port->io.rbuf;
+    int len,n;
+    //存放读取到的字节数
+    TRACE_BEGIN("frame_rx");
+    len = port->io.rlen;
+    if(len<=0)
+    {
+      TRACE_END("frame_rx");
+      return -1;
     }
+    port->rx_ns = uart_now_ns();
+    metric_add(m_rx_bytes, len);
+    DEBUG("read_tmp: %.*s\n",len,read_tmp);
+    n = frame_feed(port, read_tmp, len);
+    TRACE_END("frame_rx");
+    return n;
+}
+
+static void frame_ready(struct uart_port *port, struct fbuf *f)
+{
+    if(port->frames == 1)	//-启动到收到第一帧用了多久,重启后多久能恢复服务
+      LOG(LOGM_UART, LOG_INFO, "first frame %.3f ms after start", daemon_since_start_ms());
+    LOG_FRAME(LOGM_UART, LOG_DBG, f, "frame:");	//-把准备处理的报文打印出来;日志线程写完才放回缓冲,这里不复制
+    uart_1_Main(port->fd, f);
+    metric_observe(m_latency, (uart_now_ns() - port->rx_ns) / 1000);
 }
 
 /*
 从上面的代码中，我们可以看到，每一次从串口读取数据，将读到的数据放在read_tmp中。
-对这个数组进行逐个地字符分析，遇到帧头标志就清空缓冲数组read_data中，保证了缓冲
-数组中的数组都是以‘$’开头的；如果遇到了帧尾，哈，我们现在遇到有了一个完整的帧
-啦，可以去处理帧咯,将数据帧拷贝到read_report中，程序直接对read_report进行处理，处理之
-前别忘了帧尾后面的字符是新的一桢的开头部分，要把它们也保存下来。在程序中我们看到
+遇到帧头标志就从缓冲池拿一个缓冲(已经在拼的就清空)，保证了缓冲中的数据都是以‘$’
+开头的；如果遇到了帧尾，哈，我们现在遇到有了一个完整的帧啦，可以去处理帧咯,这个缓冲
+直接交给处理函数，不再复制，处理之前别忘了帧尾后面的字符是新的一桢的开头部分，要放到
+下一个缓冲里。在程序中我们看到
 读不到数据就返回，如果不返回，这个函数就会一直运行，那么这样做的效果不就等价于阻
 塞操作了么，非阻塞就失去了其意义。
 */
@@ -104,22 +234,633 @@ void get_complete_frame(int fd)
 命令实例:
 1.recv	$0001#
   send	0001
+
+命令帧的格式是 $ + 4位数字的命令码 + 参数(可以没有) + #,
+按命令码在uart_cmd_table里二分查找处理函数,参数原样传给处理函数.
+以后增加命令只要在表里加一行,不用再往if/else里加strcmp.
 */
+typedef void (*uart_cmd_fn)(int fd, const char *arg, int arglen);
 
-void uart_1_Main(int fd)
+struct uart_cmd {
+	int code;
+	uart_cmd_fn fn;
+};
+
+static void cmd_0001(int fd, const char *arg, int arglen)
 {
 	char send_buf[20]="tiger john\n";
-	int len;
-	
-	get_complete_frame(fd);
-	if(read_report[0] == '$')
+
+	UART0_Send(fd,send_buf,strlen(send_buf));
+}
+
+static void cmd_0002(int fd, const char *arg, int arglen)
+{
+	char send_buf[20]="tiger john\n";
+
+	send_buf[0] = '2';
+	UART0_Send(fd,send_buf,strlen(send_buf));
+}
+
+//-参数复制成字符串,处理函数拿到的参数没有结尾的0
+static void cmd_arg(char *buf, int size, const char *arg, int arglen)
+{
+	if(arglen < 0)
+		arglen = 0;
+	if(arglen > size - 1)
+		arglen = size - 1;
+	memcpy(buf, arg, arglen);
+	buf[arglen] = 0;
+}
+
+static void cmd_reply(int fd, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+static void cmd_reply(int fd, const char *fmt, ...)
+{
+	char send_buf[256];
+	va_list ap;
+	int n;
+
+	va_start(ap, fmt);
+	n = vsnprintf(send_buf, sizeof(send_buf), fmt, ap);
+	va_end(ap);
+	if(n > (int)sizeof(send_buf) - 1)
+		n = sizeof(send_buf) - 1;
+	UART0_Send(fd, send_buf, n);
+}
+
+//-$0003# 查询状态
+static void cmd_0003(int fd, const char *arg, int arglen)
+{
+	cmd_reply(fd, "up %.0f ms frames %lu timeouts %lu log_level %d log_mask 0x%x\n",
+		  daemon_since_start_ms(), port1.frames, port1.timeouts, log_level, log_mask);
+}
+
+//-$0004<级别>[,<模块掩码>]# 改日志级别,例如$00043,0x3#
+static void cmd_0004(int fd, const char *arg, int arglen)
+{
+	char buf[32];
+	int level;
+	unsigned int mask;
+
+	cmd_arg(buf, sizeof(buf), arg, arglen);
+	switch(sscanf(buf, "%d,%i", &level, &mask))
+	{
+	case 2:
+		log_mask = mask;
+		/* fall through */
+	case 1:
+		log_level = level;
+		break;
+	default:
+		cmd_reply(fd, "error: level[,mask]\n");
+		return;
+	}
+	cmd_reply(fd, "log_level %d log_mask 0x%x\n", log_level, log_mask);
+}
+
+//-$0005<引脚>,<0|1># 写GPIO
+static void cmd_0005(int fd, const char *arg, int arglen)
+{
+	char buf[32];
+	int pin, v;
+
+	cmd_arg(buf, sizeof(buf), arg, arglen);
+	if(sscanf(buf, "%d,%d", &pin, &v) != 2)
+	{
+		cmd_reply(fd, "error: pin,value\n");
+		return;
+	}
+	if(gpio_open(gpio_spec) != 0 || gpio_dir(pin, gpio_out) != 0 || gpio_write(pin, v) != 0)
+	{
+		cmd_reply(fd, "error: gpio %d\n", pin);
+		return;
+	}
+	cmd_reply(fd, "gpio %d %d\n", pin, v != 0);
+}
+
+//-$0006<引脚>,<闪法># LED,闪法见led_named,例如$000611,fast#
+static void cmd_0006(int fd, const char *arg, int arglen)
+{
+	char buf[48], name[16];
+	int pin;
+
+	cmd_arg(buf, sizeof(buf), arg, arglen);
+	if(sscanf(buf, "%d,%15s", &pin, name) != 2)
+	{
+		cmd_reply(fd, "error: pin,pattern\n");
+		return;
+	}
+	if(gpio_open(gpio_spec) != 0 || led_named(pin, name) != 0)
+	{
+		cmd_reply(fd, "error: led %d %s\n", pin, name);
+		return;
+	}
+	cmd_reply(fd, "led %d %s\n", pin, name);
+}
+
+//-$0007<0|1># 停止/开始抓包
+static void cmd_0007(int fd, const char *arg, int arglen)
+{
+	if(arglen == 1 && arg[0] == '0')
+		sniffer_stop();
+	else if(arglen == 1 && arg[0] == '1')
+	{
+		if(sniffer_sub(0, NULL) != 0)
+		{
+			cmd_reply(fd, "error: capture\n");
+			return;
+		}
+	}
+	else
+	{
+		cmd_reply(fd, "error: 0|1\n");
+		return;
+	}
+	cmd_reply(fd, "capture %c\n", arg[0]);
+}
+
+//-$0008<从站>,<功能码>,<地址>[,<个数>]# 读Modbus轮询到的值,不等总线,例如$00081,3,0,4#
+static void cmd_0008(int fd, const char *arg, int arglen)
+{
+	char buf[48], out[160];
+	int slave, fc, addr, count = 1, i, n, r;
+	uint16_t v;
+	uint64_t age = 0;
+
+	cmd_arg(buf, sizeof(buf), arg, arglen);
+	if(sscanf(buf, "%d,%d,%d,%d", &slave, &fc, &addr, &count) < 3 || count < 1 || count > 16)
+	{
+		cmd_reply(fd, "error: slave,fc,addr[,count]\n");
+		return;
+	}
+	n = snprintf(out, sizeof(out), "modbus %d %d %d:", slave, fc, addr);
+	for(i = 0; i < count; i++)
+	{
+		if((r = modbus_get(slave, fc, addr + i, &v, i ? NULL : &age)) != 0)
+		{
+			cmd_reply(fd, "error: modbus %d %d %d %s\n", slave, fc, addr + i, r == -1 ? "not polled" : "no data");
+			return;
+		}
+		n += snprintf(out + n, sizeof(out) - n, " %u", v);
+	}
+	cmd_reply(fd, "%s age %llu ms\n", out, (unsigned long long)age);
+}
+
+//-$0009[<IP>|@<从第几项>]# 查抓包学到的邻居表,不带参数是项数和前几项,例如$0009192.168.1.5#
+#define CMD_NEIGH_PAGE	6	//-一次回复最多几项,控制socket的回复有长度限制
+static void cmd_0009(int fd, const char *arg, int arglen)
+{
+	static struct neigh_entry list[NEIGH_MAX];
+	struct neigh_entry e;
+	char buf[64], line[200];
+	uint8_t ip[16];
+	int i, n, start = 0;
+
+	cmd_arg(buf, sizeof(buf), arg, arglen);
+	if(buf[0] && buf[0] != '@')
+	{
+		if(inet_pton(AF_INET, buf, ip) == 1)
+			n = neigh_find(ip, 4, &e);
+		else if(inet_pton(AF_INET6, buf, ip) == 1)
+			n = neigh_find(ip, 6, &e);
+		else
+		{
+			cmd_reply(fd, "error: IP|@start\n");
+			return;
+		}
+		if(n != 0)
+		{
+			cmd_reply(fd, "error: %s not seen\n", buf);
+			return;
+		}
+		neigh_str(&e, line, sizeof(line));
+		cmd_reply(fd, "%s\n", line);
+		return;
+	}
+	if(buf[0] == '@')
+		start = atoi(buf + 1);
+	n = neigh_list(list, NEIGH_MAX);
+	if(n > NEIGH_MAX)
+		n = NEIGH_MAX;
+	cmd_reply(fd, "neigh %d entries\n", n);
+	for(i = start; i < n && i < start + CMD_NEIGH_PAGE; i++)
+	{
+		neigh_str(&list[i], line, sizeof(line));
+		cmd_reply(fd, "%s\n", line);
+	}
+	if(i < n)
+		cmd_reply(fd, "more @%d\n", i);
+}
+
+//-$0010[<服务器IP>|@<从第几个>]# 查抓包看到的DNS服务器:查询数,回复,NXDOMAIN,SERVFAIL,超时,p50/p99延时
+#define CMD_DNS_PAGE	6
+static void cmd_0010(int fd, const char *arg, int arglen)
+{
+	struct dns_server_stats list[DNS_SERVERS];
+	char buf[64], line[200];
+	uint8_t ip[16] = { 0 };
+	int i, n, ver = 0, start = 0;
+
+	cmd_arg(buf, sizeof(buf), arg, arglen);
+	if(buf[0] && buf[0] != '@')
+	{
+		if(inet_pton(AF_INET, buf, ip) == 1)
+			ver = 4;
+		else if(inet_pton(AF_INET6, buf, ip) == 1)
+			ver = 6;
+		else
+		{
+			cmd_reply(fd, "error: IP|@start\n");
+			return;
+		}
+	}
+	if(buf[0] == '@')
+		start = atoi(buf + 1);
+	n = dns_servers(list, DNS_SERVERS);
+	if(ver)
+	{
+		for(i = 0; i < n; i++)
+			if(list[i].ver == ver && memcmp(list[i].ip, ip, 16) == 0)
+				break;
+		if(i == n)
+		{
+			cmd_reply(fd, "error: %s not seen\n", buf);
+			return;
+		}
+		dns_server_str(&list[i], line, sizeof(line));
+		cmd_reply(fd, "%s\n", line);
+		return;
+	}
+	cmd_reply(fd, "dns %d servers\n", n);
+	for(i = start; i < n && i < start + CMD_DNS_PAGE; i++)
+	{
+		dns_server_str(&list[i], line, sizeof(line));
+		cmd_reply(fd, "%s\n", line);
+	}
+	if(i < n)
+		cmd_reply(fd, "more @%d\n", i);
+}
+
+//-必须按code从小到大排列
+static const struct uart_cmd uart_cmd_table[] = {
+	{ 1, cmd_0001 },
+	{ 2, cmd_0002 },
+	{ 3, cmd_0003 },
+	{ 4, cmd_0004 },
+	{ 5, cmd_0005 },
+	{ 6, cmd_0006 },
+	{ 7, cmd_0007 },
+	{ 8, cmd_0008 },
+	{ 9, cmd_0009 },
+	{ 10, cmd_0010 },
+};
+
+//-解析帧头的命令码并查表,不是合法的命令帧或者没有这个命令返回NULL
+static const struct uart_cmd *uart_cmd_find(const char *frame, int len)
+{
+	int lo = 0, hi = sizeof(uart_cmd_table) / sizeof(uart_cmd_table[0]) - 1, mid;
+	int i, code = 0;
+
+	if(len < 6 || frame[0] != '$' || frame[len-1] != '#')
+		return NULL;
+	for(i = 1; i <= 4; i++)
+	{
+		if(frame[i] < '0' || frame[i] > '9')
+			return NULL;
+		code = code * 10 + (frame[i] - '0');
+	}
+	while(lo <= hi)
+	{
+		mid = (lo + hi) / 2;
+		if(uart_cmd_table[mid].code == code)
+			return &uart_cmd_table[mid];
+		if(uart_cmd_table[mid].code < code)
+			lo = mid + 1;
+		else
+			hi = mid - 1;
+	}
+	return NULL;
+}
+
+//-处理一帧命令,回复写到fd;不认识的命令返回-1
+int uart_dispatch(int fd, const char *frame, int len)
+{
+	const struct uart_cmd *cmd = uart_cmd_find(frame, len);
+
+	if(cmd == NULL)
+		return -1;
+	TRACE_BEGIN("dispatch");
+	cmd->fn(fd, frame + 5, len - 6);
+	TRACE_END("dispatch");
+	return 0;
+}
+
+//-处理已经拼好的一帧
+void uart_1_Main(int fd, struct fbuf *f)
+{
+	if(f->data[0] == '$')
 	{//-说明有有效命令接收到,下面开始处理
-		if(strcmp(read_report,"$0001#") == 0)
-			len = UART0_Send(fd,send_buf,strlen(send_buf));
-		else if(strcmp(read_report,"$0002#") == 0)
+		if(uart_dispatch(fd, f->data, f->len) != 0)
+			metric_inc(m_bad);	//-不认识的命令
+	}
+}
+
+static void uart_1_io_cb(struct ev_io *io, unsigned int revents)
+{
+	struct uart_port *port = io->arg;
+
+	//-读不到数据说明对方断线或者设备出错,从事件循环里拿掉,不然会一直被唤醒
+	if(get_complete_frame(port) < 0 && (revents & EV_ERR))
+	{
+		LOG(LOGM_UART, LOG_ERR, "uart fd %d error, stop reading\n", port->fd);
+		ev_del(io);
+		timer_cancel(&port->frame_tmo);
+	}
+}
+
+/*
+热重启交接的串口状态:拼了一半的帧,帧超时还剩多久,计数.
+半帧比UART_STATE_DATA长的不交接,新进程从下一个'$'开始.
+交接时串口先从事件循环里拿掉,之后到的数据留在内核里,由新进程读.
+*/
+struct uart_state {
+	int tmo_ms;			//-帧超时还剩的ms,-1表示没有在等
+	unsigned long frames;
+	unsigned long timeouts;
+	int len;
+	char data[UART_STATE_DATA];
+};
+
+static int uart_1_save(void *arg, int *fd, void *buf, int size)
+{
+	struct uart_port *port = arg;
+	struct uart_state *st = buf;
+
+	if (size < (int)sizeof(*st))
+		return -1;
+	ev_del(&port->io);
+	ev_flush();	//-排队的回复先写完,fd就要交给新进程了
+	st->tmo_ms = -1;
+	if (timer_pending(&port->frame_tmo))
+		st->tmo_ms = (long)(port->frame_tmo.expires - timer_now()) > 0 ? (int)(port->frame_tmo.expires - timer_now()) : 0;
+	timer_cancel(&port->frame_tmo);
+	st->frames = port->frames;
+	st->timeouts = port->timeouts;
+	st->len = 0;
+	if (port->cur != NULL && port->cur->len <= sizeof(st->data)) {
+		st->len = port->cur->len;
+		memcpy(st->data, port->cur->data, st->len);
+	} else if (port->cur != NULL) {
+		LOG(LOGM_UART, LOG_WARN, "partial frame of %u bytes not handed off", port->cur->len);
+		st->tmo_ms = -1;
+	}
+	*fd = port->fd;
+	return sizeof(*st);
+}
+
+static void uart_1_restart_tmo(struct uart_port *port, int tmo_ms)
+{
+	if (tmo_ms >= 0)
+		timer_start(&port->frame_tmo, tmo_ms, 0);
+}
+
+//-新进程没有接手,老进程接着读
+static void uart_1_resume(void *arg)
+{
+	struct uart_port *port = arg;
+
+	ev_add(&port->io);
+	if (port->cur != NULL)
+		timer_start(&port->frame_tmo, FRAME_TIMEOUT_MS, 0);
+}
+
+static void uart_1_metrics(void)
+{
+	m_rx_bytes = metric_counter("serial_rx_bytes_total", "bytes read from the serial port");
+	uart_tx_bytes = metric_counter("serial_tx_bytes_total", "bytes written to the serial port");
+	m_frames = metric_counter("serial_frames_total", "complete frames received");
+	m_bad = metric_counter("serial_bad_frames_total", "frames with an unknown command");
+	m_oversize = metric_counter("serial_oversize_frames_total", "frames dropped for exceeding the maximum frame size");
+	m_nobuf = metric_counter("serial_nobuf_frames_total", "frames dropped because no frame buffer could be allocated");
+	metric_func("frame_buffers_in_use", "frame buffers taken from the pool and not yet released", METRIC_GAUGE, fbuf_in_use);
+	m_timeouts = metric_counter("serial_frame_timeouts_total", "partial frames dropped by the frame timeout");
+	m_latency = metric_histogram("serial_reply_latency_us", "read() return to reply written, microseconds");
+}
+
+//-把已经打开设置好的串口加到事件循环
+int uart_1_Open(int fd)
+{
+	uart_1_metrics();
+	port1.fd = fd;
+	if(uart_frames_shm != NULL && uart_frames_shm[0] != 0 && shmring_create(&frame_ring, uart_frames_shm, SHMRING_SLOTS) == 0)
+		port1.ring = &frame_ring;
+	port1.on_frame = frame_ready;
+	timer_setup(&port1.frame_tmo, frame_timeout, &port1);
+	ev_io_init(&port1.io, fd, EV_READ, uart_1_io_cb, &port1);
+	ev_io_read(&port1.io, port1.rx, sizeof(port1.rx));
+	handoff_register("uart1", uart_1_save, uart_1_resume, &port1);
+	return ev_add(&port1.io);
+}
+
+//-热重启:接着老进程的状态,在uart_1_Open之后调用
+void uart_1_Restore(const void *buf, int len)
+{
+	const struct uart_state *st = buf;
+
+	if (len != (int)sizeof(*st))
+		return;
+	port1.frames = st->frames;
+	port1.timeouts = st->timeouts;
+	if (st->len > 0 && st->len <= (int)sizeof(st->data) && (port1.cur = fbuf_get(st->len)) != NULL) {
+		fbuf_append(&port1.cur, st->data, st->len);
+		uart_1_restart_tmo(&port1, st->tmo_ms);
+	}
+	LOG(LOGM_UART, LOG_INFO, "resumed fd %d, partial frame \"%s\", %lu frames so far",
+	    port1.fd, port1.cur ? port1.cur->data : "", port1.frames);
+}
+
+//-退出时调用:热重启交接出去以后共享内存由新进程接着写,不标记退出
+void uart_1_Close(void)
+{
+	port1.ring = NULL;
+	shmring_close(&frame_ring, uart_frames_shm, handoff_done);
+}
+
+//-SIGUSR1统计
+void uart_1_Stats(void)
+{
+	LOG(LOGM_UART, LOG_INFO, "uart1: fd %d, %lu frames, %lu timeouts, buffer \"%s\"",
+	    port1.fd, port1.frames, port1.timeouts, port1.cur ? port1.cur->data : "");
+	fbuf_stats();
+}
+
+
+/*
+基准测试(dreamflower_app -D -T):帧拼接和命令分发是每一帧都要走的路径
+*/
+static void bench_on_frame(struct uart_port *port, struct fbuf *f)
+{
+	bench_keep(f->data[1]);
+}
+
+static void bench_frame_parse(long iters, void *arg)
+{
+	static const char frame[] = "$0001#";
+	struct uart_port port;
+	long i;
+
+	memset(&port, 0, sizeof(port));
+	port.fd = -1;
+	port.on_frame = bench_on_frame;
+	timer_setup(&port.frame_tmo, frame_timeout, &port);
+	for(i = 0; i < iters; i++)
+		frame_feed(&port, frame, sizeof(frame) - 1);
+	timer_cancel(&port.frame_tmo);
+}
+
+//-共享内存发布一帧:读的人不影响这个时间
+static void bench_frame_publish(long iters, void *arg)
+{
+	static const char frame[] = "$0001#";
+	static struct shmring ring;
+	long i;
+
+	if(ring.h == NULL)
+	{
+		if(shmring_create(&ring, "/dreamflower_app.bench", SHMRING_SLOTS) != 0)
+			return;
+		shm_unlink("/dreamflower_app.bench");	//-映射还在,不留文件
+	}
+	for(i = 0; i < iters; i++)
+		shmring_publish(&ring, i, frame, sizeof(frame) - 1);
+}
+
+static void bench_dispatch_lookup(long iters, void *arg)
+{
+	static const char frame[] = "$0002#";
+	long i;
+
+	for(i = 0; i < iters; i++)
+	{
+		bench_clobber();	//-每次都要重新查,不能被提到循环外面
+		bench_keep(uart_cmd_find(frame, sizeof(frame) - 1));
+	}
+}
+
+static void bench_dispatch(long iters, void *arg)
+{
+	static const char frame[] = "$0001#";
+	int fd = *(int *)arg;
+	long i;
+
+	for(i = 0; i < iters; i++)
+		uart_dispatch(fd, frame, sizeof(frame) - 1);
+}
+
+static void bench_pty_frame(struct uart_port *port, struct fbuf *f)
+{
+	uart_1_Main(port->fd, f);
+}
+
+//-pty的另一头:收到回复就算一次
+static void bench_pty_master(struct ev_io *io, unsigned int revents)
+{
+	char buf[64];
+	int n = read(io->fd, buf, sizeof(buf));
+
+	if(n > 0)
+		*(int *)io->arg += n;
+}
+
+/*
+收一帧回一帧的整个路径:pty写进去,事件循环等到,读,拼帧,分发,回复,pty另一头读到.
+arg是同时收发的口数,多个口一起来帧时io_uring一次提交就能把几个回复都写出去.
+用来比较epoll和io_uring(-U)两个后端,两次运行分别加不加-U.
+*/
+#define BENCH_PTYS	4
+
+static void bench_pty_echo(long iters, void *arg)
+{
+	static const char frame[] = "$0001#";
+	struct uart_port port[BENCH_PTYS];
+	struct ev_io mio[BENCH_PTYS];
+	struct termios tio;
+	int m[BENCH_PTYS], s[BENCH_PTYS], got[BENCH_PTYS];
+	int nports = *(int *)arg, k, n, added = 0, done;
+	long i;
+
+	for(k = 0; k < BENCH_PTYS; k++)
+		m[k] = s[k] = -1;
+	for(k = 0; k < nports; k++)
+	{
+		m[k] = posix_openpt(O_RDWR | O_NOCTTY | O_NONBLOCK);
+		if(m[k] < 0 || grantpt(m[k]) != 0 || unlockpt(m[k]) != 0 || (s[k] = open(ptsname(m[k]), O_RDWR | O_NOCTTY | O_NONBLOCK)) < 0)
+			goto out;
+		tcgetattr(s[k], &tio);
+		cfmakeraw(&tio);
+		tcsetattr(s[k], TCSANOW, &tio);
+		memset(&port[k], 0, sizeof(port[k]));
+		port[k].fd = s[k];
+		port[k].on_frame = bench_pty_frame;
+		timer_setup(&port[k].frame_tmo, frame_timeout, &port[k]);
+		ev_io_init(&port[k].io, s[k], EV_READ, uart_1_io_cb, &port[k]);
+		ev_io_read(&port[k].io, port[k].rx, sizeof(port[k].rx));
+		ev_io_init(&mio[k], m[k], EV_READ, bench_pty_master, &got[k]);
+		if(ev_add(&port[k].io) != 0)
+			goto out;
+		if(ev_add(&mio[k]) != 0)
+		{
+			ev_del(&port[k].io);
+			goto out;
+		}
+		added++;
+	}
+	for(i = 0; i < iters; i++)
+	{
+		for(k = 0; k < nports; k++)
+		{
+			got[k] = 0;
+			if(write(m[k], frame, sizeof(frame) - 1) != sizeof(frame) - 1)
+				goto out;
+		}
+		for(done = 0, n = 0; !done; )
 		{
-			send_buf[0] = '2';
-			len = UART0_Send(fd,send_buf,strlen(send_buf));
+			//-io_uring只完成了写也会返回0;一秒都没有回调就是出问题了
+			if((k = ev_run_once(100)) < 0 || (k == 0 && ++n > 10))
+				goto out;
+			for(done = 1, k = 0; k < nports; k++)
+				if(got[k] < 11)	//-"tiger john\n"
+					done = 0;
 		}
 	}
+out:
+	for(k = 0; k < added; k++)
+	{
+		ev_del(&mio[k]);
+		ev_del(&port[k].io);
+		timer_cancel(&port[k].frame_tmo);
+		fbuf_put(port[k].cur);
+	}
+	ev_flush();
+	for(k = 0; k < nports; k++)
+	{
+		if(s[k] >= 0)
+			close(s[k]);
+		if(m[k] >= 0)
+			close(m[k]);
+	}
+}
+
+void uart_1_Bench(void)
+{
+	static int devnull = -1;
+	static int one = 1, four = BENCH_PTYS;
+
+	if(devnull < 0)
+		devnull = open("/dev/null", O_WRONLY);
+	bench_add("frame_parse", bench_frame_parse, NULL);
+	bench_add("frame_publish", bench_frame_publish, NULL);
+	bench_add("dispatch_lookup", bench_dispatch_lookup, NULL);
+	bench_add("dispatch+reply", bench_dispatch, &devnull);	//-回复写到/dev/null,包括一次write系统调用
+	bench_add("pty_echo", bench_pty_echo, &one);
+	bench_add("pty_echo_x4", bench_pty_echo, &four);	//-4个口同时来帧
 }